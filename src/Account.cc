@@ -1,13 +1,19 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <phosg/Encoding.hh>
 #include <phosg/Filesystem.hh>
 #include <phosg/Hash.hh>
 #include <phosg/Random.hh>
 #include <phosg/Time.hh>
 
 #include "Account.hh"
+#include "Loggers.hh"
 
 using namespace std;
 
@@ -386,37 +392,444 @@ void Account::print(FILE* stream) const {
 }
 
 void Account::save() const {
-  if (!this->is_temporary) {
-    auto json = this->json();
-    string json_data = json.serialize(JSON::SerializeOption::FORMAT | JSON::SerializeOption::HEX_INTEGERS);
-    string filename = string_printf("system/licenses/%010" PRIu32 ".json", this->account_id);
-    save_file(filename, json_data);
+  if (!this->is_temporary && this->store) {
+    this->store->save(*this);
   }
 }
 
 void Account::delete_file() const {
-  string filename = string_printf("system/licenses/%010" PRIu32 ".json", this->account_id);
-  remove(filename.c_str());
+  if (this->store) {
+    this->store->remove(this->account_id);
+  }
+}
+
+void AccountStore::flush() {}
+
+JSONAccountStore::JSONAccountStore(const string& directory, shared_ptr<FileWriteQueue> write_queue)
+    : directory(directory),
+      write_queue(write_queue) {}
+
+string JSONAccountStore::filename_for_account(uint32_t account_id) const {
+  return string_printf("%s/%010" PRIu32 ".json", this->directory.c_str(), account_id);
+}
+
+vector<shared_ptr<Account>> JSONAccountStore::load_all() {
+  vector<shared_ptr<Account>> ret;
+  if (this->write_queue) {
+    this->write_queue->flush();
+  }
+  if (!isdir(this->directory)) {
+    mkdir(this->directory.c_str(), 0755);
+    return ret;
+  }
+  for (const auto& item : list_directory(this->directory)) {
+    if (ends_with(item, ".json")) {
+      try {
+        JSON json = JSON::parse(load_file(this->directory + "/" + item));
+        ret.emplace_back(make_shared<Account>(json));
+      } catch (const exception& e) {
+        log_error("Failed to index account %s", item.c_str());
+        throw;
+      }
+    }
+  }
+  return ret;
+}
+
+void JSONAccountStore::save(const Account& a) {
+  auto json = a.json();
+  string json_data = json.serialize(JSON::SerializeOption::FORMAT | JSON::SerializeOption::HEX_INTEGERS);
+  if (this->write_queue) {
+    this->write_queue->write(this->filename_for_account(a.account_id), make_shared<string>(std::move(json_data)));
+  } else {
+    save_file(this->filename_for_account(a.account_id), json_data);
+  }
+}
+
+void JSONAccountStore::remove(uint32_t account_id) {
+  string filename = this->filename_for_account(account_id);
+  if (this->write_queue) {
+    this->write_queue->remove(filename);
+  } else {
+    ::remove(filename.c_str());
+  }
+}
+
+struct LogAccountStore::FileHeader {
+  static constexpr uint64_t SIGNATURE = 0x4E534143434C4F47; // 'NSACCLOG'
+  static constexpr uint32_t FORMAT_VERSION = 1;
+  le_uint64_t signature = SIGNATURE;
+  le_uint32_t format_version = FORMAT_VERSION;
+  le_uint32_t unused = 0;
+} __packed_ws__(FileHeader, 0x10);
+
+struct LogAccountStore::RecordHeader {
+  static constexpr uint8_t TYPE_SAVE = 1;
+  static constexpr uint8_t TYPE_REMOVE = 2;
+  le_uint32_t checksum = 0; // crc32 of the rest of the record, including data
+  le_uint32_t data_size = 0;
+  le_uint32_t account_id = 0;
+  uint8_t type = 0;
+  parray<uint8_t, 3> unused;
+  // Account JSON (data_size bytes) follows immediately
+} __packed_ws__(RecordHeader, 0x10);
+
+// The log is not compacted until it's at least this large, so small servers
+// don't rewrite it frequently
+static constexpr uint64_t LOG_COMPACTION_MIN_SIZE = 0x100000;
+
+static void write_all(int fd, const void* data, size_t size) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  while (size > 0) {
+    ssize_t bytes_written = ::write(fd, bytes, size);
+    if (bytes_written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw runtime_error(string_printf("cannot write to account log (errno %d)", errno));
+    }
+    bytes += bytes_written;
+    size -= bytes_written;
+  }
+}
+
+static void read_all_at(int fd, void* data, size_t size, uint64_t offset) {
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(data);
+  while (size > 0) {
+    ssize_t bytes_read = ::pread(fd, bytes, size, offset);
+    if (bytes_read < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw runtime_error(string_printf("cannot read from account log (errno %d)", errno));
+    }
+    if (bytes_read == 0) {
+      throw runtime_error("account log is truncated");
+    }
+    bytes += bytes_read;
+    size -= bytes_read;
+    offset += bytes_read;
+  }
+}
+
+LogAccountStore::LogAccountStore(
+    const string& filename,
+    uint64_t sync_interval_usecs,
+    shared_ptr<struct event_base> base,
+    shared_ptr<FileWriteQueue> write_queue)
+    : filename(filename),
+      sync_interval_usecs(sync_interval_usecs),
+      base(base),
+      write_queue(write_queue),
+      sync_event(
+          this->base ? event_new(this->base.get(), -1, EV_TIMEOUT, &LogAccountStore::dispatch_sync, this) : nullptr,
+          event_free),
+      fd(-1),
+      file_size(0),
+      live_bytes(0),
+      last_sync_time(0),
+      sync_pending(false) {
+  lock_guard g(this->lock);
+  this->open_locked();
+}
+
+LogAccountStore::~LogAccountStore() {
+  // Queued functions refer to this store, so they must finish first
+  if (this->write_queue) {
+    this->write_queue->flush();
+  }
+  lock_guard g(this->lock);
+  if (this->fd >= 0) {
+    if (this->sync_pending) {
+      fsync(this->fd);
+    }
+    close(this->fd);
+  }
+}
+
+void LogAccountStore::open_locked() {
+  this->fd = open(this->filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (this->fd < 0) {
+    throw cannot_open_file(this->filename);
+  }
+  struct stat st;
+  if (fstat(this->fd, &st) != 0) {
+    throw runtime_error("cannot stat account log");
+  }
+  this->file_size = st.st_size;
+  if (this->file_size == 0) {
+    FileHeader header;
+    write_all(this->fd, &header, sizeof(header));
+    fsync(this->fd);
+    this->file_size = sizeof(header);
+  }
+}
+
+vector<shared_ptr<Account>> LogAccountStore::load_all() {
+  if (this->write_queue) {
+    this->write_queue->flush();
+  }
+  lock_guard g(this->lock);
+
+  string data(this->file_size, '\0');
+  read_all_at(this->fd, data.data(), data.size(), 0);
+
+  StringReader r(data);
+  const auto& header = r.get<FileHeader>();
+  if (header.signature != FileHeader::SIGNATURE) {
+    throw runtime_error("file is not an account log");
+  }
+  if (header.format_version != FileHeader::FORMAT_VERSION) {
+    throw runtime_error("unsupported account log format version");
+  }
+
+  // Replay all records, keeping only the location of the latest record for
+  // each account
+  this->record_locations.clear();
+  this->live_bytes = 0;
+  size_t valid_end_offset = r.where();
+  while (r.remaining() >= sizeof(RecordHeader)) {
+    size_t offset = r.where();
+    const auto& rec_header = r.get<RecordHeader>();
+    if (r.remaining() < rec_header.data_size) {
+      break;
+    }
+    size_t record_size = sizeof(RecordHeader) + rec_header.data_size;
+    uint32_t checksum = crc32(data.data() + offset + sizeof(rec_header.checksum), record_size - sizeof(rec_header.checksum));
+    if (checksum != rec_header.checksum) {
+      // A crash during a write can only damage the last record. If there's
+      // more data after this one, the log is corrupt, and discarding the rest
+      // of it would lose every account record written after this one
+      if (offset + record_size < data.size()) {
+        throw runtime_error(string_printf(
+            "account log %s has a corrupt record at offset %zX followed by %zu more bytes; it must be repaired manually",
+            this->filename.c_str(), offset, data.size() - (offset + record_size)));
+      }
+      break;
+    }
+    r.skip(rec_header.data_size);
+
+    auto it = this->record_locations.find(rec_header.account_id);
+    if (it != this->record_locations.end()) {
+      this->live_bytes -= it->second.size;
+    }
+    if (rec_header.type == RecordHeader::TYPE_SAVE) {
+      this->record_locations[rec_header.account_id] = RecordLocation{offset, record_size};
+      this->live_bytes += record_size;
+    } else if (rec_header.type == RecordHeader::TYPE_REMOVE) {
+      if (it != this->record_locations.end()) {
+        this->record_locations.erase(it);
+      }
+    } else {
+      throw runtime_error(string_printf("account log record at %zX has unknown type %02hhX", offset, rec_header.type));
+    }
+    valid_end_offset = r.where();
+  }
+
+  // If the server crashed while writing a record, the last record may be
+  // incomplete; discard it so new records are appended after the last valid
+  // one
+  if (valid_end_offset < data.size()) {
+    log_warning("Discarding %zu bytes of incomplete data at end of account log %s",
+        data.size() - valid_end_offset, this->filename.c_str());
+    if (ftruncate(this->fd, valid_end_offset) != 0) {
+      throw runtime_error("cannot truncate account log");
+    }
+    this->file_size = valid_end_offset;
+  }
+
+  vector<shared_ptr<Account>> ret;
+  ret.reserve(this->record_locations.size());
+  for (const auto& it : this->record_locations) {
+    string json_data = data.substr(it.second.offset + sizeof(RecordHeader), it.second.size - sizeof(RecordHeader));
+    try {
+      ret.emplace_back(make_shared<Account>(JSON::parse(json_data)));
+    } catch (const exception& e) {
+      log_error("Failed to index account %08" PRIX32 " from account log", it.first);
+      throw;
+    }
+  }
+
+  if ((this->file_size >= LOG_COMPACTION_MIN_SIZE) && (this->file_size > 2 * (this->live_bytes + sizeof(FileHeader)))) {
+    this->compact_locked();
+  }
+
+  return ret;
+}
+
+void LogAccountStore::run_io(function<void()>&& fn) {
+  if (this->write_queue) {
+    this->write_queue->run(std::move(fn));
+  } else {
+    fn();
+  }
+}
+
+void LogAccountStore::save(const Account& a) {
+  this->run_io([this, account_id = a.account_id, json_data = a.json().serialize()]() -> void {
+    lock_guard g(this->lock);
+    this->append_record_locked(RecordHeader::TYPE_SAVE, account_id, json_data);
+  });
+}
+
+void LogAccountStore::remove(uint32_t account_id) {
+  this->run_io([this, account_id]() -> void {
+    lock_guard g(this->lock);
+    if (this->record_locations.count(account_id)) {
+      this->append_record_locked(RecordHeader::TYPE_REMOVE, account_id, "");
+    }
+  });
+}
+
+void LogAccountStore::flush() {
+  this->run_io([this]() -> void {
+    lock_guard g(this->lock);
+    if (this->sync_pending) {
+      this->sync_locked();
+    }
+  });
+  if (this->write_queue) {
+    this->write_queue->flush();
+  }
+}
+
+void LogAccountStore::compact() {
+  this->run_io([this]() -> void {
+    lock_guard g(this->lock);
+    this->compact_locked();
+  });
+}
+
+void LogAccountStore::append_record_locked(uint8_t type, uint32_t account_id, const string& data) {
+  string record(sizeof(RecordHeader) + data.size(), '\0');
+  auto* rec_header = reinterpret_cast<RecordHeader*>(record.data());
+  rec_header->data_size = data.size();
+  rec_header->account_id = account_id;
+  rec_header->type = type;
+  memcpy(record.data() + sizeof(RecordHeader), data.data(), data.size());
+  rec_header->checksum = crc32(record.data() + sizeof(rec_header->checksum), record.size() - sizeof(rec_header->checksum));
+
+  write_all(this->fd, record.data(), record.size());
+  uint64_t offset = this->file_size;
+  this->file_size += record.size();
+
+  auto it = this->record_locations.find(account_id);
+  if (it != this->record_locations.end()) {
+    this->live_bytes -= it->second.size;
+    this->record_locations.erase(it);
+  }
+  if (type == RecordHeader::TYPE_SAVE) {
+    this->record_locations.emplace(account_id, RecordLocation{offset, record.size()});
+    this->live_bytes += record.size();
+  }
+
+  uint64_t since_last_sync_usecs = now() - this->last_sync_time;
+  if (since_last_sync_usecs >= this->sync_interval_usecs) {
+    this->sync_locked();
+  } else {
+    this->sync_pending = true;
+    // Make sure the write is synced even if nothing else is written soon
+    if (this->sync_event && !event_pending(this->sync_event.get(), EV_TIMEOUT, nullptr)) {
+      auto tv = usecs_to_timeval(this->sync_interval_usecs - since_last_sync_usecs);
+      event_add(this->sync_event.get(), &tv);
+    }
+  }
+
+  if ((this->file_size >= LOG_COMPACTION_MIN_SIZE) && (this->file_size > 2 * (this->live_bytes + sizeof(FileHeader)))) {
+    this->compact_locked();
+  }
+}
+
+void LogAccountStore::dispatch_sync(evutil_socket_t, short, void* ctx) {
+  // This runs on the event thread, so it only queues the sync (if there's a
+  // write queue) instead of waiting for it like flush() does
+  auto* store = reinterpret_cast<LogAccountStore*>(ctx);
+  try {
+    store->run_io([store]() -> void {
+      lock_guard g(store->lock);
+      if (store->sync_pending) {
+        store->sync_locked();
+      }
+    });
+  } catch (const exception& e) {
+    config_log.warning("Cannot sync account log: %s", e.what());
+  }
+}
+
+void LogAccountStore::sync_locked() {
+  if (fsync(this->fd) != 0) {
+    throw runtime_error(string_printf("cannot sync account log (errno %d)", errno));
+  }
+  this->last_sync_time = now();
+  this->sync_pending = false;
+}
+
+void LogAccountStore::compact_locked() {
+  uint64_t start_time = now();
+  uint64_t orig_file_size = this->file_size;
+
+  StringWriter w;
+  w.put<FileHeader>(FileHeader());
+  unordered_map<uint32_t, RecordLocation> new_record_locations;
+  for (const auto& it : this->record_locations) {
+    string record(it.second.size, '\0');
+    read_all_at(this->fd, record.data(), record.size(), it.second.offset);
+    new_record_locations.emplace(it.first, RecordLocation{w.size(), record.size()});
+    w.write(record);
+  }
+
+  // Write the compacted log to a temporary file and rename it, so the log is
+  // never in a partially-written state
+  string temp_filename = this->filename + ".tmp";
+  int temp_fd = open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (temp_fd < 0) {
+    throw cannot_open_file(temp_filename);
+  }
+  try {
+    write_all(temp_fd, w.str().data(), w.size());
+    if (fsync(temp_fd) != 0) {
+      throw runtime_error("cannot sync compacted account log");
+    }
+  } catch (const exception&) {
+    close(temp_fd);
+    ::remove(temp_filename.c_str());
+    throw;
+  }
+  close(temp_fd);
+  if (rename(temp_filename.c_str(), this->filename.c_str()) != 0) {
+    ::remove(temp_filename.c_str());
+    throw runtime_error("cannot rename compacted account log into place");
+  }
+
+  close(this->fd);
+  this->open_locked();
+  this->record_locations = std::move(new_record_locations);
+  this->live_bytes = this->file_size - sizeof(FileHeader);
+  this->last_sync_time = now();
+  this->sync_pending = false;
+
+  string duration_str = format_duration(now() - start_time);
+  log_info("Compacted account log %s from %" PRIu64 " to %" PRIu64 " bytes in %s",
+      this->filename.c_str(), orig_file_size, this->file_size, duration_str.c_str());
 }
 
 size_t AccountIndex::count() const {
-  shared_lock g(this->lock);
   return this->by_account_id.size();
 }
 
 shared_ptr<Account> AccountIndex::from_account_id(uint32_t account_id) const {
   try {
-    shared_lock g(this->lock);
     return this->by_account_id.at(account_id);
   } catch (const out_of_range&) {
     throw missing_account();
   }
 }
 
-shared_ptr<Login> AccountIndex::from_dc_nte_credentials_locked(const string& serial_number, const string& access_key) {
+shared_ptr<Login> AccountIndex::check_dc_nte_credentials(const string& serial_number, const string& access_key) {
   auto login = make_shared<Login>();
-  login->account = this->by_dc_nte_serial_number.at(serial_number);
-  login->dc_nte_license = login->account->dc_nte_licenses.at(serial_number);
+  auto entry = this->by_dc_nte_serial_number.at(serial_number);
+  login->account = entry.account;
+  login->dc_nte_license = entry.license;
   if (login->dc_nte_license->access_key != access_key) {
     throw incorrect_access_key();
   }
@@ -433,14 +846,13 @@ shared_ptr<Login> AccountIndex::from_dc_nte_credentials(
   }
 
   try {
-    shared_lock g(this->lock);
-    return this->from_dc_nte_credentials_locked(serial_number, access_key);
+    return this->check_dc_nte_credentials(serial_number, access_key);
   } catch (const out_of_range&) {
   }
 
-  unique_lock g(this->lock);
+  lock_guard g(this->write_lock);
   try {
-    return this->from_dc_nte_credentials_locked(serial_number, access_key);
+    return this->check_dc_nte_credentials(serial_number, access_key);
   } catch (const out_of_range&) {
   }
 
@@ -461,11 +873,12 @@ shared_ptr<Login> AccountIndex::from_dc_nte_credentials(
   }
 }
 
-shared_ptr<Login> AccountIndex::from_dc_credentials_locked(
+shared_ptr<Login> AccountIndex::check_dc_credentials(
     uint32_t serial_number, const string& access_key, const string& character_name) {
   auto login = make_shared<Login>();
-  login->account = this->by_dc_serial_number.at(serial_number);
-  login->dc_license = login->account->dc_licenses.at(serial_number);
+  auto entry = this->by_dc_serial_number.at(serial_number);
+  login->account = entry.account;
+  login->dc_license = entry.license;
   bool is_shared = login->account->check_flag(Account::Flag::IS_SHARED_ACCOUNT);
   if (!is_shared && (login->dc_license->access_key != access_key)) {
     throw incorrect_access_key();
@@ -486,14 +899,13 @@ shared_ptr<Login> AccountIndex::from_dc_credentials(
   }
 
   try {
-    shared_lock g(this->lock);
-    return this->from_dc_credentials_locked(serial_number, access_key, character_name);
+    return this->check_dc_credentials(serial_number, access_key, character_name);
   } catch (const out_of_range&) {
   }
 
-  unique_lock g(this->lock);
+  lock_guard g(this->write_lock);
   try {
-    return this->from_dc_credentials_locked(serial_number, access_key, character_name);
+    return this->check_dc_credentials(serial_number, access_key, character_name);
   } catch (const out_of_range&) {
   }
 
@@ -534,11 +946,12 @@ shared_ptr<Login> AccountIndex::from_pc_nte_credentials(uint32_t guild_card_numb
   return login;
 }
 
-shared_ptr<Login> AccountIndex::from_pc_credentials_locked(
+shared_ptr<Login> AccountIndex::check_pc_credentials(
     uint32_t serial_number, const string& access_key, const string& character_name) {
   auto login = make_shared<Login>();
-  login->account = this->by_pc_serial_number.at(serial_number);
-  login->pc_license = login->account->pc_licenses.at(serial_number);
+  auto entry = this->by_pc_serial_number.at(serial_number);
+  login->account = entry.account;
+  login->pc_license = entry.license;
   bool is_shared = login->account->check_flag(Account::Flag::IS_SHARED_ACCOUNT);
   if (!is_shared && (login->pc_license->access_key != access_key)) {
     throw incorrect_access_key();
@@ -559,14 +972,13 @@ shared_ptr<Login> AccountIndex::from_pc_credentials(
   }
 
   try {
-    shared_lock g(this->lock);
-    return this->from_pc_credentials_locked(serial_number, access_key, character_name);
+    return this->check_pc_credentials(serial_number, access_key, character_name);
   } catch (const out_of_range&) {
   }
 
-  unique_lock g(this->lock);
+  lock_guard g(this->write_lock);
   try {
-    return this->from_pc_credentials_locked(serial_number, access_key, character_name);
+    return this->check_pc_credentials(serial_number, access_key, character_name);
   } catch (const out_of_range&) {
   }
 
@@ -587,11 +999,12 @@ shared_ptr<Login> AccountIndex::from_pc_credentials(
   }
 }
 
-shared_ptr<Login> AccountIndex::from_gc_credentials_locked(
+shared_ptr<Login> AccountIndex::check_gc_credentials(
     uint32_t serial_number, const string& access_key, const string* password, const string& character_name) {
   auto login = make_shared<Login>();
-  login->account = this->by_gc_serial_number.at(serial_number);
-  login->gc_license = login->account->gc_licenses.at(serial_number);
+  auto entry = this->by_gc_serial_number.at(serial_number);
+  login->account = entry.account;
+  login->gc_license = entry.license;
   bool is_shared = login->account->check_flag(Account::Flag::IS_SHARED_ACCOUNT);
   if (!is_shared && (login->gc_license->access_key != access_key)) {
     throw incorrect_access_key();
@@ -615,14 +1028,13 @@ shared_ptr<Login> AccountIndex::from_gc_credentials(
   }
 
   try {
-    shared_lock g(this->lock);
-    return this->from_gc_credentials_locked(serial_number, access_key, password, character_name);
+    return this->check_gc_credentials(serial_number, access_key, password, character_name);
   } catch (const out_of_range&) {
   }
 
-  unique_lock g(this->lock);
+  lock_guard g(this->write_lock);
   try {
-    return this->from_gc_credentials_locked(serial_number, access_key, password, character_name);
+    return this->check_gc_credentials(serial_number, access_key, password, character_name);
   } catch (const out_of_range&) {
   }
 
@@ -644,10 +1056,11 @@ shared_ptr<Login> AccountIndex::from_gc_credentials(
   }
 }
 
-shared_ptr<Login> AccountIndex::from_xb_credentials_locked(const string& gamertag, uint64_t user_id, uint64_t account_id) {
+shared_ptr<Login> AccountIndex::check_xb_credentials(const string& gamertag, uint64_t user_id, uint64_t account_id) {
   auto login = make_shared<Login>();
-  login->account = this->by_xb_gamertag.at(gamertag);
-  login->xb_license = login->account->xb_licenses.at(gamertag);
+  auto entry = this->by_xb_gamertag.at(gamertag);
+  login->account = entry.account;
+  login->xb_license = entry.license;
   if ((login->xb_license->user_id && (login->xb_license->user_id != user_id)) ||
       (login->xb_license->account_id && (login->xb_license->account_id != account_id))) {
     throw incorrect_access_key();
@@ -665,14 +1078,13 @@ shared_ptr<Login> AccountIndex::from_xb_credentials(
   }
 
   try {
-    shared_lock g(this->lock);
-    return this->from_xb_credentials_locked(gamertag, user_id, account_id);
+    return this->check_xb_credentials(gamertag, user_id, account_id);
   } catch (const out_of_range&) {
   }
 
-  unique_lock g(this->lock);
+  lock_guard g(this->write_lock);
   try {
-    return this->from_xb_credentials_locked(gamertag, user_id, account_id);
+    return this->check_xb_credentials(gamertag, user_id, account_id);
   } catch (const out_of_range&) {
   }
 
@@ -694,10 +1106,11 @@ shared_ptr<Login> AccountIndex::from_xb_credentials(
   }
 }
 
-shared_ptr<Login> AccountIndex::from_bb_credentials_locked(const string& username, const string* password) {
+shared_ptr<Login> AccountIndex::check_bb_credentials(const string& username, const string* password) {
   auto login = make_shared<Login>();
-  login->account = this->by_bb_username.at(username);
-  login->bb_license = login->account->bb_licenses.at(username);
+  auto entry = this->by_bb_username.at(username);
+  login->account = entry.account;
+  login->bb_license = entry.license;
   if (password && (login->bb_license->password != *password)) {
     throw incorrect_password();
   }
@@ -713,14 +1126,13 @@ shared_ptr<Login> AccountIndex::from_bb_credentials(const string& username, cons
   }
 
   try {
-    shared_lock g(this->lock);
-    return this->from_bb_credentials_locked(username, password);
+    return this->check_bb_credentials(username, password);
   } catch (const out_of_range&) {
   }
 
-  unique_lock g(this->lock);
+  lock_guard g(this->write_lock);
   try {
-    return this->from_bb_credentials_locked(username, password);
+    return this->check_bb_credentials(username, password);
   } catch (const out_of_range&) {
   }
 
@@ -742,17 +1154,16 @@ shared_ptr<Login> AccountIndex::from_bb_credentials(const string& username, cons
 }
 
 vector<shared_ptr<Account>> AccountIndex::all() const {
-  shared_lock g(this->lock);
   vector<shared_ptr<Account>> ret;
   ret.reserve(this->by_account_id.size());
-  for (const auto& it : this->by_account_id) {
-    ret.emplace_back(it.second);
-  }
+  this->by_account_id.for_each([&](const shared_ptr<Account>& a) -> void {
+    ret.emplace_back(a);
+  });
   return ret;
 }
 
 void AccountIndex::add(shared_ptr<Account> a) {
-  unique_lock g(this->lock);
+  lock_guard g(this->write_lock);
   this->add_locked(a);
 }
 
@@ -760,6 +1171,7 @@ void AccountIndex::add_locked(shared_ptr<Account> a) {
   if (this->force_all_temporary) {
     a->is_temporary = true;
   }
+  a->store = this->store;
 
   for (const auto& it : a->dc_nte_licenses) {
     if (this->by_dc_nte_serial_number.count(it.second->serial_number)) {
@@ -796,35 +1208,38 @@ void AccountIndex::add_locked(shared_ptr<Account> a) {
     a->account_id = (a->account_id + 1) & 0x7FFFFFFF;
   }
 
-  this->by_account_id[a->account_id] = a;
+  // The license maps are updated before by_account_id, so a reader that finds
+  // the account by ID can also find it by any of its licenses
   for (const auto& it : a->dc_nte_licenses) {
-    this->by_dc_nte_serial_number[it.second->serial_number] = a;
+    this->by_dc_nte_serial_number.emplace(it.second->serial_number, {a, it.second});
   }
   for (const auto& it : a->dc_licenses) {
-    this->by_dc_serial_number[it.second->serial_number] = a;
+    this->by_dc_serial_number.emplace(it.second->serial_number, {a, it.second});
   }
   for (const auto& it : a->pc_licenses) {
-    this->by_pc_serial_number[it.second->serial_number] = a;
+    this->by_pc_serial_number.emplace(it.second->serial_number, {a, it.second});
   }
   for (const auto& it : a->gc_licenses) {
-    this->by_gc_serial_number[it.second->serial_number] = a;
+    this->by_gc_serial_number.emplace(it.second->serial_number, {a, it.second});
   }
   for (const auto& it : a->xb_licenses) {
-    this->by_xb_gamertag[it.second->gamertag] = a;
+    this->by_xb_gamertag.emplace(it.second->gamertag, {a, it.second});
   }
   for (const auto& it : a->bb_licenses) {
-    this->by_bb_username[it.second->username] = a;
+    this->by_bb_username.emplace(it.second->username, {a, it.second});
   }
+  this->by_account_id.emplace(a->account_id, a);
 }
 
 void AccountIndex::remove(uint32_t account_id) {
-  unique_lock g(this->lock);
-  auto acc_it = this->by_account_id.find(account_id);
-  if (acc_it == this->by_account_id.end()) {
+  lock_guard g(this->write_lock);
+  shared_ptr<Account> a;
+  try {
+    a = this->by_account_id.at(account_id);
+  } catch (const out_of_range&) {
     throw out_of_range("account does not exist");
   }
-  auto a = std::move(acc_it->second);
-  this->by_account_id.erase(acc_it);
+  this->by_account_id.erase(account_id);
 
   for (const auto& it : a->dc_nte_licenses) {
     this->by_dc_nte_serial_number.erase(it.second->serial_number);
@@ -847,7 +1262,8 @@ void AccountIndex::remove(uint32_t account_id) {
 }
 
 void AccountIndex::add_dc_nte_license(shared_ptr<Account> account, shared_ptr<DCNTELicense> license) {
-  if (!this->by_dc_nte_serial_number.emplace(license->serial_number, account).second) {
+  lock_guard g(this->write_lock);
+  if (!this->by_dc_nte_serial_number.emplace(license->serial_number, {account, license})) {
     throw runtime_error("serial number already registered");
   }
   if (!account->dc_nte_licenses.emplace(license->serial_number, license).second) {
@@ -857,7 +1273,8 @@ void AccountIndex::add_dc_nte_license(shared_ptr<Account> account, shared_ptr<DC
 }
 
 void AccountIndex::add_dc_license(shared_ptr<Account> account, shared_ptr<V1V2License> license) {
-  if (!this->by_dc_serial_number.emplace(license->serial_number, account).second) {
+  lock_guard g(this->write_lock);
+  if (!this->by_dc_serial_number.emplace(license->serial_number, {account, license})) {
     throw runtime_error("serial number already registered");
   }
   if (!account->dc_licenses.emplace(license->serial_number, license).second) {
@@ -867,7 +1284,8 @@ void AccountIndex::add_dc_license(shared_ptr<Account> account, shared_ptr<V1V2Li
 }
 
 void AccountIndex::add_pc_license(shared_ptr<Account> account, shared_ptr<V1V2License> license) {
-  if (!this->by_pc_serial_number.emplace(license->serial_number, account).second) {
+  lock_guard g(this->write_lock);
+  if (!this->by_pc_serial_number.emplace(license->serial_number, {account, license})) {
     throw runtime_error("serial number already registered");
   }
   if (!account->pc_licenses.emplace(license->serial_number, license).second) {
@@ -877,7 +1295,8 @@ void AccountIndex::add_pc_license(shared_ptr<Account> account, shared_ptr<V1V2Li
 }
 
 void AccountIndex::add_gc_license(shared_ptr<Account> account, shared_ptr<GCLicense> license) {
-  if (!this->by_gc_serial_number.emplace(license->serial_number, account).second) {
+  lock_guard g(this->write_lock);
+  if (!this->by_gc_serial_number.emplace(license->serial_number, {account, license})) {
     throw runtime_error("serial number already registered");
   }
   if (!account->gc_licenses.emplace(license->serial_number, license).second) {
@@ -887,7 +1306,8 @@ void AccountIndex::add_gc_license(shared_ptr<Account> account, shared_ptr<GCLice
 }
 
 void AccountIndex::add_xb_license(shared_ptr<Account> account, shared_ptr<XBLicense> license) {
-  if (!this->by_xb_gamertag.emplace(license->gamertag, account).second) {
+  lock_guard g(this->write_lock);
+  if (!this->by_xb_gamertag.emplace(license->gamertag, {account, license})) {
     throw runtime_error("gamertag already registered");
   }
   if (!account->xb_licenses.emplace(license->gamertag, license).second) {
@@ -897,7 +1317,8 @@ void AccountIndex::add_xb_license(shared_ptr<Account> account, shared_ptr<XBLice
 }
 
 void AccountIndex::add_bb_license(shared_ptr<Account> account, shared_ptr<BBLicense> license) {
-  if (!this->by_bb_username.emplace(license->username, account).second) {
+  lock_guard g(this->write_lock);
+  if (!this->by_bb_username.emplace(license->username, {account, license})) {
     throw runtime_error("username already registered");
   }
   if (!account->bb_licenses.emplace(license->username, license).second) {
@@ -907,6 +1328,7 @@ void AccountIndex::add_bb_license(shared_ptr<Account> account, shared_ptr<BBLice
 }
 
 void AccountIndex::remove_dc_nte_license(shared_ptr<Account> account, const string& serial_number) {
+  lock_guard g(this->write_lock);
   auto it = account->dc_nte_licenses.find(serial_number);
   if (it == account->dc_nte_licenses.end()) {
     throw runtime_error("license not registered to account");
@@ -918,6 +1340,7 @@ void AccountIndex::remove_dc_nte_license(shared_ptr<Account> account, const stri
 }
 
 void AccountIndex::remove_dc_license(shared_ptr<Account> account, uint32_t serial_number) {
+  lock_guard g(this->write_lock);
   auto it = account->dc_licenses.find(serial_number);
   if (it == account->dc_licenses.end()) {
     throw runtime_error("license not registered to account");
@@ -929,6 +1352,7 @@ void AccountIndex::remove_dc_license(shared_ptr<Account> account, uint32_t seria
 }
 
 void AccountIndex::remove_pc_license(shared_ptr<Account> account, uint32_t serial_number) {
+  lock_guard g(this->write_lock);
   auto it = account->pc_licenses.find(serial_number);
   if (it == account->pc_licenses.end()) {
     throw runtime_error("license not registered to account");
@@ -940,6 +1364,7 @@ void AccountIndex::remove_pc_license(shared_ptr<Account> account, uint32_t seria
 }
 
 void AccountIndex::remove_gc_license(shared_ptr<Account> account, uint32_t serial_number) {
+  lock_guard g(this->write_lock);
   auto it = account->gc_licenses.find(serial_number);
   if (it == account->gc_licenses.end()) {
     throw runtime_error("license not registered to account");
@@ -951,6 +1376,7 @@ void AccountIndex::remove_gc_license(shared_ptr<Account> account, uint32_t seria
 }
 
 void AccountIndex::remove_xb_license(shared_ptr<Account> account, const string& gamertag) {
+  lock_guard g(this->write_lock);
   auto it = account->xb_licenses.find(gamertag);
   if (it == account->xb_licenses.end()) {
     throw runtime_error("license not registered to account");
@@ -962,6 +1388,7 @@ void AccountIndex::remove_xb_license(shared_ptr<Account> account, const string&
 }
 
 void AccountIndex::remove_bb_license(shared_ptr<Account> account, const string& username) {
+  lock_guard g(this->write_lock);
   auto it = account->bb_licenses.find(username);
   if (it == account->bb_licenses.end()) {
     throw runtime_error("license not registered to account");
@@ -981,23 +1408,12 @@ shared_ptr<Account> AccountIndex::create_temporary_account_for_shared_account(
   return ret;
 }
 
-AccountIndex::AccountIndex(bool force_all_temporary)
-    : force_all_temporary(force_all_temporary) {
-  if (!this->force_all_temporary) {
-    if (!isdir("system/licenses")) {
-      mkdir("system/licenses", 0755);
-    } else {
-      for (const auto& item : list_directory("system/licenses")) {
-        if (ends_with(item, ".json")) {
-          try {
-            JSON json = JSON::parse(load_file("system/licenses/" + item));
-            this->add(make_shared<Account>(json));
-          } catch (const exception& e) {
-            log_error("Failed to index account %s", item.c_str());
-            throw;
-          }
-        }
-      }
+AccountIndex::AccountIndex(shared_ptr<AccountStore> store, bool force_all_temporary)
+    : store(store),
+      force_all_temporary(force_all_temporary) {
+  if (!this->force_all_temporary && this->store) {
+    for (const auto& a : this->store->load_all()) {
+      this->add(a);
     }
   }
 }
@@ -1,16 +1,22 @@
 #pragma once
 
+#include <event2/event.h>
+
+#include <array>
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <phosg/JSON.hh>
-#include <shared_mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "FileWriteQueue.hh"
 #include "Text.hh"
 
 class LicenseIndex;
+class AccountStore;
 
 struct DCNTELicense {
   std::string serial_number;
@@ -100,6 +106,10 @@ struct Account {
   std::unordered_map<std::string, std::shared_ptr<XBLicense>> xb_licenses;
   std::unordered_map<std::string, std::shared_ptr<BBLicense>> bb_licenses;
 
+  // Set by AccountIndex when the account is added to it; save() and
+  // delete_file() do nothing if this is null
+  std::shared_ptr<AccountStore> store;
+
   Account() = default;
   explicit Account(const JSON& json);
   virtual ~Account() = default;
@@ -127,6 +137,111 @@ struct Account {
   void print(FILE* stream) const;
 };
 
+// Persistent storage for accounts. AccountIndex loads all accounts from its
+// store when it's constructed; after that, Account::save and
+// Account::delete_file write through to the store. Stores must be thread-safe,
+// since accounts are used by both the game server and patch server threads.
+class AccountStore {
+public:
+  virtual ~AccountStore() = default;
+
+  virtual std::vector<std::shared_ptr<Account>> load_all() = 0;
+  virtual void save(const Account& a) = 0;
+  virtual void remove(uint32_t account_id) = 0;
+  // Stores may defer syncing writes to disk; this forces all previous writes
+  // to be synced.
+  virtual void flush();
+
+protected:
+  AccountStore() = default;
+};
+
+// Stores each account in its own JSON file in the given directory. This format
+// is easy to edit by hand, but every change rewrites the entire file, and
+// loading all accounts requires opening every file.
+class JSONAccountStore : public AccountStore {
+public:
+  // If write_queue is not null, saves and removals are done asynchronously
+  // through it.
+  JSONAccountStore(const std::string& directory, std::shared_ptr<FileWriteQueue> write_queue = nullptr);
+  virtual ~JSONAccountStore() = default;
+
+  virtual std::vector<std::shared_ptr<Account>> load_all();
+  virtual void save(const Account& a);
+  virtual void remove(uint32_t account_id);
+
+private:
+  std::string directory;
+  std::shared_ptr<FileWriteQueue> write_queue;
+
+  std::string filename_for_account(uint32_t account_id) const;
+};
+
+// Stores all accounts in a single append-only log. Each save appends a
+// checksummed record containing the account's JSON, and each removal appends
+// a tombstone record; the location of the latest record for each account is
+// kept in memory. When loading, a torn record at the end of the log (e.g. from
+// a crash during a write) is discarded, but a corrupt record followed by more
+// records is an error, and the file is left untouched. When most of the log
+// consists of superseded records, it's compacted by rewriting only the latest
+// record for each account. Appended records are synced to disk at most once
+// per sync_interval_usecs, so bursts of saves share a single fsync.
+class LogAccountStore : public AccountStore {
+public:
+  // If base is not null, a timer on it syncs deferred writes once
+  // sync_interval_usecs has elapsed, even if there are no further writes. If
+  // write_queue is not null, all writes, syncs, and compactions are done on
+  // its thread instead of the calling thread; flush() waits for them.
+  LogAccountStore(
+      const std::string& filename,
+      uint64_t sync_interval_usecs,
+      std::shared_ptr<struct event_base> base = nullptr,
+      std::shared_ptr<FileWriteQueue> write_queue = nullptr);
+  LogAccountStore(const LogAccountStore&) = delete;
+  LogAccountStore(LogAccountStore&&) = delete;
+  LogAccountStore& operator=(const LogAccountStore&) = delete;
+  LogAccountStore& operator=(LogAccountStore&&) = delete;
+  virtual ~LogAccountStore();
+
+  virtual std::vector<std::shared_ptr<Account>> load_all();
+  virtual void save(const Account& a);
+  virtual void remove(uint32_t account_id);
+  virtual void flush();
+
+  void compact();
+
+private:
+  struct FileHeader;
+  struct RecordHeader;
+  struct RecordLocation {
+    uint64_t offset;
+    uint64_t size; // Including the RecordHeader
+  };
+
+  std::mutex lock;
+  std::string filename;
+  uint64_t sync_interval_usecs;
+  std::shared_ptr<struct event_base> base;
+  std::shared_ptr<FileWriteQueue> write_queue;
+  std::unique_ptr<struct event, void (*)(struct event*)> sync_event;
+  int fd;
+  uint64_t file_size;
+  uint64_t live_bytes;
+  uint64_t last_sync_time;
+  bool sync_pending;
+  std::unordered_map<uint32_t, RecordLocation> record_locations;
+
+  // Calls fn on write_queue's thread, or immediately if there's no write_queue
+  void run_io(std::function<void()>&& fn);
+
+  void open_locked();
+  void append_record_locked(uint8_t type, uint32_t account_id, const std::string& data);
+  void sync_locked();
+  void compact_locked();
+
+  static void dispatch_sync(evutil_socket_t fd, short events, void* ctx);
+};
+
 struct Login {
   bool account_was_created = false;
   // This field will never be null
@@ -160,7 +275,7 @@ public:
     missing_account() : invalid_argument("missing account") {}
   };
 
-  explicit AccountIndex(bool force_all_temporary);
+  AccountIndex(std::shared_ptr<AccountStore> store, bool force_all_temporary);
   virtual ~AccountIndex() = default;
 
   std::shared_ptr<Account> create_account(bool is_temporary) const;
@@ -222,42 +337,135 @@ public:
       std::shared_ptr<const Account> src_a, const std::string& variation_data) const;
 
 protected:
+  std::shared_ptr<AccountStore> store;
   bool force_all_temporary;
 
+  // A map that can be read without taking any lock. Entries are split into
+  // shards; each shard is an immutable map which is replaced with an atomic
+  // pointer swap when it changes. Writers must hold AccountIndex::write_lock,
+  // and copy only the shard containing the key they are changing. Readers see
+  // each shard either entirely before or entirely after any write.
+  template <typename KeyT, typename ValueT>
+  class ShardedMap {
+  public:
+    using MapT = std::unordered_map<KeyT, ValueT>;
+
+    ShardedMap() {
+      for (auto& shard : this->shards) {
+        shard.store(std::make_shared<const MapT>());
+      }
+    }
+    ShardedMap(const ShardedMap&) = delete;
+    ShardedMap(ShardedMap&&) = delete;
+    ShardedMap& operator=(const ShardedMap&) = delete;
+    ShardedMap& operator=(ShardedMap&&) = delete;
+    ~ShardedMap() = default;
+
+    // Throws std::out_of_range if the key doesn't exist, like unordered_map
+    ValueT at(const KeyT& key) const {
+      return this->shard_for(key).load()->at(key);
+    }
+    bool count(const KeyT& key) const {
+      return this->shard_for(key).load()->count(key);
+    }
+    size_t size() const {
+      return this->num_entries.load();
+    }
+    void for_each(const std::function<void(const ValueT&)>& fn) const {
+      for (const auto& shard : this->shards) {
+        for (const auto& it : *shard.load()) {
+          fn(it.second);
+        }
+      }
+    }
+
+    // Returns false (and does nothing) if the key already exists
+    bool emplace(const KeyT& key, ValueT value) {
+      auto& shard = this->shard_for(key);
+      auto orig_map = shard.load();
+      if (orig_map->count(key)) {
+        return false;
+      }
+      auto new_map = std::make_shared<MapT>(*orig_map);
+      new_map->emplace(key, std::move(value));
+      shard.store(std::move(new_map));
+      this->num_entries++;
+      return true;
+    }
+    // Returns false if the key didn't exist
+    bool erase(const KeyT& key) {
+      auto& shard = this->shard_for(key);
+      auto orig_map = shard.load();
+      if (!orig_map->count(key)) {
+        return false;
+      }
+      auto new_map = std::make_shared<MapT>(*orig_map);
+      new_map->erase(key);
+      shard.store(std::move(new_map));
+      this->num_entries--;
+      return true;
+    }
+
+  private:
+    static constexpr size_t NUM_SHARDS = 64;
+    std::array<std::atomic<std::shared_ptr<const MapT>>, NUM_SHARDS> shards;
+    std::atomic<size_t> num_entries = 0;
+
+    inline std::atomic<std::shared_ptr<const MapT>>& shard_for(const KeyT& key) {
+      return this->shards[std::hash<KeyT>()(key) % NUM_SHARDS];
+    }
+    inline const std::atomic<std::shared_ptr<const MapT>>& shard_for(const KeyT& key) const {
+      return this->shards[std::hash<KeyT>()(key) % NUM_SHARDS];
+    }
+  };
+
+  // The license maps hold the license along with the account, so lookups
+  // never have to read the account's own license maps, which are modified in
+  // place (under write_lock) when licenses are added or removed. (Logging in
+  // to a shared account copies the account, including its license maps, but
+  // only DC, PC and GC clients can do that, and their logins and all license
+  // changes happen on the server's event thread.)
+  template <typename LicenseT>
+  struct LicenseEntry {
+    std::shared_ptr<Account> account;
+    std::shared_ptr<LicenseT> license;
+  };
+
   // This class must be thread-safe because it's used by both the patch server
-  // and game server threads
-  mutable std::shared_mutex lock;
-  std::unordered_map<uint32_t, std::shared_ptr<Account>> by_account_id;
-  std::unordered_map<std::string, std::shared_ptr<Account>> by_dc_nte_serial_number;
-  std::unordered_map<uint32_t, std::shared_ptr<Account>> by_dc_serial_number;
-  std::unordered_map<uint32_t, std::shared_ptr<Account>> by_pc_serial_number;
-  std::unordered_map<uint32_t, std::shared_ptr<Account>> by_gc_serial_number;
-  std::unordered_map<std::string, std::shared_ptr<Account>> by_xb_gamertag;
-  std::unordered_map<std::string, std::shared_ptr<Account>> by_bb_username;
+  // and game server threads. Lookups don't take any lock; all modifications
+  // hold write_lock.
+  std::mutex write_lock;
+  ShardedMap<uint32_t, std::shared_ptr<Account>> by_account_id;
+  ShardedMap<std::string, LicenseEntry<DCNTELicense>> by_dc_nte_serial_number;
+  ShardedMap<uint32_t, LicenseEntry<V1V2License>> by_dc_serial_number;
+  ShardedMap<uint32_t, LicenseEntry<V1V2License>> by_pc_serial_number;
+  ShardedMap<uint32_t, LicenseEntry<GCLicense>> by_gc_serial_number;
+  ShardedMap<std::string, LicenseEntry<XBLicense>> by_xb_gamertag;
+  ShardedMap<std::string, LicenseEntry<BBLicense>> by_bb_username;
 
   void add_locked(std::shared_ptr<Account> a);
 
-  std::shared_ptr<Login> from_dc_nte_credentials_locked(
+  std::shared_ptr<Login> check_dc_nte_credentials(
       const std::string& serial_number,
       const std::string& access_key);
-  std::shared_ptr<Login> from_dc_credentials_locked(
+  std::shared_ptr<Login> check_dc_credentials(
       uint32_t serial_number,
       const std::string& access_key,
       const std::string& character_name);
-  std::shared_ptr<Login> from_pc_credentials_locked(
+  std::shared_ptr<Login> check_pc_credentials(
       uint32_t serial_number,
       const std::string& access_key,
       const std::string& character_name);
-  std::shared_ptr<Login> from_gc_credentials_locked(
+  std::shared_ptr<Login> check_gc_credentials(
       uint32_t serial_number,
       const std::string& access_key,
       const std::string* password,
       const std::string& character_name);
-  std::shared_ptr<Login> from_xb_credentials_locked(
+  std::shared_ptr<Login> check_xb_credentials(
       const std::string& gamertag,
       uint64_t user_id,
       uint64_t account_id);
-  std::shared_ptr<Login> from_bb_credentials_locked(
+  std::shared_ptr<Login> check_bb_credentials(
       const std::string& username,
       const std::string* password);
 };
@@ -1212,10 +1212,12 @@ static void server_command_password(shared_ptr<Client> c, const std::string& arg
 
   if (!args[0]) {
     l->password.clear();
+    l->invalidate_game_menus();
     send_text_message(l, "$C6Game unlocked");
 
   } else {
     l->password = args;
+    l->invalidate_game_menus();
     string escaped = remove_color(l->password);
     send_text_message_printf(l, "$C6Game password:\n%s", escaped.c_str());
   }
@@ -1403,6 +1405,10 @@ static void server_command_edit(shared_ptr<Client> c, const std::string& args) {
     return;
   }
 
+  // The name or language (which affects how the name is decoded) may have
+  // changed, so update the channel name and the client index
+  c->update_channel_name();
+
   // Reload the client in the lobby
   send_player_leave_notification(l, c->lobby_client_id);
   if (c->version() == Version::BB_V4) {
@@ -1634,6 +1640,10 @@ static void server_command_silence(shared_ptr<Client> c, const std::string& args
   check_account_flag(c, Account::Flag::SILENCE_USER);
 
   auto target = s->find_client(&args);
+  if (!target) {
+    send_text_message(c, "$C6Player not found");
+    return;
+  }
   if (!target->login) {
     // this should be impossible, but I'll bet it's not actually
     send_text_message(c, "$C6Client not logged in");
@@ -1657,6 +1667,10 @@ static void server_command_kick(shared_ptr<Client> c, const std::string& args) {
   check_account_flag(c, Account::Flag::KICK_USER);
 
   auto target = s->find_client(&args);
+  if (!target) {
+    send_text_message(c, "$C6Player not found");
+    return;
+  }
   if (!target->login) {
     // This should be impossible, but I'll bet it's not actually
     send_text_message(c, "$C6Client not logged in");
@@ -1687,6 +1701,10 @@ static void server_command_ban(shared_ptr<Client> c, const std::string& args) {
 
   string identifier = args.substr(space_pos + 1);
   auto target = s->find_client(&identifier);
+  if (!target) {
+    send_text_message(c, "$C6Player not found");
+    return;
+  }
   if (!target->login) {
     // This should be impossible, but I'll bet it's not actually
     send_text_message(c, "$C6Client not logged in");
@@ -1848,19 +1866,19 @@ static void server_command_what(shared_ptr<Client> c, const std::string&) {
   }
 
   float min_dist2 = 0.0f;
-  shared_ptr<const Lobby::FloorItem> nearest_fi;
-  for (const auto& it : l->floor_item_managers.at(c->floor).items) {
-    if (!it.second->visible_to_client(c->lobby_client_id)) {
-      continue;
+  const Lobby::FloorItem* nearest_fi = nullptr;
+  l->floor_item_managers.at(c->floor).for_each([&](const Lobby::FloorItem& fi) -> void {
+    if (!fi.visible_to_client(c->lobby_client_id)) {
+      return;
     }
-    float dx = it.second->x - c->x;
-    float dz = it.second->z - c->z;
+    float dx = fi.x - c->x;
+    float dz = fi.z - c->z;
     float dist2 = (dx * dx) + (dz * dz);
     if (!nearest_fi || (dist2 < min_dist2)) {
-      nearest_fi = it.second;
+      nearest_fi = &fi;
       min_dist2 = dist2;
     }
-  }
+  });
 
   if (!nearest_fi) {
     send_text_message(c, "$C4No items are near you");
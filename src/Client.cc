@@ -279,6 +279,13 @@ void Client::update_channel_name() {
   } else {
     this->channel.name = string_printf("C-%" PRIX64 " @ %s", this->id, ip_str.c_str());
   }
+
+  // The player's name may have changed, so update the client index as well.
+  // (This is also called from the constructor, but the client isn't in a lobby
+  // yet at that point, so it isn't indexed.)
+  if (this->lobby.lock()) {
+    this->require_server_state()->update_client_index(this->shared_from_this());
+  }
 }
 
 void Client::reschedule_save_game_data_event() {
@@ -724,6 +731,46 @@ void Client::create_character_file(
   this->save_character_file();
 }
 
+void Client::prefetch_player_files() const {
+  vector<string> filenames;
+  filenames.emplace_back(this->system_filename());
+  filenames.emplace_back(this->guild_card_filename());
+  filenames.emplace_back(this->shared_bank_filename());
+  for (int8_t z = 0; z < 4; z++) {
+    filenames.emplace_back(this->character_filename(z));
+  }
+  this->require_server_state()->player_files_manager->prefetch(filenames);
+}
+
+template <typename T>
+static T parse_player_file(const string& data, bool allow_oversize = false) {
+  if ((data.size() < sizeof(T)) || (!allow_oversize && (data.size() > sizeof(T)))) {
+    throw runtime_error("player file has incorrect size");
+  }
+  return StringReader(data).get<T>();
+}
+
+static shared_ptr<PSOBBCharacterFile> parse_character_file(
+    const string& data, shared_ptr<PSOBBBaseSystemFile>* system_out = nullptr) {
+  StringReader r(data);
+  const auto& header = r.get<PSOCommandHeaderBB>();
+  if (header.size != 0x399C) {
+    throw runtime_error("incorrect size in character file header");
+  }
+  if (header.command != 0x00E7) {
+    throw runtime_error("incorrect command in character file header");
+  }
+  if (header.flag != 0x00000000) {
+    throw runtime_error("incorrect flag in character file header");
+  }
+  static_assert(sizeof(PSOBBCharacterFile) + sizeof(PSOBBFullSystemFile) == 0x3994, ".psochar size is incorrect");
+  auto ret = make_shared<PSOBBCharacterFile>(r.get<PSOBBCharacterFile>());
+  if (system_out) {
+    *system_out = make_shared<PSOBBBaseSystemFile>(r.get<PSOBBBaseSystemFile>());
+  }
+  return ret;
+}
+
 void Client::load_all_files() {
   if (this->version() != Version::BB_V4) {
     this->system_data = make_shared<PSOBBBaseSystemFile>();
@@ -739,14 +786,16 @@ void Client::load_all_files() {
   this->character_data.reset();
   this->guild_card_data.reset();
 
-  auto files_manager = this->require_server_state()->player_files_manager;
+  auto s = this->require_server_state();
+  auto files_manager = s->player_files_manager;
 
   string sys_filename = this->system_filename();
   this->system_data = files_manager->get_system(sys_filename);
+  shared_ptr<const string> file_data;
   if (this->system_data) {
     player_data_log.info("Using loaded system file %s", sys_filename.c_str());
-  } else if (isfile(sys_filename)) {
-    this->system_data = make_shared<PSOBBBaseSystemFile>(load_object_file<PSOBBBaseSystemFile>(sys_filename, true));
+  } else if ((file_data = files_manager->load_file_data(sys_filename))) {
+    this->system_data = make_shared<PSOBBBaseSystemFile>(parse_player_file<PSOBBBaseSystemFile>(*file_data, true));
     files_manager->set_system(sys_filename, this->system_data);
     player_data_log.info("Loaded system data from %s", sys_filename.c_str());
   } else {
@@ -758,27 +807,15 @@ void Client::load_all_files() {
     this->character_data = files_manager->get_character(char_filename);
     if (this->character_data) {
       player_data_log.info("Using loaded character file %s", char_filename.c_str());
-    } else if (isfile(char_filename)) {
-      auto f = fopen_unique(char_filename, "rb");
-      auto header = freadx<PSOCommandHeaderBB>(f.get());
-      if (header.size != 0x399C) {
-        throw runtime_error("incorrect size in character file header");
-      }
-      if (header.command != 0x00E7) {
-        throw runtime_error("incorrect command in character file header");
-      }
-      if (header.flag != 0x00000000) {
-        throw runtime_error("incorrect flag in character file header");
-      }
-      static_assert(sizeof(PSOBBCharacterFile) + sizeof(PSOBBFullSystemFile) == 0x3994, ".psochar size is incorrect");
-      this->character_data = make_shared<PSOBBCharacterFile>(freadx<PSOBBCharacterFile>(f.get()));
+    } else if ((file_data = files_manager->load_file_data(char_filename))) {
+      // If there was no .psosys file, load the system file from the .psochar
+      // file instead
+      bool load_system = !this->system_data;
+      this->character_data = parse_character_file(*file_data, load_system ? &this->system_data : nullptr);
       files_manager->set_character(char_filename, this->character_data);
       player_data_log.info("Loaded character data from %s", char_filename.c_str());
 
-      // If there was no .psosys file, load the system file from the .psochar
-      // file instead
-      if (!this->system_data) {
-        this->system_data = make_shared<PSOBBBaseSystemFile>(freadx<PSOBBBaseSystemFile>(f.get()));
+      if (load_system) {
         files_manager->set_system(sys_filename, this->system_data);
         player_data_log.info("Loaded system data from %s", char_filename.c_str());
       }
@@ -795,8 +832,8 @@ void Client::load_all_files() {
   this->guild_card_data = files_manager->get_guild_card(card_filename);
   if (this->guild_card_data) {
     player_data_log.info("Using loaded Guild Card file %s", card_filename.c_str());
-  } else if (isfile(card_filename)) {
-    this->guild_card_data = make_shared<PSOBBGuildCardFile>(load_object_file<PSOBBGuildCardFile>(card_filename));
+  } else if ((file_data = files_manager->load_file_data(card_filename))) {
+    this->guild_card_data = make_shared<PSOBBGuildCardFile>(parse_player_file<PSOBBGuildCardFile>(*file_data));
     files_manager->set_guild_card(card_filename, this->guild_card_data);
     player_data_log.info("Loaded Guild Card data from %s", card_filename.c_str());
   } else {
@@ -917,9 +954,7 @@ void Client::save_all() {
     this->save_guild_card_file();
   }
   if (this->external_bank) {
-    string filename = this->shared_bank_filename();
-    save_object_file<PlayerBank200>(filename, *this->external_bank);
-    player_data_log.info("Saved shared bank file %s", filename.c_str());
+    this->save_shared_bank_file();
   }
   if (this->external_bank_character) {
     this->save_character_file(
@@ -934,19 +969,20 @@ void Client::save_system_file() const {
     throw logic_error("no system file loaded");
   }
   string filename = this->system_filename();
-  save_object_file(filename, *this->system_data);
+  this->require_server_state()->player_files_manager->save_file_data(
+      filename, make_shared<string>(reinterpret_cast<const char*>(this->system_data.get()), sizeof(PSOBBBaseSystemFile)));
   player_data_log.info("Saved system file %s", filename.c_str());
 }
 
 void Client::save_character_file(
     const string& filename,
     shared_ptr<const PSOBBBaseSystemFile> system,
-    shared_ptr<const PSOBBCharacterFile> character) {
-  auto f = fopen_unique(filename, "wb");
+    shared_ptr<const PSOBBCharacterFile> character) const {
+  StringWriter w;
   PSOCommandHeaderBB header = {sizeof(PSOCommandHeaderBB) + sizeof(PSOBBCharacterFile) + sizeof(PSOBBBaseSystemFile) + sizeof(PSOBBTeamMembership), 0x00E7, 0x00000000};
-  fwritex(f.get(), header);
-  fwritex(f.get(), *character);
-  fwritex(f.get(), *system);
+  w.put(header);
+  w.put(*character);
+  w.put(*system);
   // TODO: Technically, we should write the actual team membership struct to the
   // file here, but that would cause Client to depend on Account, which
   // it currently does not. This data doesn't matter at all for correctness
@@ -958,7 +994,8 @@ void Client::save_character_file(
   // of teams with a different set of team IDs anyway, so the membership struct
   // here would be useless either way.
   static const PSOBBTeamMembership empty_membership;
-  fwritex(f.get(), empty_membership);
+  w.put(empty_membership);
+  this->require_server_state()->player_files_manager->save_file_data(filename, make_shared<string>(std::move(w.str())));
   player_data_log.info("Saved character file %s", filename.c_str());
 }
 
@@ -987,26 +1024,31 @@ void Client::save_guild_card_file() const {
     throw logic_error("no Guild Card file loaded");
   }
   string filename = this->guild_card_filename();
-  save_object_file(filename, *this->guild_card_data);
+  this->require_server_state()->player_files_manager->save_file_data(
+      filename, make_shared<string>(reinterpret_cast<const char*>(this->guild_card_data.get()), sizeof(PSOBBGuildCardFile)));
   player_data_log.info("Saved Guild Card file %s", filename.c_str());
 }
 
+void Client::save_shared_bank_file() const {
+  if (!this->external_bank) {
+    throw logic_error("no shared bank loaded");
+  }
+  string filename = this->shared_bank_filename();
+  this->require_server_state()->player_files_manager->save_file_data(
+      filename, make_shared<string>(reinterpret_cast<const char*>(this->external_bank.get()), sizeof(PlayerBank200)));
+  player_data_log.info("Saved shared bank file %s", filename.c_str());
+}
+
 void Client::load_backup_character(uint32_t account_id, size_t index) {
   string filename = this->backup_character_filename(account_id, index);
-  auto f = fopen_unique(filename, "rb");
-  auto header = freadx<PSOCommandHeaderBB>(f.get());
-  if (header.size != 0x399C) {
-    throw runtime_error("incorrect size in character file header");
-  }
-  if (header.command != 0x00E7) {
-    throw runtime_error("incorrect command in character file header");
-  }
-  if (header.flag != 0x00000000) {
-    throw runtime_error("incorrect flag in character file header");
+  auto file_data = this->require_server_state()->player_files_manager->load_file_data(filename);
+  if (!file_data) {
+    throw cannot_open_file(filename);
   }
-  this->character_data = make_shared<PSOBBCharacterFile>(freadx<PSOBBCharacterFile>(f.get()));
+  this->character_data = parse_character_file(*file_data);
   this->update_character_data_after_load(this->character_data);
   this->v1_v2_last_reported_disp.reset();
+  this->update_channel_name();
 }
 
 void Client::save_and_unload_character() {
@@ -1033,7 +1075,7 @@ std::shared_ptr<PSOBBCharacterFile> Client::current_bank_character() {
 void Client::use_default_bank() {
   if (this->external_bank) {
     string filename = this->shared_bank_filename();
-    save_object_file<PlayerBank200>(filename, *this->external_bank);
+    this->save_shared_bank_file();
     this->external_bank.reset();
     player_data_log.info("Detached shared bank %s", filename.c_str());
   }
@@ -1049,13 +1091,15 @@ bool Client::use_shared_bank() {
   this->use_default_bank();
 
   string filename = this->shared_bank_filename();
-  auto files_manager = this->require_server_state()->player_files_manager;
+  auto s = this->require_server_state();
+  auto files_manager = s->player_files_manager;
   this->external_bank = files_manager->get_bank(filename);
+  shared_ptr<const string> file_data;
   if (this->external_bank) {
     player_data_log.info("Using loaded shared bank %s", filename.c_str());
     return true;
-  } else if (isfile(filename)) {
-    this->external_bank = make_shared<PlayerBank200>(load_object_file<PlayerBank200>(filename));
+  } else if ((file_data = files_manager->load_file_data(filename))) {
+    this->external_bank = make_shared<PlayerBank200>(parse_player_file<PlayerBank200>(*file_data));
     files_manager->set_bank(filename, this->external_bank);
     player_data_log.info("Loaded shared bank %s", filename.c_str());
     return true;
@@ -1070,26 +1114,17 @@ bool Client::use_shared_bank() {
 void Client::use_character_bank(int8_t index) {
   this->use_default_bank();
   if (index != this->bb_character_index) {
-    auto files_manager = this->require_server_state()->player_files_manager;
+    auto s = this->require_server_state();
+    auto files_manager = s->player_files_manager;
 
     string filename = this->character_filename(index);
     this->external_bank_character = files_manager->get_character(filename);
+    shared_ptr<const string> file_data;
     if (this->external_bank_character) {
       this->external_bank_character_index = index;
       player_data_log.info("Using loaded character file %s for external bank", filename.c_str());
-    } else if (isfile(filename)) {
-      auto f = fopen_unique(filename, "rb");
-      auto header = freadx<PSOCommandHeaderBB>(f.get());
-      if (header.size != 0x399C) {
-        throw runtime_error("incorrect size in character file header");
-      }
-      if (header.command != 0x00E7) {
-        throw runtime_error("incorrect command in character file header");
-      }
-      if (header.flag != 0x00000000) {
-        throw runtime_error("incorrect flag in character file header");
-      }
-      this->external_bank_character = make_shared<PSOBBCharacterFile>(freadx<PSOBBCharacterFile>(f.get()));
+    } else if ((file_data = files_manager->load_file_data(filename))) {
+      this->external_bank_character = parse_character_file(*file_data);
       this->update_character_data_after_load(this->external_bank_character);
       this->external_bank_character_index = index;
       files_manager->set_character(filename, this->external_bank_character);
@@ -213,6 +213,11 @@ public:
   uint8_t lobby_client_id;
   uint8_t lobby_arrow_color;
   int64_t preferred_lobby_id; // <0 = no preference
+  // Keys under which this client is in ServerState's client indexes (see
+  // ServerState::update_client_index)
+  bool is_indexed = false;
+  uint32_t indexed_account_id = 0;
+  std::string indexed_name;
 
   std::unique_ptr<struct event, void (*)(struct event*)> save_game_data_event;
   std::unique_ptr<struct event, void (*)(struct event*)> send_ping_event;
@@ -271,6 +276,7 @@ public:
   // File loading state
   uint32_t dol_base_addr;
   std::shared_ptr<DOLFileIndex::File> loading_dol_file;
+  // Values are prebuilt 13/A7 commands; see encode_quest_file_chunks
   std::unordered_map<std::string, std::shared_ptr<const std::string>> sending_files;
 
   Client(
@@ -374,14 +380,18 @@ public:
 
   void save_all();
   void save_system_file() const;
-  static void save_character_file(
+  void save_character_file(
       const std::string& filename,
       std::shared_ptr<const PSOBBBaseSystemFile> sys,
-      std::shared_ptr<const PSOBBCharacterFile> character);
+      std::shared_ptr<const PSOBBCharacterFile> character) const;
   // Note: This function is not const because it updates the player's play time.
   void save_character_file();
   void save_guild_card_file() const;
+  void save_shared_bank_file() const;
 
+  // Starts loading all of the player's BB files in the background, so they
+  // will likely already be in memory when the client asks for them.
+  void prefetch_player_files() const;
   void load_backup_character(uint32_t account_id, size_t index);
   void save_and_unload_character();
 
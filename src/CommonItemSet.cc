@@ -135,6 +135,32 @@ CommonItemSet::Table::Table(const JSON& json, Episode episode)
       }
     }
   }
+
+  this->compute_weighted_index_tables();
+}
+
+parray<uint8_t, 0x0D> CommonItemSet::Table::weapon_type_prob_table(uint8_t area_norm) const {
+  parray<uint8_t, 0x0D> ret;
+  ret[0] = 0;
+  for (size_t z = 1; z < 13; z++) {
+    // Technically this should be `if (... < 0)`, but whatever
+    ret[z] = ((area_norm + this->subtype_base_table.at(z - 1)) & 0x80) ? 0 : this->base_weapon_type_prob_table[z - 1];
+  }
+  return ret;
+}
+
+void CommonItemSet::Table::compute_weighted_index_tables() {
+  this->armor_shield_type_index_weights = WeightedIndexTable(this->armor_shield_type_index_prob_table);
+  this->armor_slot_count_weights = WeightedIndexTable(this->armor_slot_count_prob_table);
+  for (size_t z = 0; z < this->base_weapon_type_weights.size(); z++) {
+    this->base_weapon_type_weights[z] = WeightedIndexTable(this->weapon_type_prob_table(z));
+  }
+  this->grind_weights = WeightedIndexTable::for_columns(this->grind_prob_table);
+  this->bonus_value_weights = WeightedIndexTable::for_columns(this->bonus_value_prob_table);
+  this->bonus_type_weights = WeightedIndexTable::for_columns(this->bonus_type_prob_table);
+  this->tool_class_weights = WeightedIndexTable::for_columns(this->tool_class_prob_table);
+  this->technique_index_weights = WeightedIndexTable::for_columns(this->technique_index_prob_table);
+  this->box_item_class_weights = WeightedIndexTable::for_columns(this->box_item_class_prob_table);
 }
 
 static const char* name_for_common_item_class(uint8_t item_class) {
@@ -430,6 +456,7 @@ CommonItemSet::Table::Table(const StringReader& r, bool is_big_endian, bool is_v
   } else {
     this->parse_itempt_t<false>(r, is_v3);
   }
+  this->compute_weighted_index_tables();
 }
 
 template <bool IsBigEndian>
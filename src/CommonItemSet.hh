@@ -1,14 +1,61 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <phosg/Encoding.hh>
 #include <phosg/JSON.hh>
+#include <vector>
 
 #include "GSLArchive.hh"
 #include "PSOEncryption.hh"
 #include "StaticGameData.hh"
 #include "Text.hh"
 
+// An index probability table (see the comments in CommonItemSet::Table) with
+// its weights summed ahead of time. The client sums a table's weights and walks
+// it on every draw; index_for_value() returns the same index as that walk for
+// every value, but uses a binary search over the cumulative weights instead.
+// Callers still choose the value with a single random draw in [0, total()), so
+// the results and the random values consumed are exactly the same as before.
+class WeightedIndexTable {
+public:
+  WeightedIndexTable() = default;
+  template <typename IntT>
+  WeightedIndexTable(const IntT* weights, size_t num_values, size_t stride = 1) {
+    uint32_t total = 0;
+    this->cumulative_weights.reserve(num_values);
+    for (size_t z = 0; z < num_values; z++) {
+      total += weights[z * stride];
+      this->cumulative_weights.emplace_back(total);
+    }
+  }
+  template <typename IntT, size_t X>
+  explicit WeightedIndexTable(const parray<IntT, X>& weights)
+      : WeightedIndexTable(weights.data(), X, 1) {}
+
+  // Returns one table for each column of a 2D table indexed as [value][column]
+  template <typename IntT, size_t X, size_t Y>
+  static std::array<WeightedIndexTable, X> for_columns(const parray<parray<IntT, X>, Y>& weights) {
+    std::array<WeightedIndexTable, X> ret;
+    for (size_t x = 0; x < X; x++) {
+      ret[x] = WeightedIndexTable(weights[0].data() + x, Y, X);
+    }
+    return ret;
+  }
+
+  inline uint64_t total() const {
+    return this->cumulative_weights.empty() ? 0 : this->cumulative_weights.back();
+  }
+
+  // value must be less than total().
+  inline size_t index_for_value(uint64_t value) const {
+    return std::upper_bound(this->cumulative_weights.begin(), this->cumulative_weights.end(), value) - this->cumulative_weights.begin();
+  }
+
+private:
+  std::vector<uint32_t> cumulative_weights;
+};
+
 class CommonItemSet {
 public:
   class Table {
@@ -47,10 +94,31 @@ public:
     parray<uint8_t, 0x0A> unit_max_stars_table;
     parray<parray<uint8_t, 10>, 7> box_item_class_prob_table;
 
+    // Precomputed forms of the index probability tables above, built when the
+    // table is loaded. The 2D tables have one entry per column (that is, per
+    // offset passed to the lookup). base_weapon_type_weights has one entry per
+    // area - 1, since weapon types are excluded from areas before they can
+    // appear; see weapon_type_prob_table().
+    WeightedIndexTable armor_shield_type_index_weights;
+    WeightedIndexTable armor_slot_count_weights;
+    std::array<WeightedIndexTable, 0x0A> base_weapon_type_weights;
+    std::array<WeightedIndexTable, 4> grind_weights;
+    std::array<WeightedIndexTable, 6> bonus_value_weights;
+    std::array<WeightedIndexTable, 10> bonus_type_weights;
+    std::array<WeightedIndexTable, 0x0A> tool_class_weights;
+    std::array<WeightedIndexTable, 0x0A> technique_index_weights;
+    std::array<WeightedIndexTable, 10> box_item_class_weights;
+
+    // Returns the weapon type index probability table for the given area - 1.
+    // Entry 0 means no item; entries 1-12 correspond to weapon types 01-0C.
+    parray<uint8_t, 0x0D> weapon_type_prob_table(uint8_t area_norm) const;
+
     JSON json() const;
     void print(FILE* stream) const;
 
   private:
+    void compute_weighted_index_tables();
+
     template <bool IsBigEndian>
     void parse_itempt_t(const StringReader& r, bool is_v3);
 
@@ -0,0 +1,194 @@
+#include "DataSnapshot.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <phosg/Encoding.hh>
+#include <phosg/Filesystem.hh>
+#include <phosg/Strings.hh>
+#include <stdexcept>
+
+using namespace std;
+
+struct DataSnapshot::FileHeader {
+  le_uint64_t signature;
+  le_uint32_t format_version;
+  le_uint32_t num_entries;
+  // FileEntry[num_entries] follows immediately
+} __packed_ws__(FileHeader, 0x10);
+
+struct DataSnapshot::FileEntry {
+  le_uint64_t source_size;
+  le_uint64_t source_mtime_nsecs;
+  le_uint64_t path_offset; // Relative to start of file
+  le_uint64_t path_size;
+  le_uint64_t data_offset; // Relative to start of file
+  le_uint64_t data_size;
+} __packed_ws__(FileEntry, 0x30);
+
+// The 1-second resolution of st_mtime isn't enough to catch a file that was
+// rewritten shortly after the snapshot was built, so we use the full timestamp
+static uint64_t mtime_nsecs_for_stat(const struct stat& st) {
+#ifdef __APPLE__
+  const auto& ts = st.st_mtimespec;
+#else
+  const auto& ts = st.st_mtim;
+#endif
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+DataSnapshot::DataSnapshot(const string& filename)
+    : fd(-1),
+      mapped_data(nullptr),
+      mapped_size(0) {
+  this->fd = open(filename.c_str(), O_RDONLY);
+  if (this->fd < 0) {
+    throw cannot_open_file(filename);
+  }
+
+  try {
+    struct stat st;
+    if (fstat(this->fd, &st) != 0) {
+      throw runtime_error("cannot stat data snapshot file");
+    }
+    this->mapped_size = st.st_size;
+    if (this->mapped_size < sizeof(FileHeader)) {
+      throw runtime_error("data snapshot file is too small");
+    }
+    this->mapped_data = mmap(nullptr, this->mapped_size, PROT_READ, MAP_SHARED, this->fd, 0);
+    if (this->mapped_data == MAP_FAILED) {
+      this->mapped_data = nullptr;
+      throw runtime_error("cannot map data snapshot file");
+    }
+
+    StringReader r(this->mapped_data, this->mapped_size);
+    const auto& header = r.get<FileHeader>();
+    if (header.signature != SIGNATURE) {
+      throw runtime_error("file is not a data snapshot");
+    }
+    if (header.format_version != FORMAT_VERSION) {
+      throw runtime_error(string_printf(
+          "data snapshot format version is %" PRIu32 " (expected %" PRIu32 ")",
+          header.format_version.load(), FORMAT_VERSION));
+    }
+
+    const char* base = reinterpret_cast<const char*>(this->mapped_data);
+    for (size_t z = 0; z < header.num_entries; z++) {
+      const auto& file_entry = r.get<FileEntry>();
+      uint64_t path_offset = file_entry.path_offset;
+      uint64_t path_size = file_entry.path_size;
+      uint64_t data_offset = file_entry.data_offset;
+      uint64_t data_size = file_entry.data_size;
+      // These fields come from the file, so they're checked in a way that
+      // can't overflow
+      if ((path_offset > this->mapped_size) || (path_size > this->mapped_size - path_offset) ||
+          (data_offset > this->mapped_size) || (data_size > this->mapped_size - data_offset)) {
+        throw runtime_error("data snapshot entry extends beyond end of file");
+      }
+      this->entries.emplace(
+          string(base + path_offset, path_size),
+          Entry{
+              .source_size = file_entry.source_size,
+              .source_mtime_nsecs = file_entry.source_mtime_nsecs,
+              .data = base + data_offset,
+              .size = data_size,
+          });
+    }
+  } catch (const exception&) {
+    if (this->mapped_data) {
+      munmap(this->mapped_data, this->mapped_size);
+    }
+    close(this->fd);
+    throw;
+  }
+}
+
+DataSnapshot::~DataSnapshot() {
+  if (this->mapped_data) {
+    munmap(this->mapped_data, this->mapped_size);
+  }
+  if (this->fd >= 0) {
+    close(this->fd);
+  }
+}
+
+DecodedFileData DataSnapshot::get(const string& source_path) const {
+  auto it = this->entries.find(source_path);
+  if (it == this->entries.end()) {
+    return DecodedFileData();
+  }
+  const auto& entry = it->second;
+
+  struct stat st;
+  if (::stat(source_path.c_str(), &st) != 0) {
+    return DecodedFileData();
+  }
+  if ((static_cast<uint64_t>(st.st_size) != entry.source_size) ||
+      (mtime_nsecs_for_stat(st) != entry.source_mtime_nsecs)) {
+    return DecodedFileData();
+  }
+  return DecodedFileData{
+      .owner = this->shared_from_this(),
+      .data = string_view(entry.data, entry.size),
+  };
+}
+
+void DataSnapshot::Builder::add(const string& source_path, const string& decoded_data) {
+  auto st = stat(source_path);
+  lock_guard g(this->lock);
+  this->entries[source_path] = Entry{
+      .source_size = static_cast<uint64_t>(st.st_size),
+      .source_mtime_nsecs = mtime_nsecs_for_stat(st),
+      .data = decoded_data,
+  };
+}
+
+void DataSnapshot::Builder::save(const string& filename) const {
+  lock_guard g(this->lock);
+
+  // Entry data is aligned to 0x10-byte boundaries so that objects that are
+  // used in place from the decoded data are reasonably aligned
+  size_t paths_offset = sizeof(FileHeader) + sizeof(FileEntry) * this->entries.size();
+  size_t data_offset = paths_offset;
+  for (const auto& it : this->entries) {
+    data_offset += it.first.size();
+  }
+  data_offset = (data_offset + 0x0F) & (~0x0F);
+
+  StringWriter w;
+  w.put<FileHeader>(FileHeader{
+      .signature = SIGNATURE,
+      .format_version = FORMAT_VERSION,
+      .num_entries = static_cast<uint32_t>(this->entries.size()),
+  });
+  size_t path_offset = paths_offset;
+  for (const auto& it : this->entries) {
+    w.put<FileEntry>(FileEntry{
+        .source_size = it.second.source_size,
+        .source_mtime_nsecs = it.second.source_mtime_nsecs,
+        .path_offset = path_offset,
+        .path_size = it.first.size(),
+        .data_offset = data_offset,
+        .data_size = it.second.data.size(),
+    });
+    path_offset += it.first.size();
+    data_offset = (data_offset + it.second.data.size() + 0x0F) & (~0x0F);
+  }
+  for (const auto& it : this->entries) {
+    w.write(it.first);
+  }
+  for (const auto& it : this->entries) {
+    w.extend_to((w.size() + 0x0F) & (~0x0F));
+    w.write(it.second.data);
+  }
+
+  // Write to a temporary file and rename it, so a running server never sees a
+  // partially-written snapshot
+  string temp_filename = filename + ".tmp";
+  save_file(temp_filename, w.str());
+  if (rename(temp_filename.c_str(), filename.c_str()) != 0) {
+    throw runtime_error("cannot rename data snapshot file into place");
+  }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Decoded contents of a static data file. The data may point into a mapped
+// DataSnapshot or into a heap string; in either case, owner keeps the memory
+// alive, so objects that use the data in place should hold a reference to it.
+struct DecodedFileData {
+  std::shared_ptr<const void> owner;
+  std::string_view data;
+
+  inline explicit operator bool() const {
+    return this->owner != nullptr;
+  }
+};
+
+// A DataSnapshot is a single file containing the decoded (decompressed and/or
+// decrypted) contents of many static data files, so the server doesn't have
+// to decode them again every time it starts. The file is memory-mapped, and
+// entries are returned as views into the mapping, which stays mapped as long
+// as any returned view's owner is alive.
+//
+// Each entry records the size and modification time (with nanosecond
+// resolution) of the source file it was generated from. If the source file has
+// changed since the snapshot was built, the entry is ignored and the caller
+// should load the source file instead; in this way, a stale snapshot is never
+// worse than having no snapshot at all.
+//
+// Only files that have to be decompressed or decrypted before use are stored
+// here (item definitions, the mag evolution table, level tables, and text
+// sets). Battle parameters, common item sets, set data tables, and binary rare
+// item sets are used in place from their uncompressed source files, so a
+// snapshot wouldn't save anything for them; JSON rare item sets are parsed
+// into structures that aren't a flat blob; and the Episode 3 card index
+// already uses pre-decompressed .mnrd files when they're present.
+class DataSnapshot : public std::enable_shared_from_this<DataSnapshot> {
+public:
+  static constexpr uint64_t SIGNATURE = 0x4E53444154415331; // 'NSDATAS1'
+  static constexpr uint32_t FORMAT_VERSION = 2;
+
+  explicit DataSnapshot(const std::string& filename);
+  DataSnapshot(const DataSnapshot&) = delete;
+  DataSnapshot(DataSnapshot&&) = delete;
+  DataSnapshot& operator=(const DataSnapshot&) = delete;
+  DataSnapshot& operator=(DataSnapshot&&) = delete;
+  ~DataSnapshot();
+
+  // Returns an empty DecodedFileData if the snapshot doesn't have an entry for
+  // this file, or if the entry is stale. The snapshot must be owned by a
+  // shared_ptr, since the returned data holds a reference to it.
+  DecodedFileData get(const std::string& source_path) const;
+
+  inline size_t num_entries() const {
+    return this->entries.size();
+  }
+
+  class Builder {
+  public:
+    Builder() = default;
+    ~Builder() = default;
+
+    // Thread-safe; may be called from multiple loader threads.
+    void add(const std::string& source_path, const std::string& decoded_data);
+    void save(const std::string& filename) const;
+
+    inline size_t num_entries() const {
+      return this->entries.size();
+    }
+
+  private:
+    struct Entry {
+      uint64_t source_size;
+      uint64_t source_mtime_nsecs;
+      std::string data;
+    };
+    mutable std::mutex lock;
+    std::map<std::string, Entry> entries;
+  };
+
+private:
+  struct FileHeader;
+  struct FileEntry;
+
+  struct Entry {
+    uint64_t source_size;
+    uint64_t source_mtime_nsecs;
+    const char* data;
+    size_t size;
+  };
+
+  int fd;
+  void* mapped_data;
+  size_t mapped_size;
+  std::unordered_map<std::string, Entry> entries;
+};
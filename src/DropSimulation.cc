@@ -0,0 +1,153 @@
+#include "DropSimulation.hh"
+
+#include <inttypes.h>
+
+#include <algorithm>
+#include <phosg/Hash.hh>
+#include <phosg/Strings.hh>
+#include <phosg/Time.hh>
+#include <phosg/Tools.hh>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static constexpr uint64_t DROPS_PER_BATCH = 0x1000;
+
+void DropSimulationResult::add(const ItemCreator::DropResult& res) {
+  this->num_drops++;
+  if (res.item.empty()) {
+    return;
+  }
+  this->num_items++;
+  auto& stats = this->items[res.item.primary_identifier()];
+  if (stats.count == 0) {
+    stats.item = res.item;
+  }
+  stats.count++;
+  if (res.is_from_rare_table) {
+    stats.rare_count++;
+    this->num_rare_items++;
+  }
+}
+
+void DropSimulationResult::merge(const DropSimulationResult& other) {
+  this->num_drops += other.num_drops;
+  this->num_items += other.num_items;
+  this->num_rare_items += other.num_rare_items;
+  for (const auto& [pi, other_stats] : other.items) {
+    auto& stats = this->items[pi];
+    if (stats.count == 0) {
+      stats.item = other_stats.item;
+    }
+    stats.count += other_stats.count;
+    stats.rare_count += other_stats.rare_count;
+  }
+}
+
+static vector<const DropSimulationResult::ItemStats*> sorted_item_stats(const DropSimulationResult& res) {
+  vector<const DropSimulationResult::ItemStats*> ret;
+  ret.reserve(res.items.size());
+  for (const auto& it : res.items) {
+    ret.emplace_back(&it.second);
+  }
+  sort(ret.begin(), ret.end(), [](const auto* a, const auto* b) -> bool {
+    if (a->count != b->count) {
+      return a->count > b->count;
+    }
+    return a->item.primary_identifier() < b->item.primary_identifier();
+  });
+  return ret;
+}
+
+static string describe_simulated_item(const ItemData& item, shared_ptr<const ItemNameIndex> name_index) {
+  return name_index ? name_index->describe_item(item) : item.hex();
+}
+
+JSON DropSimulationResult::json(shared_ptr<const ItemNameIndex> name_index) const {
+  auto items_json = JSON::list();
+  for (const auto* stats : sorted_item_stats(*this)) {
+    items_json.emplace_back(JSON::dict({
+        {"PrimaryIdentifier", stats->item.primary_identifier()},
+        {"Description", describe_simulated_item(stats->item, name_index)},
+        {"Count", stats->count},
+        {"RareCount", stats->rare_count},
+        {"Probability", this->num_drops ? (static_cast<double>(stats->count) / this->num_drops) : 0.0},
+    }));
+  }
+  return JSON::dict({
+      {"NumDrops", this->num_drops},
+      {"NumItems", this->num_items},
+      {"NumRareItems", this->num_rare_items},
+      {"Usecs", this->usecs},
+      {"Items", std::move(items_json)},
+  });
+}
+
+void DropSimulationResult::print(FILE* stream, shared_ptr<const ItemNameIndex> name_index) const {
+  double drops_per_sec = this->usecs ? (static_cast<double>(this->num_drops) * 1000000.0 / this->usecs) : 0.0;
+  fprintf(stream, "%" PRIu64 " drops in %s (%.0f/sec); %" PRIu64 " items (%" PRIu64 " from rare table)\n",
+      this->num_drops, format_duration(this->usecs).c_str(), drops_per_sec, this->num_items, this->num_rare_items);
+  for (const auto* stats : sorted_item_stats(*this)) {
+    double probability = this->num_drops ? (static_cast<double>(stats->count) / this->num_drops) : 0.0;
+    string desc = describe_simulated_item(stats->item, name_index);
+    fprintf(stream, "  %08" PRIX32 "  %10.6f%%  1/%-10.0f  %10" PRIu64 " (%" PRIu64 " rare)  %s\n",
+        stats->item.primary_identifier(), probability * 100.0, probability ? (1.0 / probability) : 0.0,
+        stats->count, stats->rare_count, desc.c_str());
+  }
+}
+
+DropSimulationResult simulate_drops(const ItemCreator& prototype, const DropSimulationOptions& options) {
+  if ((options.rt_index != DropSimulationOptions::BOX_DROPS) && (options.rt_index > 0x58)) {
+    throw runtime_error("invalid rare table index");
+  }
+
+  uint64_t num_batches = (options.num_drops + DROPS_PER_BATCH - 1) / DROPS_PER_BATCH;
+  // More threads than cores would only add contention, so requests for more
+  // (e.g. from the HTTP API) are clamped
+  size_t max_threads = max<size_t>(thread::hardware_concurrency(), 1);
+  size_t num_threads = options.num_threads ? min<size_t>(options.num_threads, max_threads) : max_threads;
+  num_threads = max<size_t>(min<uint64_t>(num_threads, num_batches), 1);
+
+  // Each thread has its own item creator and counts, so the threads never
+  // contend on anything until the results are merged at the end
+  vector<shared_ptr<ItemCreator>> thread_creators(num_threads);
+  vector<DropSimulationResult> thread_results(num_threads);
+  uint32_t seed_hash = fnv1a32(&options.seed, sizeof(options.seed));
+
+  uint64_t start_time = now();
+  parallel_range<uint64_t>([&](uint64_t batch_index, size_t thread_num) -> bool {
+    if (options.canceled && options.canceled->load()) {
+      return true;
+    }
+    auto& creator = thread_creators.at(thread_num);
+    if (!creator) {
+      creator = make_shared<ItemCreator>(prototype);
+      creator->set_log_level(LogLevel::WARNING);
+    }
+    // PSOV2Encryption's output is affine in its seed, so consecutive seeds
+    // produce correlated streams; hashing the batch index avoids this
+    creator->set_random_crypt(make_shared<PSOV2Encryption>(
+        fnv1a32(&batch_index, sizeof(batch_index), seed_hash)));
+
+    auto& res = thread_results[thread_num];
+    uint64_t end_index = min<uint64_t>((batch_index + 1) * DROPS_PER_BATCH, options.num_drops);
+    for (uint64_t z = batch_index * DROPS_PER_BATCH; z < end_index; z++) {
+      res.add((options.rt_index == DropSimulationOptions::BOX_DROPS)
+              ? creator->on_box_item_drop(options.area)
+              : creator->on_monster_item_drop(options.rt_index, options.area));
+    }
+    return false;
+  },
+      0, num_batches, num_threads, nullptr);
+  if (options.canceled && options.canceled->load()) {
+    throw runtime_error("drop simulation was canceled");
+  }
+
+  DropSimulationResult ret;
+  for (const auto& res : thread_results) {
+    ret.merge(res);
+  }
+  ret.usecs = now() - start_time;
+  return ret;
+}
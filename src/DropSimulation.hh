@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <phosg/JSON.hh>
+#include <string>
+#include <unordered_map>
+
+#include "ItemCreator.hh"
+#include "ItemNameIndex.hh"
+
+// Runs many item drops through copies of an ItemCreator in parallel and counts
+// how often each item appears. Drops are generated in fixed-size batches, and
+// each batch has its own random stream derived from the seed and the batch
+// index, so the results depend only on the options and not on how many threads
+// are used or how the batches are scheduled.
+struct DropSimulationOptions {
+  // Area (floor) number, as passed to ItemCreator::on_*_item_drop
+  uint8_t area = 1;
+  // Enemy rare table index to simulate, or BOX_DROPS to simulate box drops
+  static constexpr uint32_t BOX_DROPS = 0xFFFFFFFF;
+  uint32_t rt_index = BOX_DROPS;
+  uint64_t num_drops = 1000000;
+  size_t num_threads = 0; // 0 = use all cores; clamped to the number of cores
+  uint32_t seed = 0;
+  // If given and set to true while the simulation is running, the simulation
+  // stops early and simulate_drops throws
+  const std::atomic<bool>* canceled = nullptr;
+};
+
+struct DropSimulationResult {
+  struct ItemStats {
+    ItemData item; // The first item seen with this primary identifier
+    uint64_t count = 0;
+    uint64_t rare_count = 0; // Drops that came from the rare table
+  };
+
+  uint64_t num_drops = 0;
+  uint64_t num_items = 0; // Drops that produced an item (not nothing)
+  uint64_t num_rare_items = 0;
+  uint64_t usecs = 0;
+  std::unordered_map<uint32_t, ItemStats> items; // Keyed by primary identifier
+
+  void add(const ItemCreator::DropResult& res);
+  void merge(const DropSimulationResult& other);
+
+  // Both of these sort items by descending frequency. name_index may be null,
+  // in which case items are described by their raw data.
+  JSON json(std::shared_ptr<const ItemNameIndex> name_index) const;
+  void print(FILE* stream, std::shared_ptr<const ItemNameIndex> name_index) const;
+};
+
+// The prototype is copied once per thread; it isn't modified.
+DropSimulationResult simulate_drops(const ItemCreator& prototype, const DropSimulationOptions& options);
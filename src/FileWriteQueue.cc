@@ -0,0 +1,226 @@
+#include "FileWriteQueue.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <phosg/Filesystem.hh>
+#include <phosg/Strings.hh>
+#include <stdexcept>
+
+#include "Loggers.hh"
+
+using namespace std;
+
+FileWriteQueue::FileWriteQueue()
+    : th(&FileWriteQueue::thread_fn, this) {}
+
+FileWriteQueue::~FileWriteQueue() {
+  {
+    lock_guard g(this->lock);
+    this->should_exit = true;
+  }
+  this->work_cv.notify_all();
+  this->th.join();
+}
+
+void FileWriteQueue::write(const string& filename, shared_ptr<const string> data) {
+  if (!data) {
+    throw logic_error("cannot write null data");
+  }
+  this->enqueue(filename, std::move(data));
+}
+
+void FileWriteQueue::remove(const string& filename) {
+  this->enqueue(filename, nullptr);
+}
+
+void FileWriteQueue::run(function<void()> fn) {
+  {
+    lock_guard g(this->lock);
+    this->current_stats.writes_requested++;
+    this->pending_tasks.emplace_back(PendingTask{std::move(fn), this->next_sequence_number++});
+    this->current_stats.queue_depth = this->pending.size() + this->pending_tasks.size() + (this->in_progress ? 1 : 0);
+    this->current_stats.max_queue_depth = max(this->current_stats.max_queue_depth, this->current_stats.queue_depth);
+  }
+  this->work_cv.notify_one();
+}
+
+void FileWriteQueue::enqueue(const string& filename, shared_ptr<const string> data) {
+  {
+    lock_guard g(this->lock);
+    this->current_stats.writes_requested++;
+    auto emplace_ret = this->pending.emplace(filename, PendingWrite{data, this->next_sequence_number++});
+    if (emplace_ret.second) {
+      this->pending_order.emplace_back(filename);
+      this->current_stats.queue_depth = this->pending.size() + this->pending_tasks.size() + (this->in_progress ? 1 : 0);
+      this->current_stats.max_queue_depth = max(this->current_stats.max_queue_depth, this->current_stats.queue_depth);
+    } else {
+      emplace_ret.first->second.data = std::move(data);
+      this->current_stats.writes_coalesced++;
+    }
+  }
+  this->work_cv.notify_one();
+}
+
+bool FileWriteQueue::get_pending(const string& filename, shared_ptr<const string>* data) const {
+  lock_guard g(this->lock);
+  auto it = this->pending.find(filename);
+  if (it != this->pending.end()) {
+    *data = it->second.data;
+    return true;
+  }
+  if (this->in_progress && (this->in_progress_filename == filename)) {
+    *data = this->in_progress_data;
+    return true;
+  }
+  return false;
+}
+
+void FileWriteQueue::flush() {
+  unique_lock g(this->lock);
+  uint64_t target_sequence_number = this->next_sequence_number - 1;
+  this->progress_cv.wait(g, [&]() -> bool {
+    return this->oldest_outstanding_sequence_number_locked() > target_sequence_number;
+  });
+}
+
+uint64_t FileWriteQueue::oldest_outstanding_sequence_number_locked() const {
+  // The thread always takes the oldest request next, so an in-progress request
+  // is older than all queued requests
+  if (this->in_progress) {
+    return this->in_progress_sequence_number;
+  }
+  uint64_t ret = this->next_sequence_number;
+  if (!this->pending_order.empty()) {
+    ret = min(ret, this->pending.at(this->pending_order.front()).sequence_number);
+  }
+  if (!this->pending_tasks.empty()) {
+    ret = min(ret, this->pending_tasks.front().sequence_number);
+  }
+  return ret;
+}
+
+FileWriteQueue::Stats FileWriteQueue::stats() const {
+  lock_guard g(this->lock);
+  return this->current_stats;
+}
+
+void FileWriteQueue::write_file_atomic(const string& filename, const string& data) {
+  string temp_filename = filename + ".tmp";
+  int fd = open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw cannot_open_file(temp_filename);
+  }
+  try {
+    const char* bytes = data.data();
+    size_t remaining = data.size();
+    while (remaining > 0) {
+      ssize_t bytes_written = ::write(fd, bytes, remaining);
+      if (bytes_written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw runtime_error(string_printf("cannot write file (errno %d)", errno));
+      }
+      bytes += bytes_written;
+      remaining -= bytes_written;
+    }
+    // The data must be on disk before the rename, or a crash shortly after the
+    // rename could leave an empty or partial file in place of the old one
+    if (fsync(fd) != 0) {
+      throw runtime_error(string_printf("cannot sync file (errno %d)", errno));
+    }
+  } catch (const exception&) {
+    close(fd);
+    ::remove(temp_filename.c_str());
+    throw;
+  }
+  close(fd);
+  if (rename(temp_filename.c_str(), filename.c_str()) != 0) {
+    ::remove(temp_filename.c_str());
+    throw runtime_error("cannot rename file into place");
+  }
+}
+
+void FileWriteQueue::thread_fn() {
+  unique_lock g(this->lock);
+  for (;;) {
+    // On exit, the queue is drained before the thread returns, so nothing that
+    // was saved before shutdown is lost
+    this->work_cv.wait(g, [&]() -> bool {
+      return this->should_exit || !this->pending_order.empty() || !this->pending_tasks.empty();
+    });
+    if (this->pending_order.empty() && this->pending_tasks.empty()) {
+      return;
+    }
+
+    // Run the oldest request next, whether it's a file write or a function
+    if (!this->pending_tasks.empty() &&
+        (this->pending_order.empty() ||
+            (this->pending_tasks.front().sequence_number < this->pending.at(this->pending_order.front()).sequence_number))) {
+      auto task = std::move(this->pending_tasks.front());
+      this->pending_tasks.pop_front();
+      this->in_progress_sequence_number = task.sequence_number;
+      this->in_progress = true;
+      g.unlock();
+
+      bool success = true;
+      try {
+        task.fn();
+      } catch (const exception& e) {
+        player_data_log.error("Failed to run queued I/O function: %s", e.what());
+        success = false;
+      }
+      task.fn = nullptr; // Destroy any captured state before taking the lock
+
+      g.lock();
+      if (success) {
+        this->current_stats.writes_completed++;
+      } else {
+        this->current_stats.writes_failed++;
+      }
+      this->in_progress = false;
+      this->current_stats.queue_depth = this->pending.size() + this->pending_tasks.size();
+      this->progress_cv.notify_all();
+      continue;
+    }
+
+    this->in_progress_filename = std::move(this->pending_order.front());
+    this->pending_order.pop_front();
+    auto it = this->pending.find(this->in_progress_filename);
+    this->in_progress_data = std::move(it->second.data);
+    this->in_progress_sequence_number = it->second.sequence_number;
+    this->pending.erase(it);
+    this->in_progress = true;
+    g.unlock();
+
+    bool success = true;
+    try {
+      if (this->in_progress_data) {
+        write_file_atomic(this->in_progress_filename, *this->in_progress_data);
+      } else {
+        ::remove(this->in_progress_filename.c_str());
+      }
+    } catch (const exception& e) {
+      player_data_log.error("Failed to write %s: %s", this->in_progress_filename.c_str(), e.what());
+      success = false;
+    }
+
+    g.lock();
+    if (success) {
+      this->current_stats.writes_completed++;
+      if (this->in_progress_data) {
+        this->current_stats.bytes_written += this->in_progress_data->size();
+      }
+    } else {
+      this->current_stats.writes_failed++;
+    }
+    this->in_progress = false;
+    this->in_progress_filename.clear();
+    this->in_progress_data.reset();
+    this->current_stats.queue_depth = this->pending.size() + this->pending_tasks.size();
+    this->progress_cv.notify_all();
+  }
+}
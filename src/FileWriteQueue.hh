@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Writes files on a background thread, so the event thread doesn't have to
+// wait for disk I/O when saving player data. Callers pass a snapshot of the
+// complete file contents; if the same file is written again before the
+// previous write has started, only the newer contents are written. Each file
+// is written to a temporary file, synced, and renamed into place, so a crash
+// never leaves a partially-written file behind.
+//
+// Callers that read files which may have been written through this queue must
+// call get_pending() first, since the queued contents are newer than what's on
+// disk. The destructor blocks until all queued writes are done.
+//
+// Callers that need to do other kinds of I/O (e.g. appending to a file) can
+// queue a function with run(); these functions are run on the same thread, in
+// order with the queued writes, and are never coalesced.
+class FileWriteQueue {
+public:
+  struct Stats {
+    size_t queue_depth = 0; // Files and functions waiting, including in-progress write
+    size_t max_queue_depth = 0;
+    uint64_t writes_requested = 0; // Including functions queued with run()
+    uint64_t writes_coalesced = 0; // Requests that replaced an earlier queued write
+    uint64_t writes_completed = 0;
+    uint64_t writes_failed = 0;
+    uint64_t bytes_written = 0;
+  };
+
+  FileWriteQueue();
+  FileWriteQueue(const FileWriteQueue&) = delete;
+  FileWriteQueue(FileWriteQueue&&) = delete;
+  FileWriteQueue& operator=(const FileWriteQueue&) = delete;
+  FileWriteQueue& operator=(FileWriteQueue&&) = delete;
+  ~FileWriteQueue();
+
+  void write(const std::string& filename, std::shared_ptr<const std::string> data);
+  // Deletes the file after any writes to it that are already queued.
+  void remove(const std::string& filename);
+  // Calls fn on the queue's thread after all previously-queued writes and
+  // functions are done. If fn throws, the exception is logged.
+  void run(std::function<void()> fn);
+
+  // If there is a queued or in-progress write or delete for this file, returns
+  // true and sets *data to the contents that will be written (or nullptr if
+  // the file will be deleted). Returns false if the file on disk is current.
+  bool get_pending(const std::string& filename, std::shared_ptr<const std::string>* data) const;
+
+  // Blocks until all writes queued before this call are done. Writes queued
+  // after this call don't delay it.
+  void flush();
+
+  Stats stats() const;
+
+private:
+  // Every write or delete request gets a sequence number when it's queued. A
+  // queued write that is replaced by a newer one keeps the sequence number of
+  // the oldest request it covers, so the sequence numbers of the entries in
+  // pending_order are always increasing.
+  struct PendingWrite {
+    std::shared_ptr<const std::string> data; // nullptr for queued deletes
+    uint64_t sequence_number;
+  };
+  struct PendingTask {
+    std::function<void()> fn;
+    uint64_t sequence_number;
+  };
+
+  mutable std::mutex lock;
+  std::condition_variable work_cv; // Signaled when work is queued or on exit
+  std::condition_variable progress_cv; // Signaled when a write is done
+  std::unordered_map<std::string, PendingWrite> pending;
+  std::deque<std::string> pending_order;
+  std::deque<PendingTask> pending_tasks;
+  std::string in_progress_filename;
+  std::shared_ptr<const std::string> in_progress_data;
+  uint64_t in_progress_sequence_number = 0;
+  bool in_progress = false;
+  uint64_t next_sequence_number = 1;
+  bool should_exit = false;
+  Stats current_stats;
+  std::thread th;
+
+  void enqueue(const std::string& filename, std::shared_ptr<const std::string> data);
+  // Returns the sequence number of the oldest request that isn't done yet, or
+  // next_sequence_number if all requests are done. Must be called with lock
+  // held.
+  uint64_t oldest_outstanding_sequence_number_locked() const;
+  void thread_fn();
+  static void write_file_atomic(const std::string& filename, const std::string& data);
+};
@@ -10,6 +10,7 @@
 #include <string>
 #include <vector>
 
+#include "DropSimulation.hh"
 #include "EventUtils.hh"
 #include "Loggers.hh"
 #include "ProxyServer.hh"
@@ -196,11 +197,16 @@ void HTTPServer::add_socket(int fd) {
 }
 
 void HTTPServer::schedule_stop() {
+  // Don't make wait_for_stop wait for a long simulation to finish
+  this->drop_simulation_canceled = true;
   event_base_loopexit(this->base.get(), nullptr);
 }
 
 void HTTPServer::wait_for_stop() {
   this->th.join();
+  if (this->drop_simulation_thread.joinable()) {
+    this->drop_simulation_thread.join();
+  }
 }
 
 HTTPServer::WebsocketClient::WebsocketClient(struct evhttp_connection* conn)
@@ -542,7 +548,7 @@ JSON HTTPServer::generate_account_json_st(shared_ptr<const Account> a) {
   });
 };
 
-JSON HTTPServer::generate_game_client_json_st(shared_ptr<const Client> c, shared_ptr<const ItemNameIndex> item_name_index) {
+JSON HTTPServer::generate_game_client_json_st(shared_ptr<const Client> c, shared_ptr<const ServerState> s) {
   auto ret = JSON::dict({
       {"ID", c->id},
       {"RemoteAddress", render_sockaddr_storage(c->channel.remote_addr)},
@@ -580,6 +586,7 @@ JSON HTTPServer::generate_game_client_json_st(shared_ptr<const Client> c, shared
           ret.emplace("NumLuckMaterialsUsed", p->get_material_usage(PSOBBCharacterFile::MaterialType::LUCK));
         }
       }
+      bool has_item_name_index = (s->item_name_index_opt(c->version()) != nullptr);
       JSON items_json = JSON::list();
       for (size_t z = 0; z < p->inventory.num_items; z++) {
         const auto& item = p->inventory.items[z];
@@ -588,8 +595,8 @@ JSON HTTPServer::generate_game_client_json_st(shared_ptr<const Client> c, shared
             {"Data", item.data.hex()},
             {"ItemID", item.data.id.load()},
         });
-        if (item_name_index) {
-          item_dict.emplace("Description", item_name_index->describe_item(item.data, false));
+        if (has_item_name_index) {
+          item_dict.emplace("Description", s->describe_item(c->version(), item.data, false));
         }
         items_json.emplace_back(std::move(item_dict));
       }
@@ -763,7 +770,7 @@ JSON HTTPServer::generate_proxy_client_json_st(shared_ptr<const ProxyServer::Lin
   return ret;
 }
 
-JSON HTTPServer::generate_lobby_json_st(shared_ptr<const Lobby> l, shared_ptr<const ItemNameIndex> item_name_index) {
+JSON HTTPServer::generate_lobby_json_st(shared_ptr<const Lobby> l, shared_ptr<const ServerState> s) {
   std::array<std::shared_ptr<Client>, 12> clients;
 
   auto client_ids_json = JSON::list();
@@ -839,24 +846,24 @@ JSON HTTPServer::generate_lobby_json_st(shared_ptr<const Lobby> l, shared_ptr<co
         }
       }
 
+      bool has_item_name_index = (s->item_name_index_opt(l->base_version) != nullptr);
       auto floor_items_json = JSON::list();
       for (size_t floor = 0; floor < l->floor_item_managers.size(); floor++) {
-        for (const auto& it : l->floor_item_managers[floor].items) {
-          const auto& item = it.second;
+        l->floor_item_managers[floor].for_each([&](const Lobby::FloorItem& item) -> void {
           auto item_dict = JSON::dict({
               {"LocationFloor", floor},
-              {"LocationX", item->x},
-              {"LocationZ", item->z},
-              {"DropNumber", item->drop_number},
-              {"Flags", item->flags},
-              {"Data", item->data.hex()},
-              {"ItemID", item->data.id.load()},
+              {"LocationX", item.x},
+              {"LocationZ", item.z},
+              {"DropNumber", item.drop_number},
+              {"Flags", item.flags},
+              {"Data", item.data.hex()},
+              {"ItemID", item.data.id.load()},
           });
-          if (item_name_index) {
-            item_dict.emplace("Description", item_name_index->describe_item(item->data, false));
+          if (has_item_name_index) {
+            item_dict.emplace("Description", s->describe_item(l->base_version, item.data, false));
           }
           floor_items_json.emplace_back(std::move(item_dict));
-        }
+        });
       }
       ret.emplace("FloorItems", std::move(floor_items_json));
       ret.emplace("Quest", HTTPServer::generate_quest_json_st(l->quest));
@@ -968,7 +975,7 @@ JSON HTTPServer::generate_game_server_clients_json() const {
   return call_on_event_thread<JSON>(this->state->base, [&]() {
     auto res = JSON::list();
     for (const auto& it : this->state->channel_to_client) {
-      res.emplace_back(this->generate_game_client_json_st(it.second, this->state->item_name_index_opt(it.second->version())));
+      res.emplace_back(this->generate_game_client_json_st(it.second, this->state));
     }
     return res;
   });
@@ -998,6 +1005,41 @@ JSON HTTPServer::generate_server_info_json() const {
       }
     }
     uint64_t uptime_usecs = now() - this->state->creation_time;
+    JSON file_write_queue_json = nullptr;
+    if (this->state->file_write_queue) {
+      auto stats = this->state->file_write_queue->stats();
+      file_write_queue_json = JSON::dict({
+          {"QueueDepth", stats.queue_depth},
+          {"MaxQueueDepth", stats.max_queue_depth},
+          {"WritesRequested", stats.writes_requested},
+          {"WritesCoalesced", stats.writes_coalesced},
+          {"WritesCompleted", stats.writes_completed},
+          {"WritesFailed", stats.writes_failed},
+          {"BytesWritten", stats.bytes_written},
+      });
+    }
+    JSON player_files_json = nullptr;
+    if (this->state->player_files_manager) {
+      auto stats = this->state->player_files_manager->stats();
+      player_files_json = JSON::dict({
+          {"LoadedHits", stats.loaded_hits},
+          {"CacheHits", stats.cache_hits},
+          {"CacheMisses", stats.cache_misses},
+          {"PrefetchedFiles", stats.prefetched_files},
+          {"EvictedFiles", stats.evicted_files},
+          {"CacheEntries", stats.cache_entries},
+          {"CacheBytes", stats.cache_bytes},
+          {"MaxCacheBytes", stats.max_cache_bytes},
+      });
+    }
+    auto item_description_cache_stats = this->state->item_description_cache->stats();
+    auto item_description_cache_json = JSON::dict({
+        {"Hits", item_description_cache_stats.hits},
+        {"Misses", item_description_cache_stats.misses},
+        {"Evictions", item_description_cache_stats.evictions},
+        {"Entries", item_description_cache_stats.entries},
+        {"MaxEntries", item_description_cache_stats.max_entries},
+    });
     return JSON::dict({
         {"StartTimeUsecs", this->state->creation_time},
         {"StartTime", format_time(this->state->creation_time)},
@@ -1008,6 +1050,9 @@ JSON HTTPServer::generate_server_info_json() const {
         {"ClientCount", this->state->channel_to_client.size()},
         {"ProxySessionCount", this->state->proxy_server ? this->state->proxy_server->num_sessions() : 0},
         {"ServerName", this->state->name},
+        {"FileWriteQueue", std::move(file_write_queue_json)},
+        {"PlayerFiles", std::move(player_files_json)},
+        {"ItemDescriptionCache", std::move(item_description_cache_json)},
     });
   });
 }
@@ -1016,7 +1061,7 @@ JSON HTTPServer::generate_lobbies_json() const {
   return call_on_event_thread<JSON>(this->state->base, [&]() {
     JSON res = JSON::list();
     for (const auto& it : this->state->id_to_lobby) {
-      res.emplace_back(this->generate_lobby_json_st(it.second, this->state->item_name_index_opt(it.second->base_version)));
+      res.emplace_back(this->generate_lobby_json_st(it.second, this->state));
     }
     return res;
   });
@@ -1152,6 +1197,157 @@ JSON HTTPServer::generate_rare_table_json(const std::string& table_name) const {
   }
 }
 
+function<JSON()> HTTPServer::prepare_drop_simulation(const unordered_multimap<string, string>& query) const {
+  // Only one simulation can run at a time, so this limit keeps a single
+  // request from making all others fail for too long
+  static constexpr uint64_t MAX_DROPS = 10000000;
+
+  static const string empty_str = "";
+  static const string default_version_str = "BB_V4";
+  static const string default_episode_str = "1";
+  static const string default_mode_str = "normal";
+  static const string default_zero_str = "0";
+  static const string default_area_str = "1";
+  static const string default_drops_str = "100000";
+
+  Version version;
+  Episode episode;
+  GameMode mode;
+  uint8_t difficulty;
+  uint8_t section_id;
+  DropSimulationOptions options;
+  string rare_table_name;
+  try {
+    version = enum_for_name<Version>(this->get_url_param(query, "version", &default_version_str).c_str());
+    switch (stoul(this->get_url_param(query, "episode", &default_episode_str))) {
+      case 1:
+        episode = Episode::EP1;
+        break;
+      case 2:
+        episode = Episode::EP2;
+        break;
+      case 4:
+        episode = Episode::EP4;
+        break;
+      default:
+        throw runtime_error("invalid episode");
+    }
+    const string& mode_str = this->get_url_param(query, "mode", &default_mode_str);
+    if (mode_str == "normal") {
+      mode = GameMode::NORMAL;
+    } else if (mode_str == "battle") {
+      mode = GameMode::BATTLE;
+    } else if (mode_str == "challenge") {
+      mode = GameMode::CHALLENGE;
+    } else if (mode_str == "solo") {
+      mode = GameMode::SOLO;
+    } else {
+      throw runtime_error("invalid mode");
+    }
+    difficulty = stoul(this->get_url_param(query, "difficulty", &default_zero_str));
+    if (difficulty > 3) {
+      throw runtime_error("invalid difficulty");
+    }
+    section_id = section_id_for_name(this->get_url_param(query, "section-id", &default_zero_str));
+    if (section_id == 0xFF) {
+      throw runtime_error("invalid section ID");
+    }
+
+    options.area = stoul(this->get_url_param(query, "area", &default_area_str));
+    const string& enemy_name = this->get_url_param(query, "enemy", &empty_str);
+    if (!enemy_name.empty()) {
+      options.rt_index = rare_table_index_for_enemy_type(enum_for_name<EnemyType>(enemy_name.c_str()));
+    }
+    options.num_drops = min<uint64_t>(stoull(this->get_url_param(query, "drops", &default_drops_str)), MAX_DROPS);
+    // simulate_drops clamps this to the number of CPU cores
+    options.num_threads = stoul(this->get_url_param(query, "threads", &default_zero_str));
+    options.seed = stoul(this->get_url_param(query, "seed", &default_zero_str), nullptr, 16);
+    rare_table_name = this->get_url_param(query, "rare-table", &empty_str);
+  } catch (const exception& e) {
+    throw http_error(400, string_printf("invalid parameter: %s", e.what()));
+  }
+  options.canceled = &this->drop_simulation_canceled;
+
+  auto [prototype, name_index] = call_on_event_thread<pair<shared_ptr<ItemCreator>, shared_ptr<const ItemNameIndex>>>(this->state->base, [&]() {
+    shared_ptr<const RareItemSet> rare_item_set;
+    if (!rare_table_name.empty()) {
+      auto it = this->state->rare_item_sets.find(rare_table_name);
+      if (it == this->state->rare_item_sets.end()) {
+        return make_pair(shared_ptr<ItemCreator>(), shared_ptr<const ItemNameIndex>());
+      }
+      rare_item_set = it->second;
+    }
+    return make_pair(
+        this->state->create_item_creator(version, episode, mode, difficulty, section_id, nullptr, nullptr, rare_item_set),
+        this->state->item_name_index_opt(version));
+  });
+  if (!prototype) {
+    throw http_error(404, "table does not exist");
+  }
+
+  return [prototype = prototype, name_index = name_index, options, version, episode, mode, difficulty, section_id]() -> JSON {
+    auto ret = simulate_drops(*prototype, options).json(name_index);
+    ret.emplace("Version", name_for_enum(version));
+    ret.emplace("Episode", name_for_episode(episode));
+    ret.emplace("Mode", name_for_mode(mode));
+    ret.emplace("Difficulty", difficulty);
+    ret.emplace("SectionID", name_for_section_id(section_id));
+    ret.emplace("Area", options.area);
+    ret.emplace("Seed", options.seed);
+    return ret;
+  };
+}
+
+void HTTPServer::dispatch_on_drop_simulation_connection_closed(struct evhttp_connection*, void* ctx) {
+  // evhttp frees the request when its connection is closed, so we must not
+  // send the response to it later
+  reinterpret_cast<HTTPServer*>(ctx)->drop_simulation_req = nullptr;
+}
+
+void HTTPServer::start_drop_simulation(
+    struct evhttp_request* req, function<JSON()>&& run, uint32_t serialize_options, uint64_t start_time) {
+  if (this->drop_simulation_running) {
+    throw logic_error("drop simulation started while another is running");
+  }
+  // If the previous simulation's thread is still joinable, it has already
+  // delivered its result and is about to exit
+  if (this->drop_simulation_thread.joinable()) {
+    this->drop_simulation_thread.join();
+  }
+
+  this->drop_simulation_running = true;
+  this->drop_simulation_req = req;
+  evhttp_connection_set_closecb(
+      evhttp_request_get_connection(req), &HTTPServer::dispatch_on_drop_simulation_connection_closed, this);
+
+  this->drop_simulation_thread = thread([this, run = std::move(run), serialize_options, start_time]() -> void {
+    shared_ptr<const JSON> ret;
+    string error_str;
+    try {
+      ret = make_shared<JSON>(run());
+    } catch (const exception& e) {
+      error_str = e.what();
+    }
+
+    forward_to_event_thread(this->base, [this, ret = std::move(ret), error_str = std::move(error_str), serialize_options, start_time]() -> void {
+      this->drop_simulation_running = false;
+      struct evhttp_request* req = this->drop_simulation_req;
+      this->drop_simulation_req = nullptr;
+      if (!req) {
+        server_log.info("[HTTPServer] Client disconnected before drop simulation was done");
+        return;
+      }
+      evhttp_connection_set_closecb(evhttp_request_get_connection(req), nullptr, nullptr);
+      if (ret) {
+        this->send_json_response(req, *ret, serialize_options, "/y/simulate-drops", start_time);
+      } else {
+        this->send_response(req, 500, "text/plain", "Error during request: %s", error_str.c_str());
+        server_log.warning("internal server error during http request: %s", error_str.c_str());
+      }
+    });
+  });
+}
+
 void HTTPServer::handle_request(struct evhttp_request* req) {
   shared_ptr<const JSON> ret;
   uint32_t serialize_options = 0;
@@ -1182,6 +1378,7 @@ void HTTPServer::handle_request(struct evhttp_request* req) {
           "/y/data/rare-tables",
           "/y/data/rare-tables/<TABLE-NAME>",
           "/y/data/config",
+          "/y/simulate-drops?version=<VERSION>&episode=<N>&mode=<MODE>&difficulty=<N>&section-id=<NAME>&area=<N>&enemy=<TYPE>&rare-table=<TABLE-NAME>&drops=<N>&seed=<HEX>",
           "/y/clients",
           "/y/proxy-clients",
           "/y/lobbies",
@@ -1215,6 +1412,15 @@ void HTTPServer::handle_request(struct evhttp_request* req) {
       ret = make_shared<JSON>(this->generate_rare_table_json(uri.substr(20)));
     } else if (uri == "/y/data/config") {
       ret = call_on_event_thread<shared_ptr<const JSON>>(this->state->base, [this]() { return this->state->config_json; });
+    } else if (uri == "/y/simulate-drops") {
+      // This is checked before preparing the simulation, since preparing it
+      // requires a round trip to the server's event thread
+      if (this->drop_simulation_running) {
+        throw http_error(503, "another drop simulation is already running");
+      }
+      // The response is sent when the simulation is done
+      this->start_drop_simulation(req, this->prepare_drop_simulation(query), serialize_options, start_time);
+      return;
     } else if (uri == "/y/clients") {
       ret = make_shared<JSON>(this->generate_game_server_clients_json());
     } else if (uri == "/y/proxy-clients") {
@@ -1246,9 +1452,14 @@ void HTTPServer::handle_request(struct evhttp_request* req) {
     return;
   }
 
+  this->send_json_response(req, *ret, serialize_options, uri, start_time);
+}
+
+void HTTPServer::send_json_response(
+    struct evhttp_request* req, const JSON& ret, uint32_t serialize_options, const string& uri, uint64_t start_time) {
   uint64_t handler_end = now();
   unique_ptr<struct evbuffer, void (*)(struct evbuffer*)> out_buffer(evbuffer_new(), evbuffer_free);
-  string* serialized = new string(ret->serialize(JSON::SerializeOption::ESCAPE_CONTROLS_ONLY | serialize_options));
+  string* serialized = new string(ret.serialize(JSON::SerializeOption::ESCAPE_CONTROLS_ONLY | serialize_options));
   size_t size = serialized->size();
   uint64_t serialize_end = now();
   auto cleanup = +[](const void*, size_t, void* s) -> void {
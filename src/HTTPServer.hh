@@ -5,8 +5,11 @@
 #include <event2/http.h>
 #include <stdlib.h>
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <string>
+#include <thread>
 
 #include "ProxyServer.hh"
 #include "ServerState.hh"
@@ -63,6 +66,18 @@ protected:
 
   std::unordered_map<struct bufferevent*, std::shared_ptr<WebsocketClient>> bev_to_websocket_client;
 
+  // Drop simulations run on their own thread so they don't block other
+  // requests. Each simulation already uses all CPU cores, so only one may run
+  // at a time; requests made while one is running get a 503 response. Except
+  // for drop_simulation_canceled, these fields are only accessed on the HTTP
+  // thread. drop_simulation_req is set to null if the client disconnects
+  // before the simulation is done. drop_simulation_canceled is set by
+  // schedule_stop so that shutdown doesn't wait for the simulation to finish.
+  std::thread drop_simulation_thread;
+  bool drop_simulation_running = false;
+  std::atomic<bool> drop_simulation_canceled = false;
+  struct evhttp_request* drop_simulation_req = nullptr;
+
   std::shared_ptr<WebsocketClient> enable_websockets(struct evhttp_request* req);
 
   static void dispatch_on_websocket_read(struct bufferevent* bev, void* ctx);
@@ -82,6 +97,12 @@ protected:
 
   static void dispatch_handle_request(struct evhttp_request* req, void* ctx);
   void handle_request(struct evhttp_request* req);
+  void send_json_response(
+      struct evhttp_request* req, const JSON& ret, uint32_t serialize_options, const std::string& uri, uint64_t start_time);
+
+  static void dispatch_on_drop_simulation_connection_closed(struct evhttp_connection* conn, void* ctx);
+  void start_drop_simulation(
+      struct evhttp_request* req, std::function<JSON()>&& run, uint32_t serialize_options, uint64_t start_time);
 
   static const std::unordered_map<int, const char*> explanation_for_response_code;
   static void send_response(struct evhttp_request* req, int code, const char* content_type, struct evbuffer* b);
@@ -97,9 +118,9 @@ protected:
   static JSON generate_quest_json_st(std::shared_ptr<const Quest> q);
   static JSON generate_client_config_json_st(const Client::Config& config);
   static JSON generate_account_json_st(std::shared_ptr<const Account> a);
-  static JSON generate_game_client_json_st(std::shared_ptr<const Client> c, std::shared_ptr<const ItemNameIndex> item_name_index);
+  static JSON generate_game_client_json_st(std::shared_ptr<const Client> c, std::shared_ptr<const ServerState> s);
   static JSON generate_proxy_client_json_st(std::shared_ptr<const ProxyServer::LinkedSession> ses);
-  static JSON generate_lobby_json_st(std::shared_ptr<const Lobby> l, std::shared_ptr<const ItemNameIndex> item_name_index);
+  static JSON generate_lobby_json_st(std::shared_ptr<const Lobby> l, std::shared_ptr<const ServerState> s);
   JSON generate_game_server_clients_json() const;
   JSON generate_proxy_server_clients_json() const;
   JSON generate_server_info_json() const;
@@ -111,4 +132,7 @@ protected:
   JSON generate_common_tables_json() const;
   JSON generate_rare_tables_json() const;
   JSON generate_rare_table_json(const std::string& table_name) const;
+  // Parses the query and creates the item creator on the calling thread;
+  // returns a function that runs the simulation and generates the response.
+  std::function<JSON()> prepare_drop_simulation(const std::unordered_multimap<std::string, std::string>& query) const;
 };
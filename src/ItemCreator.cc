@@ -172,7 +172,7 @@ ItemCreator::DropResult ItemCreator::on_box_item_drop_with_area_norm(uint8_t are
   if (!res.item.empty()) {
     res.is_from_rare_table = true;
   } else {
-    uint8_t item_class = this->get_rand_from_weighted_tables_2d_vertical(this->pt->box_item_class_prob_table, area_norm);
+    uint8_t item_class = this->get_rand_from_weighted_tables_2d_vertical(this->pt->box_item_class_prob_table, this->pt->box_item_class_weights, area_norm);
     this->log.info("Item class is %02hhX", item_class);
     switch (item_class) {
       case 0: // Weapon
@@ -428,8 +428,8 @@ void ItemCreator::generate_rare_weapon_bonuses(ItemData& item, uint32_t random_s
   }
 
   for (size_t z = 0; z < 6; z += 2) {
-    uint8_t bonus_type = this->get_rand_from_weighted_tables_2d_vertical(this->pt->bonus_type_prob_table, random_sample);
-    int16_t bonus_value = this->get_rand_from_weighted_tables_2d_vertical(this->pt->bonus_value_prob_table, 5);
+    uint8_t bonus_type = this->get_rand_from_weighted_tables_2d_vertical(this->pt->bonus_type_prob_table, this->pt->bonus_type_weights, random_sample);
+    int16_t bonus_value = this->get_rand_from_weighted_tables_2d_vertical(this->pt->bonus_value_prob_table, this->pt->bonus_value_weights, 5);
     item.data1[z + 6] = bonus_type;
     item.data1[z + 7] = bonus_value * 5 - 10;
     // Note: The original code has a special case here, which divides
@@ -451,8 +451,8 @@ void ItemCreator::generate_common_weapon_bonuses(ItemData& item, uint8_t area_no
     if (spec == 0xFF) {
       this->log.info("Bonus %zu is forbidden", row);
     } else {
-      item.data1[(row * 2) + 6] = this->get_rand_from_weighted_tables_2d_vertical(this->pt->bonus_type_prob_table, area_norm);
-      int16_t amount = this->get_rand_from_weighted_tables_2d_vertical(this->pt->bonus_value_prob_table, spec);
+      item.data1[(row * 2) + 6] = this->get_rand_from_weighted_tables_2d_vertical(this->pt->bonus_type_prob_table, this->pt->bonus_type_weights, area_norm);
+      int16_t amount = this->get_rand_from_weighted_tables_2d_vertical(this->pt->bonus_value_prob_table, this->pt->bonus_value_weights, spec);
       item.data1[(row * 2) + 7] = amount * 5 - 10;
       this->log.info("Bonus %zu generated as %02hhX %02hhX from area_norm %02hhX and spec %02hhX", row, item.data1[(row * 2) + 6], item.data1[(row * 2) + 7], area_norm, spec);
     }
@@ -655,7 +655,7 @@ void ItemCreator::generate_common_item_variances(uint32_t area_norm, ItemData& i
 void ItemCreator::generate_common_armor_or_shield_type_and_variances(char area_norm, ItemData& item) {
   this->generate_common_armor_slots_and_bonuses(item);
 
-  uint8_t type = this->get_rand_from_weighted_tables_1d(this->pt->armor_shield_type_index_prob_table);
+  uint8_t type = this->get_rand_from_weighted_tables_1d(this->pt->armor_shield_type_index_prob_table, this->pt->armor_shield_type_index_weights);
   item.data1[2] = area_norm + type + this->pt->armor_or_shield_type_bias;
   if (item.data1[2] < 3) {
     item.data1[2] = 0;
@@ -681,13 +681,13 @@ void ItemCreator::generate_common_armor_slots_and_bonuses(ItemData& item) {
 }
 
 void ItemCreator::generate_common_armor_slot_count(ItemData& item) {
-  item.data1[5] = this->get_rand_from_weighted_tables_1d(this->pt->armor_slot_count_prob_table);
+  item.data1[5] = this->get_rand_from_weighted_tables_1d(this->pt->armor_slot_count_prob_table, this->pt->armor_slot_count_weights);
 }
 
 void ItemCreator::generate_common_tool_variances(uint32_t area_norm, ItemData& item) {
   item.clear();
 
-  uint8_t tool_class = this->get_rand_from_weighted_tables_2d_vertical(this->pt->tool_class_prob_table, area_norm);
+  uint8_t tool_class = this->get_rand_from_weighted_tables_2d_vertical(this->pt->tool_class_prob_table, this->pt->tool_class_weights, area_norm);
   if ((!is_v1_or_v2(this->logic_version) || (this->logic_version == Version::GC_NTE)) && (tool_class == 0x1A)) {
     tool_class = 0x73;
   }
@@ -712,7 +712,7 @@ void ItemCreator::generate_common_tool_variances(uint32_t area_norm, ItemData& i
   }
 
   if (item.data1[1] == 0x02) { // Tech disk
-    item.data1[4] = this->get_rand_from_weighted_tables_2d_vertical(this->pt->technique_index_prob_table, area_norm);
+    item.data1[4] = this->get_rand_from_weighted_tables_2d_vertical(this->pt->technique_index_prob_table, this->pt->technique_index_weights, area_norm);
     item.data1[2] = this->generate_tech_disk_level(item.data1[4], area_norm);
     this->clear_tool_item_if_invalid(item);
   }
@@ -750,27 +750,20 @@ void ItemCreator::generate_common_weapon_variances(uint8_t area_norm, ItemData&
   item.clear();
   item.data1[0] = 0x00;
 
-  parray<uint8_t, 0x0D> weapon_type_prob_table;
-  weapon_type_prob_table[0] = 0;
-  memmove(
-      weapon_type_prob_table.data() + 1,
-      this->pt->base_weapon_type_prob_table.data(),
-      0x0C);
-
-  for (size_t z = 1; z < 13; z++) {
-    // Technically this should be `if (... < 0)`, but whatever
-    if ((area_norm + this->pt->subtype_base_table.at(z - 1)) & 0x80) {
-      weapon_type_prob_table[z] = 0;
-    }
+  if (this->log.should_log(LogLevel::INFO)) {
+    auto weapon_type_prob_table = this->pt->weapon_type_prob_table(area_norm);
+    this->log.info("Subtype table: %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX",
+        weapon_type_prob_table[0], weapon_type_prob_table[1], weapon_type_prob_table[2], weapon_type_prob_table[3],
+        weapon_type_prob_table[4], weapon_type_prob_table[5], weapon_type_prob_table[6], weapon_type_prob_table[7],
+        weapon_type_prob_table[8], weapon_type_prob_table[9], weapon_type_prob_table[10], weapon_type_prob_table[11],
+        weapon_type_prob_table[12]);
   }
 
-  this->log.info("Subtype table: %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX",
-      weapon_type_prob_table[0], weapon_type_prob_table[1], weapon_type_prob_table[2], weapon_type_prob_table[3],
-      weapon_type_prob_table[4], weapon_type_prob_table[5], weapon_type_prob_table[6], weapon_type_prob_table[7],
-      weapon_type_prob_table[8], weapon_type_prob_table[9], weapon_type_prob_table[10], weapon_type_prob_table[11],
-      weapon_type_prob_table[12]);
-
-  item.data1[1] = this->get_rand_from_weighted_tables_1d(weapon_type_prob_table);
+  if (this->use_precomputed_weights && (area_norm < this->pt->base_weapon_type_weights.size())) {
+    item.data1[1] = this->get_rand_from_weighted_index_table(this->pt->base_weapon_type_weights[area_norm]);
+  } else {
+    item.data1[1] = this->get_rand_from_weighted_tables_1d(this->pt->weapon_type_prob_table(area_norm));
+  }
   if (item.data1[1] == 0) {
     this->log.info("00 chosen from subtype table; skipping item");
     item.clear();
@@ -796,7 +789,7 @@ void ItemCreator::generate_common_weapon_variances(uint8_t area_norm, ItemData&
 void ItemCreator::generate_common_weapon_grind(ItemData& item, uint8_t offset_within_subtype_range) {
   if (item.data1[0] == 0) {
     uint8_t offset = clamp<uint8_t>(offset_within_subtype_range, 0, 3);
-    item.data1[3] = this->get_rand_from_weighted_tables_2d_vertical(this->pt->grind_prob_table, offset);
+    item.data1[3] = this->get_rand_from_weighted_tables_2d_vertical(this->pt->grind_prob_table, this->pt->grind_weights, offset);
     this->log.info("Generated grind %02hhX from offset within subtype range %02hhX", item.data1[3], offset_within_subtype_range);
   }
 }
@@ -960,16 +953,41 @@ IntT ItemCreator::get_rand_from_weighted_tables(const IntT* tables, size_t offse
   throw logic_error("selector was not less than rand_max");
 }
 
+size_t ItemCreator::get_rand_from_weighted_index_table(const WeightedIndexTable& table) {
+  uint64_t total = table.total();
+  if (total == 0) {
+    throw runtime_error("weighted table is empty");
+  }
+  return table.index_for_value(this->rand_int(total));
+}
+
 template <typename IntT, size_t X>
 IntT ItemCreator::get_rand_from_weighted_tables_1d(const parray<IntT, X>& tables) {
   return ItemCreator::get_rand_from_weighted_tables<IntT>(tables.data(), 0, X, 1);
 }
 
+template <typename IntT, size_t X>
+IntT ItemCreator::get_rand_from_weighted_tables_1d(const parray<IntT, X>& tables, const WeightedIndexTable& precomputed) {
+  return this->use_precomputed_weights
+      ? this->get_rand_from_weighted_index_table(precomputed)
+      : this->get_rand_from_weighted_tables_1d(tables);
+}
+
 template <typename IntT, size_t X, size_t Y>
 IntT ItemCreator::get_rand_from_weighted_tables_2d_vertical(const parray<parray<IntT, X>, Y>& tables, size_t offset) {
   return ItemCreator::get_rand_from_weighted_tables<IntT>(tables[0].data(), offset, Y, X);
 }
 
+template <typename IntT, size_t X, size_t Y>
+IntT ItemCreator::get_rand_from_weighted_tables_2d_vertical(
+    const parray<parray<IntT, X>, Y>& tables, const array<WeightedIndexTable, X>& precomputed, size_t offset) {
+  // The client doesn't check offset, so if it's out of range, we use the
+  // original lookup to get the same result the client would
+  return (this->use_precomputed_weights && (offset < X))
+      ? this->get_rand_from_weighted_index_table(precomputed[offset])
+      : this->get_rand_from_weighted_tables_2d_vertical(tables, offset);
+}
+
 vector<ItemData> ItemCreator::generate_armor_shop_contents(size_t player_level) {
   vector<ItemData> shop;
   this->generate_armor_shop_armors(shop, player_level);
@@ -52,10 +52,22 @@ public:
   inline void set_restrictions(std::shared_ptr<const BattleRules> restrictions) {
     this->restrictions = restrictions;
   }
+  inline std::shared_ptr<const RareItemSet> get_rare_item_set() const {
+    return this->rare_item_set;
+  }
   inline uint8_t get_section_id() const {
     return this->section_id;
   }
   void set_section_id(uint8_t new_section_id);
+  inline void set_log_level(LogLevel level) {
+    this->log.min_level = level;
+  }
+  // If false, weighted draws walk the original probability tables like the
+  // client does, instead of using the tables' precomputed cumulative weights.
+  // The results are the same either way; drop-tables-test uses this to check.
+  inline void set_use_precomputed_weights(bool use) {
+    this->use_precomputed_weights = use;
+  }
 
 private:
   PrefixedLogger log;
@@ -74,6 +86,7 @@ private:
   std::shared_ptr<const CommonItemSet> common_item_set;
   std::shared_ptr<const CommonItemSet::Table> pt;
   std::shared_ptr<const BattleRules> restrictions;
+  bool use_precomputed_weights = true;
 
   struct UnitResult {
     uint8_t unit;
@@ -181,7 +194,13 @@ private:
       const IntT* tables, size_t offset, size_t num_values, size_t stride);
   template <typename IntT, size_t X>
   IntT get_rand_from_weighted_tables_1d(const parray<IntT, X>& tables);
+  template <typename IntT, size_t X>
+  IntT get_rand_from_weighted_tables_1d(const parray<IntT, X>& tables, const WeightedIndexTable& precomputed);
   template <typename IntT, size_t X, size_t Y>
   IntT get_rand_from_weighted_tables_2d_vertical(
       const parray<parray<IntT, X>, Y>& tables, size_t offset);
+  template <typename IntT, size_t X, size_t Y>
+  IntT get_rand_from_weighted_tables_2d_vertical(
+      const parray<parray<IntT, X>, Y>& tables, const std::array<WeightedIndexTable, X>& precomputed, size_t offset);
+  size_t get_rand_from_weighted_index_table(const WeightedIndexTable& table);
 };
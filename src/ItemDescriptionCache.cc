@@ -0,0 +1,90 @@
+#include "ItemDescriptionCache.hh"
+
+#include <string.h>
+
+#include <phosg/Hash.hh>
+
+using namespace std;
+
+size_t ItemDescriptionCache::KeyHash::operator()(const Key& key) const {
+  return fnv1a64(key.data(), key.size());
+}
+
+ItemDescriptionCache::ItemDescriptionCache(size_t max_entries)
+    : max_entries(max_entries) {
+  this->current_stats.max_entries = max_entries;
+}
+
+ItemDescriptionCache::Key ItemDescriptionCache::make_key(Version version, const ItemData& item, bool include_color_codes) {
+  Key ret;
+  ret[0] = static_cast<uint8_t>(version);
+  ret[1] = include_color_codes ? 1 : 0;
+  memcpy(&ret[2], item.data1.data(), 12);
+  memcpy(&ret[14], item.data2.data(), 4);
+  return ret;
+}
+
+string ItemDescriptionCache::get(
+    Version version,
+    const ItemData& item,
+    bool include_color_codes,
+    const function<string()>& describe_fn) {
+  Key key = this->make_key(version, item, include_color_codes);
+  {
+    lock_guard g(this->lock);
+    auto it = this->index.find(key);
+    if (it != this->index.end()) {
+      this->entries.splice(this->entries.begin(), this->entries, it->second);
+      this->current_stats.hits++;
+      return it->second->description;
+    }
+    this->current_stats.misses++;
+  }
+
+  // The description is generated without holding the lock, since it may be
+  // slow; if another thread added the same entry in the meantime, the existing
+  // entry is replaced (they should have the same contents anyway)
+  string description = describe_fn();
+
+  lock_guard g(this->lock);
+  if (this->max_entries == 0) {
+    return description;
+  }
+  auto it = this->index.find(key);
+  if (it != this->index.end()) {
+    this->entries.erase(it->second);
+    this->index.erase(it);
+  }
+  this->entries.emplace_front(Entry{key, description});
+  this->index.emplace(key, this->entries.begin());
+  this->evict_entries();
+  return description;
+}
+
+void ItemDescriptionCache::clear() {
+  lock_guard g(this->lock);
+  this->entries.clear();
+  this->index.clear();
+  this->current_stats.entries = 0;
+}
+
+void ItemDescriptionCache::set_max_entries(size_t max_entries) {
+  lock_guard g(this->lock);
+  this->max_entries = max_entries;
+  this->current_stats.max_entries = max_entries;
+  this->evict_entries();
+}
+
+ItemDescriptionCache::Stats ItemDescriptionCache::stats() const {
+  lock_guard g(this->lock);
+  return this->current_stats;
+}
+
+void ItemDescriptionCache::evict_entries() {
+  while (this->entries.size() > this->max_entries) {
+    this->index.erase(this->entries.back().key);
+    this->entries.pop_back();
+    this->current_stats.evictions++;
+  }
+  this->current_stats.entries = this->entries.size();
+}
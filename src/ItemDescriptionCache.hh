@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "ItemData.hh"
+#include "Version.hh"
+
+// Remembers recently-generated item descriptions, so that describing the same
+// item again (e.g. when the same inventories are returned by the HTTP server
+// repeatedly) doesn't require generating the description again. Entries are
+// keyed by the version and the item's data (excluding the item ID), and are
+// evicted in LRU order when there are more than max_entries of them. Since
+// descriptions depend on the item definitions and names, the cache must be
+// cleared when either of those are reloaded.
+class ItemDescriptionCache {
+public:
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t max_entries = 0;
+  };
+
+  explicit ItemDescriptionCache(size_t max_entries);
+  ItemDescriptionCache(const ItemDescriptionCache&) = delete;
+  ItemDescriptionCache(ItemDescriptionCache&&) = delete;
+  ItemDescriptionCache& operator=(const ItemDescriptionCache&) = delete;
+  ItemDescriptionCache& operator=(ItemDescriptionCache&&) = delete;
+  ~ItemDescriptionCache() = default;
+
+  // Returns the cached description if there is one; otherwise, calls
+  // describe_fn and caches its result. If describe_fn throws, nothing is
+  // cached.
+  std::string get(
+      Version version,
+      const ItemData& item,
+      bool include_color_codes,
+      const std::function<std::string()>& describe_fn);
+
+  void clear();
+  void set_max_entries(size_t max_entries);
+  Stats stats() const;
+
+private:
+  // Version, include_color_codes, data1, data2
+  using Key = std::array<uint8_t, 18>;
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+  struct Entry {
+    Key key;
+    std::string description;
+  };
+
+  mutable std::mutex lock;
+  // Front = most recently used
+  std::list<Entry> entries;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+  size_t max_entries;
+  Stats current_stats;
+
+  static Key make_key(Version version, const ItemData& item, bool include_color_codes);
+  void evict_entries();
+};
@@ -1,33 +1,12 @@
 #include "ItemNameIndex.hh"
 
-#include "StaticGameData.hh"
-
-using namespace std;
+#include <ctype.h>
 
-ItemNameIndex::ItemNameIndex(
-    std::shared_ptr<const ItemParameterTable> item_parameter_table,
-    std::shared_ptr<const ItemData::StackLimits> limits,
-    const std::vector<std::string>& name_coll)
-    : item_parameter_table(item_parameter_table),
-      limits(limits) {
+#include <algorithm>
 
-  for (uint32_t primary_identifier : item_parameter_table->compute_all_valid_primary_identifiers()) {
-    const string* name = nullptr;
-    try {
-      ItemData item = ItemData::from_primary_identifier(*this->limits, primary_identifier);
-      name = &name_coll.at(item_parameter_table->get_item_id(item));
-    } catch (const out_of_range&) {
-    }
+#include "StaticGameData.hh"
 
-    if (name) {
-      auto meta = make_shared<ItemMetadata>();
-      meta->primary_identifier = primary_identifier;
-      meta->name = *name;
-      this->primary_identifier_index.emplace(meta->primary_identifier, meta);
-      this->name_index.emplace(tolower(meta->name), meta);
-    }
-  }
-}
+using namespace std;
 
 static const char* s_rank_name_characters = "\0ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_";
 
@@ -97,6 +76,132 @@ const array<const char*, 0x11> name_for_s_rank_special = {
     "King\'s",
 };
 
+ItemNameIndex::ItemNameIndex(
+    std::shared_ptr<const ItemParameterTable> item_parameter_table,
+    std::shared_ptr<const ItemData::StackLimits> limits,
+    const std::vector<std::string>& name_coll)
+    : item_parameter_table(item_parameter_table),
+      limits(limits) {
+
+  for (uint32_t primary_identifier : item_parameter_table->compute_all_valid_primary_identifiers()) {
+    const string* name = nullptr;
+    try {
+      ItemData item = ItemData::from_primary_identifier(*this->limits, primary_identifier);
+      name = &name_coll.at(item_parameter_table->get_item_id(item));
+    } catch (const out_of_range&) {
+    }
+
+    if (name) {
+      auto meta = make_shared<ItemMetadata>();
+      meta->primary_identifier = primary_identifier;
+      meta->name = *name;
+      this->primary_identifier_index.emplace(meta->primary_identifier, meta);
+      this->name_index.emplace(this->normalize_name(meta->name), meta);
+    }
+  }
+
+  map<string, uint32_t> name_trie_entries;
+  for (const auto& it : this->name_index) {
+    if (!it.first.empty()) {
+      name_trie_entries.emplace(it.first, it.second->primary_identifier);
+    }
+  }
+  this->name_trie = NameTrie(name_trie_entries);
+
+  map<string, uint32_t> special_trie_entries;
+  for (size_t z = 0; z < name_for_weapon_special.size(); z++) {
+    if (name_for_weapon_special[z]) {
+      special_trie_entries.emplace(this->normalize_name(name_for_weapon_special[z]) + " ", z);
+    }
+  }
+  this->weapon_special_trie = NameTrie(special_trie_entries);
+}
+
+ItemNameIndex::NameTrie::NameTrie(const map<string, uint32_t>& entries) {
+  this->add_node(entries.begin(), entries.end(), 0);
+}
+
+uint32_t ItemNameIndex::NameTrie::add_node(EntryIterator begin, EntryIterator end, size_t depth) {
+  // All entries in [begin, end) have the same first (depth) characters. Since
+  // the entries are sorted, the entry that ends at this node (if any) is first,
+  // and the entries for each child node are contiguous.
+  uint32_t node_index = this->nodes.size();
+  this->nodes.emplace_back();
+  if ((begin != end) && (begin->first.size() == depth)) {
+    this->nodes[node_index].value = begin->second;
+    this->nodes[node_index].has_value = true;
+    begin++;
+  }
+
+  vector<EntryIterator> child_begins;
+  for (auto it = begin; it != end; it++) {
+    if (child_begins.empty() || (it->first[depth] != child_begins.back()->first[depth])) {
+      child_begins.emplace_back(it);
+    }
+  }
+  child_begins.emplace_back(end);
+
+  // Reserve this node's edges before adding any children, so they will be
+  // contiguous
+  uint32_t first_edge = this->edge_chars.size();
+  this->nodes[node_index].first_edge = first_edge;
+  this->nodes[node_index].num_edges = child_begins.size() - 1;
+  for (size_t z = 0; z < child_begins.size() - 1; z++) {
+    this->edge_chars.push_back(child_begins[z]->first[depth]);
+    this->edge_targets.emplace_back(0);
+  }
+  for (size_t z = 0; z < child_begins.size() - 1; z++) {
+    uint32_t child_index = this->add_node(child_begins[z], child_begins[z + 1], depth + 1);
+    this->edge_targets[first_edge + z] = child_index;
+  }
+  return node_index;
+}
+
+size_t ItemNameIndex::NameTrie::longest_prefix_match(const string& s, size_t offset, uint32_t* value) const {
+  if (this->nodes.empty()) {
+    return 0;
+  }
+
+  size_t ret = 0;
+  const Node* node = &this->nodes[0];
+  for (size_t z = offset; z < s.size(); z++) {
+    auto edges_begin = this->edge_chars.begin() + node->first_edge;
+    auto edges_end = edges_begin + node->num_edges;
+    // std::map sorts strings by unsigned character values, so the edges are
+    // sorted that way too
+    auto edge_it = lower_bound(edges_begin, edges_end, s[z], +[](char a, char b) -> bool {
+      return static_cast<uint8_t>(a) < static_cast<uint8_t>(b);
+    });
+    if ((edge_it == edges_end) || (*edge_it != s[z])) {
+      break;
+    }
+    node = &this->nodes[this->edge_targets[edge_it - this->edge_chars.begin()]];
+    if (node->has_value) {
+      *value = node->value;
+      ret = z + 1 - offset;
+    }
+  }
+  return ret;
+}
+
+string ItemNameIndex::normalize_name(const string& name) {
+  string ret;
+  ret.reserve(name.size());
+  for (char ch : name) {
+    if (isspace(static_cast<uint8_t>(ch))) {
+      if (!ret.empty() && (ret.back() != ' ')) {
+        ret.push_back(' ');
+      }
+    } else {
+      ret.push_back(tolower(static_cast<uint8_t>(ch)));
+    }
+  }
+  if (!ret.empty() && (ret.back() == ' ')) {
+    ret.pop_back();
+  }
+  return ret;
+}
+
 std::string ItemNameIndex::describe_item(const ItemData& item, bool include_color_escapes) const {
   if (item.data1[0] == 0x04) {
     return string_printf("%s%" PRIu32 " Meseta", include_color_escapes ? "$C7" : "", item.data2d.load());
@@ -353,12 +458,13 @@ std::string ItemNameIndex::describe_item(const ItemData& item, bool include_colo
 }
 
 ItemData ItemNameIndex::parse_item_description(const std::string& desc) const {
+  string normalized_desc = this->normalize_name(desc);
   ItemData ret;
   try {
-    ret = this->parse_item_description_phase(desc, false);
+    ret = this->parse_item_description_phase(normalized_desc, false);
   } catch (const exception& e1) {
     try {
-      ret = this->parse_item_description_phase(desc, true);
+      ret = this->parse_item_description_phase(normalized_desc, true);
     } catch (const exception& e2) {
       try {
         ret = ItemData::from_data(parse_data_string(desc));
@@ -377,13 +483,13 @@ ItemData ItemNameIndex::parse_item_description(const std::string& desc) const {
   return ret;
 }
 
-ItemData ItemNameIndex::parse_item_description_phase(const std::string& description, bool skip_special) const {
+ItemData ItemNameIndex::parse_item_description_phase(const std::string& normalized_desc, bool skip_special) const {
   ItemData ret;
   ret.data1d.clear(0);
   ret.id = 0xFFFFFFFF;
   ret.data2d = 0;
 
-  string desc = tolower(description);
+  string desc = normalized_desc;
   if (ends_with(desc, " meseta")) {
     ret.data1[0] = 0x04;
     ret.data2d = stol(desc, nullptr, 10);
@@ -433,48 +539,31 @@ ItemData ItemNameIndex::parse_item_description_phase(const std::string& descript
 
   // TODO: It'd be nice to be able to parse S-rank weapon specials here too.
   uint8_t weapon_special = 0;
+  size_t offset = 0;
   if (!skip_special) {
-    for (size_t z = 0; z < name_for_weapon_special.size(); z++) {
-      if (!name_for_weapon_special[z]) {
-        continue;
-      }
-      string prefix = tolower(name_for_weapon_special[z]);
-      prefix += ' ';
-      if (starts_with(desc, prefix)) {
-        weapon_special = z;
-        desc = desc.substr(prefix.size());
-        break;
-      }
+    uint32_t special_index;
+    size_t special_size = this->weapon_special_trie.longest_prefix_match(desc, 0, &special_index);
+    if (special_size) {
+      weapon_special = special_index;
+      offset = special_size;
     }
   }
 
-  auto name_it = this->name_index.lower_bound(desc);
-  // Look up to 3 places before the lower bound. We have to do this to catch
-  // cases like Sange vs. Sange & Yasha - if the input is like "Sange 0/...",
-  // then we'll see Sange & Yasha first, which we should skip.
-  size_t lookback = 0;
-  while (lookback < 4) {
-    if (name_it != this->name_index.end() && desc.starts_with(name_it->first)) {
-      break;
-    } else if (name_it == this->name_index.begin()) {
-      throw runtime_error("no such item");
-    } else {
-      name_it--;
-      lookback++;
-    }
+  // If multiple names match, the longest one is correct (e.g. the input
+  // "Sange & Yasha 0/..." matches both Sange and Sange & Yasha)
+  uint32_t primary_identifier;
+  size_t name_size = this->name_trie.longest_prefix_match(desc, offset, &primary_identifier);
+  if (name_size == 0) {
+    throw runtime_error("item not found: " + desc.substr(offset));
   }
-  if (lookback >= 4) {
-    throw runtime_error("item not found: " + desc);
-  }
-
-  desc = desc.substr(name_it->first.size());
-  if (starts_with(desc, " ")) {
-    desc = desc.substr(1);
+  offset += name_size;
+  if ((offset < desc.size()) && (desc[offset] == ' ')) {
+    offset++;
   }
+  desc = desc.substr(offset);
 
   // Tech disks should have already been handled above, so we don't need to
   // special-case 0302xxxx identifiers here.
-  uint32_t primary_identifier = name_it->second->primary_identifier;
   ret.data1[0] = (primary_identifier >> 24) & 0xFF;
   ret.data1[1] = (primary_identifier >> 16) & 0xFF;
   ret.data1[2] = (primary_identifier >> 8) & 0xFF;
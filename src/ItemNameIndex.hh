@@ -3,6 +3,7 @@
 #include <stdint.h>
 
 #include <array>
+#include <map>
 #include <memory>
 #include <phosg/JSON.hh>
 #include <string>
@@ -41,11 +42,45 @@ public:
   void print_table(FILE* stream) const;
 
 private:
-  ItemData parse_item_description_phase(const std::string& description, bool skip_special) const;
+  // Maps normalized names (see normalize_name) to values. The trie is built
+  // all at once from a sorted map and stored in flat arrays, so lookups don't
+  // allocate memory or compare whole strings.
+  class NameTrie {
+  public:
+    NameTrie() = default;
+    explicit NameTrie(const std::map<std::string, uint32_t>& entries);
+
+    // Finds the longest entry that s starts with (at offset), sets *value to
+    // its value, and returns its length. Returns 0 if there is no such entry.
+    size_t longest_prefix_match(const std::string& s, size_t offset, uint32_t* value) const;
+
+  private:
+    struct Node {
+      uint32_t first_edge = 0;
+      uint32_t num_edges = 0;
+      uint32_t value = 0;
+      bool has_value = false;
+    };
+    std::vector<Node> nodes;
+    // Edges for each node are contiguous and sorted by character
+    std::string edge_chars;
+    std::vector<uint32_t> edge_targets;
+
+    using EntryIterator = std::map<std::string, uint32_t>::const_iterator;
+    uint32_t add_node(EntryIterator begin, EntryIterator end, size_t depth);
+  };
+
+  // Converts to lowercase, collapses runs of whitespace into single spaces,
+  // and removes leading and trailing whitespace.
+  static std::string normalize_name(const std::string& name);
+
+  ItemData parse_item_description_phase(const std::string& desc, bool skip_special) const;
 
   std::shared_ptr<const ItemParameterTable> item_parameter_table;
   std::shared_ptr<const ItemData::StackLimits> limits;
 
   std::unordered_map<uint32_t, std::shared_ptr<const ItemMetadata>> primary_identifier_index;
   std::map<std::string, std::shared_ptr<const ItemMetadata>> name_index;
+  NameTrie name_trie; // Values are primary identifiers
+  NameTrie weapon_special_trie; // Keys include the trailing space
 };
@@ -3,9 +3,12 @@
 using namespace std;
 
 ItemParameterTable::ItemParameterTable(shared_ptr<const string> data, Version version)
+    : ItemParameterTable(data, *data, version) {}
+
+ItemParameterTable::ItemParameterTable(shared_ptr<const void> owner, string_view data, Version version)
     : version(version),
-      data(data),
-      r(*data),
+      data_owner(std::move(owner)),
+      r(data.data(), data.size()),
       offsets_dc_protos(nullptr),
       offsets_v1_v2(nullptr),
       offsets_gc_nte(nullptr),
@@ -13,8 +16,8 @@ ItemParameterTable::ItemParameterTable(shared_ptr<const string> data, Version ve
       offsets_v3_be(nullptr),
       offsets_v4(nullptr) {
   size_t offset_table_offset = is_big_endian(version)
-      ? this->r.pget_u32b(this->data->size() - 0x10)
-      : this->r.pget_u32l(this->data->size() - 0x10);
+      ? this->r.pget_u32b(this->r.size() - 0x10)
+      : this->r.pget_u32l(this->r.size() - 0x10);
 
   switch (this->version) {
     case Version::DC_NTE: {
@@ -107,6 +110,8 @@ ItemParameterTable::ItemParameterTable(shared_ptr<const string> data, Version ve
   }
 
   this->first_rare_mag_index = 0x28;
+
+  this->parse_all_definitions();
 }
 
 set<uint32_t> ItemParameterTable::compute_all_valid_primary_identifiers() const {
@@ -431,6 +436,109 @@ const T& indirect_lookup_2d(const StringReader& r, size_t root_offset, size_t co
   return r.pget<T>(co.offset + sizeof(T) * item_index);
 }
 
+template <typename SrcT, bool IsBigEndian, typename V4T>
+void ItemParameterTable::parse_table(ParsedTable<V4T>& ret, size_t root_offset, size_t num_classes) const {
+  ret.items.clear();
+  ret.class_offsets.clear();
+  for (size_t class_index = 0; class_index < num_classes; class_index++) {
+    ret.class_offsets.emplace_back(ret.items.size());
+    // Some classes may refer to data outside the file; these were previously
+    // only an error if an item in that class was looked up, so we just stop at
+    // the first unreadable entry and leave the remaining entries out
+    try {
+      size_t count = indirect_lookup_2d_count<IsBigEndian>(this->r, root_offset, class_index);
+      for (size_t item_index = 0; item_index < count; item_index++) {
+        ret.items.emplace_back(indirect_lookup_2d<SrcT, IsBigEndian>(this->r, root_offset, class_index, item_index).to_v4());
+      }
+    } catch (const out_of_range&) {
+    }
+  }
+  ret.class_offsets.emplace_back(ret.items.size());
+}
+
+void ItemParameterTable::parse_all_definitions() {
+  if (this->offsets_dc_protos) {
+    const auto* offsets = this->offsets_dc_protos;
+    this->parse_table<WeaponDCProtos, false>(this->parsed_weapons, offsets->weapon_table, this->num_weapon_classes);
+    this->parse_table<ArmorOrShieldDCProtos, false>(this->parsed_armors_and_shields, offsets->armor_table, 2);
+    this->parse_table<UnitDCProtos, false>(this->parsed_units, offsets->unit_table, 1);
+    this->parse_table<MagV1, false>(this->parsed_mags, offsets->mag_table, 1);
+    this->parse_table<ToolV1V2, false>(this->parsed_tools, offsets->tool_table, this->num_tool_classes);
+
+  } else if (this->offsets_v1_v2) {
+    const auto* offsets = this->offsets_v1_v2;
+    this->parse_table<WeaponV1V2, false>(this->parsed_weapons, offsets->weapon_table, this->num_weapon_classes);
+    this->parse_table<ArmorOrShieldV1V2, false>(this->parsed_armors_and_shields, offsets->armor_table, 2);
+    this->parse_table<UnitV1V2, false>(this->parsed_units, offsets->unit_table, 1);
+    if (is_v1(this->version)) {
+      this->parse_table<MagV1, false>(this->parsed_mags, offsets->mag_table, 1);
+    } else {
+      this->parse_table<MagV2, false>(this->parsed_mags, offsets->mag_table, 1);
+    }
+    this->parse_table<ToolV1V2, false>(this->parsed_tools, offsets->tool_table, this->num_tool_classes);
+
+  } else if (this->offsets_gc_nte) {
+    const auto* offsets = this->offsets_gc_nte;
+    this->parse_table<WeaponGCNTE, true>(this->parsed_weapons, offsets->weapon_table, this->num_weapon_classes);
+    this->parse_table<ArmorOrShieldV3BE, true>(this->parsed_armors_and_shields, offsets->armor_table, 2);
+    this->parse_table<UnitV3BE, true>(this->parsed_units, offsets->unit_table, 1);
+    this->parse_table<MagV3BE, true>(this->parsed_mags, offsets->mag_table, 1);
+    this->parse_table<ToolV3BE, true>(this->parsed_tools, offsets->tool_table, this->num_tool_classes);
+    for (size_t z = 0; z < this->num_specials; z++) {
+      const auto& sp_be = this->r.pget<SpecialBE>(offsets->special_data_table + sizeof(SpecialBE) * z);
+      auto& sp = this->parsed_specials.emplace_back();
+      sp.type = sp_be.type.load();
+      sp.amount = sp_be.amount.load();
+    }
+
+  } else if (this->offsets_v3_le) {
+    const auto* offsets = this->offsets_v3_le;
+    this->parse_table<WeaponV3, false>(this->parsed_weapons, offsets->weapon_table, this->num_weapon_classes);
+    this->parse_table<ArmorOrShieldV3, false>(this->parsed_armors_and_shields, offsets->armor_table, 2);
+    this->parse_table<UnitV3, false>(this->parsed_units, offsets->unit_table, 1);
+    this->parse_table<MagV3, false>(this->parsed_mags, offsets->mag_table, 1);
+    this->parse_table<ToolV3, false>(this->parsed_tools, offsets->tool_table, this->num_tool_classes);
+
+  } else if (this->offsets_v3_be) {
+    const auto* offsets = this->offsets_v3_be;
+    this->parse_table<WeaponV3BE, true>(this->parsed_weapons, offsets->weapon_table, this->num_weapon_classes);
+    this->parse_table<ArmorOrShieldV3BE, true>(this->parsed_armors_and_shields, offsets->armor_table, 2);
+    this->parse_table<UnitV3BE, true>(this->parsed_units, offsets->unit_table, 1);
+    this->parse_table<MagV3BE, true>(this->parsed_mags, offsets->mag_table, 1);
+    this->parse_table<ToolV3BE, true>(this->parsed_tools, offsets->tool_table, this->num_tool_classes);
+    for (size_t z = 0; z < this->num_specials; z++) {
+      const auto& sp_be = this->r.pget<SpecialBE>(offsets->special_data_table + sizeof(SpecialBE) * z);
+      auto& sp = this->parsed_specials.emplace_back();
+      sp.type = sp_be.type.load();
+      sp.amount = sp_be.amount.load();
+    }
+  }
+
+  uint32_t combinations_offset = 0;
+  uint32_t combinations_count = 0;
+  if (this->offsets_v3_le) {
+    const auto& co = this->r.pget<ArrayRef>(this->offsets_v3_le->combination_table);
+    combinations_offset = co.offset;
+    combinations_count = co.count;
+  } else if (this->offsets_v3_be) {
+    const auto& co = this->r.pget<ArrayRefBE>(this->offsets_v3_be->combination_table);
+    combinations_offset = co.offset;
+    combinations_count = co.count;
+  } else if (this->offsets_v4) {
+    const auto& co = this->r.pget<ArrayRef>(this->offsets_v4->combination_table);
+    combinations_offset = co.offset;
+    combinations_count = co.count;
+  }
+  if (combinations_count) {
+    const auto* defs = &this->r.pget<ItemCombination>(combinations_offset, combinations_count * sizeof(ItemCombination));
+    for (size_t z = 0; z < combinations_count; z++) {
+      const auto& def = defs[z];
+      uint32_t key = (def.used_item[0] << 16) | (def.used_item[1] << 8) | def.used_item[2];
+      this->item_combination_index[key].emplace_back(def);
+    }
+  }
+}
+
 size_t ItemParameterTable::num_weapons_in_class(uint8_t data1_1) const {
   if (data1_1 >= this->num_weapon_classes) {
     throw out_of_range("weapon ID out of range");
@@ -456,31 +564,10 @@ const ItemParameterTable::WeaponV4& ItemParameterTable::get_weapon(uint8_t data1
   if (data1_1 >= this->num_weapon_classes) {
     throw out_of_range("weapon ID out of range");
   }
-
   if (this->offsets_v4) {
     return indirect_lookup_2d<WeaponV4, false>(this->r, this->offsets_v4->weapon_table, data1_1, data1_2);
   }
-
-  uint16_t key = (data1_1 << 8) | data1_2;
-  try {
-    return this->parsed_weapons.at(key);
-  } catch (const std::out_of_range&) {
-    WeaponV4 def_v4;
-    if (this->offsets_dc_protos) {
-      def_v4 = indirect_lookup_2d<WeaponDCProtos, false>(this->r, this->offsets_dc_protos->weapon_table, data1_1, data1_2).to_v4();
-    } else if (this->offsets_v1_v2) {
-      def_v4 = indirect_lookup_2d<WeaponV1V2, false>(this->r, this->offsets_v1_v2->weapon_table, data1_1, data1_2).to_v4();
-    } else if (this->offsets_gc_nte) {
-      def_v4 = indirect_lookup_2d<WeaponGCNTE, true>(this->r, this->offsets_gc_nte->weapon_table, data1_1, data1_2).to_v4();
-    } else if (this->offsets_v3_le) {
-      def_v4 = indirect_lookup_2d<WeaponV3, false>(this->r, this->offsets_v3_le->weapon_table, data1_1, data1_2).to_v4();
-    } else if (this->offsets_v3_be) {
-      def_v4 = indirect_lookup_2d<WeaponV3BE, true>(this->r, this->offsets_v3_be->weapon_table, data1_1, data1_2).to_v4();
-    } else {
-      throw logic_error("table is not v2, v3, or v4");
-    }
-    return this->parsed_weapons.emplace(key, def_v4).first->second;
-  }
+  return this->parsed_weapons.get(data1_1, data1_2);
 }
 
 size_t ItemParameterTable::num_armors_or_shields_in_class(uint8_t data1_1) const {
@@ -508,40 +595,10 @@ const ItemParameterTable::ArmorOrShieldV4& ItemParameterTable::get_armor_or_shie
   if ((data1_1 < 1) || (data1_1 > 2)) {
     throw out_of_range("armor/shield class ID out of range");
   }
-
   if (this->offsets_v4) {
     return indirect_lookup_2d<ArmorOrShieldV4, false>(this->r, this->offsets_v4->armor_table, data1_1 - 1, data1_2);
   }
-
-  auto& parsed_vec = (data1_1 == 2) ? this->parsed_shields : this->parsed_armors;
-  try {
-    const auto& ret = parsed_vec.at(data1_2);
-    if (ret.base.id == 0xFFFFFFFF) {
-      throw out_of_range("cache entry not populated");
-    }
-    return ret;
-  } catch (const std::out_of_range&) {
-    ArmorOrShieldV4 def_v4;
-
-    if (this->offsets_dc_protos) {
-      def_v4 = indirect_lookup_2d<ArmorOrShieldDCProtos, false>(this->r, this->offsets_dc_protos->armor_table, data1_1 - 1, data1_2).to_v4();
-    } else if (this->offsets_v1_v2) {
-      def_v4 = indirect_lookup_2d<ArmorOrShieldV1V2, false>(this->r, this->offsets_v1_v2->armor_table, data1_1 - 1, data1_2).to_v4();
-    } else if (this->offsets_gc_nte) {
-      def_v4 = indirect_lookup_2d<ArmorOrShieldV3BE, true>(this->r, this->offsets_gc_nte->armor_table, data1_1 - 1, data1_2).to_v4();
-    } else if (this->offsets_v3_le) {
-      def_v4 = indirect_lookup_2d<ArmorOrShieldV3, false>(this->r, this->offsets_v3_le->armor_table, data1_1 - 1, data1_2).to_v4();
-    } else if (this->offsets_v3_be) {
-      def_v4 = indirect_lookup_2d<ArmorOrShieldV3BE, true>(this->r, this->offsets_v3_be->armor_table, data1_1 - 1, data1_2).to_v4();
-    } else {
-      throw logic_error("table is not v2, v3, or v4");
-    }
-    if (data1_2 >= parsed_vec.size()) {
-      parsed_vec.resize(data1_2 + 1);
-    }
-    parsed_vec[data1_2] = def_v4;
-    return parsed_vec[data1_2];
-  }
+  return this->parsed_armors_and_shields.get(data1_1 - 1, data1_2);
 }
 
 size_t ItemParameterTable::num_units() const {
@@ -566,34 +623,7 @@ const ItemParameterTable::UnitV4& ItemParameterTable::get_unit(uint8_t data1_2)
   if (this->offsets_v4) {
     return indirect_lookup_2d<UnitV4, false>(this->r, this->offsets_v4->unit_table, 0, data1_2);
   }
-
-  try {
-    const auto& ret = this->parsed_units.at(data1_2);
-    if (ret.base.id == 0xFFFFFFFF) {
-      throw out_of_range("cache entry not populated");
-    }
-    return ret;
-  } catch (const std::out_of_range&) {
-    UnitV4 def_v4;
-    if (this->offsets_dc_protos) {
-      def_v4 = indirect_lookup_2d<UnitDCProtos, false>(this->r, this->offsets_dc_protos->unit_table, 0, data1_2).to_v4();
-    } else if (this->offsets_v1_v2) {
-      def_v4 = indirect_lookup_2d<UnitV1V2, false>(this->r, this->offsets_v1_v2->unit_table, 0, data1_2).to_v4();
-    } else if (this->offsets_gc_nte) {
-      def_v4 = indirect_lookup_2d<UnitV3BE, true>(this->r, this->offsets_gc_nte->unit_table, 0, data1_2).to_v4();
-    } else if (this->offsets_v3_le) {
-      def_v4 = indirect_lookup_2d<UnitV3, false>(this->r, this->offsets_v3_le->unit_table, 0, data1_2).to_v4();
-    } else if (this->offsets_v3_be) {
-      def_v4 = indirect_lookup_2d<UnitV3BE, true>(this->r, this->offsets_v3_be->unit_table, 0, data1_2).to_v4();
-    } else {
-      throw logic_error("table is not v2, v3, or v4");
-    }
-    if (data1_2 >= this->parsed_units.size()) {
-      this->parsed_units.resize(data1_2 + 1);
-    }
-    this->parsed_units[data1_2] = def_v4;
-    return this->parsed_units[data1_2];
-  }
+  return this->parsed_units.get(0, data1_2);
 }
 
 size_t ItemParameterTable::num_mags() const {
@@ -618,38 +648,7 @@ const ItemParameterTable::MagV4& ItemParameterTable::get_mag(uint8_t data1_1) co
   if (this->offsets_v4) {
     return indirect_lookup_2d<MagV4, false>(this->r, this->offsets_v4->mag_table, 0, data1_1);
   }
-
-  try {
-    const auto& ret = this->parsed_mags.at(data1_1);
-    if (ret.base.id == 0xFFFFFFFF) {
-      throw out_of_range("cache entry not populated");
-    }
-    return ret;
-  } catch (const std::out_of_range&) {
-    MagV4 def_v4;
-    if (this->offsets_dc_protos) {
-      def_v4 = indirect_lookup_2d<MagV1, false>(this->r, this->offsets_dc_protos->mag_table, 0, data1_1).to_v4();
-    } else if (this->offsets_v1_v2) {
-      if (is_v1(this->version)) {
-        def_v4 = indirect_lookup_2d<MagV1, false>(this->r, this->offsets_v1_v2->mag_table, 0, data1_1).to_v4();
-      } else {
-        def_v4 = indirect_lookup_2d<MagV2, false>(this->r, this->offsets_v1_v2->mag_table, 0, data1_1).to_v4();
-      }
-    } else if (this->offsets_gc_nte) {
-      def_v4 = indirect_lookup_2d<MagV3BE, true>(this->r, this->offsets_gc_nte->mag_table, 0, data1_1).to_v4();
-    } else if (this->offsets_v3_le) {
-      def_v4 = indirect_lookup_2d<MagV3, false>(this->r, this->offsets_v3_le->mag_table, 0, data1_1).to_v4();
-    } else if (this->offsets_v3_be) {
-      def_v4 = indirect_lookup_2d<MagV3BE, true>(this->r, this->offsets_v3_be->mag_table, 0, data1_1).to_v4();
-    } else {
-      throw logic_error("table is not v2, v3, or v4");
-    }
-    if (data1_1 >= this->parsed_mags.size()) {
-      this->parsed_mags.resize(data1_1 + 1);
-    }
-    this->parsed_mags[data1_1] = def_v4;
-    return this->parsed_mags[data1_1];
-  }
+  return this->parsed_mags.get(0, data1_1);
 }
 
 size_t ItemParameterTable::num_tools_in_class(uint8_t data1_1) const {
@@ -677,33 +676,10 @@ const ItemParameterTable::ToolV4& ItemParameterTable::get_tool(uint8_t data1_1,
   if (data1_1 >= this->num_tool_classes) {
     throw out_of_range("tool class ID out of range");
   }
-
   if (this->offsets_v4) {
     return indirect_lookup_2d<ToolV4, false>(this->r, this->offsets_v4->tool_table, data1_1, data1_2);
   }
-
-  uint16_t key = (data1_1 << 8) | data1_2;
-  try {
-    return this->parsed_tools.at(key);
-  } catch (const std::out_of_range&) {
-    ToolV4 def_v4;
-
-    if (this->offsets_dc_protos) {
-      def_v4 = indirect_lookup_2d<ToolV1V2, false>(this->r, this->offsets_dc_protos->tool_table, data1_1, data1_2).to_v4();
-    } else if (this->offsets_v1_v2) {
-      def_v4 = indirect_lookup_2d<ToolV1V2, false>(this->r, this->offsets_v1_v2->tool_table, data1_1, data1_2).to_v4();
-    } else if (this->offsets_gc_nte) {
-      def_v4 = indirect_lookup_2d<ToolV3BE, true>(this->r, this->offsets_gc_nte->tool_table, data1_1, data1_2).to_v4();
-    } else if (this->offsets_v3_le) {
-      def_v4 = indirect_lookup_2d<ToolV3, false>(this->r, this->offsets_v3_le->tool_table, data1_1, data1_2).to_v4();
-    } else if (this->offsets_v3_be) {
-      def_v4 = indirect_lookup_2d<ToolV3BE, true>(this->r, this->offsets_v3_be->tool_table, data1_1, data1_2).to_v4();
-    } else {
-      throw logic_error("table is not v2, v3, or v4");
-    }
-
-    return this->parsed_tools.emplace(key, def_v4).first->second;
-  }
+  return this->parsed_tools.get(data1_1, data1_2);
 }
 
 template <typename ToolDefT, bool IsBigEndian>
@@ -868,26 +844,8 @@ const ItemParameterTable::Special& ItemParameterTable::get_special(uint8_t speci
     return this->r.pget<Special>(this->offsets_v1_v2->special_data_table + sizeof(Special) * special);
   } else if (this->offsets_v3_le) {
     return this->r.pget<Special>(this->offsets_v3_le->special_data_table + sizeof(Special) * special);
-  } else if (this->offsets_gc_nte) {
-    if ((special >= this->parsed_specials.size()) || (this->parsed_specials[special].type != 0xFFFF)) {
-      if (special >= this->parsed_specials.size()) {
-        this->parsed_specials.resize(special + 1);
-      }
-      const auto& sp_be = this->r.pget<SpecialBE>(this->offsets_gc_nte->special_data_table + sizeof(SpecialBE) * special);
-      this->parsed_specials[special].type = sp_be.type.load();
-      this->parsed_specials[special].amount = sp_be.amount.load();
-    }
-    return this->parsed_specials[special];
-  } else if (this->offsets_v3_be) {
-    if ((special >= this->parsed_specials.size()) || (this->parsed_specials[special].type != 0xFFFF)) {
-      if (special >= this->parsed_specials.size()) {
-        this->parsed_specials.resize(special + 1);
-      }
-      const auto& sp_be = this->r.pget<SpecialBE>(this->offsets_v3_be->special_data_table + sizeof(SpecialBE) * special);
-      this->parsed_specials[special].type = sp_be.type.load();
-      this->parsed_specials[special].amount = sp_be.amount.load();
-    }
-    return this->parsed_specials[special];
+  } else if (this->offsets_gc_nte || this->offsets_v3_be) {
+    return this->parsed_specials.at(special);
   } else if (this->offsets_v4) {
     return this->r.pget<Special>(this->offsets_v4->special_data_table + sizeof(Special) * special);
   } else {
@@ -1105,34 +1063,6 @@ const std::vector<ItemParameterTable::ItemCombination>& ItemParameterTable::get_
 }
 
 const std::map<uint32_t, std::vector<ItemParameterTable::ItemCombination>>& ItemParameterTable::get_all_item_combinations() const {
-  if (this->item_combination_index.empty()) {
-    uint32_t offset, count;
-    if (this->offsets_dc_protos || this->offsets_v1_v2 || this->offsets_gc_nte) {
-      static const std::map<uint32_t, std::vector<ItemParameterTable::ItemCombination>> empty_map;
-      return empty_map;
-    } else if (this->offsets_v3_le) {
-      const auto& co = this->r.pget<ArrayRef>(this->offsets_v3_le->combination_table);
-      offset = co.offset;
-      count = co.count;
-    } else if (this->offsets_v3_be) {
-      const auto& co = this->r.pget<ArrayRefBE>(this->offsets_v3_be->combination_table);
-      offset = co.offset;
-      count = co.count;
-    } else if (this->offsets_v4) {
-      const auto& co = this->r.pget<ArrayRef>(this->offsets_v4->combination_table);
-      offset = co.offset;
-      count = co.count;
-    } else {
-      throw logic_error("table is not v2, v3, or v4");
-    }
-
-    const auto* defs = &this->r.pget<ItemCombination>(offset, count * sizeof(ItemCombination));
-    for (size_t z = 0; z < count; z++) {
-      const auto& def = defs[z];
-      uint32_t key = (def.used_item[0] << 16) | (def.used_item[1] << 8) | def.used_item[2];
-      this->item_combination_index[key].emplace_back(def);
-    }
-  }
   return this->item_combination_index;
 }
 
@@ -1258,9 +1188,12 @@ size_t ItemParameterTable::price_for_item(const ItemData& item) const {
 }
 
 MagEvolutionTable::MagEvolutionTable(shared_ptr<const string> data)
-    : data(data),
-      r(*data) {
-  size_t offset_table_offset = this->r.pget_u32l(this->data->size() - 0x10);
+    : MagEvolutionTable(data, *data) {}
+
+MagEvolutionTable::MagEvolutionTable(shared_ptr<const void> owner, string_view data)
+    : data_owner(std::move(owner)),
+      r(data.data(), data.size()) {
+  size_t offset_table_offset = this->r.pget_u32l(this->r.size() - 0x10);
   this->offsets = &r.pget<TableOffsets>(offset_table_offset);
 }
 
@@ -6,7 +6,9 @@
 #include <memory>
 #include <phosg/Encoding.hh>
 #include <set>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "ItemData.hh"
@@ -468,6 +470,9 @@ public:
   check_struct_size(NonWeaponSaleDivisorsBE, 0x10);
 
   ItemParameterTable(std::shared_ptr<const std::string> data, Version version);
+  // data must remain valid as long as owner is alive (e.g. it may point into a
+  // mapped DataSnapshot)
+  ItemParameterTable(std::shared_ptr<const void> owner, std::string_view data, Version version);
   ~ItemParameterTable() = default;
 
   void print(FILE* stream) const;
@@ -621,7 +626,7 @@ private:
   check_struct_size(TableOffsetsV3V4BE, 0x5C);
 
   Version version;
-  std::shared_ptr<const std::string> data;
+  std::shared_ptr<const void> data_owner;
   StringReader r;
   const TableOffsetsDCProtos* offsets_dc_protos;
   const TableOffsetsV1V2* offsets_v1_v2;
@@ -630,19 +635,45 @@ private:
   const TableOffsetsV3V4BE* offsets_v3_be;
   const TableOffsetsV3V4* offsets_v4;
 
-  // These are unused if offsets_v4 is not null (in that case, we just return
-  // references pointing inside the data string)
-  mutable std::unordered_map<uint16_t, WeaponV4> parsed_weapons;
-  mutable std::vector<ArmorOrShieldV4> parsed_armors;
-  mutable std::vector<ArmorOrShieldV4> parsed_shields;
-  mutable std::vector<UnitV4> parsed_units;
-  mutable std::vector<MagV4> parsed_mags;
-  mutable std::unordered_map<uint16_t, ToolV4> parsed_tools;
-  mutable std::vector<Special> parsed_specials;
+  // All definitions in a two-level table (indexed by data1[1] and data1[2],
+  // or by data1[1] - 1 for armors and shields), converted to the V4 format.
+  // The definitions for class c are items[class_offsets[c]] through
+  // items[class_offsets[c + 1] - 1].
+  template <typename T>
+  struct ParsedTable {
+    std::vector<T> items;
+    std::vector<uint32_t> class_offsets;
+
+    const T& get(size_t class_index, size_t item_index) const {
+      if (class_index + 1 >= this->class_offsets.size()) {
+        throw std::out_of_range("item class ID out of range");
+      }
+      size_t offset = this->class_offsets[class_index] + item_index;
+      if (offset >= this->class_offsets[class_index + 1]) {
+        throw std::out_of_range("item ID out of range");
+      }
+      return this->items[offset];
+    }
+  };
+
+  // All definitions are parsed in the constructor, so nothing here changes
+  // after that and the table can be used from multiple threads at once. These
+  // are unused if offsets_v4 is not null (in that case, we just return
+  // references pointing inside the data string).
+  ParsedTable<WeaponV4> parsed_weapons;
+  ParsedTable<ArmorOrShieldV4> parsed_armors_and_shields;
+  ParsedTable<UnitV4> parsed_units;
+  ParsedTable<MagV4> parsed_mags;
+  ParsedTable<ToolV4> parsed_tools;
+  std::vector<Special> parsed_specials; // Only used for big-endian tables
 
   // Key is used_item. We can't index on (used_item, equipped_item) because
   // equipped_item may contain wildcards, and the matching order matters.
-  mutable std::map<uint32_t, std::vector<ItemCombination>> item_combination_index;
+  std::map<uint32_t, std::vector<ItemCombination>> item_combination_index;
+
+  void parse_all_definitions();
+  template <typename SrcT, bool IsBigEndian, typename V4T>
+  void parse_table(ParsedTable<V4T>& ret, size_t root_offset, size_t num_classes) const;
 
   template <typename ToolDefT, bool IsBigEndian>
   std::pair<uint8_t, uint8_t> find_tool_by_id_t(uint32_t tool_table_offset, uint32_t id) const;
@@ -671,12 +702,13 @@ public:
   } __packed_ws__(EvolutionNumberTable, 0x53);
 
   MagEvolutionTable(std::shared_ptr<const std::string> data);
+  MagEvolutionTable(std::shared_ptr<const void> owner, std::string_view data);
   ~MagEvolutionTable() = default;
 
   uint8_t get_evolution_number(uint8_t data1_1) const;
 
 private:
-  std::shared_ptr<const std::string> data;
+  std::shared_ptr<const void> data_owner;
   StringReader r;
   const TableOffsets* offsets;
 };
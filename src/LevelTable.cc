@@ -32,7 +32,7 @@ void LevelTable::advance_to_level(PlayerStats& stats, uint32_t level, uint8_t ch
   }
 }
 
-LevelTableV2::LevelTableV2(const string& data, bool compressed) {
+LevelTableV2::LevelTableV2(string_view data, bool compressed) {
   struct Offsets {
     // TODO: The overall format of this file on V2 has much more data than we
     // actually use. What's known of the structure so far:
@@ -57,10 +57,10 @@ LevelTableV2::LevelTableV2(const string& data, bool compressed) {
   StringReader r;
   string decompressed_data;
   if (compressed) {
-    decompressed_data = prs_decompress(data);
+    decompressed_data = prs_decompress(data.data(), data.size());
     r = StringReader(decompressed_data);
   } else {
-    r = StringReader(data);
+    r = StringReader(data.data(), data.size());
   }
 
   const auto& offsets = r.pget<Offsets>(r.pget_u32l(r.size() - 0x10));
@@ -93,18 +93,18 @@ const LevelStatsDelta& LevelTableV2::stats_delta_for_level(uint8_t char_class, u
   return this->level_deltas.at(char_class).at(level);
 }
 
-LevelTableV3BE::LevelTableV3BE(const string& data, bool encrypted) {
+LevelTableV3BE::LevelTableV3BE(string_view data, bool encrypted) {
   StringReader r;
   string decompressed_data;
   if (encrypted) {
-    auto decrypted = decrypt_pr2_data<true>(data);
+    auto decrypted = decrypt_pr2_data<true>(string(data));
     decompressed_data = prs_decompress(decrypted.compressed_data);
     if (decompressed_data.size() != decrypted.decompressed_size) {
       throw runtime_error("decompressed data size does not match expected size");
     }
     r = StringReader(decompressed_data);
   } else {
-    r = StringReader(data);
+    r = StringReader(data.data(), data.size());
   }
 
   // The GC format is very simple (but everything is big-endian):
@@ -154,7 +154,7 @@ const LevelStatsDelta& LevelTableV3BE::stats_delta_for_level(uint8_t char_class,
   return this->level_deltas.at(char_class).at(level);
 }
 
-LevelTableV4::LevelTableV4(const string& data, bool compressed) {
+LevelTableV4::LevelTableV4(string_view data, bool compressed) {
   struct Offsets {
     le_uint32_t base_stats; // -> u32[12] -> CharacterStats
     le_uint32_t level_deltas; // -> u32[12] -> LevelStatsDelta[200]
@@ -163,10 +163,10 @@ LevelTableV4::LevelTableV4(const string& data, bool compressed) {
   StringReader r;
   string decompressed_data;
   if (compressed) {
-    decompressed_data = prs_decompress(data);
+    decompressed_data = prs_decompress(data.data(), data.size());
     r = StringReader(decompressed_data);
   } else {
-    r = StringReader(data);
+    r = StringReader(data.data(), data.size());
   }
 
   const auto& offsets = r.pget<Offsets>(r.pget_u32l(r.size() - 0x10));
@@ -6,6 +6,7 @@
 #include <memory>
 #include <phosg/Encoding.hh>
 #include <string>
+#include <string_view>
 
 #include "Text.hh"
 
@@ -132,7 +133,7 @@ public:
     /* 1C */
   } __packed_ws__(Level100Entry, 0x1C);
 
-  LevelTableV2(const std::string& data, bool compressed);
+  LevelTableV2(std::string_view data, bool compressed);
   virtual ~LevelTableV2() = default;
 
   virtual const CharacterStats& base_stats_for_class(uint8_t char_class) const;
@@ -149,7 +150,7 @@ private:
 
 class LevelTableV3BE : public LevelTable { // from PlyLevelTbl.cpt (GC)
 public:
-  LevelTableV3BE(const std::string& data, bool encrypted);
+  LevelTableV3BE(std::string_view data, bool encrypted);
   virtual ~LevelTableV3BE() = default;
 
   virtual const CharacterStats& base_stats_for_class(uint8_t char_class) const;
@@ -161,7 +162,7 @@ private:
 
 class LevelTableV4 : public LevelTable { // from PlyLevelTbl.prs (BB)
 public:
-  LevelTableV4(const std::string& data, bool compressed);
+  LevelTableV4(std::string_view data, bool compressed);
   virtual ~LevelTableV4() = default;
 
   virtual const CharacterStats& base_stats_for_class(uint8_t char_class) const;
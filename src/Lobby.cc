@@ -2,6 +2,7 @@
 
 #include <string.h>
 
+#include <algorithm>
 #include <phosg/Random.hh>
 
 #include "Compression.hh"
@@ -19,118 +20,191 @@ Lobby::FloorItemManager::FloorItemManager(uint32_t lobby_id, uint8_t floor)
     : log(string_printf("[Lobby:%08" PRIX32 ":FloorItems:%02hhX] ", lobby_id, floor), lobby_log.min_level),
       next_drop_number(0) {}
 
+vector<pair<uint32_t, uint32_t>>::const_iterator Lobby::FloorItemManager::index_find(uint32_t item_id) const {
+  auto it = lower_bound(this->item_id_index.begin(), this->item_id_index.end(), make_pair(item_id, static_cast<uint32_t>(0)));
+  return ((it != this->item_id_index.end()) && (it->first == item_id)) ? it : this->item_id_index.end();
+}
+
 bool Lobby::FloorItemManager::exists(uint32_t item_id) const {
-  return this->items.count(item_id);
+  return this->index_find(item_id) != this->item_id_index.end();
 }
 
-shared_ptr<Lobby::FloorItem> Lobby::FloorItemManager::find(uint32_t item_id) const {
-  return this->items.at(item_id);
+const Lobby::FloorItem& Lobby::FloorItemManager::find(uint32_t item_id) const {
+  auto it = this->index_find(item_id);
+  if (it == this->item_id_index.end()) {
+    throw out_of_range("item not present");
+  }
+  return this->slots[it->second].item;
+}
+
+void Lobby::FloorItemManager::link_for_client(uint32_t slot_index, uint8_t client_id) {
+  // Items are almost always added in increasing drop number order, but an item
+  // that was removed and put back (e.g. if the player's inventory was full)
+  // keeps its original drop number, so it may need to go before newer items
+  auto& queue = this->queue_for_client[client_id];
+  auto& slot = this->slots[slot_index];
+  uint32_t prev_index = queue.tail;
+  while ((prev_index != NO_SLOT) && (this->slots[prev_index].item.drop_number > slot.item.drop_number)) {
+    prev_index = this->slots[prev_index].prev_for_client[client_id];
+  }
+  uint32_t next_index = (prev_index == NO_SLOT) ? queue.head : this->slots[prev_index].next_for_client[client_id];
+
+  slot.prev_for_client[client_id] = prev_index;
+  slot.next_for_client[client_id] = next_index;
+  if (prev_index == NO_SLOT) {
+    queue.head = slot_index;
+  } else {
+    this->slots[prev_index].next_for_client[client_id] = slot_index;
+  }
+  if (next_index == NO_SLOT) {
+    queue.tail = slot_index;
+  } else {
+    this->slots[next_index].prev_for_client[client_id] = slot_index;
+  }
+  queue.size++;
+}
+
+void Lobby::FloorItemManager::unlink_for_client(uint32_t slot_index, uint8_t client_id) {
+  auto& queue = this->queue_for_client[client_id];
+  if (queue.size == 0) {
+    throw logic_error("item queue for client is inconsistent");
+  }
+  auto& slot = this->slots[slot_index];
+  uint32_t prev_index = slot.prev_for_client[client_id];
+  uint32_t next_index = slot.next_for_client[client_id];
+  if (prev_index == NO_SLOT) {
+    queue.head = next_index;
+  } else {
+    this->slots[prev_index].next_for_client[client_id] = next_index;
+  }
+  if (next_index == NO_SLOT) {
+    queue.tail = prev_index;
+  } else {
+    this->slots[next_index].prev_for_client[client_id] = prev_index;
+  }
+  slot.prev_for_client[client_id] = NO_SLOT;
+  slot.next_for_client[client_id] = NO_SLOT;
+  queue.size--;
 }
 
 void Lobby::FloorItemManager::add(const ItemData& item, float x, float z, uint16_t flags) {
-  auto fi = make_shared<FloorItem>();
-  fi->data = item;
-  fi->x = x;
-  fi->z = z;
-  fi->drop_number = this->next_drop_number++;
-  fi->flags = flags;
+  FloorItem fi;
+  fi.data = item;
+  fi.x = x;
+  fi.z = z;
+  fi.drop_number = this->next_drop_number++;
+  fi.flags = flags;
   this->add(fi);
 }
 
-void Lobby::FloorItemManager::add(shared_ptr<Lobby::FloorItem> fi) {
-  if (fi->flags == 0) {
+void Lobby::FloorItemManager::add(const FloorItem& fi) {
+  if (fi.flags == 0) {
     throw logic_error("floor item is not visible to any player");
   }
 
-  auto emplace_ret = this->items.emplace(fi->data.id, fi);
-  if (!emplace_ret.second) {
+  uint32_t item_id = fi.data.id;
+  auto index_it = lower_bound(this->item_id_index.begin(), this->item_id_index.end(), make_pair(item_id, static_cast<uint32_t>(0)));
+  if ((index_it != this->item_id_index.end()) && (index_it->first == item_id)) {
     throw runtime_error("floor item already exists with the same ID");
   }
+
+  uint32_t slot_index;
+  if (this->free_slot_indexes.empty()) {
+    slot_index = this->slots.size();
+    this->slots.emplace_back();
+  } else {
+    slot_index = this->free_slot_indexes.back();
+    this->free_slot_indexes.pop_back();
+  }
+  auto& slot = this->slots[slot_index];
+  slot.item = fi;
+  this->item_id_index.emplace(index_it, item_id, slot_index);
   for (size_t z = 0; z < 12; z++) {
-    if (fi->visible_to_client(z)) {
-      this->queue_for_client[z].emplace(fi->drop_number, fi);
+    if (fi.visible_to_client(z)) {
+      this->link_for_client(slot_index, z);
     }
   }
   this->log.info("Added floor item %08" PRIX32 " at %g, %g with drop number %" PRIu64 " with flags %03hX",
-      fi->data.id.load(), fi->x, fi->z, fi->drop_number, fi->flags);
+      item_id, fi.x, fi.z, fi.drop_number, fi.flags);
 }
 
-std::shared_ptr<Lobby::FloorItem> Lobby::FloorItemManager::remove(uint32_t item_id, uint8_t client_id) {
-  auto item_it = this->items.find(item_id);
-  if (item_it == this->items.end()) {
+Lobby::FloorItem Lobby::FloorItemManager::remove(uint32_t item_id, uint8_t client_id) {
+  auto index_it = this->index_find(item_id);
+  if (index_it == this->item_id_index.end()) {
     throw out_of_range("item not present");
   }
-  auto fi = item_it->second;
-  if ((client_id != 0xFF) && !fi->visible_to_client(client_id)) {
+  uint32_t slot_index = index_it->second;
+  FloorItem fi = this->slots[slot_index].item;
+  if ((client_id != 0xFF) && !fi.visible_to_client(client_id)) {
     throw runtime_error("client does not have access to item");
   }
   for (size_t z = 0; z < 12; z++) {
-    if (fi->visible_to_client(z) && !this->queue_for_client[z].erase(fi->drop_number)) {
-      throw logic_error("item queue for client is inconsistent");
+    if (fi.visible_to_client(z)) {
+      this->unlink_for_client(slot_index, z);
     }
   }
-  this->items.erase(item_it);
+  this->item_id_index.erase(index_it);
+  this->free_slot_indexes.emplace_back(slot_index);
   this->log.info("Removed floor item %08" PRIX32 " at %g, %g with drop number %" PRIu64 " with flags %03hX",
-      fi->data.id.load(), fi->x, fi->z, fi->drop_number, fi->flags);
+      item_id, fi.x, fi.z, fi.drop_number, fi.flags);
   return fi;
 }
 
-std::unordered_set<std::shared_ptr<Lobby::FloorItem>> Lobby::FloorItemManager::evict() {
-  unordered_set<shared_ptr<FloorItem>> ret;
+vector<Lobby::FloorItem> Lobby::FloorItemManager::evict() {
+  vector<FloorItem> ret;
   for (size_t z = 0; z < 12; z++) {
-    while (this->queue_for_client[z].size() > 48) {
-      ret.emplace(this->remove(this->queue_for_client[z].begin()->second->data.id, 0xFF));
+    while (this->queue_for_client[z].size > 48) {
+      ret.emplace_back(this->remove(this->slots[this->queue_for_client[z].head].item.data.id, 0xFF));
     }
   }
   this->log.info("Evicted %zu items", ret.size());
   return ret;
 }
 
-void Lobby::FloorItemManager::clear_inaccessible(uint16_t remaining_clients_mask) {
-  unordered_set<uint32_t> item_ids_to_delete;
-  for (const auto& it : this->items) {
-    if ((it.second->flags & remaining_clients_mask) == 0) {
-      item_ids_to_delete.emplace(it.first);
+void Lobby::FloorItemManager::remove_if(const char* description, function<bool(const FloorItem&)> pred) {
+  vector<uint32_t> item_ids_to_delete;
+  for (const auto& it : this->item_id_index) {
+    if (pred(this->slots[it.second].item)) {
+      item_ids_to_delete.emplace_back(it.first);
     }
   }
   for (uint32_t item_id : item_ids_to_delete) {
     this->remove(item_id, 0xFF);
   }
-  this->log.info("Deleted %zu inaccessible items", item_ids_to_delete.size());
+  this->log.info("Deleted %zu %s items", item_ids_to_delete.size(), description);
+}
+
+void Lobby::FloorItemManager::clear_inaccessible(uint16_t remaining_clients_mask) {
+  this->remove_if("inaccessible", [&](const FloorItem& fi) -> bool {
+    return (fi.flags & remaining_clients_mask) == 0;
+  });
 }
 
 void Lobby::FloorItemManager::clear_private() {
-  unordered_set<uint32_t> item_ids_to_delete;
-  for (const auto& it : this->items) {
-    if ((it.second->flags & 0x00F) != 0x00F) {
-      item_ids_to_delete.emplace(it.first);
-    }
-  }
-  for (uint32_t item_id : item_ids_to_delete) {
-    this->remove(item_id, 0xFF);
-  }
-  this->log.info("Deleted %zu private items", item_ids_to_delete.size());
+  this->remove_if("private", [](const FloorItem& fi) -> bool {
+    return (fi.flags & 0x00F) != 0x00F;
+  });
 }
 
 void Lobby::FloorItemManager::clear() {
-  size_t num_items = this->items.size();
-  this->items.clear();
+  size_t num_items = this->item_id_index.size();
+  this->slots.clear();
+  this->free_slot_indexes.clear();
+  this->item_id_index.clear();
   for (auto& queue : this->queue_for_client) {
-    queue.clear();
+    queue = ClientQueue();
   }
   this->next_drop_number = 0;
   this->log.info("Deleted %zu items", num_items);
 }
 
 uint32_t Lobby::FloorItemManager::reassign_all_item_ids(uint32_t next_item_id) {
-  ::map<uint32_t, shared_ptr<FloorItem>> old_items;
-  old_items.swap(this->items);
-  for (auto& queue : this->queue_for_client) {
-    queue.clear();
-  }
-  for (auto& it : old_items) {
-    it.second->data.id = next_item_id++;
-    this->add(it.second);
+  // Slots and eviction queues are unaffected; only the item IDs change. The
+  // items are renumbered in their existing item ID order, so the index stays
+  // sorted.
+  for (auto& it : this->item_id_index) {
+    it.first = next_item_id++;
+    this->slots[it.second].item.data.id = it.first;
   }
   return next_item_id;
 }
@@ -181,6 +255,15 @@ void Lobby::reset_next_item_ids() {
   this->next_game_item_id = 0xCC000000;
 }
 
+void Lobby::invalidate_game_menus() const {
+  if (this->is_game()) {
+    auto s = this->server_state.lock();
+    if (s) {
+      s->game_menu_generation++;
+    }
+  }
+}
+
 shared_ptr<ServerState> Lobby::require_server_state() const {
   auto s = this->server_state.lock();
   if (!s) {
@@ -210,52 +293,10 @@ void Lobby::set_drop_mode(DropMode new_mode) {
 
 void Lobby::create_item_creator() {
   auto s = this->require_server_state();
-
-  shared_ptr<const RareItemSet> rare_item_set;
-  shared_ptr<const CommonItemSet> common_item_set;
-  switch (this->base_version) {
-    case Version::PC_PATCH:
-    case Version::BB_PATCH:
-    case Version::GC_EP3_NTE:
-    case Version::GC_EP3:
-      throw runtime_error("cannot create item creator for this base version");
-    case Version::DC_NTE:
-    case Version::DC_V1_11_2000_PROTOTYPE:
-    case Version::DC_V1:
-      // TODO: We should probably have a v1 common item set at some point too
-      common_item_set = s->common_item_set_v2;
-      rare_item_set = s->rare_item_sets.at("rare-table-v1");
-      break;
-    case Version::DC_V2:
-    case Version::PC_NTE:
-    case Version::PC_V2:
-      common_item_set = s->common_item_set_v2;
-      rare_item_set = s->rare_item_sets.at("rare-table-v2");
-      break;
-    case Version::GC_NTE:
-    case Version::GC_V3:
-    case Version::XB_V3:
-      common_item_set = s->common_item_set_v3_v4;
-      rare_item_set = s->rare_item_sets.at("rare-table-v3");
-      break;
-    case Version::BB_V4:
-      common_item_set = s->common_item_set_v3_v4;
-      rare_item_set = s->rare_item_sets.at("rare-table-v4");
-      break;
-    default:
-      throw logic_error("invalid lobby base version");
-  }
-  this->item_creator = make_shared<ItemCreator>(
-      common_item_set,
-      rare_item_set,
-      s->armor_random_set,
-      s->tool_random_set,
-      s->weapon_random_sets.at(this->difficulty),
-      s->tekker_adjustment_set,
-      s->item_parameter_table(this->base_version),
-      s->item_stack_limits(this->base_version),
+  this->item_creator = s->create_item_creator(
+      this->base_version,
       this->episode,
-      (this->mode == GameMode::SOLO) ? GameMode::NORMAL : this->mode,
+      this->mode,
       this->difficulty,
       this->effective_section_id(),
       this->opt_rand_crypt,
@@ -325,7 +366,9 @@ shared_ptr<Map> Lobby::load_maps(
     uint32_t random_seed,
     shared_ptr<PSOLFGEncryption> opt_rand_crypt,
     const parray<le_uint32_t, 0x20>& variations,
-    const PrefixedLogger* log) {
+    const PrefixedLogger* log,
+    shared_ptr<MapTemplateCache> template_cache,
+    bool defer_floors) {
   auto enemy_filenames = sdt->map_filenames_for_variations(variations, episode, mode, SetDataTable::FilenameType::ENEMIES);
   auto object_filenames = sdt->map_filenames_for_variations(variations, episode, mode, SetDataTable::FilenameType::OBJECTS);
   auto event_filenames = sdt->map_filenames_for_variations(variations, episode, mode, SetDataTable::FilenameType::EVENTS);
@@ -343,7 +386,9 @@ shared_ptr<Map> Lobby::load_maps(
       rare_rates,
       random_seed,
       opt_rand_crypt,
-      log);
+      log,
+      template_cache,
+      defer_floors);
 }
 
 shared_ptr<Map> Lobby::load_maps(
@@ -360,7 +405,9 @@ shared_ptr<Map> Lobby::load_maps(
     shared_ptr<const Map::RareEnemyRates> rare_rates,
     uint32_t rare_seed,
     shared_ptr<PSOLFGEncryption> opt_rand_crypt,
-    const PrefixedLogger* log) {
+    const PrefixedLogger* log,
+    shared_ptr<MapTemplateCache> template_cache,
+    bool defer_floors) {
   auto map = make_shared<Map>(version, lobby_id, rare_seed, opt_rand_crypt);
 
   // Don't load free-roam maps in Challenge mode, since players can't go to
@@ -369,19 +416,40 @@ shared_ptr<Map> Lobby::load_maps(
     return map;
   }
 
+  // Parsed map files don't depend on the game's random seed, so they can be
+  // shared between games if a cache is given. The rare enemy rolls happen
+  // when the templates are added to the map.
+  auto get_template = [&](const string& key, const string& filename, function<void(Map::EntitiesTemplate&, const string&)> parse) -> shared_ptr<const Map::EntitiesTemplate> {
+    auto generate = [&]() -> shared_ptr<const Map::EntitiesTemplate> {
+      auto map_data = get_file_data(version, filename);
+      if (!map_data) {
+        return nullptr;
+      }
+      auto t = make_shared<Map::EntitiesTemplate>();
+      parse(*t, *map_data);
+      return t;
+    };
+    return template_cache ? template_cache->get(key, generate) : generate();
+  };
+  // If defer_floors is true, each floor's entities are only added to the map
+  // when a player first goes there (see Map::materialize_floor)
+  auto add_template = [&](size_t floor, shared_ptr<const Map::EntitiesTemplate> t) -> void {
+    if (defer_floors) {
+      map->add_entities_from_template_deferred(floor, t, rare_rates);
+    } else {
+      map->add_entities_from_template(*t, rare_rates);
+    }
+  };
+
   for (size_t floor = 0; floor < 0x12; floor++) {
     const auto& floor_enemy_filename = enemy_filenames.at(floor);
     if (!floor_enemy_filename.empty()) {
-      auto map_data = get_file_data(version, floor_enemy_filename);
-      if (map_data) {
-        map->add_enemies_from_map_data(
-            episode,
-            difficulty,
-            event,
-            floor,
-            map_data->data(),
-            map_data->size(),
-            rare_rates);
+      string key = string_printf("%s:enemies:%s:%hhu:%hhu:%02zX:%s", name_for_enum(version), name_for_episode(episode), difficulty, event, floor, floor_enemy_filename.c_str());
+      auto t = get_template(key, floor_enemy_filename, [&](Map::EntitiesTemplate& parsed, const string& data) -> void {
+        parsed.add_enemies_from_map_data(version, episode, difficulty, event, floor, data.data(), data.size(), map->log);
+      });
+      if (t) {
+        add_template(floor, t);
         if (log) {
           log->info("Loaded enemies map %s for floor %02zX", floor_enemy_filename.c_str(), floor);
         }
@@ -394,9 +462,12 @@ shared_ptr<Map> Lobby::load_maps(
 
     const auto& floor_object_filename = object_filenames.at(floor);
     if (!floor_object_filename.empty()) {
-      auto map_data = get_file_data(version, floor_object_filename);
-      if (map_data) {
-        map->add_objects_from_map_data(floor, map_data->data(), map_data->size());
+      string key = string_printf("%s:objects:%02zX:%s", name_for_enum(version), floor, floor_object_filename.c_str());
+      auto t = get_template(key, floor_object_filename, [&](Map::EntitiesTemplate& parsed, const string& data) -> void {
+        parsed.add_objects_from_map_data(floor, data.data(), data.size());
+      });
+      if (t) {
+        add_template(floor, t);
         if (log) {
           log->info("Loaded objects map %s for floor %02zX", floor_object_filename.c_str(), floor);
         }
@@ -409,9 +480,12 @@ shared_ptr<Map> Lobby::load_maps(
 
     const auto& floor_event_filename = event_filenames.at(floor);
     if (!floor_event_filename.empty()) {
-      auto map_data = get_file_data(version, floor_event_filename);
-      if (map_data) {
-        map->add_events_from_map_data(floor, map_data->data(), map_data->size());
+      string key = string_printf("%s:events:%02zX:%s", name_for_enum(version), floor, floor_event_filename.c_str());
+      auto t = get_template(key, floor_event_filename, [&](Map::EntitiesTemplate& parsed, const string& data) -> void {
+        parsed.add_events_from_map_data(floor, data.data(), data.size());
+      });
+      if (t) {
+        add_template(floor, t);
         if (log) {
           log->info("Loaded events map %s for floor %02zX", floor_event_filename.c_str(), floor);
         }
@@ -423,6 +497,10 @@ shared_ptr<Map> Lobby::load_maps(
     }
   }
 
+  // All players start on Pioneer 2 (or Lab), so there's no reason to defer
+  // floor 0
+  map->materialize_floor(0);
+
   return map;
 }
 
@@ -438,7 +516,8 @@ void Lobby::load_maps() {
     }
 
     auto vq = this->quest->version(this->base_version, leader_c->language());
-    if (!vq->dat_contents_decompressed) {
+    auto dat_contents_decompressed = vq->dat_contents_decompressed();
+    if (!dat_contents_decompressed) {
       throw runtime_error("quest does not have DAT data");
     }
     this->map = this->load_maps(
@@ -450,7 +529,7 @@ void Lobby::load_maps() {
         rare_rates,
         this->random_seed,
         this->opt_rand_crypt,
-        vq->dat_contents_decompressed);
+        dat_contents_decompressed);
 
   } else if (this->mode != GameMode::CHALLENGE) {
     auto s = this->require_server_state();
@@ -467,7 +546,9 @@ void Lobby::load_maps() {
         this->random_seed,
         this->opt_rand_crypt,
         this->variations,
-        &this->log);
+        &this->log,
+        s->map_template_cache,
+        s->defer_map_floors);
 
   } else {
     this->map = make_shared<Map>(this->base_version, this->lobby_id, this->random_seed, this->opt_rand_crypt);
@@ -607,6 +688,12 @@ void Lobby::add_client(shared_ptr<Client> c, ssize_t required_client_id) {
   c->lobby_client_id = index;
   c->lobby = this->weak_from_this();
   c->lobby_arrow_color = 0;
+  auto s = this->server_state.lock();
+  if (s) {
+    s->update_client_index(c);
+    s->update_public_lobby_free_positions(this->shared_from_this());
+  }
+  this->invalidate_game_menus();
 
   // If there's no one else in the lobby, set the leader id as well
   size_t leader_index;
@@ -688,6 +775,13 @@ void Lobby::remove_client(shared_ptr<Client> c) {
         static_cast<uint8_t>(other_c ? other_c->lobby_client_id : 0xFF)));
   }
   this->clients[c->lobby_client_id] = nullptr;
+  {
+    auto s = this->server_state.lock();
+    if (s) {
+      s->update_public_lobby_free_positions(this->shared_from_this());
+    }
+  }
+  this->invalidate_game_menus();
 
   // Unassign the client's lobby if it matches the current lobby (it may not
   // match if the client was already added to another lobby - this can happen
@@ -696,6 +790,10 @@ void Lobby::remove_client(shared_ptr<Client> c) {
     auto c_lobby = c->lobby.lock();
     if (c_lobby.get() == this) {
       c->lobby.reset();
+      auto s = this->server_state.lock();
+      if (s) {
+        s->update_client_index(c);
+      }
     }
   }
 
@@ -773,23 +871,6 @@ void Lobby::move_client_to_lobby(
   dest_lobby->add_client(c, required_client_id);
 }
 
-shared_ptr<Client> Lobby::find_client(const string* identifier, uint64_t account_id) {
-  for (size_t x = 0; x < this->max_clients; x++) {
-    auto lc = this->clients[x];
-    if (!lc) {
-      continue;
-    }
-    if (account_id && lc->login && (lc->login->account->account_id == account_id)) {
-      return lc;
-    }
-    if (identifier && (lc->character()->disp.name.eq(*identifier, lc->language()))) {
-      return lc;
-    }
-  }
-
-  throw out_of_range("client not found");
-}
-
 Lobby::JoinError Lobby::join_error_for_client(std::shared_ptr<Client> c, const std::string* password) const {
   if (this->count_clients() >= this->max_clients) {
     return JoinError::FULL;
@@ -852,7 +933,7 @@ bool Lobby::item_exists(uint8_t floor, uint32_t item_id) const {
   return this->floor_item_managers.at(floor).exists(item_id);
 }
 
-shared_ptr<Lobby::FloorItem> Lobby::find_item(uint8_t floor, uint32_t item_id) const {
+const Lobby::FloorItem& Lobby::find_item(uint8_t floor, uint32_t item_id) const {
   return this->floor_item_managers.at(floor).find(item_id);
 }
 
@@ -862,7 +943,7 @@ void Lobby::add_item(uint8_t floor, const ItemData& data, float x, float z, uint
   this->evict_items_from_floor(floor);
 }
 
-void Lobby::add_item(uint8_t floor, shared_ptr<FloorItem> fi) {
+void Lobby::add_item(uint8_t floor, const FloorItem& fi) {
   auto& m = this->floor_item_managers.at(floor);
   m.add(fi);
   this->evict_items_from_floor(floor);
@@ -876,15 +957,15 @@ void Lobby::evict_items_from_floor(uint8_t floor) {
     for (const auto& fi : evicted) {
       for (size_t z = 0; z < 12; z++) {
         auto lc = this->clients[z];
-        if (lc && fi->visible_to_client(z)) {
-          send_destroy_floor_item_to_client(lc, fi->data.id, floor);
+        if (lc && fi.visible_to_client(z)) {
+          send_destroy_floor_item_to_client(lc, fi.data.id, floor);
         }
       }
     }
   }
 }
 
-shared_ptr<Lobby::FloorItem> Lobby::remove_item(uint8_t floor, uint32_t item_id, uint8_t requesting_client_id) {
+Lobby::FloorItem Lobby::remove_item(uint8_t floor, uint32_t item_id, uint8_t requesting_client_id) {
   return this->floor_item_managers.at(floor).remove(item_id, requesting_client_id);
 }
 
@@ -4,6 +4,7 @@
 #include <inttypes.h>
 
 #include <array>
+#include <functional>
 #include <memory>
 #include <phosg/Encoding.hh>
 #include <random>
@@ -39,27 +40,63 @@ struct Lobby : public std::enable_shared_from_this<Lobby> {
 
     bool visible_to_client(uint8_t client_id) const;
   };
+  // Floor items are stored in a flat array of slots, so dropping an item
+  // doesn't allocate anything once the array has grown to the floor's peak
+  // item count. Slots are found by item ID through a sorted index, and each
+  // client's eviction queue is an intrusive list (in drop number order)
+  // threaded through the slots themselves.
   struct FloorItemManager {
     PrefixedLogger log;
     uint64_t next_drop_number;
-    // It's important that this is a map and not an unordered_map. See the
-    // comment in send_game_item_state for more details.
-    std::map<uint32_t, std::shared_ptr<FloorItem>> items; // Keyed on item_id
-    std::array<std::map<uint64_t, std::shared_ptr<FloorItem>>, 12> queue_for_client;
 
     FloorItemManager(uint32_t lobby_id, uint8_t floor);
     ~FloorItemManager() = default;
 
     bool exists(uint32_t item_id) const;
-    std::shared_ptr<FloorItem> find(uint32_t item_id) const;
+    const FloorItem& find(uint32_t item_id) const;
     void add(const ItemData& item, float x, float z, uint16_t flags);
-    void add(std::shared_ptr<FloorItem> fi);
-    std::shared_ptr<FloorItem> remove(uint32_t item_id, uint8_t client_id);
-    std::unordered_set<std::shared_ptr<FloorItem>> evict();
+    void add(const FloorItem& fi);
+    FloorItem remove(uint32_t item_id, uint8_t client_id);
+    std::vector<FloorItem> evict();
     void clear_inaccessible(uint16_t remaining_clients_mask);
     void clear_private();
     void clear();
     uint32_t reassign_all_item_ids(uint32_t next_item_id);
+
+    inline size_t size() const {
+      return this->item_id_index.size();
+    }
+    // Calls fn for each item on the floor, in increasing order of item ID. It's
+    // important that send_game_item_state sees items in this order; see the
+    // comment there for more details. fn must not add or remove items.
+    template <typename FnT>
+    void for_each(FnT&& fn) const {
+      for (const auto& it : this->item_id_index) {
+        fn(this->slots[it.second].item);
+      }
+    }
+
+  private:
+    static constexpr uint32_t NO_SLOT = 0xFFFFFFFF;
+    struct Slot {
+      FloorItem item;
+      uint32_t prev_for_client[12];
+      uint32_t next_for_client[12];
+    };
+    struct ClientQueue {
+      uint32_t head = NO_SLOT; // Oldest item (lowest drop number)
+      uint32_t tail = NO_SLOT; // Newest item (highest drop number)
+      size_t size = 0;
+    };
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_slot_indexes;
+    std::vector<std::pair<uint32_t, uint32_t>> item_id_index; // (item_id, slot index), sorted by item_id
+    std::array<ClientQueue, 12> queue_for_client;
+
+    std::vector<std::pair<uint32_t, uint32_t>>::const_iterator index_find(uint32_t item_id) const;
+    void link_for_client(uint32_t slot_index, uint8_t client_id);
+    void unlink_for_client(uint32_t slot_index, uint8_t client_id);
+    void remove_if(const char* description, std::function<bool(const FloorItem&)> pred);
   };
   enum class Flag {
     // clang-format off
@@ -195,13 +232,20 @@ struct Lobby : public std::enable_shared_from_this<Lobby> {
   }
   inline void set_flag(Flag flag) {
     this->enabled_flags |= static_cast<uint32_t>(flag);
+    this->invalidate_game_menus();
   }
   inline void clear_flag(Flag flag) {
     this->enabled_flags &= (~static_cast<uint32_t>(flag));
+    this->invalidate_game_menus();
   }
   inline void toggle_flag(Flag flag) {
     this->enabled_flags ^= static_cast<uint32_t>(flag);
+    this->invalidate_game_menus();
   }
+  // Must be called when anything that appears in this game's game menu entry
+  // changes (name, password, player count, flags, etc.), so that cached game
+  // menus aren't sent to clients after the change. Does nothing for lobbies.
+  void invalidate_game_menus() const;
 
   std::shared_ptr<ServerState> require_server_state() const;
   std::shared_ptr<ChallengeParameters> require_challenge_params() const;
@@ -232,7 +276,9 @@ struct Lobby : public std::enable_shared_from_this<Lobby> {
       uint32_t random_seed,
       std::shared_ptr<PSOLFGEncryption> opt_rand_crypt,
       const parray<le_uint32_t, 0x20>& variations,
-      const PrefixedLogger* log = nullptr);
+      const PrefixedLogger* log = nullptr,
+      std::shared_ptr<MapTemplateCache> template_cache = nullptr,
+      bool defer_floors = false);
   static std::shared_ptr<Map> load_maps(
       const std::vector<std::string>& enemy_filenames,
       const std::vector<std::string>& object_filenames,
@@ -247,7 +293,9 @@ struct Lobby : public std::enable_shared_from_this<Lobby> {
       std::shared_ptr<const Map::RareEnemyRates> rare_rates,
       uint32_t random_seed,
       std::shared_ptr<PSOLFGEncryption> opt_rand_crypt,
-      const PrefixedLogger* log = nullptr);
+      const PrefixedLogger* log = nullptr,
+      std::shared_ptr<MapTemplateCache> template_cache = nullptr,
+      bool defer_floors = false);
   void load_maps();
   void create_ep3_server();
 
@@ -278,8 +326,6 @@ struct Lobby : public std::enable_shared_from_this<Lobby> {
       std::shared_ptr<Client> c,
       ssize_t required_client_id = -1);
 
-  std::shared_ptr<Client> find_client(const std::string* identifier = nullptr, uint64_t account_id = 0);
-
   enum class JoinError {
     ALLOWED = 0,
     FULL,
@@ -297,11 +343,11 @@ struct Lobby : public std::enable_shared_from_this<Lobby> {
   JoinError join_error_for_client(std::shared_ptr<Client> c, const std::string* password) const;
 
   bool item_exists(uint8_t floor, uint32_t item_id) const;
-  std::shared_ptr<FloorItem> find_item(uint8_t floor, uint32_t item_id) const;
+  const FloorItem& find_item(uint8_t floor, uint32_t item_id) const;
   void add_item(uint8_t floor, const ItemData& item, float x, float z, uint16_t flags);
-  void add_item(uint8_t floor, std::shared_ptr<FloorItem>);
+  void add_item(uint8_t floor, const FloorItem& fi);
   void evict_items_from_floor(uint8_t floor);
-  std::shared_ptr<FloorItem> remove_item(uint8_t floor, uint32_t item_id, uint8_t requesting_client_id);
+  FloorItem remove_item(uint8_t floor, uint32_t item_id, uint8_t requesting_client_id);
 
   uint32_t generate_item_id(uint8_t client_id);
   void on_item_id_generated_externally(uint32_t item_id);
@@ -2,9 +2,12 @@
 #include <event2/thread.h>
 #include <pwd.h>
 #include <signal.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
 #include <mutex>
+#include <new>
 #include <phosg/Arguments.hh>
 #include <phosg/Filesystem.hh>
 #include <phosg/JSON.hh>
@@ -15,6 +18,7 @@
 #include <set>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
 #ifdef HAVE_RESOURCE_FILE
 #include "AddressTranslator.hh"
@@ -26,6 +30,7 @@
 #include "Compression.hh"
 #include "DCSerialNumbers.hh"
 #include "DNSServer.hh"
+#include "DropSimulation.hh"
 #include "GSLArchive.hh"
 #include "GVMEncoder.hh"
 #include "HTTPServer.hh"
@@ -53,6 +58,50 @@ using namespace std;
 
 bool use_terminal_colors = false;
 
+#ifdef NEWSERV_COUNT_ALLOCATIONS
+// bench-game-create reports how many allocations each step of game creation
+// makes. The count is per-thread, so it's cheap to maintain and benchmark
+// threads don't see each other's allocations. This replaces the global
+// allocation functions, which interferes with sanitizers and malloc
+// replacements, so it's only enabled in builds made specifically for
+// benchmarking (cmake -DNEWSERV_COUNT_ALLOCATIONS=ON).
+static constexpr bool COUNT_ALLOCATIONS = true;
+static thread_local uint64_t num_allocations_on_this_thread = 0;
+
+void* operator new(size_t size) {
+  num_allocations_on_this_thread++;
+  for (;;) {
+    void* ret = malloc(size ? size : 1);
+    if (ret) {
+      return ret;
+    }
+    auto handler = get_new_handler();
+    if (!handler) {
+      throw bad_alloc();
+    }
+    handler();
+  }
+}
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+#else
+static constexpr bool COUNT_ALLOCATIONS = false;
+static thread_local uint64_t num_allocations_on_this_thread = 0;
+#endif
+
 void print_version_info();
 void print_usage();
 
@@ -1132,14 +1181,14 @@ Action a_encode_qst(
       string pvr_filename = ends_with(bin_filename, ".bin")
           ? (bin_filename.substr(0, bin_filename.size() - 3) + "pvr")
           : (bin_filename + ".pvr");
-      auto bin_data = make_shared<string>(load_file(bin_filename));
-      auto dat_data = make_shared<string>(load_file(dat_filename));
-      shared_ptr<string> pvr_data;
+      auto bin_source = QuestFileSource::from_data(make_shared<string>(load_file(bin_filename)));
+      auto dat_source = QuestFileSource::from_data(make_shared<string>(load_file(dat_filename)));
+      shared_ptr<const QuestFileSource> pvr_source;
       try {
-        pvr_data = make_shared<string>(load_file(pvr_filename));
+        pvr_source = QuestFileSource::from_data(make_shared<string>(load_file(pvr_filename)));
       } catch (const cannot_open_file&) {
       }
-      auto vq = make_shared<VersionedQuest>(0, 0, version, 0, bin_data, dat_data, pvr_data);
+      auto vq = make_shared<VersionedQuest>(0, 0, version, 0, bin_source, dat_source, pvr_source);
       if (download) {
         vq = vq->create_download_quest();
       }
@@ -1793,6 +1842,36 @@ Action a_print_item_parameter_tables(
       }
     });
 
+Action a_build_data_snapshot(
+    "build-data-snapshot", "\
+  build-data-snapshot [OUTPUT-FILENAME]\n\
+    Decode all of the static game data files that are decoded at startup time\n\
+    (item definitions, level tables, text sets, etc.) and save the results in a\n\
+    single file, which the server will then use at startup time instead of\n\
+    decoding the source files again. If OUTPUT-FILENAME is not given, the\n\
+    snapshot is written to the path given by DataSnapshotFile in config.json\n\
+    (by default, system/data-snapshot.bin). Entries in the snapshot whose\n\
+    source files have changed are ignored, so there is no need to delete the\n\
+    snapshot after modifying the source files, but it should be rebuilt to\n\
+    regain the startup time benefit.\n",
+    +[](Arguments& args) {
+      auto s = make_shared<ServerState>(get_config_filename(args));
+      s->load_config_early();
+      s->data_snapshot_builder = make_shared<DataSnapshot::Builder>();
+      s->load_patch_indexes(false);
+      s->load_level_tables(false);
+      s->load_item_definitions(false);
+      s->load_text_index(false);
+      s->load_word_select_table(false);
+
+      string output_filename = args.get<string>(1, false);
+      if (output_filename.empty()) {
+        output_filename = s->data_snapshot_filename;
+      }
+      s->data_snapshot_builder->save(output_filename);
+      log_info("Saved %zu entries to %s", s->data_snapshot_builder->num_entries(), output_filename.c_str());
+    });
+
 Action a_show_ep3_cards(
     "show-ep3-cards", "\
   show-ep3-cards\n\
@@ -2059,6 +2138,84 @@ Action a_show_battle_params(
       s->battle_params->get_table(true, Episode::EP4).print(stdout);
     });
 
+Action a_simulate_drops(
+    "simulate-drops", "\
+  simulate-drops OPTIONS...\n\
+    Generate many item drops and show how often each item appears. A version\n\
+    option (e.g. --bb) and an episode option (--ep1, --ep2, or --ep4) are\n\
+    required. A difficulty option (--hard, --very-hard, or --ultimate) and a\n\
+    mode option (--battle, --challenge, or --solo) may also be given. Options:\n\
+      --section-id=NAME: Section ID to simulate drops for (default Viridia).\n\
+      --area=NUMBER: Floor number to simulate drops on (default 1).\n\
+      --enemy=TYPE: Simulate drops from this enemy type (e.g. --enemy=HILDEBEAR)\n\
+          instead of from boxes.\n\
+      --rare-table=NAME: Use this rare table (e.g. --rare-table=rare-table-v4)\n\
+          instead of the version\'s default rare table.\n\
+      --rare-rate-multiplier=FACTOR: Multiply all rare rates by FACTOR.\n\
+      --drops=COUNT: Number of drops to generate (default 1000000).\n\
+      --threads=COUNT: Number of threads to use (default one per CPU core).\n\
+      --seed=SEED: Random seed (hex; default 0). The results depend only on\n\
+          the seed and the above options, not on the number of threads.\n\
+      --json: Write the results as JSON instead of as a table.\n",
+    +[](Arguments& args) {
+      auto version = get_cli_version(args);
+      auto episode = get_cli_episode(args);
+      auto difficulty = get_cli_difficulty(args);
+      auto mode = get_cli_game_mode(args);
+      uint8_t section_id = 0;
+      string section_id_name = args.get<string>("section-id", false);
+      if (!section_id_name.empty()) {
+        section_id = section_id_for_name(section_id_name);
+        if (section_id == 0xFF) {
+          throw runtime_error("invalid section ID");
+        }
+      }
+
+      DropSimulationOptions options;
+      options.area = args.get<uint8_t>("area", 1);
+      string enemy_name = args.get<string>("enemy", false);
+      if (!enemy_name.empty()) {
+        options.rt_index = rare_table_index_for_enemy_type(enum_for_name<EnemyType>(enemy_name.c_str()));
+      }
+      options.num_drops = args.get<uint64_t>("drops", 1000000);
+      options.num_threads = args.get<size_t>("threads", 0);
+      string seed_str = args.get<string>("seed", false);
+      options.seed = seed_str.empty() ? 0 : stoul(seed_str, nullptr, 16);
+
+      auto s = make_shared<ServerState>(get_config_filename(args));
+      s->load_config_early();
+      s->load_patch_indexes(false);
+      s->load_text_index(false);
+      s->load_item_definitions(false);
+      s->load_item_name_indexes(false);
+      s->load_drop_tables(false);
+
+      shared_ptr<const RareItemSet> rare_item_set;
+      string rare_table_name = args.get<string>("rare-table", false);
+      if (!rare_table_name.empty()) {
+        rare_item_set = s->rare_item_sets.at(rare_table_name);
+      }
+      double rate_factor = args.get<double>("rare-rate-multiplier", 1.0);
+      if (rate_factor != 1.0) {
+        if (!rare_item_set) {
+          rare_item_set = s->create_item_creator(version, episode, mode, difficulty, section_id, nullptr)->get_rare_item_set();
+        }
+        auto multiplied_set = make_shared<RareItemSet>(*rare_item_set);
+        multiplied_set->multiply_all_rates(rate_factor);
+        rare_item_set = multiplied_set;
+      }
+
+      auto prototype = s->create_item_creator(version, episode, mode, difficulty, section_id, nullptr, nullptr, rare_item_set);
+      auto result = simulate_drops(*prototype, options);
+      if (args.get<bool>("json")) {
+        string data = result.json(s->item_name_index_opt(version)).serialize(JSON::SerializeOption::FORMAT);
+        fwritex(stdout, data);
+        fputc('\n', stdout);
+      } else {
+        result.print(stdout, s->item_name_index_opt(version));
+      }
+    });
+
 Action a_find_rare_enemy_seeds(
     "find-rare-enemy-seeds", "\
   find-rare-enemy-seeds OPTIONS...\n\
@@ -2084,6 +2241,7 @@ Action a_find_rare_enemy_seeds(
 
       auto s = make_shared<ServerState>(get_config_filename(args));
       shared_ptr<const VersionedQuest> vq;
+      shared_ptr<const string> quest_dat_contents_decompressed;
       if (!quest_name.empty()) {
         s->load_config_early();
         s->load_quest_index(false);
@@ -2095,6 +2253,10 @@ Action a_find_rare_enemy_seeds(
         if (!vq) {
           throw runtime_error("quest version does not exist");
         }
+        quest_dat_contents_decompressed = vq->dat_contents_decompressed();
+        if (!quest_dat_contents_decompressed) {
+          throw runtime_error("quest does not have DAT data");
+        }
       } else if (version == Version::BB_V4) {
         s->load_config_early();
       } else if (version == Version::PC_V2) {
@@ -2112,52 +2274,58 @@ Action a_find_rare_enemy_seeds(
         rare_rates = s->rare_enemy_rates_by_difficulty[difficulty];
       }
 
+      // Parsing the maps and generating the variations for every seed would
+      // take days, so we parse the maps once and only compute the rare rolls
+      // for each seed. This isn't possible for quests with random enemies,
+      // since the enemies themselves depend on the seed; for those, we have to
+      // generate the entire map for each seed.
+      unique_ptr<RareEnemySeedEvaluator> evaluator;
+      if (vq) {
+        try {
+          evaluator = make_unique<RareEnemySeedEvaluator>(
+              version, episode, difficulty, 0, *quest_dat_contents_decompressed, rare_rates);
+        } catch (const exception& e) {
+          log_warning("Cannot precompute rare enemies for this quest (%s); generating full maps instead", e.what());
+        }
+      } else {
+        evaluator = make_unique<RareEnemySeedEvaluator>(
+            version,
+            episode,
+            mode,
+            difficulty,
+            0,
+            s->set_data_table(version, episode, mode, difficulty),
+            bind(&ServerState::load_map_file, s.get(), placeholders::_1, placeholders::_2),
+            rare_rates);
+      }
+
       mutex output_lock;
+      auto print_result = [&](uint64_t seed, const vector<RareEnemySeedEvaluator::RareEnemy>& rares) -> void {
+        lock_guard g(output_lock);
+        fprintf(stdout, "%08" PRIX64 ":", seed);
+        for (const auto& rare : rares) {
+          fprintf(stdout, " E-%zX:%s", rare.enemy_index, name_for_enum(rare.type));
+        }
+        fprintf(stdout, "\n");
+      };
       auto thread_fn = [&](uint64_t seed, size_t) -> bool {
-        auto random_crypt = make_shared<PSOV2Encryption>(seed);
-        parray<le_uint32_t, 0x20> variations;
-
-        shared_ptr<Map> map;
-        if (vq) {
-          if (!vq->dat_contents_decompressed) {
-            throw runtime_error("quest does not have DAT data");
-          }
-          map = Lobby::load_maps(
-              version, episode, difficulty, 0, 0, rare_rates, seed, random_crypt, vq->dat_contents_decompressed);
-
+        thread_local vector<RareEnemySeedEvaluator::RareEnemy> rares;
+        if (evaluator) {
+          evaluator->evaluate(rares, seed);
         } else {
-          generate_variations_deprecated(variations, random_crypt, version, episode, (mode == GameMode::SOLO));
-          map = Lobby::load_maps(
-              version,
-              episode,
-              mode,
-              difficulty,
-              0,
-              0,
-              s->set_data_table(version, episode, mode, difficulty),
-              bind(&ServerState::load_map_file, s.get(), placeholders::_1, placeholders::_2),
-              rare_rates,
-              seed,
-              random_crypt,
-              variations);
-        }
-
-        vector<size_t> rare_indexes;
-        for (size_t z = 0; z < map->enemies.size(); z++) {
-          if (enemy_type_is_rare(map->enemies[z].type)) {
-            rare_indexes.emplace_back(z);
+          auto random_crypt = make_shared<PSOV2Encryption>(seed);
+          auto map = Lobby::load_maps(
+              version, episode, difficulty, 0, 0, rare_rates, seed, random_crypt, quest_dat_contents_decompressed);
+          rares.clear();
+          for (size_t z = 0; z < map->enemies.size(); z++) {
+            if (enemy_type_is_rare(map->enemies[z].type)) {
+              rares.emplace_back(RareEnemySeedEvaluator::RareEnemy{z, map->enemies[z].type});
+            }
           }
         }
-
-        if (rare_indexes.size() >= min_count) {
-          lock_guard g(output_lock);
-          fprintf(stdout, "%08" PRIX64 ":", seed);
-          for (size_t index : rare_indexes) {
-            fprintf(stdout, " E-%zX:%s", index, name_for_enum(map->enemies[index].type));
-          }
-          fprintf(stdout, "\n");
+        if (rares.size() >= min_count) {
+          print_result(seed, rares);
         }
-
         return false;
       };
 
@@ -2265,7 +2433,7 @@ Action a_load_maps_test(
               Map::DEFAULT_RARE_ENEMIES,
               0,
               nullptr,
-              vq->dat_contents_decompressed);
+              vq->dat_contents_decompressed());
           fprintf(stderr, "... %" PRIu32 " (%s) %s %s %s => %zu enemies (%zu sets), %zu objects, %zu events\n",
               vq->quest_number,
               vq->name.c_str(),
@@ -2280,6 +2448,449 @@ Action a_load_maps_test(
       }
     });
 
+Action a_drop_tables_test(
+    "drop-tables-test", nullptr, +[](Arguments& args) {
+      auto s = make_shared<ServerState>(get_config_filename(args));
+      s->load_config_early();
+      s->load_patch_indexes(false);
+      s->load_text_index(false);
+      s->load_item_definitions(false);
+      s->load_item_name_indexes(false);
+      s->load_drop_tables(false);
+
+      // Check that every precomputed weighted table chooses the same index as
+      // the client's linear walk for every possible random value
+      auto check_table = [&]<typename IntT>(const char* name, const IntT* weights, size_t num_values, size_t stride, const WeightedIndexTable& table) -> void {
+        uint64_t total = 0;
+        for (size_t z = 0; z < num_values; z++) {
+          total += weights[z * stride];
+        }
+        if (table.total() != total) {
+          throw runtime_error(string_printf("%s: total is incorrect (expected %" PRIu64 ", received %" PRIu64 ")", name, total, table.total()));
+        }
+        for (uint64_t value = 0; value < total; value++) {
+          uint64_t x = value;
+          size_t expected_index = 0;
+          while (x >= weights[expected_index * stride]) {
+            x -= weights[expected_index * stride];
+            expected_index++;
+          }
+          size_t index = table.index_for_value(value);
+          if (index != expected_index) {
+            throw runtime_error(string_printf("%s: incorrect index for %" PRIu64 " (expected %zu, received %zu)", name, value, expected_index, index));
+          }
+        }
+      };
+      auto check_columns = [&]<typename IntT, size_t X, size_t Y>(const char* name, const parray<parray<IntT, X>, Y>& weights, const array<WeightedIndexTable, X>& tables) -> void {
+        for (size_t x = 0; x < X; x++) {
+          check_table(name, weights[0].data() + x, Y, X, tables[x]);
+        }
+      };
+
+      const array<Episode, 3> episodes = {Episode::EP1, Episode::EP2, Episode::EP4};
+      const array<GameMode, 4> modes = {GameMode::NORMAL, GameMode::BATTLE, GameMode::CHALLENGE, GameMode::SOLO};
+      for (const auto& item_set : {s->common_item_set_v2, s->common_item_set_v3_v4}) {
+        unordered_set<const CommonItemSet::Table*> checked_tables;
+        for (Episode episode : episodes) {
+          for (GameMode mode : modes) {
+            for (uint8_t difficulty = 0; difficulty < 4; difficulty++) {
+              for (uint8_t section_id = 0; section_id < 10; section_id++) {
+                shared_ptr<const CommonItemSet::Table> table;
+                try {
+                  table = item_set->get_table(episode, mode, difficulty, section_id);
+                } catch (const runtime_error&) {
+                  continue;
+                }
+                if (!checked_tables.emplace(table.get()).second) {
+                  continue;
+                }
+                fprintf(stderr, "... %s %s %s %s\n",
+                    name_for_episode(episode), name_for_mode(mode), name_for_difficulty(difficulty), name_for_section_id(section_id));
+                check_table("armor_shield_type_index", table->armor_shield_type_index_prob_table.data(),
+                    table->armor_shield_type_index_prob_table.size(), 1, table->armor_shield_type_index_weights);
+                check_table("armor_slot_count", table->armor_slot_count_prob_table.data(),
+                    table->armor_slot_count_prob_table.size(), 1, table->armor_slot_count_weights);
+                for (size_t area_norm = 0; area_norm < table->base_weapon_type_weights.size(); area_norm++) {
+                  auto weapon_type_prob_table = table->weapon_type_prob_table(area_norm);
+                  check_table("base_weapon_type", weapon_type_prob_table.data(), weapon_type_prob_table.size(), 1,
+                      table->base_weapon_type_weights[area_norm]);
+                }
+                check_columns("grind", table->grind_prob_table, table->grind_weights);
+                check_columns("bonus_value", table->bonus_value_prob_table, table->bonus_value_weights);
+                check_columns("bonus_type", table->bonus_type_prob_table, table->bonus_type_weights);
+                check_columns("tool_class", table->tool_class_prob_table, table->tool_class_weights);
+                check_columns("technique_index", table->technique_index_prob_table, table->technique_index_weights);
+                check_columns("box_item_class", table->box_item_class_prob_table, table->box_item_class_weights);
+              }
+            }
+          }
+        }
+      }
+
+      // Check that real drops are the same when the item creator uses the
+      // precomputed weights and when it uses the original linear walk, and
+      // that both consume the same amount of the random stream
+      static constexpr size_t DROPS_PER_AREA = 200;
+      const array<Version, 2> versions = {Version::PC_V2, Version::BB_V4};
+      for (Version version : versions) {
+        for (Episode episode : episodes) {
+          vector<uint8_t> areas;
+          switch (episode) {
+            case Episode::EP1:
+              for (uint8_t area = 0x01; area < 0x0F; area++) {
+                areas.emplace_back(area);
+              }
+              break;
+            case Episode::EP2:
+              for (uint8_t area = 0x13; area < 0x24; area++) {
+                areas.emplace_back(area);
+              }
+              break;
+            case Episode::EP4:
+              for (uint8_t area = 0x24; area < 0x2D; area++) {
+                areas.emplace_back(area);
+              }
+              break;
+            default:
+              throw logic_error("invalid episode");
+          }
+
+          for (GameMode mode : modes) {
+            for (uint8_t difficulty = 0; difficulty < 4; difficulty++) {
+              for (uint8_t section_id = 0; section_id < 10; section_id++) {
+                uint32_t seed = (static_cast<uint32_t>(version) << 24) | (static_cast<uint32_t>(episode) << 16) |
+                    (static_cast<uint32_t>(mode) << 8) | (difficulty << 4) | section_id;
+                auto fast_crypt = make_shared<PSOV2Encryption>(seed);
+                auto slow_crypt = make_shared<PSOV2Encryption>(seed);
+                shared_ptr<ItemCreator> fast_creator;
+                shared_ptr<ItemCreator> slow_creator;
+                try {
+                  fast_creator = s->create_item_creator(version, episode, mode, difficulty, section_id, nullptr);
+                  slow_creator = s->create_item_creator(version, episode, mode, difficulty, section_id, nullptr);
+                } catch (const runtime_error&) {
+                  continue;
+                }
+                fprintf(stderr, "... %s %s %s %s %s (seed %08" PRIX32 ")\n",
+                    name_for_enum(version), name_for_episode(episode), name_for_mode(mode), name_for_difficulty(difficulty),
+                    name_for_section_id(section_id), seed);
+                fast_creator->set_log_level(LogLevel::WARNING);
+                slow_creator->set_log_level(LogLevel::WARNING);
+                fast_creator->set_random_crypt(fast_crypt);
+                slow_creator->set_random_crypt(slow_crypt);
+                slow_creator->set_use_precomputed_weights(false);
+
+                auto check_result = [&](const char* type, uint8_t area, size_t z, const ItemCreator::DropResult& fast_res, const ItemCreator::DropResult& slow_res) -> void {
+                  if ((fast_res.item != slow_res.item) || (fast_res.is_from_rare_table != slow_res.is_from_rare_table)) {
+                    throw runtime_error(string_printf("%s drop %zu in area %02hhX is incorrect (expected %s%s, received %s%s)",
+                        type, z, area, slow_res.item.hex().c_str(), slow_res.is_from_rare_table ? " (rare)" : "",
+                        fast_res.item.hex().c_str(), fast_res.is_from_rare_table ? " (rare)" : ""));
+                  }
+                };
+                for (uint8_t area : areas) {
+                  for (size_t z = 0; z < DROPS_PER_AREA; z++) {
+                    // Cycle through all the rare table indexes so that rare
+                    // drops (and their bonuses) are exercised too
+                    uint32_t rt_index = z % 0x59;
+                    check_result("monster", area, z, fast_creator->on_monster_item_drop(rt_index, area), slow_creator->on_monster_item_drop(rt_index, area));
+                    check_result("box", area, z, fast_creator->on_box_item_drop(area), slow_creator->on_box_item_drop(area));
+                  }
+                }
+
+                if ((fast_crypt->absolute_offset() != slow_crypt->absolute_offset()) || (fast_crypt->next(false) != slow_crypt->next(false))) {
+                  throw runtime_error(string_printf("final random state is incorrect (expected offset %" PRIu32 ", received %" PRIu32 ")",
+                      slow_crypt->absolute_offset(), fast_crypt->absolute_offset()));
+                }
+              }
+            }
+          }
+        }
+      }
+    });
+
+Action a_item_name_index_test(
+    "item-name-index-test", nullptr, +[](Arguments& args) {
+      auto s = make_shared<ServerState>(get_config_filename(args));
+      s->load_config_early();
+      s->load_patch_indexes(false);
+      s->load_text_index(false);
+      s->load_item_definitions(false);
+      s->load_item_name_indexes(false);
+
+      // Some descriptions are ambiguous (e.g. a weapon whose name begins with
+      // a special's name), so instead of comparing items, this checks that the
+      // parsed item has the same description as the original item
+      auto add_extra_spaces = +[](const string& desc) -> string {
+        string ret = "  ";
+        for (char ch : desc) {
+          ret += (ch == ' ') ? string(" \t ") : string(1, ch);
+        }
+        ret += " ";
+        return ret;
+      };
+
+      for (size_t v_s = NUM_PATCH_VERSIONS; v_s < NUM_VERSIONS; v_s++) {
+        Version v = static_cast<Version>(v_s);
+        auto index = s->item_name_index_opt(v);
+        if (!index) {
+          continue;
+        }
+        fprintf(stderr, "... %s (%zu names)\n", name_for_enum(v), index->all_by_name().size());
+
+        auto check = [&](const string& desc, const ItemData& expected_item) -> void {
+          string expected_desc = index->describe_item(expected_item);
+          ItemData item = index->parse_item_description(desc);
+          string parsed_desc = index->describe_item(item);
+          if (parsed_desc != expected_desc) {
+            throw runtime_error(string_printf("%s: \"%s\" parsed as %s (%s); expected %s (%s)",
+                name_for_enum(v), desc.c_str(), item.hex().c_str(), parsed_desc.c_str(),
+                expected_item.hex().c_str(), expected_desc.c_str()));
+          }
+        };
+
+        size_t num_prefix_names = 0;
+        for (const auto& [normalized_name, meta] : index->all_by_name()) {
+          // Tech disks are described by technique and level instead of by name,
+          // and names that begin with a description prefix (e.g. "????" for
+          // unused items) can't be parsed
+          if (((meta->primary_identifier & 0xFFFF0000) == 0x03020000) ||
+              normalized_name.empty() || starts_with(normalized_name, "?") || starts_with(normalized_name, "wrapped ")) {
+            continue;
+          }
+          ItemData item = ItemData::from_primary_identifier(*s->item_stack_limits(v), meta->primary_identifier);
+
+          // The name alone, with different case, and with extra whitespace
+          check(meta->name, item);
+          check(toupper(meta->name), item);
+          check(add_extra_spaces(meta->name), item);
+
+          // The full description (mags' descriptions include their level,
+          // which the parser doesn't accept, so only their names are checked)
+          if (item.data1[0] != 0x02) {
+            string desc = index->describe_item(item);
+            check(desc, item);
+            check(add_extra_spaces(desc), item);
+          }
+
+          // Weapons with each special, a grind, and bonuses. The specials'
+          // names come before the weapon's name, so these also check that
+          // special names aren't confused with the beginnings of item names.
+          if ((item.data1[0] == 0x00) && !item.is_s_rank_weapon()) {
+            item.data1[3] = 5;
+            item.data1[6] = 1;
+            item.data1[7] = 10;
+            item.data1[8] = 3;
+            item.data1[9] = static_cast<uint8_t>(-5);
+            for (uint8_t special = 0; special < 0x29; special++) {
+              for (uint8_t flags : {0x00, 0x80}) { // 0x80 = unidentified
+                item.data1[4] = special | flags;
+                string desc = index->describe_item(item);
+                check(desc, item);
+                check(add_extra_spaces(toupper(desc)), item);
+              }
+            }
+          }
+
+          // Names that begin with other names (e.g. "Sange & Yasha" begins
+          // with "Sange") are checked above along with all other names; this
+          // counts them to show that the case is covered
+          for (size_t pos = normalized_name.find(' '); pos != string::npos; pos = normalized_name.find(' ', pos + 1)) {
+            if (index->all_by_name().count(normalized_name.substr(0, pos))) {
+              num_prefix_names++;
+              break;
+            }
+          }
+        }
+        fprintf(stderr, "... %s: %zu names begin with another name\n", name_for_enum(v), num_prefix_names);
+      }
+    });
+
+Action a_bench_game_create(
+    "bench-game-create", "\
+  bench-game-create [OPTIONS...]\n\
+    Measure how long it takes to set up a game's state (maps, item creator, and\n\
+    Episode 3 server) for every version, episode, mode, and difficulty, with\n\
+    randomized variations and rare seeds. For each combination, the time taken\n\
+    by each step is reported as percentiles. If newserv was built with\n\
+    -DNEWSERV_COUNT_ALLOCATIONS=ON, the number of allocations made by each\n\
+    step is reported as well.\n\
+    Options:\n\
+      --iterations=COUNT: Create this many games for each combination\n\
+          (default 100).\n\
+      --threads=COUNT: Use this many threads (default 1). If this is 0, one\n\
+          thread per CPU core is used.\n\
+      --seed=SEED: Use this seed (hex) to generate each game\'s random seed,\n\
+          so results are reproducible.\n",
+    +[](Arguments& args) {
+      size_t num_iterations = args.get<size_t>("iterations", 100);
+      size_t num_threads = args.get<size_t>("threads", 1);
+      string seed_str = args.get<string>("seed");
+      uint32_t base_seed = seed_str.empty() ? random_object<uint32_t>() : stoul(seed_str, nullptr, 16);
+
+      // Lobbies create timeout events on the server's event base, which may
+      // happen on multiple threads here. Everything else the lobbies touch in
+      // ServerState is either immutable after loading or atomic (e.g.
+      // game_menu_generation).
+      if (evthread_use_pthreads()) {
+        throw runtime_error("failed to set up libevent threads");
+      }
+      shared_ptr<struct event_base> base(event_base_new(), event_base_free);
+      auto s = make_shared<ServerState>(base, get_config_filename(args), false);
+      s->load_config_early();
+      s->clear_map_file_caches();
+      s->load_patch_indexes(false);
+      s->load_set_data_tables(false);
+      s->load_text_index(false);
+      s->load_item_definitions(false);
+      s->load_item_name_indexes(false);
+      s->load_drop_tables(false);
+      s->load_ep3_cards(false);
+      s->load_ep3_maps(false);
+      // Lobbies log their entire map when it's loaded, which would make the
+      // benchmark mostly measure logging
+      lobby_log.min_level = LogLevel::WARNING;
+
+      struct Combination {
+        Version version;
+        Episode episode;
+        GameMode mode;
+        uint8_t difficulty;
+      };
+      vector<Combination> combinations;
+      for (size_t v_s = NUM_PATCH_VERSIONS; v_s < NUM_VERSIONS; v_s++) {
+        Version v = static_cast<Version>(v_s);
+        if (is_ep3(v)) {
+          combinations.emplace_back(Combination{v, Episode::EP3, GameMode::NORMAL, 0});
+          continue;
+        }
+        const array<Episode, 3> episodes = {Episode::EP1, Episode::EP2, Episode::EP4};
+        for (Episode episode : episodes) {
+          if (episode == Episode::EP4 && !is_v4(v)) {
+            continue;
+          }
+          if (episode == Episode::EP2 && is_v1_or_v2(v) && (v != Version::GC_NTE)) {
+            continue;
+          }
+          const array<GameMode, 4> modes = {GameMode::NORMAL, GameMode::BATTLE, GameMode::CHALLENGE, GameMode::SOLO};
+          for (GameMode mode : modes) {
+            if ((mode == GameMode::BATTLE || mode == GameMode::CHALLENGE) && is_v1(v)) {
+              continue;
+            }
+            if (mode == GameMode::SOLO && !is_v4(v)) {
+              continue;
+            }
+            for (uint8_t difficulty = 0; difficulty < 4; difficulty++) {
+              if (difficulty == 3 && is_v1(v)) {
+                continue;
+              }
+              combinations.emplace_back(Combination{v, episode, mode, difficulty});
+            }
+          }
+        }
+      }
+
+      static constexpr size_t NUM_STEPS = 3;
+      static const array<const char*, NUM_STEPS> step_names = {"load_maps", "create_item_creator", "create_ep3_server"};
+      struct StepResult {
+        bool ran = false;
+        uint64_t usecs = 0;
+        uint64_t num_allocations = 0;
+      };
+      // Each run writes only its own entry, so the threads don't need a lock
+      vector<array<StepResult, NUM_STEPS>> results(combinations.size() * num_iterations);
+
+      auto run_one = [&](uint64_t run_index, size_t) -> bool {
+        const auto& comb = combinations[run_index / num_iterations];
+        auto& run_results = results[run_index];
+
+        auto l = make_shared<Lobby>(s, run_index + 1, true);
+        l->base_version = comb.version;
+        l->allow_version(comb.version);
+        l->episode = comb.episode;
+        l->mode = comb.mode;
+        l->difficulty = comb.difficulty;
+        l->random_seed = base_seed + run_index;
+        l->opt_rand_crypt = make_shared<PSOV2Encryption>(l->random_seed);
+        if (l->mode == GameMode::CHALLENGE) {
+          l->challenge_params = make_shared<Lobby::ChallengeParameters>();
+          l->rare_enemy_rates = s->rare_enemy_rates_challenge;
+        } else {
+          l->rare_enemy_rates = s->rare_enemy_rates_by_difficulty.at(l->difficulty);
+        }
+
+        auto run_step = [&](size_t step, auto&& fn) -> void {
+          uint64_t start_allocations = num_allocations_on_this_thread;
+          uint64_t start_usecs = now();
+          fn();
+          run_results[step].usecs = now() - start_usecs;
+          run_results[step].num_allocations = num_allocations_on_this_thread - start_allocations;
+          run_results[step].ran = true;
+        };
+
+        if (is_ep3(l->base_version)) {
+          run_step(2, [&]() -> void { l->create_ep3_server(); });
+        } else {
+          if (l->base_version == Version::GC_NTE) {
+            l->variations.clear(0);
+          } else {
+            auto sdt = s->set_data_table(l->base_version, l->episode, l->mode, l->difficulty);
+            l->variations = sdt->generate_variations(l->episode, (l->mode == GameMode::SOLO), l->opt_rand_crypt);
+          }
+          run_step(0, [&]() -> void { l->load_maps(); });
+          run_step(1, [&]() -> void { l->create_item_creator(); });
+        }
+        return false;
+      };
+
+      uint64_t start = now();
+      parallel_range<uint64_t>(run_one, 0, results.size(), num_threads, nullptr);
+      string total_duration_str = format_duration(now() - start);
+
+      auto percentile = [](const vector<uint64_t>& sorted_values, size_t pct) -> uint64_t {
+        return sorted_values[((sorted_values.size() - 1) * pct) / 100];
+      };
+      auto print_step_stats = [&](const char* name, vector<uint64_t>& usecs, vector<uint64_t>& allocs) -> void {
+        if (usecs.empty()) {
+          return;
+        }
+        sort(usecs.begin(), usecs.end());
+        fprintf(stdout, "  %-20s usecs: p50=%" PRIu64 " p90=%" PRIu64 " p99=%" PRIu64 " max=%" PRIu64,
+            name, percentile(usecs, 50), percentile(usecs, 90), percentile(usecs, 99), usecs.back());
+        if (COUNT_ALLOCATIONS) {
+          sort(allocs.begin(), allocs.end());
+          fprintf(stdout, "; allocations: p50=%" PRIu64 " p99=%" PRIu64 " max=%" PRIu64,
+              percentile(allocs, 50), percentile(allocs, 99), allocs.back());
+        }
+        fputc('\n', stdout);
+      };
+
+      array<vector<uint64_t>, NUM_STEPS> all_usecs;
+      array<vector<uint64_t>, NUM_STEPS> all_allocs;
+      for (size_t comb_index = 0; comb_index < combinations.size(); comb_index++) {
+        const auto& comb = combinations[comb_index];
+        fprintf(stdout, "%s %s %s %s\n",
+            name_for_enum(comb.version), name_for_episode(comb.episode), name_for_mode(comb.mode), name_for_difficulty(comb.difficulty));
+        for (size_t step = 0; step < NUM_STEPS; step++) {
+          vector<uint64_t> usecs;
+          vector<uint64_t> allocs;
+          for (size_t z = 0; z < num_iterations; z++) {
+            const auto& res = results[comb_index * num_iterations + z][step];
+            if (res.ran) {
+              usecs.emplace_back(res.usecs);
+              allocs.emplace_back(res.num_allocations);
+            }
+          }
+          all_usecs[step].insert(all_usecs[step].end(), usecs.begin(), usecs.end());
+          all_allocs[step].insert(all_allocs[step].end(), allocs.begin(), allocs.end());
+          print_step_stats(step_names[step], usecs, allocs);
+        }
+      }
+      fprintf(stdout, "All combinations (%zu games in %s; base seed %08" PRIX32 ")\n",
+          results.size(), total_duration_str.c_str(), base_seed);
+      for (size_t step = 0; step < NUM_STEPS; step++) {
+        print_step_stats(step_names[step], all_usecs[step], all_allocs[step]);
+      }
+    });
+
 Action a_parse_object_graph(
     "parse-object-graph", nullptr, +[](Arguments& args) {
       uint32_t root_object_address = args.get<uint32_t>("root", Arguments::IntFormat::HEX);
@@ -2720,6 +3331,11 @@ Action a_run_server_replay_log(
         config_log.info("Waiting for HTTP server to stop");
         state->http_server->wait_for_stop();
       }
+      if (state->file_write_queue) {
+        auto stats = state->file_write_queue->stats();
+        config_log.info("Waiting for %zu queued file write(s) to complete", stats.queue_depth);
+        state->file_write_queue->flush();
+      }
       state->proxy_server.reset(); // Break reference cycle
     });
 
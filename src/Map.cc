@@ -1,5 +1,6 @@
 #include "Map.hh"
 
+#include <algorithm>
 #include <phosg/Filesystem.hh>
 #include <phosg/Random.hh>
 #include <phosg/Strings.hh>
@@ -725,9 +726,12 @@ void Map::clear() {
   this->objects.clear();
   this->enemies.clear();
   this->rare_enemy_indexes.clear();
+  this->deferred_templates.clear();
+  this->num_deferred_enemies = 0;
+  this->indexes_stale = true;
 }
 
-void Map::add_objects_from_map_data(uint8_t floor, const void* data, size_t size) {
+void Map::EntitiesTemplate::add_objects_from_map_data(uint8_t floor, const void* data, size_t size) {
   size_t entry_count = size / sizeof(ObjectEntry);
   if (size != entry_count * sizeof(ObjectEntry)) {
     throw runtime_error("data size is not a multiple of entry size");
@@ -752,12 +756,16 @@ void Map::add_objects_from_map_data(uint8_t floor, const void* data, size_t size
         .set_flags = 0,
         .item_drop_checked = false,
     });
-    uint64_t k = section_index_key(floor, objects[z].section, objects[z].group);
-    this->floor_section_and_group_to_object_index.emplace(k, object_id);
   }
 }
 
-bool Map::check_and_log_rare_enemy(bool default_is_rare, uint32_t rare_rate) {
+void Map::add_objects_from_map_data(uint8_t floor, const void* data, size_t size) {
+  EntitiesTemplate t;
+  t.add_objects_from_map_data(floor, data, size);
+  this->add_entities_from_template(t, nullptr);
+}
+
+bool Map::check_and_log_rare_enemy(bool default_is_rare, uint32_t rare_rate, size_t enemy_index) {
   if (default_is_rare) {
     return true;
   }
@@ -768,20 +776,20 @@ bool Map::check_and_log_rare_enemy(bool default_is_rare, uint32_t rare_rate) {
   // computationally expensive.
   if (this->version == Version::BB_V4) {
     if ((this->rare_enemy_indexes.size() < 0x10) && (random_from_optional_crypt(this->opt_rand_crypt) < rare_rate)) {
-      this->rare_enemy_indexes.emplace_back(this->enemies.size());
+      this->rare_enemy_indexes.emplace_back(enemy_index);
       return true;
     }
 
   } else {
-    // TODO: We only need the first value from this crypt, so it's unfortunate
-    // that we have to initialize the entire thing. Find a way to make this
-    // faster.
-    PSOV2Encryption crypt(this->rare_seed + 0x1000 + this->enemies.size());
-    float det = (static_cast<float>((crypt.next() >> 16) & 0xFFFF) / 65536.0f);
+    // This is the first value from a PSOV2Encryption seeded with
+    // rare_seed + 0x1000 + enemy_index
+    static const PSOV2EncryptionAffineStream first_value(1);
+    uint32_t v = first_value.value(this->rare_seed + 0x1000 + enemy_index, 0);
+    float det = (static_cast<float>((v >> 16) & 0xFFFF) / 65536.0f);
     // On v1 and v2 (and GC NTE), the rare rate is 0.1% instead of 0.2%.
     float threshold = is_v1_or_v2(this->version) ? 0.001f : 0.002f;
     if (det < threshold) {
-      this->rare_enemy_indexes.emplace_back(this->enemies.size());
+      this->rare_enemy_indexes.emplace_back(enemy_index);
       return true;
     }
   }
@@ -789,22 +797,32 @@ bool Map::check_and_log_rare_enemy(bool default_is_rare, uint32_t rare_rate) {
   return false;
 }
 
-void Map::add_enemy(
+void Map::EntitiesTemplate::add_enemy(
+    Version version,
     Episode episode,
     uint8_t difficulty,
     uint8_t event,
     uint8_t floor,
     size_t source_index,
     const EnemyEntry& e,
-    std::shared_ptr<const RareEnemyRates> rare_rates) {
-  size_t set_index = this->enemy_set_flags.size();
-  this->enemy_set_flags.emplace_back(0);
+    const PrefixedLogger& log) {
+  size_t set_index = this->num_enemy_sets++;
 
   auto add = [&](EnemyType type) -> void {
-    uint16_t enemy_id = this->enemies.size();
-    this->enemies.emplace_back(enemy_id, source_index, set_index, floor, e.section, e.wave_number, type);
-    uint64_t k = section_index_key(floor, e.section, e.wave_number);
-    this->floor_section_and_wave_number_to_enemy_index.emplace(k, enemy_id);
+    this->enemies.emplace_back(TemplateEnemy{
+        .enemy = Enemy(this->enemies.size(), source_index, set_index, floor, e.section, e.wave_number, type),
+        .rare_type = type,
+        .rare_rate = nullptr,
+        .default_is_rare = false,
+        .uses_previous_roll = false,
+    });
+  };
+  auto add_maybe_rare = [&](bool default_is_rare, uint32_t RareEnemyRates::*rare_rate, EnemyType rare_type, EnemyType type) -> void {
+    add(type);
+    auto& te = this->enemies.back();
+    te.rare_type = rare_type;
+    te.rare_rate = rare_rate;
+    te.default_is_rare = default_is_rare;
   };
 
   EnemyType child_type = EnemyType::UNKNOWN;
@@ -876,43 +894,39 @@ void Map::add_enemy(
       break;
 
     case 0x0040: { // TObjEneMoja
-      bool default_is_rare = (this->version == Version::BB_V4) ? (e.uparam1 & 1) : (e.uparam1 != 0);
-      add(this->check_and_log_rare_enemy(default_is_rare, rare_rates->hildeblue)
-              ? EnemyType::HILDEBLUE
-              : EnemyType::HILDEBEAR);
+      bool default_is_rare = (version == Version::BB_V4) ? (e.uparam1 & 1) : (e.uparam1 != 0);
+      add_maybe_rare(default_is_rare, &RareEnemyRates::hildeblue, EnemyType::HILDEBLUE, EnemyType::HILDEBEAR);
       break;
     }
     case 0x0041: { // TObjEneLappy
-      bool default_is_rare = (this->version == Version::BB_V4) ? (e.uparam1 & 1) : (e.uparam1 != 0);
-      bool is_rare = this->check_and_log_rare_enemy(default_is_rare, rare_rates->rappy);
+      bool default_is_rare = (version == Version::BB_V4) ? (e.uparam1 & 1) : (e.uparam1 != 0);
       switch (episode) {
         case Episode::EP1:
-          add(is_rare ? EnemyType::AL_RAPPY : EnemyType::RAG_RAPPY);
+          add_maybe_rare(default_is_rare, &RareEnemyRates::rappy, EnemyType::AL_RAPPY, EnemyType::RAG_RAPPY);
           break;
-        case Episode::EP2:
-          if (is_rare) {
-            switch (event) {
-              case 0x01: // rappy_type 1
-                add(EnemyType::SAINT_RAPPY);
-                break;
-              case 0x04: // rappy_type 2
-                add(EnemyType::EGG_RAPPY);
-                break;
-              case 0x05: // rappy_type 3
-                add(EnemyType::HALLO_RAPPY);
-                break;
-              default:
-                add(EnemyType::LOVE_RAPPY);
-            }
-          } else {
-            add(EnemyType::RAG_RAPPY);
+        case Episode::EP2: {
+          EnemyType rare_type;
+          switch (event) {
+            case 0x01: // rappy_type 1
+              rare_type = EnemyType::SAINT_RAPPY;
+              break;
+            case 0x04: // rappy_type 2
+              rare_type = EnemyType::EGG_RAPPY;
+              break;
+            case 0x05: // rappy_type 3
+              rare_type = EnemyType::HALLO_RAPPY;
+              break;
+            default:
+              rare_type = EnemyType::LOVE_RAPPY;
           }
+          add_maybe_rare(default_is_rare, &RareEnemyRates::rappy, rare_type, EnemyType::RAG_RAPPY);
           break;
+        }
         case Episode::EP4:
           if (e.floor > 0x05) {
-            add(is_rare ? EnemyType::DEL_RAPPY_ALT : EnemyType::SAND_RAPPY_ALT);
+            add_maybe_rare(default_is_rare, &RareEnemyRates::rappy, EnemyType::DEL_RAPPY_ALT, EnemyType::SAND_RAPPY_ALT);
           } else {
-            add(is_rare ? EnemyType::DEL_RAPPY : EnemyType::SAND_RAPPY);
+            add_maybe_rare(default_is_rare, &RareEnemyRates::rappy, EnemyType::DEL_RAPPY, EnemyType::SAND_RAPPY);
           }
           break;
         default:
@@ -940,9 +954,7 @@ void Map::add_enemy(
       if ((episode == Episode::EP2) && (e.floor == 0x11)) {
         add(EnemyType::DEL_LILY);
       } else {
-        add(this->check_and_log_rare_enemy(false, rare_rates->nar_lily)
-                ? EnemyType::NAR_LILY
-                : EnemyType::POISON_LILY);
+        add_maybe_rare(false, &RareEnemyRates::nar_lily, EnemyType::NAR_LILY, EnemyType::POISON_LILY);
       }
       break;
     case 0x0062: // TObjEneNanoDrago
@@ -955,18 +967,16 @@ void Map::add_enemy(
     }
     case 0x0064: // TObjEneSlime
       if ((e.num_children != 0) && (e.num_children != 4)) {
-        this->log.warning("POFUILLY_SLIME has an unusual num_children (0x%hX)", e.num_children.load());
+        log.warning("POFUILLY_SLIME has an unusual num_children (0x%hX)", e.num_children.load());
       }
       default_num_children = -1; // Skip adding children (because we do it here)
       for (size_t z = 0; z < 5; z++) {
-        add(this->check_and_log_rare_enemy((this->version == Version::BB_V4) && (e.uparam2 & 1), rare_rates->pouilly_slime)
-                ? EnemyType::POUILLY_SLIME
-                : EnemyType::POFUILLY_SLIME);
+        add_maybe_rare((version == Version::BB_V4) && (e.uparam2 & 1), &RareEnemyRates::pouilly_slime, EnemyType::POUILLY_SLIME, EnemyType::POFUILLY_SLIME);
       }
       break;
     case 0x0065: // TObjEnePanarms
       if ((e.num_children != 0) && (e.num_children != 2)) {
-        this->log.warning("PAN_ARMS has an unusual num_children (0x%hX)", e.num_children.load());
+        log.warning("PAN_ARMS has an unusual num_children (0x%hX)", e.num_children.load());
       }
       default_num_children = -1; // Skip adding children (because we do it here)
       add(EnemyType::PAN_ARMS);
@@ -999,7 +1009,7 @@ void Map::add_enemy(
       break;
     case 0x00A1: // TObjEneRe4Sorcerer
       if ((e.num_children != 0) && (e.num_children != 2)) {
-        this->log.warning("CHAOS_SORCERER has an unusual num_children (0x%hX)", e.num_children.load());
+        log.warning("CHAOS_SORCERER has an unusual num_children (0x%hX)", e.num_children.load());
       }
       default_num_children = -1; // Skip adding children (because we do it here)
       add(EnemyType::CHAOS_SORCERER);
@@ -1042,7 +1052,7 @@ void Map::add_enemy(
       break;
     case 0x00C1: // TBoss2DeRolLe
       if ((e.num_children != 0) && (e.num_children != 0x13)) {
-        this->log.warning("DE_ROL_LE has an unusual num_children (0x%hX)", e.num_children.load());
+        log.warning("DE_ROL_LE has an unusual num_children (0x%hX)", e.num_children.load());
       }
       default_num_children = -1; // Skip adding children (because we do it here)
       add(EnemyType::DE_ROL_LE);
@@ -1055,7 +1065,7 @@ void Map::add_enemy(
       break;
     case 0x00C2: // TBoss3Volopt
       if ((e.num_children != 0) && (e.num_children != 0x23)) {
-        this->log.warning("VOL_OPT has an unusual num_children (0x%hX)", e.num_children.load());
+        log.warning("VOL_OPT has an unusual num_children (0x%hX)", e.num_children.load());
       }
       default_num_children = -1; // Skip adding children (because we do it here)
       add(EnemyType::VOL_OPT_1);
@@ -1077,7 +1087,7 @@ void Map::add_enemy(
       break;
     case 0x00C8: // TBoss4DarkFalz
       if ((e.num_children != 0) && (e.num_children != 0x200)) {
-        this->log.warning("DARK_FALZ has an unusual num_children (0x%hX)", e.num_children.load());
+        log.warning("DARK_FALZ has an unusual num_children (0x%hX)", e.num_children.load());
       }
       default_num_children = -1; // Skip adding children (because we do it here)
       if (difficulty) {
@@ -1170,22 +1180,18 @@ void Map::add_enemy(
       }
       break;
     case 0x0112:
-      add(this->check_and_log_rare_enemy(e.uparam1 & 0x01, rare_rates->merissa_aa)
-              ? EnemyType::MERISSA_AA
-              : EnemyType::MERISSA_A);
+      add_maybe_rare(e.uparam1 & 0x01, &RareEnemyRates::merissa_aa, EnemyType::MERISSA_AA, EnemyType::MERISSA_A);
       break;
     case 0x0113:
       add(EnemyType::GIRTABLULU);
       break;
-    case 0x0114: {
-      bool is_rare = this->check_and_log_rare_enemy(e.uparam1 & 0x01, rare_rates->pazuzu);
+    case 0x0114:
       if (e.floor > 0x05) {
-        add(is_rare ? EnemyType::PAZUZU_ALT : EnemyType::ZU_ALT);
+        add_maybe_rare(e.uparam1 & 0x01, &RareEnemyRates::pazuzu, EnemyType::PAZUZU_ALT, EnemyType::ZU_ALT);
       } else {
-        add(is_rare ? EnemyType::PAZUZU : EnemyType::ZU);
+        add_maybe_rare(e.uparam1 & 0x01, &RareEnemyRates::pazuzu, EnemyType::PAZUZU, EnemyType::ZU);
       }
       break;
-    }
     case 0x0115:
       if (e.uparam1 & 2) {
         add(EnemyType::BA_BOOTA);
@@ -1194,25 +1200,17 @@ void Map::add_enemy(
       }
       break;
     case 0x0116:
-      add(this->check_and_log_rare_enemy(e.uparam1 & 0x01, rare_rates->dorphon_eclair)
-              ? EnemyType::DORPHON_ECLAIR
-              : EnemyType::DORPHON);
+      add_maybe_rare(e.uparam1 & 0x01, &RareEnemyRates::dorphon_eclair, EnemyType::DORPHON_ECLAIR, EnemyType::DORPHON);
       break;
     case 0x0117: {
       static const EnemyType types[3] = {EnemyType::GORAN, EnemyType::PYRO_GORAN, EnemyType::GORAN_DETONATOR};
       add(types[e.uparam1 % 3]);
       break;
     }
-    case 0x0119: {
-      bool is_rare = this->check_and_log_rare_enemy((e.fparam2 != 0.0f), rare_rates->kondrieu);
-      if (is_rare) {
-        add(EnemyType::KONDRIEU);
-      } else {
-        add((e.uparam1 & 1) ? EnemyType::SHAMBERTIN : EnemyType::SAINT_MILLION);
-      }
+    case 0x0119:
+      add_maybe_rare((e.fparam2 != 0.0f), &RareEnemyRates::kondrieu, EnemyType::KONDRIEU, (e.uparam1 & 1) ? EnemyType::SHAMBERTIN : EnemyType::SAINT_MILLION);
       default_num_children = 0x18;
       break;
-    }
 
     case 0x00C3: // TBoss3VoloptP01
     case 0x00C4: // TBoss3VoloptCore or subclass
@@ -1224,7 +1222,7 @@ void Map::add_enemy(
 
     default:
       add(EnemyType::UNKNOWN);
-      this->log.warning(
+      log.warning(
           "(Entry %zu, offset %zX in file) Invalid enemy type %04hX",
           source_index, source_index * sizeof(EnemyEntry), e.base_type.load());
       break;
@@ -1232,23 +1230,49 @@ void Map::add_enemy(
 
   if (default_num_children >= 0) {
     size_t num_children = e.num_children ? e.num_children.load() : default_num_children;
+    // Children with no specific type are the same type as their parent, so if
+    // the parent can be rare, the children are rare if the parent is
+    EnemyType child_rare_type = child_type;
+    bool child_uses_previous_roll = false;
     if ((child_type == EnemyType::UNKNOWN) && !this->enemies.empty()) {
-      child_type = this->enemies.back().type;
+      const auto& parent = this->enemies.back();
+      child_type = parent.enemy.type;
+      child_rare_type = parent.rare_type;
+      child_uses_previous_roll = (parent.rare_rate || parent.uses_previous_roll);
     }
     for (size_t x = 0; x < num_children; x++) {
       add(child_type);
+      if (child_uses_previous_roll) {
+        auto& te = this->enemies.back();
+        te.rare_type = child_rare_type;
+        te.uses_previous_roll = true;
+      }
     }
   }
 }
 
-void Map::add_enemies_from_map_data(
+void Map::add_enemy(
+    Episode episode,
+    uint8_t difficulty,
+    uint8_t event,
+    uint8_t floor,
+    size_t source_index,
+    const EnemyEntry& e,
+    std::shared_ptr<const RareEnemyRates> rare_rates) {
+  EntitiesTemplate t;
+  t.add_enemy(this->version, episode, difficulty, event, floor, source_index, e, this->log);
+  this->add_entities_from_template(t, rare_rates);
+}
+
+void Map::EntitiesTemplate::add_enemies_from_map_data(
+    Version version,
     Episode episode,
     uint8_t difficulty,
     uint8_t event,
     uint8_t floor,
     const void* data,
     size_t size,
-    std::shared_ptr<const RareEnemyRates> rare_rates) {
+    const PrefixedLogger& log) {
   size_t entry_count = size / sizeof(EnemyEntry);
   if (size != entry_count * sizeof(EnemyEntry)) {
     throw runtime_error("data size is not a multiple of entry size");
@@ -1256,10 +1280,23 @@ void Map::add_enemies_from_map_data(
 
   StringReader r(data, size);
   for (size_t y = 0; y < entry_count; y++) {
-    this->add_enemy(episode, difficulty, event, floor, y, r.get<EnemyEntry>(), rare_rates);
+    this->add_enemy(version, episode, difficulty, event, floor, y, r.get<EnemyEntry>(), log);
   }
 }
 
+void Map::add_enemies_from_map_data(
+    Episode episode,
+    uint8_t difficulty,
+    uint8_t event,
+    uint8_t floor,
+    const void* data,
+    size_t size,
+    std::shared_ptr<const RareEnemyRates> rare_rates) {
+  EntitiesTemplate t;
+  t.add_enemies_from_map_data(this->version, episode, difficulty, event, floor, data, size, this->log);
+  this->add_entities_from_template(t, rare_rates);
+}
+
 Map::DATParserRandomState::DATParserRandomState(uint32_t rare_seed)
     : random(rare_seed),
       location_table_random(0),
@@ -1472,7 +1509,6 @@ void Map::add_random_enemies_from_map_data(
 }
 
 void Map::add_event(uint32_t event_id, uint16_t flags, uint8_t floor, uint16_t section, uint16_t wave_number, uint32_t action_stream_offset) {
-  size_t index = this->events.size();
   auto& ev = this->events.emplace_back();
   ev.event_id = event_id;
   ev.section = section;
@@ -1480,32 +1516,26 @@ void Map::add_event(uint32_t event_id, uint16_t flags, uint8_t floor, uint16_t s
   ev.flags = flags;
   ev.floor = floor;
   ev.action_stream_offset = action_stream_offset;
-
-  uint64_t k = (static_cast<uint64_t>(floor) << 32) | event_id;
-  this->floor_and_event_id_to_index.emplace(k, index);
-  k = section_index_key(floor, section, wave_number);
-  this->floor_section_and_wave_number_to_event_index.emplace(k, index);
+  this->indexes_stale = true;
 }
 
-vector<Map::Event*> Map::get_events(uint8_t floor, uint32_t event_id) {
+Map::EntityRange<Map::Event> Map::get_events(uint8_t floor, uint32_t event_id) {
+  this->materialize_floor(floor);
+  this->update_indexes();
   uint64_t k = (static_cast<uint64_t>(floor) << 32) | event_id;
-  vector<Event*> ret;
-  for (auto its = this->floor_and_event_id_to_index.equal_range(k); its.first != its.second; its.first++) {
-    ret.emplace_back(&this->events.at(its.first->second));
-  }
-  return ret;
+  return EntityRange<Event>(this->events.data(), this->floor_and_event_id_to_event_index.find(k));
 }
 
-vector<const Map::Event*> Map::get_events(uint8_t floor, uint32_t event_id) const {
+Map::EntityRange<const Map::Event> Map::get_events(uint8_t floor, uint32_t event_id) const {
+  // Materializing a floor doesn't change any entities that are already
+  // visible, so this is logically const (like find_enemy)
+  const_cast<Map*>(this)->materialize_floor(floor);
+  this->update_indexes();
   uint64_t k = (static_cast<uint64_t>(floor) << 32) | event_id;
-  vector<const Event*> ret;
-  for (auto its = this->floor_and_event_id_to_index.equal_range(k); its.first != its.second; its.first++) {
-    ret.emplace_back(&this->events.at(its.first->second));
-  }
-  return ret;
+  return EntityRange<const Event>(this->events.data(), this->floor_and_event_id_to_event_index.find(k));
 }
 
-void Map::add_events_from_map_data(uint8_t floor, const void* data, size_t size) {
+void Map::EntitiesTemplate::add_events_from_map_data(uint8_t floor, const void* data, size_t size) {
   StringReader r(data, size);
   const auto& header = r.get<EventsSectionHeader>();
   if (header.format != 0) {
@@ -1519,7 +1549,113 @@ void Map::add_events_from_map_data(uint8_t floor, const void* data, size_t size)
   auto events_r = r.sub(header.entries_offset, sizeof(Event1Entry) * header.entry_count);
   while (!events_r.eof()) {
     const auto& entry = events_r.get<Event1Entry>();
-    this->add_event(entry.event_id, entry.flags, floor, entry.section, entry.wave_number, entry.action_stream_offset + action_stream_base_offset);
+    auto& ev = this->events.emplace_back();
+    ev.event_id = entry.event_id;
+    ev.section = entry.section;
+    ev.wave_number = entry.wave_number;
+    ev.flags = entry.flags;
+    ev.floor = floor;
+    ev.action_stream_offset = entry.action_stream_offset + action_stream_base_offset;
+  }
+}
+
+void Map::add_events_from_map_data(uint8_t floor, const void* data, size_t size) {
+  EntitiesTemplate t;
+  t.add_events_from_map_data(floor, data, size);
+  this->add_entities_from_template(t, nullptr);
+}
+
+vector<bool> Map::roll_rare_enemies(const EntitiesTemplate& t, const RareEnemyRates* rare_rates, size_t base_enemy_index) {
+  vector<bool> ret;
+  ret.reserve(t.enemies.size());
+  bool is_rare = false;
+  for (const auto& te : t.enemies) {
+    if (!te.uses_previous_roll) {
+      is_rare = te.rare_rate && this->check_and_log_rare_enemy(te.default_is_rare, rare_rates->*te.rare_rate, base_enemy_index + ret.size());
+    }
+    ret.emplace_back(is_rare);
+  }
+  return ret;
+}
+
+void Map::append_template(const EntitiesTemplate& t, const vector<bool>& enemy_is_rare) {
+  for (const auto& obj : t.objects) {
+    uint16_t object_id = this->objects.size();
+    this->objects.emplace_back(obj).object_id = object_id;
+  }
+
+  size_t base_set_index = this->enemy_set_flags.size();
+  this->enemy_set_flags.resize(base_set_index + t.num_enemy_sets, 0);
+  for (size_t z = 0; z < t.enemies.size(); z++) {
+    const auto& te = t.enemies[z];
+    uint16_t enemy_id = this->enemies.size();
+    auto& ene = this->enemies.emplace_back(te.enemy);
+    ene.enemy_id = enemy_id;
+    ene.set_index += base_set_index;
+    if (enemy_is_rare[z]) {
+      ene.type = te.rare_type;
+    }
+  }
+
+  size_t action_stream_base_offset = this->event_action_stream.size();
+  this->event_action_stream += t.event_action_stream;
+  for (const auto& ev : t.events) {
+    this->events.emplace_back(ev).action_stream_offset += action_stream_base_offset;
+  }
+
+  this->indexes_stale = true;
+}
+
+void Map::add_entities_from_template(const EntitiesTemplate& t, shared_ptr<const RareEnemyRates> rare_rates) {
+  // Entity IDs depend on the order in which templates are added, so anything
+  // deferred must be added first
+  this->materialize_all();
+  this->append_template(t, this->roll_rare_enemies(t, rare_rates.get(), this->enemies.size()));
+}
+
+void Map::add_entities_from_template_deferred(
+    uint8_t floor, shared_ptr<const EntitiesTemplate> t, shared_ptr<const RareEnemyRates> rare_rates) {
+  if (!this->deferred_templates.empty() && (this->deferred_templates.back().floor > floor)) {
+    throw logic_error("deferred templates must be added in floor order");
+  }
+  size_t base_enemy_index = this->enemies.size() + this->num_deferred_enemies;
+  auto& def = this->deferred_templates.emplace_back(DeferredTemplate{
+      .floor = floor,
+      .t = t,
+      .enemy_is_rare = this->roll_rare_enemies(*t, rare_rates.get(), base_enemy_index),
+  });
+  this->num_deferred_enemies += def.t->enemies.size();
+}
+
+void Map::materialize_next_deferred_template() {
+  auto& def = this->deferred_templates.front();
+  this->append_template(*def.t, def.enemy_is_rare);
+  this->num_deferred_enemies -= def.t->enemies.size();
+  this->log.info("Materialized deferred entities for floor %02hhX", def.floor);
+  this->deferred_templates.pop_front();
+}
+
+void Map::materialize_floor(uint8_t floor) {
+  while (!this->deferred_templates.empty() && (this->deferred_templates.front().floor <= floor)) {
+    this->materialize_next_deferred_template();
+  }
+}
+
+void Map::materialize_all() {
+  while (!this->deferred_templates.empty()) {
+    this->materialize_next_deferred_template();
+  }
+}
+
+void Map::materialize_enemy(size_t enemy_index) {
+  while (!this->deferred_templates.empty() && (enemy_index >= this->enemies.size())) {
+    this->materialize_next_deferred_template();
+  }
+}
+
+void Map::materialize_object(size_t object_index) {
+  while (!this->deferred_templates.empty() && (object_index >= this->objects.size())) {
+    this->materialize_next_deferred_template();
   }
 }
 
@@ -1658,6 +1794,7 @@ const Map::Enemy& Map::find_enemy(uint8_t floor, EnemyType type) const {
 }
 
 Map::Enemy& Map::find_enemy(uint8_t floor, EnemyType type) {
+  this->materialize_floor(floor);
   if (enemies.empty()) {
     throw out_of_range("no enemies defined");
   }
@@ -1671,43 +1808,121 @@ Map::Enemy& Map::find_enemy(uint8_t floor, EnemyType type) {
   throw out_of_range("enemy not found");
 }
 
-std::vector<Map::Object*> Map::get_objects(uint8_t floor, uint16_t section, uint16_t group) {
-  uint64_t k = section_index_key(floor, section, group);
-  vector<Object*> ret;
-  for (auto its = this->floor_section_and_group_to_object_index.equal_range(k); its.first != its.second; its.first++) {
-    ret.emplace_back(&this->objects.at(its.first->second));
+void Map::FlatIndex::build(vector<pair<uint64_t, uint32_t>>& entries) {
+  // Sorting by (key, entity index) keeps each key's values in the order the
+  // entities were added
+  sort(entries.begin(), entries.end());
+  this->keys.clear();
+  this->offsets.clear();
+  this->values.clear();
+  this->values.reserve(entries.size());
+  for (const auto& it : entries) {
+    if (this->keys.empty() || (this->keys.back() != it.first)) {
+      this->keys.emplace_back(it.first);
+      this->offsets.emplace_back(this->values.size());
+    }
+    this->values.emplace_back(it.second);
   }
-  return ret;
+  this->offsets.emplace_back(this->values.size());
 }
 
-std::vector<Map::Enemy*> Map::get_enemies(uint8_t floor, uint16_t section, uint16_t wave_number) {
-  uint64_t k = section_index_key(floor, section, wave_number);
-  vector<Enemy*> ret;
-  for (auto its = this->floor_section_and_wave_number_to_enemy_index.equal_range(k); its.first != its.second; its.first++) {
-    ret.emplace_back(&this->enemies.at(its.first->second));
+pair<const uint32_t*, const uint32_t*> Map::FlatIndex::find(uint64_t key) const {
+  auto it = lower_bound(this->keys.begin(), this->keys.end(), key);
+  if ((it == this->keys.end()) || (*it != key)) {
+    return make_pair(nullptr, nullptr);
   }
-  return ret;
+  size_t z = it - this->keys.begin();
+  return make_pair(this->values.data() + this->offsets[z], this->values.data() + this->offsets[z + 1]);
 }
 
-std::vector<Map::Event*> Map::get_events(uint8_t floor, uint16_t section, uint16_t wave_number) {
-  uint64_t k = section_index_key(floor, section, wave_number);
-  vector<Event*> ret;
-  for (auto its = this->floor_section_and_wave_number_to_event_index.equal_range(k); its.first != its.second; its.first++) {
-    ret.emplace_back(&this->events.at(its.first->second));
+pair<const uint32_t*, const uint32_t*> Map::FlatIndex::find_range(uint64_t start_key, uint64_t end_key) const {
+  size_t start_z = lower_bound(this->keys.begin(), this->keys.end(), start_key) - this->keys.begin();
+  size_t end_z = lower_bound(this->keys.begin(), this->keys.end(), end_key) - this->keys.begin();
+  if (start_z >= end_z) {
+    return make_pair(nullptr, nullptr);
   }
-  return ret;
+  return make_pair(this->values.data() + this->offsets[start_z], this->values.data() + this->offsets[end_z]);
 }
 
-std::vector<Map::Event*> Map::get_events(uint8_t floor) {
+void Map::update_indexes() const {
+  if (!this->indexes_stale) {
+    return;
+  }
+
+  vector<pair<uint64_t, uint32_t>> entries;
+  entries.reserve(this->objects.size());
+  for (size_t z = 0; z < this->objects.size(); z++) {
+    const auto& obj = this->objects[z];
+    entries.emplace_back(section_index_key(obj.floor, obj.section, obj.group), z);
+  }
+  this->floor_section_and_group_to_object_index.build(entries);
+
+  entries.clear();
+  for (size_t z = 0; z < this->enemies.size(); z++) {
+    const auto& ene = this->enemies[z];
+    entries.emplace_back(section_index_key(ene.floor, ene.section, ene.wave_number), z);
+  }
+  this->floor_section_and_wave_number_to_enemy_index.build(entries);
+
+  entries.clear();
+  for (size_t z = 0; z < this->events.size(); z++) {
+    const auto& ev = this->events[z];
+    entries.emplace_back(section_index_key(ev.floor, ev.section, ev.wave_number), z);
+  }
+  this->floor_section_and_wave_number_to_event_index.build(entries);
+
+  entries.clear();
+  for (size_t z = 0; z < this->events.size(); z++) {
+    const auto& ev = this->events[z];
+    entries.emplace_back((static_cast<uint64_t>(ev.floor) << 32) | ev.event_id, z);
+  }
+  this->floor_and_event_id_to_event_index.build(entries);
+
+  this->indexes_stale = false;
+}
+
+Map::EntityRange<Map::Object> Map::get_objects(uint8_t floor, uint16_t section, uint16_t group) {
+  this->materialize_floor(floor);
+  this->update_indexes();
+  uint64_t k = section_index_key(floor, section, group);
+  return EntityRange<Object>(this->objects.data(), this->floor_section_and_group_to_object_index.find(k));
+}
+
+Map::EntityRange<Map::Enemy> Map::get_enemies(uint8_t floor, uint16_t section, uint16_t wave_number) {
+  this->materialize_floor(floor);
+  this->update_indexes();
+  uint64_t k = section_index_key(floor, section, wave_number);
+  return EntityRange<Enemy>(this->enemies.data(), this->floor_section_and_wave_number_to_enemy_index.find(k));
+}
+
+Map::EntityRange<Map::Event> Map::get_events(uint8_t floor, uint16_t section, uint16_t wave_number) {
+  this->materialize_floor(floor);
+  this->update_indexes();
+  uint64_t k = section_index_key(floor, section, wave_number);
+  return EntityRange<Event>(this->events.data(), this->floor_section_and_wave_number_to_event_index.find(k));
+}
+
+Map::EntityRange<Map::Event> Map::get_events(uint8_t floor) {
+  this->materialize_floor(floor);
+  this->update_indexes();
   uint64_t k_start = (static_cast<uint64_t>(floor) << 32);
   uint64_t k_end = (static_cast<uint64_t>(floor + 1) << 32);
-  vector<Event*> ret;
-  for (auto it = this->floor_and_event_id_to_index.lower_bound(k_start);
-       (it != this->floor_and_event_id_to_index.end()) && (it->first < k_end);
-       it++) {
-    ret.emplace_back(&this->events.at(it->second));
+  return EntityRange<Event>(this->events.data(), this->floor_and_event_id_to_event_index.find_range(k_start, k_end));
+}
+
+shared_ptr<const Map::EntitiesTemplate> MapTemplateCache::get(
+    const string& key, function<shared_ptr<const Map::EntitiesTemplate>()> generate) {
+  {
+    shared_lock g(this->lock);
+    auto it = this->templates.find(key);
+    if (it != this->templates.end()) {
+      return it->second;
+    }
   }
-  return ret;
+
+  auto t = generate();
+  unique_lock g(this->lock);
+  return this->templates.emplace(key, std::move(t)).first->second;
 }
 
 template <typename EntryT>
@@ -2565,3 +2780,200 @@ vector<vector<string>> map_filenames_for_variations_deprecated(
 
 const shared_ptr<const Map::RareEnemyRates> Map::NO_RARE_ENEMIES = make_shared<Map::RareEnemyRates>(0, 0);
 const shared_ptr<const Map::RareEnemyRates> Map::DEFAULT_RARE_ENEMIES = make_shared<Map::RareEnemyRates>(0x0083126E, 0x1999999A);
+
+RareEnemySeedEvaluator::RareEnemySeedEvaluator(
+    Version version,
+    Episode episode,
+    GameMode mode,
+    uint8_t difficulty,
+    uint8_t event,
+    shared_ptr<const SetDataTableBase> sdt,
+    function<shared_ptr<const string>(Version, const string&)> get_file_data,
+    shared_ptr<const Map::RareEnemyRates> rare_rates)
+    : version(version) {
+  // Lobby::load_maps doesn't load any free-roam maps in Challenge mode
+  if (mode != GameMode::CHALLENGE) {
+    bool is_solo = (mode == GameMode::SOLO);
+    for (uint8_t floor_num = 0; floor_num < 0x12; floor_num++) {
+      auto& floor = this->floors.emplace_back();
+      // This matches SetDataTableBase::generate_variations; GC NTE always
+      // uses variations of all zeroes
+      if ((floor_num < 0x10) && (version != Version::GC_NTE)) {
+        auto num_vars = sdt->num_free_roam_variations_for_floor(episode, is_solo, floor_num);
+        floor.num_var1 = max<uint32_t>(num_vars.first, 1);
+        floor.num_var2 = max<uint32_t>(num_vars.second, 1);
+      }
+      for (uint32_t var1 = 0; var1 < floor.num_var1; var1++) {
+        for (uint32_t var2 = 0; var2 < floor.num_var2; var2++) {
+          auto& fv = floor.variations.emplace_back();
+          auto filename = sdt->map_filename_for_variation(
+              floor_num, var1, var2, episode, mode, SetDataTableBase::FilenameType::ENEMIES);
+          if (filename.empty()) {
+            continue;
+          }
+          auto map_data = get_file_data(version, filename);
+          if (!map_data) {
+            continue;
+          }
+          Map::EntitiesTemplate t;
+          t.add_enemies_from_map_data(
+              version, episode, difficulty, event, floor_num, map_data->data(), map_data->size(), static_game_data_log);
+          fv = this->compile_template(t, *rare_rates);
+        }
+      }
+    }
+  }
+  this->create_stream();
+}
+
+RareEnemySeedEvaluator::RareEnemySeedEvaluator(
+    Version version,
+    Episode episode,
+    uint8_t difficulty,
+    uint8_t event,
+    const string& quest_dat_contents_decompressed,
+    shared_ptr<const Map::RareEnemyRates> rare_rates)
+    : version(version) {
+  const auto& data = quest_dat_contents_decompressed;
+  auto all_floor_sections = Map::collect_quest_map_data_sections(data.data(), data.size());
+
+  // This matches Map::add_entities_from_quest_data
+  StringReader r(data.data(), data.size());
+  for (size_t floor_num = 0; floor_num < all_floor_sections.size(); floor_num++) {
+    const auto& floor_sections = all_floor_sections[floor_num];
+    if ((floor_sections.wave_events != 0xFFFFFFFF) &&
+        (floor_sections.random_enemy_locations != 0xFFFFFFFF) &&
+        (floor_sections.random_enemy_definitions != 0xFFFFFFFF)) {
+      throw runtime_error("quest has random enemies");
+    }
+
+    auto& fv = this->floors.emplace_back().variations.emplace_back();
+    if (floor_sections.enemies != 0xFFFFFFFF) {
+      const auto& header = r.pget<Map::SectionHeader>(floor_sections.enemies);
+      if (header.data_size % sizeof(Map::EnemyEntry)) {
+        throw runtime_error("quest layout enemy section size is not a multiple of enemy entry size");
+      }
+      Map::EntitiesTemplate t;
+      t.add_enemies_from_map_data(
+          version,
+          episode,
+          difficulty,
+          event,
+          floor_num,
+          r.pgetv(floor_sections.enemies + sizeof(header), header.data_size),
+          header.data_size,
+          static_game_data_log);
+      fv = this->compile_template(t, *rare_rates);
+    }
+  }
+  this->create_stream();
+}
+
+RareEnemySeedEvaluator::FloorVariation RareEnemySeedEvaluator::compile_template(
+    const Map::EntitiesTemplate& t, const Map::RareEnemyRates& rare_rates) {
+  // This matches Map::roll_rare_enemies
+  FloorVariation ret;
+  ret.num_enemies = t.enemies.size();
+  ssize_t roll_slot_index = -1;
+  for (size_t z = 0; z < t.enemies.size(); z++) {
+    const auto& te = t.enemies[z];
+    if (te.uses_previous_roll) {
+      if (roll_slot_index >= 0) {
+        ret.slots[roll_slot_index].count++;
+        continue;
+      }
+    } else if (te.rare_rate) {
+      roll_slot_index = ret.slots.size();
+      ret.slots.emplace_back(Slot{
+          .relative_index = static_cast<uint32_t>(z),
+          .count = 1,
+          .rare_rate = rare_rates.*te.rare_rate,
+          .has_roll = true,
+          .default_is_rare = te.default_is_rare,
+          .type = te.enemy.type,
+          .rare_type = te.rare_type,
+      });
+      ret.num_rolls++;
+      continue;
+    } else {
+      roll_slot_index = -1;
+    }
+
+    if (enemy_type_is_rare(te.enemy.type)) {
+      ret.slots.emplace_back(Slot{
+          .relative_index = static_cast<uint32_t>(z),
+          .count = 1,
+          .rare_rate = 0,
+          .has_roll = false,
+          .default_is_rare = false,
+          .type = te.enemy.type,
+          .rare_type = te.enemy.type,
+      });
+    }
+  }
+  return ret;
+}
+
+void RareEnemySeedEvaluator::create_stream() {
+  // The stream must be long enough for all the variation choices, and on BB,
+  // for the most rolls that any set of variations could have
+  this->num_variation_values = 0;
+  for (const auto& floor : this->floors) {
+    this->num_variation_values += (floor.num_var1 > 1) + (floor.num_var2 > 1);
+  }
+  size_t stream_length = this->num_variation_values + 1;
+  for (const auto& floor : this->floors) {
+    if (this->version == Version::BB_V4) {
+      size_t max_rolls = 0;
+      for (const auto& fv : floor.variations) {
+        max_rolls = max<size_t>(max_rolls, fv.num_rolls);
+      }
+      stream_length += max_rolls;
+    }
+  }
+  this->stream = make_unique<PSOV2EncryptionAffineStream>(stream_length);
+}
+
+void RareEnemySeedEvaluator::evaluate(vector<RareEnemy>& ret, uint32_t seed) const {
+  ret.clear();
+
+  // All variations are chosen before any enemies are rolled, so on BB, the
+  // rolls start after all the variation values in the stream
+  size_t variation_stream_offset = 0;
+  size_t roll_stream_offset = this->num_variation_values;
+
+  // This matches Map::check_and_log_rare_enemy
+  size_t base_enemy_index = 0;
+  size_t num_rolled_rares = 0;
+  float threshold = is_v1_or_v2(this->version) ? 0.001f : 0.002f;
+  for (const auto& floor : this->floors) {
+    uint32_t var1 = (floor.num_var1 > 1) ? (this->stream->value(seed, variation_stream_offset++) % floor.num_var1) : 0;
+    uint32_t var2 = (floor.num_var2 > 1) ? (this->stream->value(seed, variation_stream_offset++) % floor.num_var2) : 0;
+    const auto& fv = floor.variations[var1 * floor.num_var2 + var2];
+    for (const auto& slot : fv.slots) {
+      size_t enemy_index = base_enemy_index + slot.relative_index;
+      bool is_rare = false;
+      if (slot.has_roll) {
+        if (slot.default_is_rare) {
+          is_rare = true;
+        } else if (this->version == Version::BB_V4) {
+          if ((num_rolled_rares < 0x10) && (this->stream->value(seed, roll_stream_offset++) < slot.rare_rate)) {
+            is_rare = true;
+            num_rolled_rares++;
+          }
+        } else {
+          uint32_t v = this->stream->value(seed + 0x1000 + enemy_index, 0);
+          is_rare = ((static_cast<float>((v >> 16) & 0xFFFF) / 65536.0f) < threshold);
+        }
+      }
+
+      EnemyType type = is_rare ? slot.rare_type : slot.type;
+      if (enemy_type_is_rare(type)) {
+        for (size_t z = 0; z < slot.count; z++) {
+          ret.emplace_back(RareEnemy{enemy_index + z, type});
+        }
+      }
+    }
+    base_enemy_index += fv.num_enemies;
+  }
+}
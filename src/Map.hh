@@ -2,11 +2,15 @@
 
 #include <inttypes.h>
 
+#include <deque>
+#include <functional>
 #include <memory>
 #include <phosg/Encoding.hh>
 #include <phosg/JSON.hh>
 #include <random>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "BattleParamsIndex.hh"
@@ -284,6 +288,139 @@ struct Map {
     std::string str() const;
   };
 
+  // The parsed entities from one map file (or one section of a quest's DAT
+  // file). Templates don't depend on the game's random seed or rare enemy
+  // rates, so the same template can be added to any number of maps without
+  // parsing the file again; each enemy that can be rare records how to roll
+  // for it, and the roll happens in add_entities_from_template.
+  struct EntitiesTemplate {
+    struct TemplateEnemy {
+      Enemy enemy; // enemy_id and set_index are relative to the template
+      // If rare_rate is not null and the roll succeeds (or default_is_rare is
+      // true), the enemy's type becomes rare_type. If uses_previous_roll is
+      // true, the previous enemy's result is used instead of rolling again;
+      // this is used for children that are the same type as their parent.
+      EnemyType rare_type;
+      uint32_t RareEnemyRates::*rare_rate;
+      bool default_is_rare;
+      bool uses_previous_roll;
+    };
+
+    std::vector<Object> objects;
+    std::vector<TemplateEnemy> enemies;
+    size_t num_enemy_sets = 0;
+    std::vector<Event> events;
+    std::string event_action_stream;
+
+    void add_objects_from_map_data(uint8_t floor, const void* data, size_t size);
+    void add_enemy(
+        Version version,
+        Episode episode,
+        uint8_t difficulty,
+        uint8_t event,
+        uint8_t floor,
+        size_t source_index,
+        const EnemyEntry& e,
+        const PrefixedLogger& log);
+    void add_enemies_from_map_data(
+        Version version,
+        Episode episode,
+        uint8_t difficulty,
+        uint8_t event,
+        uint8_t floor,
+        const void* data,
+        size_t size,
+        const PrefixedLogger& log);
+    void add_events_from_map_data(uint8_t floor, const void* data, size_t size);
+  };
+
+  void add_entities_from_template(const EntitiesTemplate& t, std::shared_ptr<const RareEnemyRates> rare_rates);
+  // Like add_entities_from_template, but the entities aren't added until the
+  // floor is materialized (see below). Rare enemies are rolled immediately, so
+  // the results are the same as if the entities had been added immediately.
+  // Templates must be deferred in increasing floor order.
+  void add_entities_from_template_deferred(
+      uint8_t floor, std::shared_ptr<const EntitiesTemplate> t, std::shared_ptr<const RareEnemyRates> rare_rates);
+  // These add deferred entities for all floors up to and including the given
+  // floor (or up to the floor that contains the given entity). Deferred
+  // templates are always added in order, so entity IDs don't depend on when
+  // floors are materialized. The get_* and find_enemy functions materialize
+  // the floor automatically; code that accesses the entity vectors directly
+  // must call one of these first.
+  void materialize_floor(uint8_t floor);
+  void materialize_enemy(size_t enemy_index);
+  void materialize_object(size_t object_index);
+  void materialize_all();
+
+  // A multimap from 64-bit keys to entity indexes, flattened into a sorted
+  // array of unique keys and a single array of values. The values for
+  // keys[z] are values[offsets[z]] through values[offsets[z + 1] - 1], in the
+  // order the entities were added. Since all keys' values are contiguous, a
+  // range of keys also maps to a contiguous range of values.
+  struct FlatIndex {
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> values;
+
+    // Sorts entries in place; entries must be (key, entity index) pairs
+    void build(std::vector<std::pair<uint64_t, uint32_t>>& entries);
+    std::pair<const uint32_t*, const uint32_t*> find(uint64_t key) const;
+    // end_key is not included in the range
+    std::pair<const uint32_t*, const uint32_t*> find_range(uint64_t start_key, uint64_t end_key) const;
+  };
+
+  // The result of an index lookup. Iterating over this yields pointers to the
+  // matching entities; no memory is allocated. The range is invalidated when
+  // any entities are added to or removed from the map.
+  template <typename EntityT>
+  class EntityRange {
+  public:
+    class Iterator {
+    public:
+      Iterator(EntityT* base, const uint32_t* it) : base(base), it(it) {}
+      inline EntityT* operator*() const {
+        return this->base + *this->it;
+      }
+      inline Iterator& operator++() {
+        this->it++;
+        return *this;
+      }
+      inline bool operator==(const Iterator& other) const {
+        return this->it == other.it;
+      }
+      inline bool operator!=(const Iterator& other) const {
+        return this->it != other.it;
+      }
+
+    private:
+      EntityT* base;
+      const uint32_t* it;
+    };
+
+    EntityRange(EntityT* base, std::pair<const uint32_t*, const uint32_t*> values)
+        : base(base),
+          values_begin(values.first),
+          values_end(values.second) {}
+
+    inline Iterator begin() const {
+      return Iterator(this->base, this->values_begin);
+    }
+    inline Iterator end() const {
+      return Iterator(this->base, this->values_end);
+    }
+    inline size_t size() const {
+      return this->values_end - this->values_begin;
+    }
+    inline bool empty() const {
+      return this->values_end == this->values_begin;
+    }
+
+  private:
+    EntityT* base;
+    const uint32_t* values_begin;
+    const uint32_t* values_end;
+  };
+
   struct DATParserRandomState {
     PSOV2Encryption random;
     PSOV2Encryption location_table_random;
@@ -305,7 +442,7 @@ struct Map {
 
   void add_objects_from_map_data(uint8_t floor, const void* data, size_t size);
 
-  bool check_and_log_rare_enemy(bool default_is_rare, uint32_t rare_rate);
+  bool check_and_log_rare_enemy(bool default_is_rare, uint32_t rare_rate, size_t enemy_index);
   void add_enemy(
       Episode episode,
       uint8_t difficulty,
@@ -340,8 +477,8 @@ struct Map {
       uint16_t section,
       uint16_t wave_number,
       uint32_t action_stream_offset);
-  std::vector<Event*> get_events(uint8_t floor, uint32_t event_id);
-  std::vector<const Event*> get_events(uint8_t floor, uint32_t event_id) const;
+  EntityRange<Event> get_events(uint8_t floor, uint32_t event_id);
+  EntityRange<const Event> get_events(uint8_t floor, uint32_t event_id) const;
   void add_events_from_map_data(uint8_t floor, const void* data, size_t size);
 
   struct DATSectionsForFloor {
@@ -363,10 +500,10 @@ struct Map {
 
   const Enemy& find_enemy(uint8_t floor, EnemyType type) const;
   Enemy& find_enemy(uint8_t floor, EnemyType type);
-  std::vector<Object*> get_objects(uint8_t floor, uint16_t section, uint16_t wave_number);
-  std::vector<Enemy*> get_enemies(uint8_t floor, uint16_t section, uint16_t wave_number);
-  std::vector<Event*> get_events(uint8_t floor, uint16_t section, uint16_t wave_number);
-  std::vector<Event*> get_events(uint8_t floor);
+  EntityRange<Object> get_objects(uint8_t floor, uint16_t section, uint16_t group);
+  EntityRange<Enemy> get_enemies(uint8_t floor, uint16_t section, uint16_t wave_number);
+  EntityRange<Event> get_events(uint8_t floor, uint16_t section, uint16_t wave_number);
+  EntityRange<Event> get_events(uint8_t floor);
 
   static std::string disassemble_objects_data(const void* data, size_t size, size_t* object_number = nullptr);
   static std::string disassemble_enemies_data(const void* data, size_t size, size_t* enemy_number = nullptr);
@@ -383,10 +520,53 @@ struct Map {
   std::vector<size_t> rare_enemy_indexes;
   std::vector<Event> events;
   std::string event_action_stream;
-  std::multimap<uint64_t, size_t> floor_and_event_id_to_index;
-  std::unordered_multimap<uint64_t, size_t> floor_section_and_group_to_object_index;
-  std::unordered_multimap<uint64_t, size_t> floor_section_and_wave_number_to_enemy_index;
-  std::unordered_multimap<uint64_t, size_t> floor_section_and_wave_number_to_event_index;
+
+private:
+  struct DeferredTemplate {
+    uint8_t floor;
+    std::shared_ptr<const EntitiesTemplate> t;
+    std::vector<bool> enemy_is_rare;
+  };
+  std::deque<DeferredTemplate> deferred_templates;
+  size_t num_deferred_enemies = 0;
+
+  std::vector<bool> roll_rare_enemies(const EntitiesTemplate& t, const RareEnemyRates* rare_rates, size_t base_enemy_index);
+  void append_template(const EntitiesTemplate& t, const std::vector<bool>& enemy_is_rare);
+  void materialize_next_deferred_template();
+
+  // These are rebuilt from the entity vectors on the first lookup after any
+  // entities are added, since entities are added in bulk when the map is
+  // loaded and then looked up many times during the game.
+  mutable bool indexes_stale = true;
+  mutable FlatIndex floor_and_event_id_to_event_index;
+  mutable FlatIndex floor_section_and_group_to_object_index;
+  mutable FlatIndex floor_section_and_wave_number_to_enemy_index;
+  mutable FlatIndex floor_section_and_wave_number_to_event_index;
+
+  void update_indexes() const;
+};
+
+// Caches parsed map files, so creating a game doesn't require parsing the same
+// map files again. This is thread-safe; templates are immutable once created.
+class MapTemplateCache {
+public:
+  MapTemplateCache() = default;
+  MapTemplateCache(const MapTemplateCache&) = delete;
+  MapTemplateCache(MapTemplateCache&&) = delete;
+  MapTemplateCache& operator=(const MapTemplateCache&) = delete;
+  MapTemplateCache& operator=(MapTemplateCache&&) = delete;
+  ~MapTemplateCache() = default;
+
+  // The key must include everything that affects how the template is parsed.
+  // generate() is called without the lock held, so multiple threads may
+  // generate the same template at once; only the first result is kept. Null
+  // results (e.g. for missing files) are cached too.
+  std::shared_ptr<const Map::EntitiesTemplate> get(
+      const std::string& key, std::function<std::shared_ptr<const Map::EntitiesTemplate>()> generate);
+
+private:
+  std::shared_mutex lock;
+  std::unordered_map<std::string, std::shared_ptr<const Map::EntitiesTemplate>> templates;
 };
 
 class SetDataTableBase {
@@ -492,3 +672,80 @@ std::vector<std::vector<std::string>> map_filenames_for_variations_deprecated(
     Episode episode,
     GameMode mode,
     bool is_enemies);
+
+// Computes which enemies would be rare in a game with a given rare seed,
+// without generating the game's map. The map files are parsed only once, when
+// the evaluator is constructed; for each seed, only the random values and
+// enemy indexes that affect the rare rolls are computed. This is used for
+// searching many seeds at once (e.g. for find-rare-enemy-seeds).
+class RareEnemySeedEvaluator {
+public:
+  // Evaluates free-roam maps, as generated by Lobby::load_maps with variations
+  // from SetDataTableBase::generate_variations using the same seed.
+  RareEnemySeedEvaluator(
+      Version version,
+      Episode episode,
+      GameMode mode,
+      uint8_t difficulty,
+      uint8_t event,
+      std::shared_ptr<const SetDataTableBase> sdt,
+      std::function<std::shared_ptr<const std::string>(Version, const std::string&)> get_file_data,
+      std::shared_ptr<const Map::RareEnemyRates> rare_rates);
+  // Evaluates a quest's map. Throws if the quest has random enemies (as in
+  // Challenge mode), since which enemies exist depends on the seed.
+  RareEnemySeedEvaluator(
+      Version version,
+      Episode episode,
+      uint8_t difficulty,
+      uint8_t event,
+      const std::string& quest_dat_contents_decompressed,
+      std::shared_ptr<const Map::RareEnemyRates> rare_rates);
+  RareEnemySeedEvaluator(const RareEnemySeedEvaluator&) = delete;
+  RareEnemySeedEvaluator(RareEnemySeedEvaluator&&) = delete;
+  RareEnemySeedEvaluator& operator=(const RareEnemySeedEvaluator&) = delete;
+  RareEnemySeedEvaluator& operator=(RareEnemySeedEvaluator&&) = delete;
+  ~RareEnemySeedEvaluator() = default;
+
+  struct RareEnemy {
+    size_t enemy_index;
+    EnemyType type;
+  };
+  // Replaces the contents of ret with the rare enemies that would appear in
+  // the map for this seed, in enemy index order. ret is passed in so the
+  // caller can reuse it across seeds.
+  void evaluate(std::vector<RareEnemy>& ret, uint32_t seed) const;
+
+private:
+  // Only enemies that might be rare are included. A slot is a group of
+  // consecutive enemies that share one rare roll (a parent and its children),
+  // or a group that's always rare.
+  struct Slot {
+    uint32_t relative_index;
+    uint32_t count;
+    uint32_t rare_rate;
+    bool has_roll;
+    bool default_is_rare;
+    EnemyType type;
+    EnemyType rare_type;
+  };
+  struct FloorVariation {
+    std::vector<Slot> slots;
+    size_t num_enemies = 0;
+    size_t num_rolls = 0;
+  };
+  struct Floor {
+    // If num_var1 or num_var2 is greater than 1, a value is taken from the
+    // random stream to choose that variation
+    uint32_t num_var1 = 1;
+    uint32_t num_var2 = 1;
+    std::vector<FloorVariation> variations; // [var1 * num_var2 + var2]
+  };
+
+  Version version;
+  std::vector<Floor> floors;
+  size_t num_variation_values = 0;
+  std::unique_ptr<PSOV2EncryptionAffineStream> stream;
+
+  static FloorVariation compile_template(const Map::EntitiesTemplate& t, const Map::RareEnemyRates& rare_rates);
+  void create_stream();
+};
@@ -147,6 +147,19 @@ PSOEncryption::Type PSOV2Encryption::type() const {
   return Type::V2;
 }
 
+PSOV2EncryptionAffineStream::PSOV2EncryptionAffineStream(size_t count) {
+  // If f(seed) = m * seed + b, then f(0) = b and f(1) - f(0) = m
+  PSOV2Encryption crypt0(0);
+  PSOV2Encryption crypt1(1);
+  this->multipliers.reserve(count);
+  this->offsets.reserve(count);
+  for (size_t z = 0; z < count; z++) {
+    uint32_t offset = crypt0.next();
+    this->multipliers.emplace_back(crypt1.next() - offset);
+    this->offsets.emplace_back(offset);
+  }
+}
+
 PSOV3Encryption::PSOV3Encryption(uint32_t seed)
     : PSOLFGEncryption(seed, STREAM_LENGTH, STREAM_LENGTH) {
   uint32_t x, y, basekey, source1, source2, source3;
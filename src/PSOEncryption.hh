@@ -85,6 +85,30 @@ protected:
   static constexpr size_t STREAM_LENGTH = 0x38;
 };
 
+// PSOV2Encryption's initial state is built from the seed using only addition
+// and subtraction, and so is every later state, so each value it generates is
+// an affine function of the seed (modulo 2^32). This computes the coefficients
+// for the first few values, so they can be computed directly for any seed
+// without generating the entire stream. This is much faster when many seeds
+// are needed, such as for rare enemy rolls on v1-v3.
+class PSOV2EncryptionAffineStream {
+public:
+  explicit PSOV2EncryptionAffineStream(size_t count);
+
+  // Returns the same value as the (index + 1)th call to next() on a
+  // PSOV2Encryption constructed with this seed
+  inline uint32_t value(uint32_t seed, size_t index) const {
+    return this->multipliers[index] * seed + this->offsets[index];
+  }
+  inline size_t size() const {
+    return this->offsets.size();
+  }
+
+private:
+  std::vector<uint32_t> multipliers;
+  std::vector<uint32_t> offsets;
+};
+
 class PSOV3Encryption : public PSOLFGEncryption {
 public:
   explicit PSOV3Encryption(uint32_t key);
@@ -8,6 +8,7 @@
 #include <phosg/Hash.hh>
 #include <stdexcept>
 
+#include "EventUtils.hh"
 #include "FileContentsCache.hh"
 #include "ItemData.hh"
 #include "Loggers.hh"
@@ -19,13 +20,27 @@
 
 using namespace std;
 
-PlayerFilesManager::PlayerFilesManager(std::shared_ptr<struct event_base> base)
+PlayerFilesManager::PlayerFilesManager(
+    std::shared_ptr<struct event_base> base, std::shared_ptr<FileWriteQueue> write_queue, size_t max_cache_bytes)
     : base(base),
+      write_queue(write_queue),
       clear_expired_files_event(
           event_new(this->base.get(), -1, EV_TIMEOUT | EV_PERSIST, &PlayerFilesManager::clear_expired_files, this),
-          event_free) {
+          event_free),
+      max_cache_bytes(max_cache_bytes),
+      prefetch_thread(&PlayerFilesManager::prefetch_thread_fn, this) {
   auto tv = usecs_to_timeval(30 * 1000 * 1000);
   event_add(this->clear_expired_files_event.get(), &tv);
+  this->current_stats.max_cache_bytes = this->max_cache_bytes;
+}
+
+PlayerFilesManager::~PlayerFilesManager() {
+  {
+    lock_guard g(this->prefetch_lock);
+    this->prefetch_should_exit = true;
+  }
+  this->prefetch_cv.notify_all();
+  this->prefetch_thread.join();
 }
 
 template <typename KeyT, typename ValueT>
@@ -44,7 +59,9 @@ size_t erase_unused(std::unordered_map<KeyT, std::shared_ptr<ValueT>>& m) {
 
 std::shared_ptr<PSOBBBaseSystemFile> PlayerFilesManager::get_system(const std::string& filename) {
   try {
-    return this->loaded_system_files.at(filename);
+    auto ret = this->loaded_system_files.at(filename);
+    this->current_stats.loaded_hits++;
+    return ret;
   } catch (const out_of_range&) {
     return nullptr;
   }
@@ -52,7 +69,9 @@ std::shared_ptr<PSOBBBaseSystemFile> PlayerFilesManager::get_system(const std::s
 
 std::shared_ptr<PSOBBCharacterFile> PlayerFilesManager::get_character(const std::string& filename) {
   try {
-    return this->loaded_character_files.at(filename);
+    auto ret = this->loaded_character_files.at(filename);
+    this->current_stats.loaded_hits++;
+    return ret;
   } catch (const out_of_range&) {
     return nullptr;
   }
@@ -60,7 +79,9 @@ std::shared_ptr<PSOBBCharacterFile> PlayerFilesManager::get_character(const std:
 
 std::shared_ptr<PSOBBGuildCardFile> PlayerFilesManager::get_guild_card(const std::string& filename) {
   try {
-    return this->loaded_guild_card_files.at(filename);
+    auto ret = this->loaded_guild_card_files.at(filename);
+    this->current_stats.loaded_hits++;
+    return ret;
   } catch (const out_of_range&) {
     return nullptr;
   }
@@ -68,7 +89,9 @@ std::shared_ptr<PSOBBGuildCardFile> PlayerFilesManager::get_guild_card(const std
 
 std::shared_ptr<PlayerBank200> PlayerFilesManager::get_bank(const std::string& filename) {
   try {
-    return this->loaded_bank_files.at(filename);
+    auto ret = this->loaded_bank_files.at(filename);
+    this->current_stats.loaded_hits++;
+    return ret;
   } catch (const out_of_range&) {
     return nullptr;
   }
@@ -98,6 +121,146 @@ void PlayerFilesManager::set_bank(const std::string& filename, std::shared_ptr<P
   }
 }
 
+bool PlayerFilesManager::discard_character_if_unused(const std::string& filename) {
+  auto it = this->loaded_character_files.find(filename);
+  if (it == this->loaded_character_files.end()) {
+    return true;
+  }
+  if (it->second.use_count() > 1) {
+    return false;
+  }
+  this->loaded_character_files.erase(it);
+  return true;
+}
+
+shared_ptr<const string> PlayerFilesManager::cache_get(const string& filename) {
+  auto it = this->cache_index.find(filename);
+  if (it == this->cache_index.end()) {
+    return nullptr;
+  }
+  this->cache_entries.splice(this->cache_entries.begin(), this->cache_entries, it->second);
+  return it->second->data;
+}
+
+void PlayerFilesManager::cache_put(const string& filename, shared_ptr<const string> data) {
+  auto it = this->cache_index.find(filename);
+  if (it != this->cache_index.end()) {
+    this->cache_bytes -= it->second->data->size();
+    this->cache_entries.erase(it->second);
+    this->cache_index.erase(it);
+  }
+
+  if (data->size() <= this->max_cache_bytes) {
+    this->cache_bytes += data->size();
+    this->cache_entries.emplace_front(CacheEntry{filename, std::move(data)});
+    this->cache_index.emplace(filename, this->cache_entries.begin());
+  }
+
+  this->evict_cache_entries();
+}
+
+void PlayerFilesManager::evict_cache_entries() {
+  while (this->cache_bytes > this->max_cache_bytes) {
+    auto& entry = this->cache_entries.back();
+    this->cache_bytes -= entry.data->size();
+    this->cache_index.erase(entry.filename);
+    this->cache_entries.pop_back();
+    this->current_stats.evicted_files++;
+  }
+  this->current_stats.cache_entries = this->cache_entries.size();
+  this->current_stats.cache_bytes = this->cache_bytes;
+}
+
+shared_ptr<const string> PlayerFilesManager::load_file_data(const string& filename) {
+  shared_ptr<const string> data;
+  if (this->write_queue && this->write_queue->get_pending(filename, &data)) {
+    this->current_stats.cache_hits++;
+    return data;
+  }
+  data = this->cache_get(filename);
+  if (data) {
+    this->current_stats.cache_hits++;
+    return data;
+  }
+  this->current_stats.cache_misses++;
+  if (!isfile(filename)) {
+    return nullptr;
+  }
+  data = make_shared<string>(load_file(filename));
+  this->cache_put(filename, data);
+  return data;
+}
+
+void PlayerFilesManager::save_file_data(const string& filename, shared_ptr<const string> data) {
+  this->cache_put(filename, data);
+  if (this->write_queue) {
+    this->write_queue->write(filename, std::move(data));
+  } else {
+    save_file(filename, *data);
+  }
+}
+
+void PlayerFilesManager::prefetch(const vector<string>& filenames) {
+  {
+    lock_guard g(this->prefetch_lock);
+    for (const auto& filename : filenames) {
+      if (!this->cache_index.count(filename)) {
+        this->prefetch_queue.emplace_back(filename);
+      }
+    }
+  }
+  this->prefetch_cv.notify_one();
+}
+
+void PlayerFilesManager::prefetch_thread_fn() {
+  unique_lock g(this->prefetch_lock);
+  for (;;) {
+    this->prefetch_cv.wait(g, [&]() -> bool {
+      return this->prefetch_should_exit || !this->prefetch_queue.empty();
+    });
+    if (this->prefetch_should_exit) {
+      return;
+    }
+    string filename = std::move(this->prefetch_queue.front());
+    this->prefetch_queue.pop_front();
+    g.unlock();
+
+    // If the file has a pending write, the event thread will get its contents
+    // from the write queue instead, so there's no need to read it
+    shared_ptr<const string> data;
+    if (!(this->write_queue && this->write_queue->get_pending(filename, &data)) && isfile(filename)) {
+      try {
+        data = make_shared<string>(load_file(filename));
+      } catch (const exception& e) {
+        player_data_log.warning("Failed to prefetch %s: %s", filename.c_str(), e.what());
+      }
+      // The file may have been loaded or saved on the event thread since this
+      // read began; in that case, the cached contents are newer and are kept
+      if (data) {
+        forward_to_event_thread(this->base, [wself = this->weak_from_this(), filename, data]() -> void {
+          auto self = wself.lock();
+          if (self && !self->cache_index.count(filename)) {
+            self->cache_put(filename, data);
+            self->current_stats.prefetched_files++;
+          }
+        });
+      }
+    }
+
+    g.lock();
+  }
+}
+
+void PlayerFilesManager::set_max_cache_bytes(size_t max_cache_bytes) {
+  this->max_cache_bytes = max_cache_bytes;
+  this->current_stats.max_cache_bytes = max_cache_bytes;
+  this->evict_cache_entries();
+}
+
+PlayerFilesManager::Stats PlayerFilesManager::stats() const {
+  return this->current_stats;
+}
+
 void PlayerFilesManager::clear_expired_files(evutil_socket_t, short, void* ctx) {
   auto* self = reinterpret_cast<PlayerFilesManager*>(ctx);
   size_t num_deleted = erase_unused(self->loaded_system_files);
@@ -5,12 +5,20 @@
 #include <stddef.h>
 
 #include <array>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <phosg/Encoding.hh>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "Episode3/DataIndexes.hh"
+#include "FileWriteQueue.hh"
 #include "ItemCreator.hh"
 #include "ItemNameIndex.hh"
 #include "LevelTable.hh"
@@ -19,10 +27,32 @@
 #include "Text.hh"
 #include "Version.hh"
 
-class PlayerFilesManager {
+// PlayerFilesManager keeps track of the player files that are currently in use
+// (so that, for example, two clients using the same shared bank see the same
+// object), and caches the contents of recently-used player files in memory, up
+// to a total size limit, so that loading them again (e.g. in the character
+// select menu, or when a player reconnects to the game server) doesn't require
+// reading them from disk. All functions must be called on the event thread.
+class PlayerFilesManager : public std::enable_shared_from_this<PlayerFilesManager> {
 public:
-  explicit PlayerFilesManager(std::shared_ptr<struct event_base> base);
-  ~PlayerFilesManager() = default;
+  struct Stats {
+    uint64_t loaded_hits = 0; // get_* calls that returned an already-loaded file
+    uint64_t cache_hits = 0; // load_file_data calls that didn't read from disk
+    uint64_t cache_misses = 0; // load_file_data calls that read from disk
+    uint64_t prefetched_files = 0;
+    uint64_t evicted_files = 0;
+    size_t cache_entries = 0;
+    size_t cache_bytes = 0;
+    size_t max_cache_bytes = 0;
+  };
+
+  PlayerFilesManager(
+      std::shared_ptr<struct event_base> base, std::shared_ptr<FileWriteQueue> write_queue, size_t max_cache_bytes);
+  PlayerFilesManager(const PlayerFilesManager&) = delete;
+  PlayerFilesManager(PlayerFilesManager&&) = delete;
+  PlayerFilesManager& operator=(const PlayerFilesManager&) = delete;
+  PlayerFilesManager& operator=(PlayerFilesManager&&) = delete;
+  ~PlayerFilesManager();
 
   std::shared_ptr<PSOBBBaseSystemFile> get_system(const std::string& filename);
   std::shared_ptr<PSOBBCharacterFile> get_character(const std::string& filename);
@@ -34,8 +64,27 @@ public:
   void set_guild_card(const std::string& filename, std::shared_ptr<PSOBBGuildCardFile> file);
   void set_bank(const std::string& filename, std::shared_ptr<PlayerBank200> file);
 
+  // Forgets the loaded character file, so the next load will use the file's
+  // contents instead. Returns false (and does nothing) if the file is in use.
+  bool discard_character_if_unused(const std::string& filename);
+
+  // Returns the contents of a player file, or nullptr if it doesn't exist. This
+  // must be used instead of reading player files directly, since the latest
+  // contents of the file may not have been written to disk yet.
+  std::shared_ptr<const std::string> load_file_data(const std::string& filename);
+  // Saves a player file. The contents are cached, and are written to disk
+  // asynchronously if there is a write queue.
+  void save_file_data(const std::string& filename, std::shared_ptr<const std::string> data);
+  // Reads the given files into the cache on a background thread. Files that
+  // are already cached or don't exist are skipped.
+  void prefetch(const std::vector<std::string>& filenames);
+
+  void set_max_cache_bytes(size_t max_cache_bytes);
+  Stats stats() const;
+
 private:
   std::shared_ptr<struct event_base> base;
+  std::shared_ptr<FileWriteQueue> write_queue;
   std::unique_ptr<struct event, void (*)(struct event*)> clear_expired_files_event;
 
   std::unordered_map<std::string, std::shared_ptr<PSOBBBaseSystemFile>> loaded_system_files;
@@ -43,5 +92,28 @@ private:
   std::unordered_map<std::string, std::shared_ptr<PSOBBGuildCardFile>> loaded_guild_card_files;
   std::unordered_map<std::string, std::shared_ptr<PlayerBank200>> loaded_bank_files;
 
+  // Recently-used file contents, in LRU order (front = most recently used)
+  struct CacheEntry {
+    std::string filename;
+    std::shared_ptr<const std::string> data;
+  };
+  std::list<CacheEntry> cache_entries;
+  std::unordered_map<std::string, std::list<CacheEntry>::iterator> cache_index;
+  size_t cache_bytes = 0;
+  size_t max_cache_bytes;
+
+  Stats current_stats;
+
+  std::mutex prefetch_lock;
+  std::condition_variable prefetch_cv;
+  std::deque<std::string> prefetch_queue;
+  bool prefetch_should_exit = false;
+  std::thread prefetch_thread;
+
+  std::shared_ptr<const std::string> cache_get(const std::string& filename);
+  void cache_put(const std::string& filename, std::shared_ptr<const std::string> data);
+  void evict_cache_entries();
+  void prefetch_thread_fn();
+
   static void clear_expired_files(evutil_socket_t fd, short events, void* ctx);
 };
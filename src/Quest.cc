@@ -194,14 +194,109 @@ struct PSODownloadQuestHeader {
   le_uint32_t encryption_seed;
 } __packed_ws__(PSODownloadQuestHeader, 8);
 
+// There is a bug in the client that prevents quests from loading properly if
+// any file's size is a multiple of 0x400. See the comments on the 13 command
+// in CommandFormats.hh for more details.
+static string pad_quest_file_size(string data) {
+  if (!(data.size() & 0x3FF)) {
+    data.push_back(0x00);
+  }
+  return data;
+}
+
+QuestContentCache::QuestContentCache(size_t max_bytes)
+    : max_bytes(max_bytes),
+      current_bytes(0) {}
+
+shared_ptr<const string> QuestContentCache::get(const string& key, const function<string()>& load) {
+  {
+    lock_guard g(this->lock);
+    auto it = this->index.find(key);
+    if (it != this->index.end()) {
+      this->entries.splice(this->entries.begin(), this->entries, it->second);
+      return it->second->data;
+    }
+  }
+
+  // Don't hold the lock while loading, since decoding some files (e.g. quest
+  // scripts that need to be assembled and compressed) can take a while
+  shared_ptr<const string> data = make_shared<string>(load());
+
+  lock_guard g(this->lock);
+  auto it = this->index.find(key);
+  if (it != this->index.end()) {
+    // Another thread loaded the same file while we were loading it
+    this->entries.splice(this->entries.begin(), this->entries, it->second);
+    return it->second->data;
+  }
+  this->insert_locked(key, data);
+  return data;
+}
+
+void QuestContentCache::put(const string& key, shared_ptr<const string> data) {
+  lock_guard g(this->lock);
+  auto it = this->index.find(key);
+  if (it != this->index.end()) {
+    this->current_bytes -= it->second->data->size();
+    this->entries.erase(it->second);
+    this->index.erase(it);
+  }
+  this->insert_locked(key, std::move(data));
+}
+
+void QuestContentCache::insert_locked(const string& key, shared_ptr<const string> data) {
+  if (data->size() > this->max_bytes) {
+    return;
+  }
+  this->current_bytes += data->size();
+  this->entries.emplace_front(Entry{key, std::move(data)});
+  this->index.emplace(key, this->entries.begin());
+  while (this->current_bytes > this->max_bytes) {
+    const auto& entry = this->entries.back();
+    this->current_bytes -= entry.data->size();
+    this->index.erase(entry.key);
+    this->entries.pop_back();
+  }
+}
+
+shared_ptr<const QuestFileSource> QuestFileSource::from_data(shared_ptr<const string> data) {
+  if (!data) {
+    return nullptr;
+  }
+  auto ret = make_shared<QuestFileSource>();
+  ret->data = std::move(data);
+  return ret;
+}
+
+shared_ptr<const string> QuestFileSource::get() const {
+  if (this->data) {
+    return this->data;
+  } else if (this->cache) {
+    return this->cache->get(this->cache_key, this->load);
+  } else {
+    return make_shared<string>(this->load());
+  }
+}
+
+shared_ptr<const string> QuestFileSource::get_chunks(const string& filename) const {
+  auto encode = [&]() -> string {
+    return encode_quest_file_chunks(filename, *this->get());
+  };
+  if (this->cache) {
+    return this->cache->get(this->cache_key + ":chunks:" + filename, encode);
+  } else {
+    return make_shared<string>(encode());
+  }
+}
+
 VersionedQuest::VersionedQuest(
     uint32_t quest_number,
     uint32_t category_id,
     Version version,
     uint8_t language,
-    std::shared_ptr<const std::string> bin_contents,
-    std::shared_ptr<const std::string> dat_contents,
-    std::shared_ptr<const std::string> pvr_contents,
+    std::shared_ptr<const QuestFileSource> bin_source,
+    std::shared_ptr<const QuestFileSource> dat_source,
+    std::shared_ptr<const QuestFileSource> pvr_source,
     std::shared_ptr<const BattleRules> battle_rules,
     ssize_t challenge_template_index,
     uint8_t description_flag,
@@ -219,20 +314,16 @@ VersionedQuest::VersionedQuest(
       version(version),
       language(language),
       is_dlq_encoded(false),
-      bin_contents(bin_contents),
-      dat_contents(dat_contents),
-      pvr_contents(pvr_contents),
+      bin_source(bin_source),
+      dat_source(dat_source),
+      pvr_source(pvr_source),
       battle_rules(battle_rules),
       challenge_template_index(challenge_template_index),
       description_flag(description_flag),
       available_expression(available_expression),
       enabled_expression(enabled_expression) {
 
-  if (this->dat_contents) {
-    this->dat_contents_decompressed = make_shared<string>(prs_decompress(*this->dat_contents));
-  }
-
-  auto bin_decompressed = prs_decompress(*this->bin_contents);
+  auto bin_decompressed = prs_decompress(*this->bin_contents());
 
   switch (this->version) {
     case Version::DC_NTE: {
@@ -341,6 +432,44 @@ VersionedQuest::VersionedQuest(
   }
 }
 
+shared_ptr<const string> VersionedQuest::bin_contents() const {
+  return this->bin_source->get();
+}
+
+shared_ptr<const string> VersionedQuest::dat_contents() const {
+  return this->dat_source ? this->dat_source->get() : nullptr;
+}
+
+shared_ptr<const string> VersionedQuest::dat_contents_decompressed() const {
+  if (!this->dat_source) {
+    return nullptr;
+  }
+  auto decompress = [&]() -> string {
+    return prs_decompress(*this->dat_source->get());
+  };
+  if (this->dat_source->cache) {
+    return this->dat_source->cache->get(this->dat_source->cache_key + ":decompressed", decompress);
+  } else {
+    return make_shared<string>(decompress());
+  }
+}
+
+shared_ptr<const string> VersionedQuest::pvr_contents() const {
+  return this->pvr_source ? this->pvr_source->get() : nullptr;
+}
+
+shared_ptr<const string> VersionedQuest::bin_chunks() const {
+  return this->bin_source->get_chunks(this->bin_filename());
+}
+
+shared_ptr<const string> VersionedQuest::dat_chunks() const {
+  return this->dat_source ? this->dat_source->get_chunks(this->dat_filename()) : nullptr;
+}
+
+shared_ptr<const string> VersionedQuest::pvr_chunks() const {
+  return this->pvr_source ? this->pvr_source->get_chunks(this->pvr_filename()) : nullptr;
+}
+
 string VersionedQuest::bin_filename() const {
   if (this->episode == Episode::EP3) {
     return string_printf("m%06" PRIu32 "p_e.bin", this->quest_number);
@@ -375,10 +504,10 @@ string VersionedQuest::xb_filename() const {
 
 string VersionedQuest::encode_qst() const {
   unordered_map<string, shared_ptr<const string>> files;
-  files.emplace(string_printf("quest%" PRIu32 ".bin", this->quest_number), this->bin_contents);
-  files.emplace(string_printf("quest%" PRIu32 ".dat", this->quest_number), this->dat_contents);
-  if (this->pvr_contents) {
-    files.emplace(string_printf("quest%" PRIu32 ".pvr", this->quest_number), this->pvr_contents);
+  files.emplace(string_printf("quest%" PRIu32 ".bin", this->quest_number), this->bin_contents());
+  files.emplace(string_printf("quest%" PRIu32 ".dat", this->quest_number), this->dat_contents());
+  if (this->pvr_source) {
+    files.emplace(string_printf("quest%" PRIu32 ".pvr", this->quest_number), this->pvr_contents());
   }
   string xb_filename = string_printf("quest%" PRIu32 "_%c.dat", quest_number, tolower(char_for_language_code(language)));
   return encode_qst_file(files, this->name, this->quest_number, xb_filename, this->version, this->is_dlq_encoded);
@@ -483,13 +612,15 @@ shared_ptr<const VersionedQuest> Quest::version(Version v, uint8_t language) con
 QuestIndex::QuestIndex(
     const string& directory,
     std::shared_ptr<const QuestCategoryIndex> category_index,
+    std::shared_ptr<QuestContentCache> content_cache,
     bool is_ep3)
     : directory(directory),
-      category_index(category_index) {
+      category_index(category_index),
+      content_cache(content_cache) {
 
   struct FileData {
     std::string filename;
-    shared_ptr<const string> data;
+    shared_ptr<const QuestFileSource> source;
   };
   map<string, FileData> bin_files;
   map<string, FileData> dat_files;
@@ -503,20 +634,26 @@ QuestIndex::QuestIndex(
       continue;
     }
 
-    auto add_file = [&](map<string, FileData>& files, const string& basename, const string& filename, string&& value, bool check_chunk_size) {
+    auto add_file = [&](map<string, FileData>& files, const string& basename, const string& filename, shared_ptr<const QuestFileSource> source) {
       if (categories.emplace(basename, cat->category_id).first->second != cat->category_id) {
         throw runtime_error("file " + basename + " exists in multiple categories");
       }
-      auto data_ptr = make_shared<string>(std::move(value));
-      if (!files.emplace(basename, FileData{filename, data_ptr}).second) {
+      if (!files.emplace(basename, FileData{filename, std::move(source)}).second) {
         throw runtime_error("file " + basename + " already exists");
       }
-      // There is a bug in the client that prevents quests from loading properly
-      // if any file's size is a multiple of 0x400. See the comments on the 13
-      // command in CommandFormats.hh for more details.
-      if (check_chunk_size && !(data_ptr->size() & 0x3FF)) {
-        data_ptr->push_back(0x00);
-      }
+    };
+
+    // Quest files aren't loaded here (except for .qst files, which we have to
+    // decode to know what they contain); instead, we remember how to load each
+    // one, and it's loaded when the quest is indexed or sent to a client.
+    auto make_source = [&](const string& cache_key, function<string()>&& load) -> shared_ptr<const QuestFileSource> {
+      auto ret = make_shared<QuestFileSource>();
+      ret->cache_key = cache_key;
+      ret->load = [load = std::move(load)]() -> string {
+        return pad_quest_file_size(load());
+      };
+      ret->cache = this->content_cache;
+      return ret;
     };
 
     string cat_path = directory + "/" + cat->directory_name;
@@ -532,26 +669,28 @@ QuestIndex::QuestIndex(
       string file_path = cat_path + "/" + filename;
       try {
         string orig_filename = filename;
-        string file_data;
+        function<string(const string&)> decode;
         if (ends_with(filename, ".gci")) {
-          file_data = decode_gci_data(load_file(file_path));
+          decode = [](const string& data) -> string { return decode_gci_data(data); };
           filename.resize(filename.size() - 4);
         } else if (ends_with(filename, ".vms")) {
-          file_data = decode_vms_data(load_file(file_path));
+          decode = [](const string& data) -> string { return decode_vms_data(data); };
           filename.resize(filename.size() - 4);
         } else if (ends_with(filename, ".dlq")) {
-          file_data = decode_dlq_data(load_file(file_path));
+          decode = [](const string& data) -> string { return decode_dlq_data(data); };
           filename.resize(filename.size() - 4);
         } else if (ends_with(filename, ".txt")) {
-          string include_dir = dirname(file_path);
-          file_data = assemble_quest_script(load_file(file_path), include_dir);
+          decode = [include_dir = dirname(file_path)](const string& data) -> string {
+            return assemble_quest_script(data, include_dir);
+          };
           filename.resize(filename.size() - 4);
           if (ends_with(filename, ".bin")) {
             filename.push_back('d');
           }
-        } else {
-          file_data = load_file(file_path);
         }
+        auto load_decoded = [file_path, decode]() -> string {
+          return decode ? decode(load_file(file_path)) : load_file(file_path);
+        };
 
         size_t dot_pos = filename.rfind('.');
         string file_basename;
@@ -564,28 +703,59 @@ QuestIndex::QuestIndex(
         }
 
         if (extension == "json") {
-          add_file(json_files, file_basename, orig_filename, std::move(file_data), false);
+          add_file(json_files, file_basename, orig_filename, QuestFileSource::from_data(make_shared<string>(load_decoded())));
         } else if (extension == "bin" || extension == "mnm") {
-          add_file(bin_files, file_basename, orig_filename, std::move(file_data), true);
+          add_file(bin_files, file_basename, orig_filename, make_source(file_path, std::move(load_decoded)));
         } else if (extension == "bind" || extension == "mnmd") {
-          add_file(bin_files, file_basename, orig_filename, prs_compress_optimal(file_data), true);
+          add_file(bin_files, file_basename, orig_filename, make_source(file_path, [load_decoded]() -> string {
+            return prs_compress_optimal(load_decoded());
+          }));
         } else if (extension == "dat") {
-          add_file(dat_files, file_basename, orig_filename, std::move(file_data), true);
+          add_file(dat_files, file_basename, orig_filename, make_source(file_path, std::move(load_decoded)));
         } else if (extension == "datd") {
-          add_file(dat_files, file_basename, orig_filename, prs_compress_optimal(file_data), true);
+          add_file(dat_files, file_basename, orig_filename, make_source(file_path, [load_decoded]() -> string {
+            return prs_compress_optimal(load_decoded());
+          }));
         } else if (extension == "pvr") {
-          add_file(pvr_files, file_basename, orig_filename, std::move(file_data), true);
+          add_file(pvr_files, file_basename, orig_filename, make_source(file_path, std::move(load_decoded)));
         } else if (extension == "qst") {
-          auto files = decode_qst_data(file_data);
+          // Decoding the container here validates it, so a malformed .qst
+          // file is reported now rather than when a client starts the quest
+          auto files = decode_qst_data(load_decoded());
+          for (const auto& it : files) {
+            if (!ends_with(it.first, ".bin") && !ends_with(it.first, ".dat") && !ends_with(it.first, ".pvr")) {
+              throw runtime_error("qst file contains unsupported file type: " + it.first);
+            }
+          }
+
+          // The inner files can only be decoded together, so when any of them
+          // has to be loaded again, the others are put in the cache as well
+          auto load_inner_file = [load_decoded, file_path, cache = this->content_cache](const string& internal_filename) -> string {
+            auto files = decode_qst_data(load_decoded());
+            string ret = std::move(files.at(internal_filename));
+            if (cache) {
+              for (auto& it : files) {
+                if (it.first != internal_filename) {
+                  cache->put(file_path + ":" + it.first, make_shared<string>(pad_quest_file_size(std::move(it.second))));
+                }
+              }
+            }
+            return ret;
+          };
           for (auto& it : files) {
+            string cache_key = file_path + ":" + it.first;
+            auto source = make_source(cache_key, [load_inner_file, internal_filename = it.first]() -> string {
+              return load_inner_file(internal_filename);
+            });
+            if (this->content_cache) {
+              this->content_cache->put(cache_key, make_shared<string>(pad_quest_file_size(std::move(it.second))));
+            }
             if (ends_with(it.first, ".bin")) {
-              add_file(bin_files, file_basename, orig_filename, std::move(it.second), true);
+              add_file(bin_files, file_basename, orig_filename, std::move(source));
             } else if (ends_with(it.first, ".dat")) {
-              add_file(dat_files, file_basename, orig_filename, std::move(it.second), true);
-            } else if (ends_with(it.first, ".pvr")) {
-              add_file(pvr_files, file_basename, orig_filename, std::move(it.second), true);
+              add_file(dat_files, file_basename, orig_filename, std::move(source));
             } else {
-              throw runtime_error("qst file contains unsupported file type: " + it.first);
+              add_file(pvr_files, file_basename, orig_filename, std::move(source));
             }
           }
         }
@@ -704,7 +874,7 @@ QuestIndex::QuestIndex(
         }
       }
       if (json_filedata) {
-        auto metadata_json = JSON::parse(*json_filedata->data);
+        auto metadata_json = JSON::parse(*json_filedata->source->get());
         try {
           battle_rules = make_shared<BattleRules>(metadata_json.at("BattleRules"));
         } catch (const out_of_range&) {
@@ -744,9 +914,9 @@ QuestIndex::QuestIndex(
           category_id,
           version,
           language,
-          bin_filedata->data,
-          dat_filedata ? dat_filedata->data : nullptr,
-          pvr_filedata ? pvr_filedata->data : nullptr,
+          bin_filedata->source,
+          dat_filedata ? dat_filedata->source : nullptr,
+          pvr_filedata ? pvr_filedata->source : nullptr,
           battle_rules,
           challenge_template_index,
           description_flag,
@@ -889,22 +1059,30 @@ string encode_download_quest_data(const string& compressed_data, size_t decompre
   return data;
 }
 
-shared_ptr<VersionedQuest> VersionedQuest::create_download_quest(uint8_t override_language) const {
+string encode_quest_file_chunks(const string& filename, const string& contents) {
+  size_t num_chunks = (contents.size() + 0x3FF) / 0x400;
+  string ret(num_chunks * sizeof(S_WriteFile_13_A7), '\0');
+  auto* cmds = reinterpret_cast<S_WriteFile_13_A7*>(ret.data());
+  for (size_t z = 0; z < num_chunks; z++) {
+    size_t offset = z * 0x400;
+    size_t chunk_bytes = min<size_t>(contents.size() - offset, 0x400);
+    auto& cmd = cmds[z];
+    cmd.filename.encode(filename);
+    memcpy(cmd.data.data(), contents.data() + offset, chunk_bytes);
+    cmd.data_size = chunk_bytes;
+  }
+  return ret;
+}
+
+static string encode_download_quest_bin(const string& compressed_bin, Version version, uint8_t override_language) {
   // The download flag needs to be set in the bin header, or else the client
   // will ignore it when scanning for download quests in an offline game. To set
   // this flag, we need to decompress the quest's .bin file, set the flag, then
   // recompress it again.
-
-  // This function should not be used for Episode 3 quests (they should be sent
-  // to the client as-is, without any encryption or other preprocessing)
-  if (this->episode == Episode::EP3 || is_ep3(this->version)) {
-    throw logic_error("Episode 3 quests cannot be converted to download quests");
-  }
-
-  string decompressed_bin = prs_decompress(*this->bin_contents);
+  string decompressed_bin = prs_decompress(compressed_bin);
 
   void* data_ptr = decompressed_bin.data();
-  switch (this->version) {
+  switch (version) {
     case Version::DC_NTE:
       if (decompressed_bin.size() < sizeof(PSOQuestHeaderDCNTE)) {
         throw runtime_error("bin file is too small for header");
@@ -947,14 +1125,41 @@ shared_ptr<VersionedQuest> VersionedQuest::create_download_quest(uint8_t overrid
       throw invalid_argument("unknown game version");
   }
 
-  string compressed_bin = prs_compress(decompressed_bin);
+  return encode_download_quest_data(prs_compress(decompressed_bin), decompressed_bin.size());
+}
+
+shared_ptr<VersionedQuest> VersionedQuest::create_download_quest(uint8_t override_language) const {
+  // This function should not be used for Episode 3 quests (they should be sent
+  // to the client as-is, without any encryption or other preprocessing)
+  if (this->episode == Episode::EP3 || is_ep3(this->version)) {
+    throw logic_error("Episode 3 quests cannot be converted to download quests");
+  }
+  if (this->version == Version::BB_V4) {
+    throw invalid_argument("PSOBB does not support download quests");
+  }
+
+  // The encoded files are built when they're first needed, and are kept in the
+  // same cache as the original files (if any), so sending the same quest to
+  // many clients only encodes it once per language
+  auto make_source = [&](const shared_ptr<const QuestFileSource>& orig_source, function<string()>&& load) {
+    auto ret = make_shared<QuestFileSource>();
+    if (orig_source && orig_source->cache) {
+      ret->cache = orig_source->cache;
+      ret->cache_key = orig_source->cache_key + string_printf(":download:%02hhX", override_language);
+    }
+    ret->load = std::move(load);
+    return ret;
+  };
 
   // Return a new VersionedQuest object with appropriately-processed .bin and
   // .dat file contents
   auto dlq = make_shared<VersionedQuest>(*this);
-  dlq->bin_contents = make_shared<string>(encode_download_quest_data(compressed_bin, decompressed_bin.size()));
-  dlq->dat_contents = make_shared<string>(encode_download_quest_data(*this->dat_contents));
-  dlq->pvr_contents = this->pvr_contents;
+  dlq->bin_source = make_source(this->bin_source, [bin_source = this->bin_source, version = this->version, override_language]() -> string {
+    return encode_download_quest_bin(*bin_source->get(), version, override_language);
+  });
+  dlq->dat_source = make_source(this->dat_source, [dat_source = this->dat_source]() -> string {
+    return encode_download_quest_data(*dat_source->get());
+  });
   dlq->is_dlq_encoded = true;
   return dlq;
 }
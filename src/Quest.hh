@@ -2,8 +2,11 @@
 
 #include <stdint.h>
 
+#include <functional>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -62,6 +65,59 @@ struct QuestCategoryIndex {
   std::shared_ptr<const Category> at(uint32_t category_id) const;
 };
 
+// Keeps the most recently used quest files in memory, up to a total size
+// limit. Quest indexes only keep each quest's metadata in memory permanently;
+// the files themselves are loaded from disk (and decoded, if needed) the first
+// time they're used, and may be evicted from the cache later.
+class QuestContentCache {
+public:
+  explicit QuestContentCache(size_t max_bytes);
+  QuestContentCache(const QuestContentCache&) = delete;
+  QuestContentCache(QuestContentCache&&) = delete;
+  QuestContentCache& operator=(const QuestContentCache&) = delete;
+  QuestContentCache& operator=(QuestContentCache&&) = delete;
+  ~QuestContentCache() = default;
+
+  // Thread-safe. If the key isn't in the cache, calls load() and caches the
+  // result (unless it's larger than the entire cache).
+  std::shared_ptr<const std::string> get(const std::string& key, const std::function<std::string()>& load);
+  // Thread-safe. Adds an entry to the cache (replacing any existing entry
+  // with the same key), as if it had just been loaded.
+  void put(const std::string& key, std::shared_ptr<const std::string> data);
+
+private:
+  struct Entry {
+    std::string key;
+    std::shared_ptr<const std::string> data;
+  };
+
+  void insert_locked(const std::string& key, std::shared_ptr<const std::string> data);
+
+  size_t max_bytes;
+  size_t current_bytes;
+  std::mutex lock;
+  std::list<Entry> entries; // Most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+};
+
+// Describes where a quest file's contents come from. If data is not null, the
+// contents are always in memory (this is used for quests created at runtime,
+// like download quests). Otherwise, load() is called when the contents are
+// needed, and the result is kept in cache (if given) under cache_key.
+struct QuestFileSource {
+  std::shared_ptr<const std::string> data;
+  std::string cache_key;
+  std::function<std::string()> load;
+  std::shared_ptr<QuestContentCache> cache;
+
+  static std::shared_ptr<const QuestFileSource> from_data(std::shared_ptr<const std::string> data);
+
+  std::shared_ptr<const std::string> get() const;
+  // Returns the file's contents as a sequence of S_WriteFile_13_A7 structs,
+  // ready to be sent to a client. See encode_quest_file_chunks.
+  std::shared_ptr<const std::string> get_chunks(const std::string& filename) const;
+};
+
 struct VersionedQuest {
   uint32_t quest_number;
   uint32_t category_id;
@@ -75,10 +131,9 @@ struct VersionedQuest {
   bool is_dlq_encoded;
   std::string short_description;
   std::string long_description;
-  std::shared_ptr<const std::string> bin_contents;
-  std::shared_ptr<const std::string> dat_contents;
-  std::shared_ptr<const std::string> dat_contents_decompressed;
-  std::shared_ptr<const std::string> pvr_contents;
+  std::shared_ptr<const QuestFileSource> bin_source;
+  std::shared_ptr<const QuestFileSource> dat_source;
+  std::shared_ptr<const QuestFileSource> pvr_source;
   std::shared_ptr<const BattleRules> battle_rules;
   ssize_t challenge_template_index;
   uint8_t description_flag;
@@ -90,9 +145,9 @@ struct VersionedQuest {
       uint32_t category_id,
       Version version,
       uint8_t language,
-      std::shared_ptr<const std::string> bin_contents,
-      std::shared_ptr<const std::string> dat_contents,
-      std::shared_ptr<const std::string> pvr_contents,
+      std::shared_ptr<const QuestFileSource> bin_source,
+      std::shared_ptr<const QuestFileSource> dat_source,
+      std::shared_ptr<const QuestFileSource> pvr_source,
       std::shared_ptr<const BattleRules> battle_rules = nullptr,
       ssize_t challenge_template_index = -1,
       uint8_t description_flag = 0,
@@ -102,6 +157,16 @@ struct VersionedQuest {
       bool force_joinable = false,
       int16_t lock_status_register = -1);
 
+  // These load the file from disk if it isn't already in memory. The dat and
+  // pvr functions return nullptr if the quest doesn't have that file.
+  std::shared_ptr<const std::string> bin_contents() const;
+  std::shared_ptr<const std::string> dat_contents() const;
+  std::shared_ptr<const std::string> dat_contents_decompressed() const;
+  std::shared_ptr<const std::string> pvr_contents() const;
+  std::shared_ptr<const std::string> bin_chunks() const;
+  std::shared_ptr<const std::string> dat_chunks() const;
+  std::shared_ptr<const std::string> pvr_chunks() const;
+
   std::string bin_filename() const;
   std::string dat_filename() const;
   std::string pvr_filename() const;
@@ -152,12 +217,17 @@ struct QuestIndex {
 
   std::string directory;
   std::shared_ptr<const QuestCategoryIndex> category_index;
+  std::shared_ptr<QuestContentCache> content_cache;
 
   std::map<uint32_t, std::shared_ptr<Quest>> quests_by_number;
   std::map<std::string, std::shared_ptr<Quest>> quests_by_name;
   std::map<uint32_t, std::map<uint32_t, std::shared_ptr<Quest>>> quests_by_category_id_and_number;
 
-  QuestIndex(const std::string& directory, std::shared_ptr<const QuestCategoryIndex> category_index, bool is_ep3);
+  QuestIndex(
+      const std::string& directory,
+      std::shared_ptr<const QuestCategoryIndex> category_index,
+      std::shared_ptr<QuestContentCache> content_cache,
+      bool is_ep3);
 
   std::shared_ptr<const Quest> get(uint32_t quest_number) const;
   std::shared_ptr<const Quest> get(const std::string& name) const;
@@ -179,6 +249,10 @@ std::string encode_download_quest_data(
     const std::string& compressed_data,
     size_t decompressed_size = 0,
     uint32_t encryption_seed = 0);
+// Splits a file into 0x400-byte chunks and returns the 13/A7 command bodies
+// for sending it to a client (concatenated S_WriteFile_13_A7 structs). The
+// last chunk is zero-padded.
+std::string encode_quest_file_chunks(const std::string& filename, const std::string& contents);
 
 std::string decode_gci_data(
     const std::string& data,
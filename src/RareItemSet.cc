@@ -1,5 +1,6 @@
 #include "RareItemSet.hh"
 
+#include <algorithm>
 #include <phosg/Filesystem.hh>
 #include <phosg/Math.hh>
 #include <phosg/Random.hh>
@@ -255,6 +256,7 @@ RareItemSet::RareItemSet(const AFSArchive& afs, bool is_v1) {
       }
     }
   }
+  this->build_index();
 }
 
 string RareItemSet::gsl_entry_name_for_table(GameMode mode, Episode episode, uint8_t difficulty, uint8_t section_id) {
@@ -284,6 +286,7 @@ RareItemSet::RareItemSet(const GSLArchive& gsl, bool is_big_endian) {
       }
     }
   }
+  this->build_index();
 }
 
 RareItemSet::RareItemSet(const string& rel_data, bool is_big_endian) {
@@ -304,6 +307,7 @@ RareItemSet::RareItemSet(const string& rel_data, bool is_big_endian) {
       }
     }
   }
+  this->build_index();
 }
 
 RareItemSet::RareItemSet(const JSON& json, shared_ptr<const ItemNameIndex> name_index) {
@@ -382,6 +386,7 @@ RareItemSet::RareItemSet(const JSON& json, shared_ptr<const ItemNameIndex> name_
       }
     }
   }
+  this->build_index();
 }
 
 std::string RareItemSet::serialize_afs(bool is_v1) const {
@@ -510,18 +515,21 @@ JSON RareItemSet::json(shared_ptr<const ItemNameIndex> name_index) const {
 }
 
 void RareItemSet::multiply_all_rates(double factor) {
-  auto multiply_rates_vec = +[](vector<vector<ExpandedDrop>>& vec, double factor) -> void {
-    for (auto& vec_it : vec) {
-      for (auto& z_it : vec_it) {
-        uint64_t new_probability = z_it.probability * factor;
-        z_it.probability = min<uint64_t>(new_probability, 0xFFFFFFFF);
-      }
-    }
+  auto multiply_rate = [factor](ExpandedDrop& drop) -> void {
+    uint64_t new_probability = drop.probability * factor;
+    drop.probability = min<uint64_t>(new_probability, 0xFFFFFFFF);
   };
   for (auto& coll_it : this->collections) {
-    multiply_rates_vec(coll_it.second.rt_index_to_specs, factor);
-    multiply_rates_vec(coll_it.second.box_area_to_specs, factor);
+    for (auto& specs : coll_it.second.rt_index_to_specs) {
+      for_each(specs.begin(), specs.end(), multiply_rate);
+    }
+    for (auto& specs : coll_it.second.box_area_to_specs) {
+      for_each(specs.begin(), specs.end(), multiply_rate);
+    }
   }
+  // The index has the same drops as the collections, so we can update it in
+  // place instead of rebuilding it
+  for_each(this->indexed_drops.begin(), this->indexed_drops.end(), multiply_rate);
 }
 
 void RareItemSet::print_collection(
@@ -588,24 +596,93 @@ void RareItemSet::print_all_collections(FILE* stream, std::shared_ptr<const Item
   }
 }
 
-std::vector<RareItemSet::ExpandedDrop> RareItemSet::get_enemy_specs(
+void RareItemSet::build_index() {
+  this->num_indexed_rt_indexes = 0;
+  this->num_indexed_box_areas = 0;
+  for (const auto& coll_it : this->collections) {
+    this->num_indexed_rt_indexes = max(this->num_indexed_rt_indexes, coll_it.second.rt_index_to_specs.size());
+    this->num_indexed_box_areas = max(this->num_indexed_box_areas, coll_it.second.box_area_to_specs.size());
+  }
+
+  this->indexed_drops.clear();
+  this->indexed_enemy_ranges.clear();
+  this->indexed_enemy_ranges.resize(NUM_INDEXED_TABLES * this->num_indexed_rt_indexes);
+  this->indexed_box_ranges.clear();
+  this->indexed_box_ranges.resize(NUM_INDEXED_TABLES * this->num_indexed_box_areas);
+
+  auto add_specs = [&](DropRange& range, const vector<ExpandedDrop>& specs) -> void {
+    range.offset = this->indexed_drops.size();
+    range.count = specs.size();
+    this->indexed_drops.insert(this->indexed_drops.end(), specs.begin(), specs.end());
+  };
+
+  static const array<GameMode, 4> modes = {GameMode::NORMAL, GameMode::BATTLE, GameMode::CHALLENGE, GameMode::SOLO};
+  static const array<Episode, 3> episodes = {Episode::EP1, Episode::EP2, Episode::EP4};
+  for (GameMode mode : modes) {
+    for (Episode episode : episodes) {
+      for (uint8_t difficulty = 0; difficulty < 4; difficulty++) {
+        for (uint8_t section_id = 0; section_id < 10; section_id++) {
+          auto coll_it = this->collections.find(this->key_for_params(mode, episode, difficulty, section_id));
+          if (coll_it == this->collections.end()) {
+            continue;
+          }
+          size_t table_index = this->index_for_params(mode, episode, difficulty, section_id);
+          const auto& coll = coll_it->second;
+          for (size_t z = 0; z < coll.rt_index_to_specs.size(); z++) {
+            add_specs(this->indexed_enemy_ranges[table_index * this->num_indexed_rt_indexes + z], coll.rt_index_to_specs[z]);
+          }
+          for (size_t z = 0; z < coll.box_area_to_specs.size(); z++) {
+            add_specs(this->indexed_box_ranges[table_index * this->num_indexed_box_areas + z], coll.box_area_to_specs[z]);
+          }
+        }
+      }
+    }
+  }
+}
+
+size_t RareItemSet::index_for_params(GameMode mode, Episode episode, uint8_t difficulty, uint8_t secid) {
+  if ((difficulty > 3) || (secid >= 10)) {
+    return NUM_INDEXED_TABLES;
+  }
+  size_t episode_index;
+  switch (episode) {
+    case Episode::EP1:
+      episode_index = 0;
+      break;
+    case Episode::EP2:
+      episode_index = 1;
+      break;
+    case Episode::EP4:
+      episode_index = 2;
+      break;
+    default:
+      return NUM_INDEXED_TABLES;
+  }
+  size_t mode_index = static_cast<size_t>(mode);
+  if (mode_index >= 4) {
+    return NUM_INDEXED_TABLES;
+  }
+  return ((mode_index * 3 + episode_index) * 4 + difficulty) * 10 + secid;
+}
+
+span<const RareItemSet::ExpandedDrop> RareItemSet::get_enemy_specs(
     GameMode mode, Episode episode, uint8_t difficulty, uint8_t secid, uint8_t rt_index) const {
-  try {
-    return this->get_collection(mode, episode, difficulty, secid).rt_index_to_specs.at(rt_index);
-  } catch (const out_of_range&) {
-    static const std::vector<ExpandedDrop> empty_vector;
-    return empty_vector;
+  size_t table_index = this->index_for_params(mode, episode, difficulty, secid);
+  if ((table_index >= NUM_INDEXED_TABLES) || (rt_index >= this->num_indexed_rt_indexes)) {
+    return {};
   }
+  const auto& range = this->indexed_enemy_ranges[table_index * this->num_indexed_rt_indexes + rt_index];
+  return span<const ExpandedDrop>(this->indexed_drops.data() + range.offset, range.count);
 }
 
-std::vector<RareItemSet::ExpandedDrop> RareItemSet::get_box_specs(
+span<const RareItemSet::ExpandedDrop> RareItemSet::get_box_specs(
     GameMode mode, Episode episode, uint8_t difficulty, uint8_t secid, uint8_t area) const {
-  try {
-    return this->get_collection(mode, episode, difficulty, secid).box_area_to_specs.at(area);
-  } catch (const out_of_range&) {
-    static const std::vector<ExpandedDrop> empty_vector;
-    return empty_vector;
+  size_t table_index = this->index_for_params(mode, episode, difficulty, secid);
+  if ((table_index >= NUM_INDEXED_TABLES) || (area >= this->num_indexed_box_areas)) {
+    return {};
   }
+  const auto& range = this->indexed_box_ranges[table_index * this->num_indexed_box_areas + area];
+  return span<const ExpandedDrop>(this->indexed_drops.data() + range.offset, range.count);
 }
 
 const RareItemSet::SpecCollection& RareItemSet::get_collection(
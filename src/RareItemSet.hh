@@ -6,7 +6,9 @@
 #include <memory>
 #include <phosg/JSON.hh>
 #include <random>
+#include <span>
 #include <string>
+#include <vector>
 
 #include "AFSArchive.hh"
 #include "GSLArchive.hh"
@@ -32,8 +34,11 @@ public:
   RareItemSet(const JSON& json, std::shared_ptr<const ItemNameIndex> name_index = nullptr);
   ~RareItemSet() = default;
 
-  std::vector<ExpandedDrop> get_enemy_specs(GameMode mode, Episode episode, uint8_t difficulty, uint8_t secid, uint8_t rt_index) const;
-  std::vector<ExpandedDrop> get_box_specs(GameMode mode, Episode episode, uint8_t difficulty, uint8_t secid, uint8_t area) const;
+  // These return views into this RareItemSet's lookup index, so they're only
+  // valid until the set is modified or destroyed. They return an empty view if
+  // there are no drops for the given parameters.
+  std::span<const ExpandedDrop> get_enemy_specs(GameMode mode, Episode episode, uint8_t difficulty, uint8_t secid, uint8_t rt_index) const;
+  std::span<const ExpandedDrop> get_box_specs(GameMode mode, Episode episode, uint8_t difficulty, uint8_t secid, uint8_t area) const;
 
   std::string serialize_afs(bool is_v1) const;
   std::string serialize_gsl(bool big_endian) const;
@@ -103,6 +108,25 @@ protected:
 
   std::unordered_map<uint16_t, SpecCollection> collections;
 
+  // Flat lookup index for get_enemy_specs and get_box_specs, built from
+  // collections by build_index(). All drops are stored contiguously in
+  // indexed_drops; the range tables are indexed by [table_index][rt_index] or
+  // [table_index][area], where table_index comes from index_for_params.
+  struct DropRange {
+    uint32_t offset = 0;
+    uint32_t count = 0;
+  };
+  std::vector<ExpandedDrop> indexed_drops;
+  std::vector<DropRange> indexed_enemy_ranges;
+  std::vector<DropRange> indexed_box_ranges;
+  size_t num_indexed_rt_indexes = 0;
+  size_t num_indexed_box_areas = 0;
+
+  void build_index();
+  // Returns NUM_INDEXED_TABLES if the parameters don't refer to any table
+  static constexpr size_t NUM_INDEXED_TABLES = 4 * 3 * 4 * 10; // Modes, episodes, difficulties, section IDs
+  static size_t index_for_params(GameMode mode, Episode episode, uint8_t difficulty, uint8_t secid);
+
   const SpecCollection& get_collection(GameMode mode, Episode episode, uint8_t difficulty, uint8_t secid) const;
 
   static std::string gsl_entry_name_for_table(GameMode mode, Episode episode, uint8_t difficulty, uint8_t section_id);
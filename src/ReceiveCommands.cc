@@ -416,8 +416,8 @@ void on_login_complete(shared_ptr<Client> c) {
             string bin_filename = vq->bin_filename();
             string dat_filename = vq->dat_filename();
             string xb_filename = vq->xb_filename();
-            send_open_quest_file(c, bin_filename, bin_filename, xb_filename, vq->quest_number, QuestFileType::ONLINE, vq->bin_contents);
-            send_open_quest_file(c, dat_filename, dat_filename, xb_filename, vq->quest_number, QuestFileType::ONLINE, vq->dat_contents);
+            send_open_quest_file(c, bin_filename, bin_filename, xb_filename, vq->quest_number, QuestFileType::ONLINE, vq->bin_chunks());
+            send_open_quest_file(c, dat_filename, dat_filename, xb_filename, vq->quest_number, QuestFileType::ONLINE, vq->dat_chunks());
 
             send_command(c, 0xAC, 0x00);
           }
@@ -1117,6 +1117,9 @@ static void on_93_BB(shared_ptr<Client> c, uint16_t, uint32_t, string& data) {
   c->channel.language = c->config.check_flag(Client::Flag::FORCE_ENGLISH_LANGUAGE_BB) ? 1 : base_cmd.language;
   c->bb_connection_phase = base_cmd.connection_phase;
   c->bb_character_index = base_cmd.character_slot;
+  if (c->bb_connection_phase < 0x04) {
+    c->prefetch_player_files();
+  }
 
   if (base_cmd.menu_id == MenuID::LOBBY) {
     c->preferred_lobby_id = base_cmd.preferred_lobby_id;
@@ -2059,6 +2062,7 @@ void set_lobby_quest(shared_ptr<Lobby> l, shared_ptr<const Quest> q, bool substi
   l->quest = q;
   if (!is_ep3(l->base_version)) {
     l->episode = q->episode;
+    l->invalidate_game_menus();
   }
   if (l->item_creator) {
     l->create_item_creator();
@@ -2105,8 +2109,8 @@ void set_lobby_quest(shared_ptr<Lobby> l, shared_ptr<const Quest> q, bool substi
     string bin_filename = vq->bin_filename();
     string dat_filename = vq->dat_filename();
     string xb_filename = vq->xb_filename();
-    send_open_quest_file(lc, bin_filename, bin_filename, xb_filename, vq->quest_number, QuestFileType::ONLINE, vq->bin_contents);
-    send_open_quest_file(lc, dat_filename, dat_filename, xb_filename, vq->quest_number, QuestFileType::ONLINE, vq->dat_contents);
+    send_open_quest_file(lc, bin_filename, bin_filename, xb_filename, vq->quest_number, QuestFileType::ONLINE, vq->bin_chunks());
+    send_open_quest_file(lc, dat_filename, dat_filename, xb_filename, vq->quest_number, QuestFileType::ONLINE, vq->dat_chunks());
 
     if (use_loading_flag) {
       lc->config.set_flag(Client::Flag::LOADING_QUEST);
@@ -2583,15 +2587,15 @@ static void on_10(shared_ptr<Client> c, uint16_t, uint32_t, string& data) {
         // TODO: This is not true for Episode 3 Trial Edition. We also would
         // have to convert the map to a MapDefinitionTrial, though.
         if (is_ep3(vq->version)) {
-          send_open_quest_file(c, q->name, vq->bin_filename(), "", vq->quest_number, QuestFileType::EPISODE_3, vq->bin_contents);
+          send_open_quest_file(c, q->name, vq->bin_filename(), "", vq->quest_number, QuestFileType::EPISODE_3, vq->bin_chunks());
         } else {
           vq = vq->create_download_quest(c->language());
           string xb_filename = vq->xb_filename();
-          QuestFileType type = vq->pvr_contents ? QuestFileType::DOWNLOAD_WITH_PVR : QuestFileType::DOWNLOAD_WITHOUT_PVR;
-          send_open_quest_file(c, q->name, vq->bin_filename(), xb_filename, vq->quest_number, type, vq->bin_contents);
-          send_open_quest_file(c, q->name, vq->dat_filename(), xb_filename, vq->quest_number, type, vq->dat_contents);
-          if (vq->pvr_contents) {
-            send_open_quest_file(c, q->name, vq->pvr_filename(), xb_filename, vq->quest_number, type, vq->pvr_contents);
+          QuestFileType type = vq->pvr_source ? QuestFileType::DOWNLOAD_WITH_PVR : QuestFileType::DOWNLOAD_WITHOUT_PVR;
+          send_open_quest_file(c, q->name, vq->bin_filename(), xb_filename, vq->quest_number, type, vq->bin_chunks());
+          send_open_quest_file(c, q->name, vq->dat_filename(), xb_filename, vq->quest_number, type, vq->dat_chunks());
+          if (vq->pvr_source) {
+            send_open_quest_file(c, q->name, vq->pvr_filename(), xb_filename, vq->quest_number, type, vq->pvr_chunks());
           }
         }
       }
@@ -2998,7 +3002,8 @@ static void on_D7_GC(shared_ptr<Client> c, uint16_t, uint32_t, string& data) {
     try {
       static FileContentsCache gba_file_cache(300 * 1000 * 1000);
       auto f = gba_file_cache.get_or_load("system/gba/" + filename).file;
-      send_open_quest_file(c, "", filename, "", 0, QuestFileType::GBA_DEMO, f->data);
+      auto chunks = make_shared<string>(encode_quest_file_chunks(filename, *f->data));
+      send_open_quest_file(c, "", filename, "", 0, QuestFileType::GBA_DEMO, chunks);
     } catch (const out_of_range&) {
       send_command(c, 0xD7, 0x00);
     } catch (const cannot_open_file&) {
@@ -3015,21 +3020,20 @@ static void on_13_A7_GC(shared_ptr<Client> c, uint16_t command, uint32_t flag, s
   string filename = cmd.filename.decode();
   size_t chunk_to_send = flag + GC_QUEST_LOAD_MAX_CHUNKS_IN_FLIGHT;
 
-  shared_ptr<const string> file_data;
+  shared_ptr<const string> chunks;
   try {
-    file_data = c->sending_files.at(filename);
+    chunks = c->sending_files.at(filename);
   } catch (const out_of_range&) {
     return;
   }
 
-  size_t chunk_offset = chunk_to_send * 0x400;
-  if (chunk_offset >= file_data->size()) {
+  size_t total_chunks = chunks->size() / sizeof(S_WriteFile_13_A7);
+  if (chunk_to_send >= total_chunks) {
     c->log.info("Done sending file %s", filename.c_str());
     c->sending_files.erase(filename);
   } else {
-    const void* chunk_data = file_data->data() + (chunk_to_send * 0x400);
-    size_t chunk_size = min<size_t>(file_data->size() - chunk_offset, 0x400);
-    send_quest_file_chunk(c, filename, chunk_to_send, chunk_data, chunk_size, is_download_quest);
+    const auto* chunk_cmds = reinterpret_cast<const S_WriteFile_13_A7*>(chunks->data());
+    send_quest_file_chunk(c, filename, chunk_to_send, chunk_cmds[chunk_to_send], is_download_quest);
   }
 }
 
@@ -3253,7 +3257,7 @@ static void on_61_98(shared_ptr<Client> c, uint16_t command, uint32_t flag, stri
             pending_export->dest_account->account_id, pending_export->character_index);
       }
 
-      if (s->player_files_manager->get_character(filename)) {
+      if (!s->player_files_manager->discard_character_if_unused(filename)) {
         send_text_message(c, "$C6The target player\nis currently loaded.\nSign off in Blue\nBurst and try again.");
 
       } else {
@@ -3291,7 +3295,7 @@ static void on_61_98(shared_ptr<Client> c, uint16_t command, uint32_t flag, stri
         bb_player->challenge_records = player->challenge_records;
         bb_player->choice_search_config = player->choice_search_config;
         try {
-          Client::save_character_file(filename, c->system_file(), bb_player);
+          c->save_character_file(filename, c->system_file(), bb_player);
           send_text_message(c, "$C7Character data saved\n(basic only)");
         } catch (const exception& e) {
           send_text_message_printf(c, "$C6Character data could\nnot be saved:\n%s", e.what());
@@ -3327,7 +3331,7 @@ static void on_30(shared_ptr<Client> c, uint16_t, uint32_t, string& data) {
   }
 
   auto s = c->require_server_state();
-  if (s->player_files_manager->get_character(filename)) {
+  if (!s->player_files_manager->discard_character_if_unused(filename)) {
     send_text_message(c, "$C6The target player\nis currently loaded.\nSign off in Blue\nBurst and try again.");
     return;
   }
@@ -3363,7 +3367,7 @@ static void on_30(shared_ptr<Client> c, uint16_t, uint32_t, string& data) {
   bb_char->disp.visual.name_color_checksum = 0x00000000;
 
   try {
-    Client::save_character_file(filename, c->system_file(), bb_char);
+    c->save_character_file(filename, c->system_file(), bb_char);
     send_text_message(c, "$C7Character data saved\n(full save file)");
   } catch (const exception& e) {
     send_text_message_printf(c, "$C6Character data could\nnot be saved:\n%s", e.what());
@@ -3828,6 +3832,7 @@ static void on_DF_BB(shared_ptr<Client> c, uint16_t command, uint32_t, string& d
       const auto& cmd = check_size_t<C_SetChallengeModeDifficulty_BB_03DF>(data);
       if (l->difficulty != cmd.difficulty) {
         l->difficulty = cmd.difficulty;
+        l->invalidate_game_menus();
         l->create_item_creator();
       }
       l->log.info("(Challenge mode) Difficulty set to %02hhX", l->difficulty);
@@ -3888,16 +3893,13 @@ static void on_89(shared_ptr<Client> c, uint16_t, uint32_t flag, string& data) {
 
 static void on_40(shared_ptr<Client> c, uint16_t, uint32_t, string& data) {
   const auto& cmd = check_size_t<C_GuildCardSearch_40>(data);
-  try {
-    auto s = c->require_server_state();
-    auto result = s->find_client(nullptr, cmd.target_guild_card_number);
-    if (!result->blocked_senders.count(c->login->account->account_id)) {
-      auto result_lobby = result->lobby.lock();
-      if (result_lobby) {
-        send_card_search_result(c, result, result_lobby);
-      }
+  auto s = c->require_server_state();
+  auto result = s->find_client(nullptr, cmd.target_guild_card_number);
+  if (result && !result->blocked_senders.count(c->login->account->account_id)) {
+    auto result_lobby = result->lobby.lock();
+    if (result_lobby) {
+      send_card_search_result(c, result, result_lobby);
     }
-  } catch (const out_of_range&) {
   }
 }
 
@@ -4048,11 +4050,7 @@ static void on_81(shared_ptr<Client> c, uint16_t, uint32_t, string& data) {
   }
 
   auto s = c->require_server_state();
-  shared_ptr<Client> target;
-  try {
-    target = s->find_client(nullptr, to_guild_card_number);
-  } catch (const out_of_range&) {
-  }
+  auto target = s->find_client(nullptr, to_guild_card_number);
 
   if (!target || !target->login) {
     // TODO: We should store pending messages for accounts somewhere, and send
@@ -4665,8 +4663,8 @@ static void on_6F(shared_ptr<Client> c, uint16_t command, uint32_t, string& data
       string bin_filename = vq->bin_filename();
       string dat_filename = vq->dat_filename();
 
-      send_open_quest_file(c, bin_filename, bin_filename, "", vq->quest_number, QuestFileType::ONLINE, vq->bin_contents);
-      send_open_quest_file(c, dat_filename, dat_filename, "", vq->quest_number, QuestFileType::ONLINE, vq->dat_contents);
+      send_open_quest_file(c, bin_filename, bin_filename, "", vq->quest_number, QuestFileType::ONLINE, vq->bin_chunks());
+      send_open_quest_file(c, dat_filename, dat_filename, "", vq->quest_number, QuestFileType::ONLINE, vq->dat_chunks());
       c->config.set_flag(Client::Flag::LOADING_RUNNING_JOINABLE_QUEST);
       c->log.info("LOADING_RUNNING_JOINABLE_QUEST flag set");
       should_resume_game = false;
@@ -4751,8 +4749,8 @@ static void on_99(shared_ptr<Client> c, uint16_t, uint32_t, string& data) {
     string bin_filename = vq->bin_filename();
     string dat_filename = vq->dat_filename();
 
-    send_open_quest_file(c, bin_filename, bin_filename, "", vq->quest_number, QuestFileType::ONLINE, vq->bin_contents);
-    send_open_quest_file(c, dat_filename, dat_filename, "", vq->quest_number, QuestFileType::ONLINE, vq->dat_contents);
+    send_open_quest_file(c, bin_filename, bin_filename, "", vq->quest_number, QuestFileType::ONLINE, vq->bin_chunks());
+    send_open_quest_file(c, dat_filename, dat_filename, "", vq->quest_number, QuestFileType::ONLINE, vq->dat_chunks());
     c->config.set_flag(Client::Flag::LOADING_RUNNING_JOINABLE_QUEST);
     c->log.info("LOADING_RUNNING_JOINABLE_QUEST flag set");
 
@@ -5047,10 +5045,8 @@ static void on_EA_BB(shared_ptr<Client> c, uint16_t command, uint32_t flag, stri
       if (team && team->members.at(c->login->account->account_id).privilege_level() >= 0x30) {
         const auto& cmd = check_size_t<C_AddOrRemoveTeamMember_BB_03EA_05EA>(data);
         auto s = c->require_server_state();
-        shared_ptr<Client> added_c;
-        try {
-          added_c = s->find_client(nullptr, cmd.guild_card_number);
-        } catch (const out_of_range&) {
+        auto added_c = s->find_client(nullptr, cmd.guild_card_number);
+        if (!added_c) {
           send_command(c, 0x04EA, 0x00000006);
         }
 
@@ -5099,10 +5095,7 @@ static void on_EA_BB(shared_ptr<Client> c, uint16_t command, uint32_t flag, stri
           if (is_removing_self) {
             removed_c = c;
           } else {
-            try {
-              removed_c = s->find_client(nullptr, cmd.guild_card_number);
-            } catch (const out_of_range&) {
-            }
+            removed_c = s->find_client(nullptr, cmd.guild_card_number);
           }
           if (removed_c) {
             send_update_team_metadata_for_client(removed_c);
@@ -5122,10 +5115,9 @@ static void on_EA_BB(shared_ptr<Client> c, uint16_t command, uint32_t flag, stri
         static const string required_end("\0\0", 2);
         if (ends_with(data, required_end)) {
           for (const auto& it : team->members) {
-            try {
-              auto target_c = s->find_client(nullptr, it.second.account_id);
+            auto target_c = s->find_client(nullptr, it.second.account_id);
+            if (target_c) {
               send_command(target_c, 0x07EA, 0x00000000, data);
-            } catch (const out_of_range&) {
             }
           }
         }
@@ -5152,10 +5144,9 @@ static void on_EA_BB(shared_ptr<Client> c, uint16_t command, uint32_t flag, stri
         const auto& cmd = check_size_t<C_SetTeamFlag_BB_0FEA>(data);
         s->team_index->set_flag_data(team->team_id, cmd.flag_data);
         for (const auto& it : team->members) {
-          try {
-            auto member_c = s->find_client(nullptr, it.second.account_id);
+          auto member_c = s->find_client(nullptr, it.second.account_id);
+          if (member_c) {
             send_update_team_metadata_for_client(member_c);
-          } catch (const out_of_range&) {
           }
         }
       }
@@ -5168,11 +5159,10 @@ static void on_EA_BB(shared_ptr<Client> c, uint16_t command, uint32_t flag, stri
 
         send_command(c, 0x10EA, 0x00000000);
         for (const auto& it : team->members) {
-          try {
-            auto member_c = s->find_client(nullptr, it.second.account_id);
+          auto member_c = s->find_client(nullptr, it.second.account_id);
+          if (member_c) {
             send_update_team_metadata_for_client(member_c);
             send_team_membership_info(member_c);
-          } catch (const out_of_range&) {
           }
         }
       }
@@ -5220,10 +5210,9 @@ static void on_EA_BB(shared_ptr<Client> c, uint16_t command, uint32_t flag, stri
 
         if (send_master_transfer_updates) {
           for (const auto& it : team->members) {
-            try {
-              auto other_c = s->find_client(nullptr, it.second.account_id);
+            auto other_c = s->find_client(nullptr, it.second.account_id);
+            if (other_c) {
               send_update_lobby_data_bb(other_c);
-            } catch (const out_of_range&) {
             }
           }
         }
@@ -5232,11 +5221,10 @@ static void on_EA_BB(shared_ptr<Client> c, uint16_t command, uint32_t flag, stri
           send_team_membership_info(c);
         }
         if (send_updates_for_other_m) {
-          try {
-            auto other_c = s->find_client(nullptr, cmd.guild_card_number);
+          auto other_c = s->find_client(nullptr, cmd.guild_card_number);
+          if (other_c) {
             send_update_team_metadata_for_client(other_c);
             send_team_membership_info(other_c);
-          } catch (const out_of_range&) {
           }
         }
       }
@@ -5274,10 +5262,9 @@ static void on_EA_BB(shared_ptr<Client> c, uint16_t command, uint32_t flag, stri
 
         if (reward.reward_flag != TeamIndex::Team::RewardFlag::NONE) {
           for (const auto& it : team->members) {
-            try {
-              auto member_c = s->find_client(nullptr, it.second.account_id);
+            auto member_c = s->find_client(nullptr, it.second.account_id);
+            if (member_c) {
               send_update_team_reward_flags(member_c);
-            } catch (const out_of_range&) {
             }
           }
         }
@@ -5303,11 +5290,10 @@ static void on_EA_BB(shared_ptr<Client> c, uint16_t command, uint32_t flag, stri
         s->team_index->rename(team->team_id, new_team_name);
         send_command(c, 0x1FEA, 0x00000000);
         for (const auto& it : team->members) {
-          try {
-            auto member_c = s->find_client(nullptr, it.second.account_id);
-            send_update_team_metadata_for_client(c);
-            send_team_membership_info(c);
-          } catch (const out_of_range&) {
+          auto member_c = s->find_client(nullptr, it.second.account_id);
+          if (member_c) {
+            send_update_team_metadata_for_client(member_c);
+            send_team_membership_info(member_c);
           }
         }
       }
@@ -371,6 +371,7 @@ static void on_sync_joining_player_compressed_state(shared_ptr<Client> c, uint8_
     case 0x6B: {
       auto l = c->require_lobby();
       if (l->map) {
+        l->map->materialize_all();
         l->log.info("Checking client enemy state against server state");
         StringReader r(decompressed);
         size_t count = r.size() / sizeof(G_SyncEnemyState_6x6B_Entry_Decompressed);
@@ -409,6 +410,7 @@ static void on_sync_joining_player_compressed_state(shared_ptr<Client> c, uint8_
     case 0x6C: {
       auto l = c->require_lobby();
       if (l->map) {
+        l->map->materialize_all();
         l->log.info("Checking client object state against server state");
         StringReader r(decompressed);
         size_t count = r.size() / sizeof(G_SyncObjectState_6x6C_Entry_Decompressed);
@@ -494,6 +496,7 @@ static void on_sync_joining_player_compressed_state(shared_ptr<Client> c, uint8_
 
       auto l = c->require_lobby();
       if (l->map) {
+        l->map->materialize_all();
         l->log.info("Checking client set flag state against server state");
 
         StringReader set_flags_r = r.sub(r.where(), dec_header.entity_set_flags_size);
@@ -1394,6 +1397,17 @@ static void on_set_player_visible(shared_ptr<Client> c, uint8_t command, uint8_t
 
 ////////////////////////////////////////////////////////////////////////////////
 
+static void set_client_floor(shared_ptr<Client> c, uint32_t floor) {
+  c->floor = floor;
+  c->recent_switch_flags.clear();
+  // If the game's map is loaded lazily, the entities on this floor might not
+  // exist yet
+  auto l = c->lobby.lock();
+  if (l && l->map) {
+    l->map->materialize_floor(min<uint32_t>(floor, 0xFF));
+  }
+}
+
 static void on_change_floor_6x1F(shared_ptr<Client> c, uint8_t command, uint8_t flag, void* data, size_t size) {
   if (is_pre_v1(c->version())) {
     check_size_t<G_SetPlayerFloor_DCNTE_6x1F>(data, size);
@@ -1409,8 +1423,7 @@ static void on_change_floor_6x1F(shared_ptr<Client> c, uint8_t command, uint8_t
   } else {
     const auto& cmd = check_size_t<G_SetPlayerFloor_6x1F>(data, size);
     if (cmd.floor >= 0 && c->floor != static_cast<uint32_t>(cmd.floor)) {
-      c->floor = cmd.floor;
-      c->recent_switch_flags.clear();
+      set_client_floor(c, cmd.floor);
     }
   }
   forward_subcommand(c, command, flag, data, size);
@@ -1419,8 +1432,7 @@ static void on_change_floor_6x1F(shared_ptr<Client> c, uint8_t command, uint8_t
 static void on_change_floor_6x21(shared_ptr<Client> c, uint8_t command, uint8_t flag, void* data, size_t size) {
   const auto& cmd = check_size_t<G_InterLevelWarp_6x21>(data, size);
   if (cmd.floor >= 0 && c->floor != static_cast<uint32_t>(cmd.floor)) {
-    c->floor = cmd.floor;
-    c->recent_switch_flags.clear();
+    set_client_floor(c, cmd.floor);
   }
   forward_subcommand(c, command, flag, data, size);
 }
@@ -1639,8 +1651,7 @@ void on_movement_with_floor(shared_ptr<Client> c, uint8_t command, uint8_t flag,
   c->x = cmd.x;
   c->z = cmd.z;
   if (cmd.floor >= 0 && c->floor != static_cast<uint32_t>(cmd.floor)) {
-    c->floor = cmd.floor;
-    c->recent_switch_flags.clear();
+    set_client_floor(c, cmd.floor);
   }
   forward_subcommand(c, command, flag, data, size);
 }
@@ -2021,7 +2032,7 @@ static void on_pick_up_item_generic(
     auto p = c->character();
     auto s = c->require_server_state();
     auto fi = l->remove_item(floor, item_id, c->lobby_client_id);
-    if (!fi->visible_to_client(c->lobby_client_id)) {
+    if (!fi.visible_to_client(c->lobby_client_id)) {
       l->log.warning("Player %hu requests to pick up %08" PRIX32 ", but is it not visible to them; dropping command",
           client_id, item_id);
       l->add_item(floor, fi);
@@ -2029,7 +2040,7 @@ static void on_pick_up_item_generic(
     }
 
     try {
-      p->add_item(fi->data, *s->item_stack_limits(c->version()));
+      p->add_item(fi.data, *s->item_stack_limits(c->version()));
     } catch (const out_of_range&) {
       // Inventory is full; put the item back where it was
       l->log.warning("Player %hu requests to pick up %08" PRIX32 ", but their inventory is full; dropping command",
@@ -2040,7 +2051,7 @@ static void on_pick_up_item_generic(
 
     if (l->log.should_log(LogLevel::INFO)) {
       auto s = c->require_server_state();
-      auto name = s->describe_item(c->version(), fi->data, false);
+      auto name = s->describe_item(c->version(), fi.data, false);
       l->log.info("Player %hu picked up %08" PRIX32 " (%s)", client_id, item_id, name.c_str());
       c->print_inventory(stderr);
     }
@@ -2050,15 +2061,15 @@ static void on_pick_up_item_generic(
       if ((!lc) || (!is_request && (lc == c))) {
         continue;
       }
-      if (fi->visible_to_client(z)) {
+      if (fi.visible_to_client(z)) {
         send_pick_up_item_to_client(lc, client_id, item_id, floor);
       } else {
-        send_create_inventory_item_to_client(lc, client_id, fi->data);
+        send_create_inventory_item_to_client(lc, client_id, fi.data);
       }
     }
 
-    if (fi->flags & 0x1000) {
-      uint32_t pi = fi->data.primary_identifier();
+    if (fi.flags & 0x1000) {
+      uint32_t pi = fi.data.primary_identifier();
       bool should_send_game_notif, should_send_global_notif;
       if (is_v1_or_v2(c->version()) && (c->version() != Version::GC_NTE)) {
         should_send_game_notif = s->notify_game_for_item_primary_identifiers_v1_v2.count(pi);
@@ -2073,8 +2084,8 @@ static void on_pick_up_item_generic(
 
       if (should_send_game_notif || should_send_global_notif) {
         string p_name = p->disp.name.decode();
-        string desc_ingame = s->describe_item(c->version(), fi->data, true);
-        string desc_http = s->describe_item(c->version(), fi->data, false);
+        string desc_ingame = s->describe_item(c->version(), fi.data, true);
+        string desc_http = s->describe_item(c->version(), fi.data, false);
 
         if (s->http_server) {
           auto message = make_shared<JSON>(JSON::dict({
@@ -2083,7 +2094,7 @@ static void on_pick_up_item_generic(
               {"PlayerVersion", name_for_enum(c->version())},
               {"GameName", l->name},
               {"GameDropMode", name_for_enum(l->drop_mode)},
-              {"ItemData", fi->data.hex()},
+              {"ItemData", fi.data.hex()},
               {"ItemDescription", desc_http},
               {"NotifyGame", should_send_game_notif},
               {"NotifyServer", should_send_global_notif},
@@ -2575,6 +2586,7 @@ DropReconcileResult reconcile_drop_request_with_map(
   Map::Enemy* map_enemy = nullptr;
   if (res.is_box) {
     if (map) {
+      map->materialize_object(cmd.entity_id);
       map_object = &map->objects.at(cmd.entity_id);
       log.info("Drop check for K-%hX %c %s",
           map_object->object_id, res.ignore_def ? 'G' : 'S', Map::name_for_object_type(map_object->base_type));
@@ -2602,6 +2614,7 @@ DropReconcileResult reconcile_drop_request_with_map(
 
   } else {
     if (map) {
+      map->materialize_enemy(cmd.entity_id);
       map_enemy = &map->enemies.at(cmd.entity_id);
       log.info("Drop check for E-%hX %s", map_enemy->enemy_id, name_for_enum(map_enemy->type));
       res.effective_rt_index = rare_table_index_for_enemy_type(map_enemy->type);
@@ -2910,6 +2923,7 @@ static void on_set_entity_set_flag(shared_ptr<Client> c, uint8_t command, uint8_
     if (cmd.header.enemy_id >= 0x4000) {
       uint16_t object_index = cmd.header.enemy_id - 0x4000;
       try {
+        l->map->materialize_object(object_index);
         uint16_t& set_flags = l->map->objects.at(object_index).set_flags;
         set_flags |= cmd.flags;
         l->log.info("Client set set flags %04hX on K-%hX (flags are now %04hX)",
@@ -2923,6 +2937,7 @@ static void on_set_entity_set_flag(shared_ptr<Client> c, uint8_t command, uint8_
       int32_t wave_number = -1;
       uint16_t enemy_index = cmd.header.enemy_id - 0x1000;
       try {
+        l->map->materialize_enemy(enemy_index);
         const auto& enemy = l->map->enemies.at(enemy_index);
         uint16_t& set_flags = l->map->enemy_set_flags.at(enemy.set_index);
         set_flags |= cmd.flags;
@@ -3202,6 +3217,7 @@ static void on_update_enemy_state(shared_ptr<Client> c, uint8_t command, uint8_t
     throw logic_error("client ID is above 3");
   }
   if (l->map) {
+    l->map->materialize_enemy(cmd.enemy_index);
     if (cmd.enemy_index >= l->map->enemies.size()) {
       return;
     }
@@ -3237,6 +3253,7 @@ static void on_update_object_state(shared_ptr<Client> c, uint8_t command, uint8_
   }
 
   if (l->map) {
+    l->map->materialize_object(cmd.object_index);
     if (cmd.object_index >= l->map->objects.size()) {
       return;
     }
@@ -3374,6 +3391,7 @@ static void on_steal_exp_bb(shared_ptr<Client> c, uint8_t, uint8_t, void* data,
     return;
   }
 
+  l->map->materialize_enemy(cmd.enemy_index);
   const auto& enemy = l->map->enemies.at(cmd.enemy_index);
   const auto& inventory = p->inventory;
   const auto& weapon = inventory.items[inventory.find_equipped_item(EquipSlot::WEAPON)];
@@ -3424,6 +3442,7 @@ static void on_enemy_exp_request_bb(shared_ptr<Client> c, uint8_t, uint8_t, void
   if (!l->map) {
     throw runtime_error("game does not have a map loaded");
   }
+  l->map->materialize_enemy(cmd.enemy_index);
   if (cmd.enemy_index >= l->map->enemies.size()) {
     send_text_message(c, "$C6Missing enemy killed");
     return;
@@ -3725,13 +3744,13 @@ static void on_destroy_floor_item(shared_ptr<Client> c, uint8_t command, uint8_t
 
   auto s = c->require_server_state();
   auto fi = l->remove_item(cmd.floor, cmd.item_id, 0xFF);
-  auto name = s->describe_item(c->version(), fi->data, false);
+  auto name = s->describe_item(c->version(), fi.data, false);
   l->log.info("Player %hhu destroyed floor item %08" PRIX32 " (%s)", c->lobby_client_id, cmd.item_id.load(), name.c_str());
 
   // Only forward to players for whom the item was visible
   for (size_t z = 0; z < l->clients.size(); z++) {
     auto lc = l->clients[z];
-    if (lc && fi->visible_to_client(z)) {
+    if (lc && fi.visible_to_client(z)) {
       if (lc->version() != c->version()) {
         G_DestroyFloorItem_6x5C_6x63 out_cmd = cmd;
         switch (lc->version()) {
@@ -16,7 +16,6 @@
 
 #include "CommandFormats.hh"
 #include "Compression.hh"
-#include "FileContentsCache.hh"
 #include "PSOProtocol.hh"
 #include "ProxyServer.hh"
 #include "ReceiveSubcommands.hh"
@@ -663,83 +662,24 @@ void send_guild_card_chunk_bb(shared_ptr<Client> c, size_t chunk_index) {
   send_command(c, 0x02DC, 0x00000000, &cmd, sizeof(cmd) - sizeof(cmd.data) + data_size);
 }
 
-static const vector<string> stream_file_entries = {
-    "ItemMagEdit.prs",
-    "ItemPMT.prs",
-    "BattleParamEntry.dat",
-    "BattleParamEntry_on.dat",
-    "BattleParamEntry_lab.dat",
-    "BattleParamEntry_lab_on.dat",
-    "BattleParamEntry_ep4.dat",
-    "BattleParamEntry_ep4_on.dat",
-    "PlyLevelTbl.prs",
-};
-static FileContentsCache bb_stream_files_cache(3600000000ULL);
-
 void send_stream_file_index_bb(shared_ptr<Client> c) {
-
-  struct S_StreamFileIndexEntry_BB_01EB {
-    le_uint32_t size;
-    le_uint32_t checksum; // crc32 of file data
-    le_uint32_t offset; // offset in stream (== sum of all previous files' sizes)
-    pstring<TextEncoding::ASCII, 0x40> filename;
-  };
-
-  vector<S_StreamFileIndexEntry_BB_01EB> entries;
-  size_t offset = 0;
-  for (const string& filename : stream_file_entries) {
-    string key = "system/blueburst/" + filename;
-    auto cache_res = bb_stream_files_cache.get_or_load(key);
-    auto& e = entries.emplace_back();
-    e.size = cache_res.file->data->size();
-    // Computing the checksum can be slow, so we cache it along with the file
-    // data. If the cache result was just populated, then it may be different,
-    // so we always recompute the checksum in that case.
-    if (cache_res.generate_called) {
-      e.checksum = crc32(cache_res.file->data->data(), e.size);
-      bb_stream_files_cache.replace_obj<uint32_t>(key + ".crc32", e.checksum);
-    } else {
-      auto compute_checksum = [&](const string&) -> uint32_t {
-        return crc32(cache_res.file->data->data(), e.size);
-      };
-      e.checksum = bb_stream_files_cache.get_obj<uint32_t>(key + ".crc32", compute_checksum).obj;
-    }
-    e.offset = offset;
-    e.filename.encode(filename);
-    offset += e.size;
+  auto stream_files = c->require_server_state()->bb_stream_files;
+  if (!stream_files) {
+    throw runtime_error("BB stream files are not available");
   }
-  send_command_vt(c, 0x01EB, entries.size(), entries);
+  send_command(c, 0x01EB, stream_files->num_files, stream_files->index_data.data(), stream_files->index_data.size());
 }
 
 void send_stream_file_chunk_bb(shared_ptr<Client> c, uint32_t chunk_index) {
-  auto cache_result = bb_stream_files_cache.get(
-      "<BB stream file>", +[](const string&) -> string {
-        size_t bytes = 0;
-        for (const auto& name : stream_file_entries) {
-          bytes += bb_stream_files_cache.get_or_load("system/blueburst/" + name).file->data->size();
-        }
-
-        string ret;
-        ret.reserve(bytes);
-        for (const auto& name : stream_file_entries) {
-          ret += *bb_stream_files_cache.get_or_load("system/blueburst/" + name).file->data;
-        }
-        return ret;
-      });
-  const auto& contents = cache_result.file->data;
-
-  S_StreamFileChunk_BB_02EB chunk_cmd;
-  chunk_cmd.chunk_index = chunk_index;
-  size_t offset = sizeof(chunk_cmd.data) * chunk_index;
-  if (offset > contents->size()) {
+  auto stream_files = c->require_server_state()->bb_stream_files;
+  if (!stream_files) {
+    throw runtime_error("BB stream files are not available");
+  }
+  if (chunk_index >= stream_files->chunk_commands.size()) {
     throw runtime_error("client requested chunk beyond end of stream file");
   }
-  size_t bytes = min<size_t>(contents->size() - offset, sizeof(chunk_cmd.data));
-  chunk_cmd.data.assign_range(reinterpret_cast<const uint8_t*>(contents->data() + offset), bytes, 0);
-
-  size_t cmd_size = offsetof(S_StreamFileChunk_BB_02EB, data) + bytes;
-  cmd_size = (cmd_size + 3) & ~3;
-  send_command(c, 0x02EB, 0x00000000, &chunk_cmd, cmd_size);
+  const auto& chunk_cmd = stream_files->chunk_commands[chunk_index];
+  send_command(c, 0x02EB, 0x00000000, chunk_cmd.data(), chunk_cmd.size());
 }
 
 void send_approve_player_choice_bb(shared_ptr<Client> c) {
@@ -1466,97 +1406,124 @@ void send_game_menu_t(
     bool show_tournaments_only) {
   auto s = c->require_server_state();
 
-  vector<S_GameMenuEntryT<Encoding>> entries;
-  {
-    auto& e = entries.emplace_back();
-    e.menu_id = MenuID::GAME;
-    e.game_id = 0x00000000;
-    e.difficulty_tag = 0x00;
-    e.num_players = 0x00;
-    e.name.encode(s->name, c->language());
-    e.episode = 0x00;
-    e.flags = 0x04;
-  }
-
-  set<shared_ptr<const Lobby>, bool (*)(const shared_ptr<const Lobby>&, const shared_ptr<const Lobby>&)> games(Lobby::compare_shared);
   bool client_has_debug = c->config.check_flag(Client::Flag::DEBUG_ENABLED);
-  for (shared_ptr<Lobby> l : s->all_lobbies()) {
-    if (l->is_game() &&
-        (client_has_debug || l->version_is_allowed(c->version())) &&
-        (client_has_debug || (l->check_flag(Lobby::Flag::IS_CLIENT_CUSTOMIZATION) == c->config.check_flag(Client::Flag::IS_CLIENT_CUSTOMIZATION))) &&
-        (l->check_flag(Lobby::Flag::IS_SPECTATOR_TEAM) == is_spectator_team_list) &&
-        (!show_tournaments_only || l->tournament_match)) {
-      games.emplace(l);
+  bool client_is_customization = c->config.check_flag(Client::Flag::IS_CLIENT_CUSTOMIZATION);
+  uint64_t cache_key = (static_cast<uint64_t>(c->version()) << 16) |
+      (static_cast<uint64_t>(c->language()) << 8) |
+      (client_has_debug ? 8 : 0) |
+      (client_is_customization ? 4 : 0) |
+      (is_spectator_team_list ? 2 : 0) |
+      (show_tournaments_only ? 1 : 0);
+  auto& cache_entry = s->game_menu_cache[cache_key];
+
+  if (cache_entry.generation != s->game_menu_generation) {
+    set<shared_ptr<const Lobby>, bool (*)(const shared_ptr<const Lobby>&, const shared_ptr<const Lobby>&)> games(Lobby::compare_shared);
+    for (shared_ptr<Lobby> l : s->all_lobbies()) {
+      if (l->is_game() &&
+          (client_has_debug || l->version_is_allowed(c->version())) &&
+          (client_has_debug || (l->check_flag(Lobby::Flag::IS_CLIENT_CUSTOMIZATION) == client_is_customization)) &&
+          (l->check_flag(Lobby::Flag::IS_SPECTATOR_TEAM) == is_spectator_team_list) &&
+          (!show_tournaments_only || l->tournament_match)) {
+        games.emplace(l);
+      }
     }
-  }
 
-  for (const auto& l : games) {
-    if (entries.size() >= 0x41) {
-      break;
-    }
-    uint8_t episode_num;
-    switch (l->episode) {
-      case Episode::EP1:
-        episode_num = 1;
-        break;
-      case Episode::EP2:
-        episode_num = 2;
-        break;
-      case Episode::EP3:
-        episode_num = 0;
-        break;
-      case Episode::EP4:
-        episode_num = 3;
+    vector<S_GameMenuEntryT<Encoding>> entries;
+    cache_entry.games.clear();
+    for (const auto& l : games) {
+      if (entries.size() >= 0x40) {
         break;
-      default:
-        throw runtime_error("lobby has incorrect episode number");
-    }
-
-    auto& e = entries.emplace_back();
-    e.menu_id = MenuID::GAME;
-    e.game_id = l->lobby_id;
-    e.difficulty_tag = (is_ep3(c->version()) ? 0x0A : (l->difficulty + 0x22));
-    e.num_players = l->count_clients();
-    if (is_dc(c->version())) {
-      e.episode = l->version_is_allowed(Version::DC_V1) ? 1 : 0;
-    } else {
-      e.episode = ((c->version() == Version::BB_V4) ? (l->max_clients << 4) : 0) | episode_num;
-    }
-    if (l->is_ep3()) {
-      e.flags = (l->password.empty() ? 0 : 2) | (l->check_flag(Lobby::Flag::BATTLE_IN_PROGRESS) ? 4 : 0);
-    } else {
-      e.flags = (l->password.empty() ? 0 : 2);
-      if ((c->version() == Version::GC_NTE) || !is_v1_or_v2(c->version())) {
-        e.flags |= (episode_num << 6);
       }
-      switch (l->mode) {
-        case GameMode::NORMAL:
+      uint8_t episode_num;
+      switch (l->episode) {
+        case Episode::EP1:
+          episode_num = 1;
           break;
-        case GameMode::BATTLE:
-          e.flags |= 0x10;
+        case Episode::EP2:
+          episode_num = 2;
           break;
-        case GameMode::CHALLENGE:
-          e.flags |= 0x20;
+        case Episode::EP3:
+          episode_num = 0;
           break;
-        case GameMode::SOLO:
-          e.episode = 0x10 | episode_num;
+        case Episode::EP4:
+          episode_num = 3;
           break;
         default:
-          throw logic_error("invalid game mode");
+          throw runtime_error("lobby has incorrect episode number");
       }
-      // On v2, render name in orange if v1 is not allowed
-      if (is_v2(c->version()) && !l->version_is_allowed(Version::DC_V1)) {
-        e.flags |= 0x40;
+
+      auto& e = entries.emplace_back();
+      e.menu_id = MenuID::GAME;
+      e.game_id = l->lobby_id;
+      e.difficulty_tag = (is_ep3(c->version()) ? 0x0A : (l->difficulty + 0x22));
+      e.num_players = l->count_clients();
+      if (is_dc(c->version())) {
+        e.episode = l->version_is_allowed(Version::DC_V1) ? 1 : 0;
+      } else {
+        e.episode = ((c->version() == Version::BB_V4) ? (l->max_clients << 4) : 0) | episode_num;
       }
-      // On BB, gray out games that can't be joined
-      if ((c->version() == Version::BB_V4) && (l->join_error_for_client(c, nullptr) != Lobby::JoinError::ALLOWED)) {
-        e.flags |= 0x04;
+      if (l->is_ep3()) {
+        e.flags = (l->password.empty() ? 0 : 2) | (l->check_flag(Lobby::Flag::BATTLE_IN_PROGRESS) ? 4 : 0);
+      } else {
+        e.flags = (l->password.empty() ? 0 : 2);
+        if ((c->version() == Version::GC_NTE) || !is_v1_or_v2(c->version())) {
+          e.flags |= (episode_num << 6);
+        }
+        switch (l->mode) {
+          case GameMode::NORMAL:
+            break;
+          case GameMode::BATTLE:
+            e.flags |= 0x10;
+            break;
+          case GameMode::CHALLENGE:
+            e.flags |= 0x20;
+            break;
+          case GameMode::SOLO:
+            e.episode = 0x10 | episode_num;
+            break;
+          default:
+            throw logic_error("invalid game mode");
+        }
+        // On v2, render name in orange if v1 is not allowed
+        if (is_v2(c->version()) && !l->version_is_allowed(Version::DC_V1)) {
+          e.flags |= 0x40;
+        }
+      }
+      e.name.encode(l->name, c->language());
+      cache_entry.games.emplace_back(l);
+    }
+
+    cache_entry.entries_data.assign(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(entries[0]));
+    cache_entry.generation = s->game_menu_generation;
+  }
+
+  // The server name entry isn't cached, since the server name can change when
+  // the configuration is reloaded
+  S_GameMenuEntryT<Encoding> header_entry;
+  header_entry.menu_id = MenuID::GAME;
+  header_entry.game_id = 0x00000000;
+  header_entry.difficulty_tag = 0x00;
+  header_entry.num_players = 0x00;
+  header_entry.name.encode(s->name, c->language());
+  header_entry.episode = 0x00;
+  header_entry.flags = 0x04;
+
+  string data(reinterpret_cast<const char*>(&header_entry), sizeof(header_entry));
+  data += cache_entry.entries_data;
+
+  // On BB, gray out games that can't be joined. This depends on the client's
+  // state, so it can't be cached.
+  if (c->version() == Version::BB_V4) {
+    auto* entries = reinterpret_cast<S_GameMenuEntryT<Encoding>*>(data.data() + sizeof(S_GameMenuEntryT<Encoding>));
+    for (size_t z = 0; z < cache_entry.games.size(); z++) {
+      auto l = cache_entry.games[z].lock();
+      if (l && !l->is_ep3() && (l->join_error_for_client(c, nullptr) != Lobby::JoinError::ALLOWED)) {
+        entries[z].flags |= 0x04;
       }
     }
-    e.name.encode(l->name, c->language());
   }
 
-  send_command_vt(c, is_spectator_team_list ? 0xE6 : 0x08, entries.size() - 1, entries);
+  send_command(c, is_spectator_team_list ? 0xE6 : 0x08, cache_entry.games.size(), data.data(), data.size());
 }
 
 void send_game_menu(
@@ -2578,6 +2545,10 @@ void send_warp(shared_ptr<Client> c, uint32_t floor, bool is_private) {
   send_warp(c->channel, c->lobby_client_id, floor, is_private);
   c->floor = floor;
   c->recent_switch_flags.clear();
+  auto l = c->lobby.lock();
+  if (l && l->map) {
+    l->map->materialize_floor(min<uint32_t>(floor, 0xFF));
+  }
 }
 
 void send_warp(shared_ptr<Lobby> l, uint32_t floor, bool is_private) {
@@ -2664,30 +2635,30 @@ void send_game_item_state(shared_ptr<Client> c) {
   for (size_t floor = 0; floor < 0x10; floor++) {
     const auto& m = l->floor_item_managers.at(floor);
     // It's important that these are added in increasing order of item_id (hence
-    // why items is a map and not an unordered_map), since the game uses binary
-    // search to find floor items when picking them up. If items aren't in the
-    // correct order, the game may fail to find an item when attempting to pick
-    // it up, causing "ghost items" which are visible but can't be picked up.
-    for (const auto& it : m.items) {
-      const auto& item = it.second;
-      if (!item->visible_to_client(c->lobby_client_id)) {
-        continue;
+    // why FloorItemManager keeps its items sorted by ID), since the game uses
+    // binary search to find floor items when picking them up. If items aren't
+    // in the correct order, the game may fail to find an item when attempting
+    // to pick it up, causing "ghost items" which are visible but can't be
+    // picked up.
+    m.for_each([&](const Lobby::FloorItem& item) -> void {
+      if (!item.visible_to_client(c->lobby_client_id)) {
+        return;
       }
 
       FloorItem fi;
       fi.floor = floor;
       fi.from_enemy = 0;
       fi.entity_id = 0xFFFF;
-      fi.x = item->x;
-      fi.z = item->z;
+      fi.x = item.x;
+      fi.z = item.z;
       fi.unknown_a2 = 0;
       fi.drop_number = (floor == 0) ? 0xFFFF : (decompressed_header.next_drop_number_per_floor.at(floor - 1)++);
-      fi.item = item->data;
+      fi.item = item.data;
       fi.item.encode_for_version(c->version(), s->item_parameter_table_for_encode(c->version()));
       floor_items_w.put(fi);
 
       decompressed_header.floor_item_count_per_floor.at(floor)++;
-    }
+    });
   }
 
   StringWriter decompressed_w;
@@ -2702,6 +2673,9 @@ void send_game_enemy_state(shared_ptr<Client> c) {
   if (!l->map) {
     return;
   }
+  // The joining client expects state for every entity in the game, not only
+  // the ones on floors that have been visited so far
+  l->map->materialize_all();
   auto s = c->require_server_state();
 
   vector<G_SyncEnemyState_6x6B_Entry_Decompressed> entries;
@@ -2722,6 +2696,7 @@ void send_game_object_state(shared_ptr<Client> c) {
   if (!l->map) {
     return;
   }
+  l->map->materialize_all();
   auto s = c->require_server_state();
 
   vector<G_SyncObjectState_6x6C_Entry_Decompressed> entries;
@@ -2741,6 +2716,7 @@ void send_game_set_state(shared_ptr<Client> c) {
   if (!l->map) {
     return;
   }
+  l->map->materialize_all();
 
   size_t num_object_sets = l->map->objects.size();
   size_t num_enemy_sets = l->map->enemy_set_flags.size();
@@ -3746,21 +3722,8 @@ void send_quest_file_chunk(
     shared_ptr<Client> c,
     const string& filename,
     size_t chunk_index,
-    const void* data,
-    size_t size,
+    const S_WriteFile_13_A7& cmd,
     bool is_download_quest) {
-  if (size > 0x400) {
-    throw logic_error("quest file chunks must be 1KB or smaller");
-  }
-
-  S_WriteFile_13_A7 cmd;
-  cmd.filename.encode(filename);
-  memcpy(cmd.data.data(), data, size);
-  if (size < 0x400) {
-    memset(&cmd.data[size], 0, 0x400 - size);
-  }
-  cmd.data_size = size;
-
   c->log.info("Sending quest file chunk %s:%zu", filename.c_str(), chunk_index);
   const auto& s = c->require_server_state();
   c->channel.send(is_download_quest ? 0xA7 : 0x13, chunk_index, &cmd, sizeof(cmd), s->hide_download_commands);
@@ -3833,27 +3796,32 @@ void send_open_quest_file(
     const string& xb_filename,
     uint32_t quest_number,
     QuestFileType type,
-    shared_ptr<const string> contents) {
+    shared_ptr<const string> chunks) {
+  // The chunk commands are prebuilt (see encode_quest_file_chunks), so the
+  // file size is implied by the number of chunks and the last chunk's size
+  size_t total_chunks = chunks->size() / sizeof(S_WriteFile_13_A7);
+  const auto* chunk_cmds = reinterpret_cast<const S_WriteFile_13_A7*>(chunks->data());
+  uint32_t file_size = total_chunks ? ((total_chunks - 1) * 0x400 + chunk_cmds[total_chunks - 1].data_size) : 0;
 
   switch (c->version()) {
     case Version::DC_V1_11_2000_PROTOTYPE:
     case Version::DC_V1:
     case Version::DC_V2:
     case Version::GC_NTE:
-      send_open_quest_file_t<S_OpenFile_DC_44_A6>(c, quest_name, filename, xb_filename, contents->size(), quest_number, type);
+      send_open_quest_file_t<S_OpenFile_DC_44_A6>(c, quest_name, filename, xb_filename, file_size, quest_number, type);
       break;
     case Version::PC_NTE:
     case Version::PC_V2:
     case Version::GC_V3:
     case Version::GC_EP3_NTE:
     case Version::GC_EP3:
-      send_open_quest_file_t<S_OpenFile_PC_GC_44_A6>(c, quest_name, filename, xb_filename, contents->size(), quest_number, type);
+      send_open_quest_file_t<S_OpenFile_PC_GC_44_A6>(c, quest_name, filename, xb_filename, file_size, quest_number, type);
       break;
     case Version::XB_V3:
-      send_open_quest_file_t<S_OpenFile_XB_44_A6>(c, quest_name, filename, xb_filename, contents->size(), quest_number, type);
+      send_open_quest_file_t<S_OpenFile_XB_44_A6>(c, quest_name, filename, xb_filename, file_size, quest_number, type);
       break;
     case Version::BB_V4:
-      send_open_quest_file_t<S_OpenFile_BB_44_A6>(c, quest_name, filename, xb_filename, contents->size(), quest_number, type);
+      send_open_quest_file_t<S_OpenFile_BB_44_A6>(c, quest_name, filename, xb_filename, file_size, quest_number, type);
       break;
     default:
       throw logic_error("cannot send quest files to this version of client");
@@ -3864,23 +3832,16 @@ void send_open_quest_file(
   // quest data is sent at once. This is likely a bug in the TCP stack, since
   // the client should apply backpressure to avoid bad situations, but we have
   // to deal with it here instead.
-  size_t total_chunks = (contents->size() + 0x3FF) / 0x400;
   size_t chunks_to_send = is_gc(c->version()) ? min<size_t>(GC_QUEST_LOAD_MAX_CHUNKS_IN_FLIGHT, total_chunks) : total_chunks;
 
   for (size_t z = 0; z < chunks_to_send; z++) {
-    size_t offset = z * 0x400;
-    size_t chunk_bytes = contents->size() - offset;
-    if (chunk_bytes > 0x400) {
-      chunk_bytes = 0x400;
-    }
-    send_quest_file_chunk(c, filename.c_str(), offset / 0x400,
-        contents->data() + offset, chunk_bytes, (type != QuestFileType::ONLINE));
+    send_quest_file_chunk(c, filename, z, chunk_cmds[z], (type != QuestFileType::ONLINE));
   }
 
   // If there are still chunks to send, track the file so the chunk
   // acknowledgement handler (13 or A7) cna know what to send next
   if (chunks_to_send < total_chunks) {
-    c->sending_files.emplace(filename, contents);
+    c->sending_files.emplace(filename, chunks);
     c->log.info("Opened file %s", filename.c_str());
   }
 }
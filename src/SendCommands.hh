@@ -429,13 +429,12 @@ void send_open_quest_file(
     const std::string& xb_filename,
     uint32_t quest_number,
     QuestFileType type,
-    std::shared_ptr<const std::string> contents);
+    std::shared_ptr<const std::string> chunks);
 void send_quest_file_chunk(
     std::shared_ptr<Client> c,
     const std::string& filename,
     size_t chunk_index,
-    const void* data,
-    size_t size,
+    const S_WriteFile_13_A7& cmd,
     bool is_download_quest);
 bool send_quest_barrier_if_all_clients_ready(std::shared_ptr<Lobby> l);
 bool send_ep3_start_tournament_deck_select_if_all_clients_ready(std::shared_ptr<Lobby> l);
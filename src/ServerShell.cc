@@ -200,6 +200,7 @@ CommandDefinition c_reload(
       accounts - reindex user accounts\n\
       battle-params - reload the BB enemy stats files\n\
       bb-keys - reload BB private keys\n\
+      bb-stream-files - reload the tables BB clients download during login\n\
       config - reload most fields from config.json\n\
       dol-files - reindex all DOL files\n\
       drop-tables - reload drop tables\n\
@@ -228,6 +229,8 @@ CommandDefinition c_reload(
       for (const auto& type : types) {
         if (type == "bb-keys") {
           args.s->load_bb_private_keys(true);
+        } else if (type == "bb-stream-files") {
+          args.s->load_bb_stream_files(true);
         } else if (type == "accounts") {
           args.s->load_accounts(true);
         } else if (type == "patch-files") {
@@ -259,15 +262,7 @@ CommandDefinition c_reload(
         } else if (type == "drop-tables") {
           args.s->load_drop_tables(true);
         } else if (type == "config") {
-          args.s->forward_to_event_thread([s = args.s]() {
-            try {
-              s->load_config_early();
-              s->load_config_late();
-            } catch (const exception& e) {
-              fprintf(stderr, "FAILED: %s\n", e.what());
-              fprintf(stderr, "Some configuration may have been reloaded. Fix the underlying issue and try again.\n");
-            }
-          });
+          args.s->load_config(true);
         } else if (type == "teams") {
           args.s->load_teams(true);
         } else if (type == "quests") {
@@ -3,6 +3,8 @@
 #include <string.h>
 
 #include <memory>
+#include <mutex>
+#include <phosg/Hash.hh>
 #include <phosg/Image.hh>
 #include <phosg/Network.hh>
 
@@ -14,6 +16,7 @@
 #include "Loggers.hh"
 #include "NetworkAddresses.hh"
 #include "SendCommands.hh"
+#include "TaskGraph.hh"
 #include "Text.hh"
 #include "TextIndex.hh"
 
@@ -44,7 +47,8 @@ ServerState::ServerState(shared_ptr<struct event_base> base, const string& confi
       base(base),
       config_filename(config_filename),
       is_replay(is_replay),
-      player_files_manager(this->base ? make_shared<PlayerFilesManager>(base) : nullptr),
+      file_write_queue(this->base ? make_shared<FileWriteQueue>() : nullptr),
+      player_files_manager(this->base ? make_shared<PlayerFilesManager>(base, this->file_write_queue, this->player_file_cache_bytes) : nullptr),
       destroy_lobbies_event(this->base ? event_new(base.get(), -1, EV_TIMEOUT, &ServerState::dispatch_destroy_lobbies, this) : nullptr, event_free) {}
 
 void ServerState::add_client_to_available_lobby(shared_ptr<Client> c) {
@@ -65,18 +69,38 @@ void ServerState::add_client_to_available_lobby(shared_ptr<Client> c) {
   }
 
   if (!added_to_lobby.get()) {
-    for (const auto& lobby_id : this->public_lobby_search_order(c)) {
-      try {
-        auto l = this->find_lobby(lobby_id);
-        if (l &&
-            !l->is_game() &&
-            l->check_flag(Lobby::Flag::PUBLIC) &&
-            l->version_is_allowed(c->version())) {
-          l->add_client(c);
-          added_to_lobby = l;
-          break;
-        }
-      } catch (const out_of_range&) {
+    // Only lobbies with free space are in the free positions set, so this loop
+    // usually adds the client to the first lobby it checks. The checks here
+    // are still necessary for the client customization search order, which
+    // isn't specific to one version.
+    const auto& order = this->public_lobby_search_order(c);
+    size_t order_index = (&order == &this->client_customization_public_lobby_search_order)
+        ? NUM_VERSIONS
+        : static_cast<size_t>(c->version());
+    const auto& free_positions = this->public_lobby_free_positions.at(order_index);
+    for (size_t pos : free_positions) {
+      auto l = this->find_lobby(order.at(pos));
+      if (l &&
+          !l->is_game() &&
+          l->check_flag(Lobby::Flag::PUBLIC) &&
+          l->version_is_allowed(c->version()) &&
+          (l->count_clients() < l->max_clients)) {
+        // This modifies free_positions, so we must not continue the loop
+        l->add_client(c);
+        added_to_lobby = l;
+        break;
+      }
+    }
+  }
+
+  if (!added_to_lobby) {
+    const auto& overflow_ids = this->overflow_lobbies_with_space.at(static_cast<size_t>(c->version()));
+    if (!overflow_ids.empty()) {
+      auto l = this->find_lobby(*overflow_ids.begin());
+      if (l) {
+        // This modifies overflow_ids, so we must not use it after this
+        l->add_client(c);
+        added_to_lobby = l;
       }
     }
   }
@@ -177,6 +201,7 @@ shared_ptr<Lobby> ServerState::create_lobby(bool is_game) {
   auto l = make_shared<Lobby>(this->shared_from_this(), this->next_lobby_id++, is_game);
   this->id_to_lobby.emplace(l->lobby_id, l);
   l->idle_timeout_usecs = this->persistent_game_idle_timeout_usecs;
+  l->invalidate_game_menus();
   return l;
 }
 
@@ -207,6 +232,8 @@ void ServerState::remove_lobby(shared_ptr<Lobby> l) {
   event_add(this->destroy_lobbies_event.get(), &tv);
 
   this->id_to_lobby.erase(lobby_it);
+  this->update_public_lobby_free_positions(l);
+  l->invalidate_game_menus();
   l->log.info("Enqueued for deletion");
 }
 
@@ -230,24 +257,82 @@ shared_ptr<Client> ServerState::find_client(const string* identifier, uint64_t a
     }
   }
 
-  if (l) {
-    try {
-      return l->find_client(identifier, account_id);
-    } catch (const out_of_range&) {
+  shared_ptr<Client> ret;
+  // Returns true if c is in l, so the search can stop
+  auto consider = [&](const shared_ptr<Client>& c) -> bool {
+    auto c_l = c->lobby.lock();
+    if (!c_l) {
+      return false;
+    }
+    if (!ret) {
+      ret = c;
+    }
+    return (c_l == l);
+  };
+
+  if (account_id && (account_id <= 0xFFFFFFFF)) {
+    auto its = this->clients_by_account_id.equal_range(account_id);
+    for (auto it = its.first; it != its.second; it++) {
+      const auto& c = it->second;
+      if (c->login && (c->login->account->account_id == account_id) && consider(c)) {
+        return ret;
+      }
+    }
+  }
+  if (identifier) {
+    auto its = this->clients_by_name.equal_range(*identifier);
+    for (auto it = its.first; it != its.second; it++) {
+      const auto& c = it->second;
+      auto p = c->character(false, false);
+      if (p && p->disp.name.eq(*identifier, c->language()) && consider(c)) {
+        return ret;
+      }
     }
   }
+  return ret;
+}
 
-  for (auto& other_l : this->all_lobbies()) {
-    if (l == other_l) {
-      continue; // don't bother looking again
+template <typename KeyT>
+static void erase_client_from_index(
+    unordered_multimap<KeyT, shared_ptr<Client>>& index, const KeyT& key, const shared_ptr<Client>& c) {
+  auto its = index.equal_range(key);
+  for (auto it = its.first; it != its.second; it++) {
+    if (it->second == c) {
+      index.erase(it);
+      return;
     }
-    try {
-      return other_l->find_client(identifier, account_id);
-    } catch (const out_of_range&) {
+  }
+}
+
+void ServerState::update_client_index(shared_ptr<Client> c) {
+  if (c->is_indexed) {
+    if (c->indexed_account_id) {
+      erase_client_from_index(this->clients_by_account_id, c->indexed_account_id, c);
     }
+    if (!c->indexed_name.empty()) {
+      erase_client_from_index(this->clients_by_name, c->indexed_name, c);
+    }
+    c->is_indexed = false;
+    c->indexed_account_id = 0;
+    c->indexed_name.clear();
+  }
+
+  if (!c->lobby.lock()) {
+    return;
   }
 
-  throw out_of_range("client not found");
+  if (c->login) {
+    c->indexed_account_id = c->login->account->account_id;
+    this->clients_by_account_id.emplace(c->indexed_account_id, c);
+  }
+  auto p = c->character(false, false);
+  if (p) {
+    c->indexed_name = p->disp.name.decode(c->language());
+    if (!c->indexed_name.empty()) {
+      this->clients_by_name.emplace(c->indexed_name, c);
+    }
+  }
+  c->is_indexed = true;
 }
 
 uint32_t ServerState::connect_address_for_client(shared_ptr<Client> c) const {
@@ -329,6 +414,65 @@ const vector<uint32_t>& ServerState::public_lobby_search_order(Version version,
   return this->public_lobby_search_orders.at(static_cast<size_t>(version));
 }
 
+void ServerState::rebuild_public_lobby_free_positions() {
+  this->public_lobby_search_positions.clear();
+  for (auto& positions : this->public_lobby_free_positions) {
+    positions.clear();
+  }
+
+  auto add_order = [&](const vector<uint32_t>& order, size_t order_index) -> void {
+    for (size_t pos = 0; pos < order.size(); pos++) {
+      this->public_lobby_search_positions[order[pos]].emplace_back(order_index, pos);
+    }
+  };
+  for (size_t v_s = 0; v_s < NUM_VERSIONS; v_s++) {
+    add_order(this->public_lobby_search_orders[v_s], v_s);
+  }
+  add_order(this->client_customization_public_lobby_search_order, NUM_VERSIONS);
+
+  for (const auto& it : this->public_lobby_search_positions) {
+    auto l = this->find_lobby(it.first);
+    if (l) {
+      this->update_public_lobby_free_positions(l);
+    }
+  }
+}
+
+void ServerState::update_public_lobby_free_positions(shared_ptr<const Lobby> l) {
+  auto registered_it = this->id_to_lobby.find(l->lobby_id);
+  bool has_space = (registered_it != this->id_to_lobby.end()) &&
+      (registered_it->second == l) &&
+      !l->is_game() &&
+      l->check_flag(Lobby::Flag::PUBLIC) &&
+      (l->count_clients() < l->max_clients);
+
+  if (l->check_flag(Lobby::Flag::IS_OVERFLOW)) {
+    for (size_t v_s = 0; v_s < NUM_VERSIONS; v_s++) {
+      auto& ids = this->overflow_lobbies_with_space[v_s];
+      if (has_space && l->version_is_allowed(static_cast<Version>(v_s))) {
+        ids.emplace(l->lobby_id);
+      } else {
+        ids.erase(l->lobby_id);
+      }
+    }
+    return;
+  }
+
+  auto positions_it = this->public_lobby_search_positions.find(l->lobby_id);
+  if (positions_it == this->public_lobby_search_positions.end()) {
+    return;
+  }
+
+  for (const auto& [order_index, pos] : positions_it->second) {
+    auto& free_positions = this->public_lobby_free_positions.at(order_index);
+    if (has_space && ((order_index >= NUM_VERSIONS) || l->version_is_allowed(static_cast<Version>(order_index)))) {
+      free_positions.emplace(pos);
+    } else {
+      free_positions.erase(pos);
+    }
+  }
+}
+
 shared_ptr<const vector<string>> ServerState::information_contents_for_client(shared_ptr<const Client> c) const {
   return is_v1_or_v2(c->version()) ? this->information_contents_v2 : this->information_contents_v3;
 }
@@ -421,6 +565,70 @@ shared_ptr<const ItemData::StackLimits> ServerState::item_stack_limits(Version v
   return ret;
 }
 
+shared_ptr<ItemCreator> ServerState::create_item_creator(
+    Version version,
+    Episode episode,
+    GameMode mode,
+    uint8_t difficulty,
+    uint8_t section_id,
+    shared_ptr<PSOLFGEncryption> opt_rand_crypt,
+    shared_ptr<const BattleRules> restrictions,
+    shared_ptr<const RareItemSet> rare_item_set) const {
+  shared_ptr<const CommonItemSet> common_item_set;
+  const char* default_rare_table_name;
+  switch (version) {
+    case Version::PC_PATCH:
+    case Version::BB_PATCH:
+    case Version::GC_EP3_NTE:
+    case Version::GC_EP3:
+      throw runtime_error("cannot create item creator for this version");
+    case Version::DC_NTE:
+    case Version::DC_V1_11_2000_PROTOTYPE:
+    case Version::DC_V1:
+      // TODO: We should probably have a v1 common item set at some point too
+      common_item_set = this->common_item_set_v2;
+      default_rare_table_name = "rare-table-v1";
+      break;
+    case Version::DC_V2:
+    case Version::PC_NTE:
+    case Version::PC_V2:
+      common_item_set = this->common_item_set_v2;
+      default_rare_table_name = "rare-table-v2";
+      break;
+    case Version::GC_NTE:
+    case Version::GC_V3:
+    case Version::XB_V3:
+      common_item_set = this->common_item_set_v3_v4;
+      default_rare_table_name = "rare-table-v3";
+      break;
+    case Version::BB_V4:
+      common_item_set = this->common_item_set_v3_v4;
+      default_rare_table_name = "rare-table-v4";
+      break;
+    default:
+      throw logic_error("invalid item creator version");
+  }
+  if (!rare_item_set) {
+    rare_item_set = this->rare_item_sets.at(default_rare_table_name);
+  }
+
+  return make_shared<ItemCreator>(
+      common_item_set,
+      rare_item_set,
+      this->armor_random_set,
+      this->tool_random_set,
+      this->weapon_random_sets.at(difficulty),
+      this->tekker_adjustment_set,
+      this->item_parameter_table(version),
+      this->item_stack_limits(version),
+      episode,
+      (mode == GameMode::SOLO) ? GameMode::NORMAL : mode,
+      difficulty,
+      section_id,
+      opt_rand_crypt,
+      restrictions);
+}
+
 shared_ptr<const ItemNameIndex> ServerState::item_name_index_opt(Version version) const {
   return this->item_name_indexes.at(static_cast<size_t>(version));
 }
@@ -434,13 +642,15 @@ shared_ptr<const ItemNameIndex> ServerState::item_name_index(Version version) co
 }
 
 string ServerState::describe_item(Version version, const ItemData& item, bool include_color_codes) const {
-  if (is_v1(version)) {
-    ItemData encoded = item;
-    encoded.encode_for_version(version, this->item_parameter_table(version));
-    return this->item_name_index(version)->describe_item(encoded, include_color_codes);
-  } else {
-    return this->item_name_index(version)->describe_item(item, include_color_codes);
-  }
+  return this->item_description_cache->get(version, item, include_color_codes, [&]() -> string {
+    if (is_v1(version)) {
+      ItemData encoded = item;
+      encoded.encode_for_version(version, this->item_parameter_table(version));
+      return this->item_name_index(version)->describe_item(encoded, include_color_codes);
+    } else {
+      return this->item_name_index(version)->describe_item(item, include_color_codes);
+    }
+  });
 }
 
 ItemData ServerState::parse_item_description(Version version, const string& description) const {
@@ -518,7 +728,9 @@ shared_ptr<const string> ServerState::load_bb_file(
   // Finally, look in system/blueburst
   const string& effective_bb_directory_filename = bb_directory_filename.empty() ? patch_index_filename : bb_directory_filename;
   static FileContentsCache cache(10 * 60 * 1000 * 1000); // 10 minutes
+  static mutex cache_lock; // load_bb_file may be called from multiple loader threads
   try {
+    lock_guard g(cache_lock);
     auto ret = cache.get_or_load("system/blueburst/" + effective_bb_directory_filename);
     return ret.file->data;
   } catch (const exception& e) {
@@ -554,6 +766,23 @@ shared_ptr<const string> ServerState::load_map_file_uncached(Version version, co
   return nullptr;
 }
 
+DecodedFileData ServerState::load_decoded_file(
+    const string& path, function<string(const string&)> decode) const {
+  if (this->data_snapshot) {
+    auto ret = this->data_snapshot->get(path);
+    if (ret) {
+      return ret;
+    }
+    config_log.info("Data snapshot entry for %s is missing or stale", path.c_str());
+  }
+  auto decoded = make_shared<string>(decode(load_file(path)));
+  if (this->data_snapshot_builder) {
+    this->data_snapshot_builder->add(path, *decoded);
+  }
+  string_view decoded_view = *decoded;
+  return DecodedFileData{.owner = std::move(decoded), .data = decoded_view};
+}
+
 pair<string, uint16_t> ServerState::parse_port_spec(const JSON& json) const {
   if (json.is_list()) {
     string addr = json.at(0).as_string();
@@ -591,13 +820,88 @@ void ServerState::collect_network_addresses() {
   }
 }
 
-void ServerState::load_config_early() {
+shared_ptr<const JSON> ServerState::load_config_json() const {
   if (this->config_filename.empty()) {
     throw logic_error("configuration filename is missing");
   }
-
   config_log.info("Loading configuration");
-  this->config_json = make_shared<JSON>(JSON::parse(load_file(this->config_filename)));
+  return make_shared<JSON>(JSON::parse(load_file(this->config_filename)));
+}
+
+vector<ServerState::Ep3LobbyBannerEntry> ServerState::load_ep3_lobby_banners(const JSON& config_json) {
+  vector<Ep3LobbyBannerEntry> ret;
+  size_t banner_index = 0;
+  for (const auto& it : config_json.get("Episode3LobbyBanners", JSON::list()).as_list()) {
+    string path = "system/ep3/banners/" + it->at(2).as_string();
+
+    string compressed_gvm_data;
+    string decompressed_gvm_data;
+    string lower_path = tolower(path);
+    if (ends_with(lower_path, ".gvm.prs")) {
+      compressed_gvm_data = load_file(path);
+    } else if (ends_with(lower_path, ".gvm")) {
+      decompressed_gvm_data = load_file(path);
+    } else if (ends_with(lower_path, ".bmp")) {
+      Image img(path);
+      decompressed_gvm_data = encode_gvm(
+          img,
+          img.get_has_alpha() ? GVRDataFormat::RGB5A3 : GVRDataFormat::RGB565,
+          string_printf("bnr%zu", banner_index),
+          0x80 | banner_index);
+      banner_index++;
+    } else {
+      throw runtime_error(string_printf("banner %s is in an unknown format", path.c_str()));
+    }
+
+    size_t decompressed_size = decompressed_gvm_data.empty()
+        ? prs_decompress_size(compressed_gvm_data)
+        : decompressed_gvm_data.size();
+    if (decompressed_size > 0x37000) {
+      throw runtime_error(string_printf("banner %s is too large (0x%zX bytes; maximum size is 0x37000 bytes)", path.c_str(), decompressed_size));
+    }
+
+    if (compressed_gvm_data.empty()) {
+      compressed_gvm_data = prs_compress_optimal(decompressed_gvm_data);
+    }
+    if (compressed_gvm_data.size() > 0x3800) {
+      throw runtime_error(string_printf("banner %s cannot be compressed small enough (0x%zX bytes; maximum size is 0x3800 bytes compressed)", it->at(2).as_string().c_str(), compressed_gvm_data.size()));
+    }
+    config_log.info("Loaded Episode 3 lobby banner %s (0x%zX -> 0x%zX bytes)", path.c_str(), decompressed_size, compressed_gvm_data.size());
+    ret.emplace_back(
+        Ep3LobbyBannerEntry{.type = static_cast<uint32_t>(it->at(0).as_int()),
+            .which = static_cast<uint32_t>(it->at(1).as_int()),
+            .data = std::move(compressed_gvm_data)});
+  }
+  return ret;
+}
+
+void ServerState::load_config(bool from_non_event_thread) {
+  // Parsing the JSON and compressing the lobby banners can be slow, so we do
+  // that before going to the event thread. Everything else in the config only
+  // sets fields on this object and is fast.
+  auto new_config_json = this->load_config_json();
+  auto new_ep3_lobby_banners = this->is_replay
+      ? nullptr
+      : make_shared<vector<Ep3LobbyBannerEntry>>(this->load_ep3_lobby_banners(*new_config_json));
+
+  auto set = [s = this->shared_from_this(),
+                 new_config_json = std::move(new_config_json),
+                 new_ep3_lobby_banners = std::move(new_ep3_lobby_banners)]() {
+    try {
+      s->load_config_early(new_config_json, new_ep3_lobby_banners);
+      s->load_config_late();
+    } catch (const exception& e) {
+      config_log.error("Failed to apply configuration: %s", e.what());
+      config_log.error("Some configuration may have been reloaded. Fix the underlying issue and try again.");
+    }
+  };
+  this->publish(from_non_event_thread, "configuration", std::move(set));
+}
+
+void ServerState::load_config_early(
+    shared_ptr<const JSON> new_config_json,
+    shared_ptr<vector<Ep3LobbyBannerEntry>> new_ep3_lobby_banners) {
+  this->config_json = new_config_json ? std::move(new_config_json) : this->load_config_json();
 
   auto parse_behavior_switch = [&](const string& json_key, BehaviorSwitch default_value) -> ServerState::BehaviorSwitch {
     try {
@@ -839,49 +1143,9 @@ void ServerState::load_config_early() {
   }
 
   if (!this->is_replay) {
-    this->ep3_lobby_banners.clear();
-    size_t banner_index = 0;
-    for (const auto& it : this->config_json->get("Episode3LobbyBanners", JSON::list()).as_list()) {
-      string path = "system/ep3/banners/" + it->at(2).as_string();
-
-      string compressed_gvm_data;
-      string decompressed_gvm_data;
-      string lower_path = tolower(path);
-      if (ends_with(lower_path, ".gvm.prs")) {
-        compressed_gvm_data = load_file(path);
-      } else if (ends_with(lower_path, ".gvm")) {
-        decompressed_gvm_data = load_file(path);
-      } else if (ends_with(lower_path, ".bmp")) {
-        Image img(path);
-        decompressed_gvm_data = encode_gvm(
-            img,
-            img.get_has_alpha() ? GVRDataFormat::RGB5A3 : GVRDataFormat::RGB565,
-            string_printf("bnr%zu", banner_index),
-            0x80 | banner_index);
-        banner_index++;
-      } else {
-        throw runtime_error(string_printf("banner %s is in an unknown format", path.c_str()));
-      }
-
-      size_t decompressed_size = decompressed_gvm_data.empty()
-          ? prs_decompress_size(compressed_gvm_data)
-          : decompressed_gvm_data.size();
-      if (decompressed_size > 0x37000) {
-        throw runtime_error(string_printf("banner %s is too large (0x%zX bytes; maximum size is 0x37000 bytes)", path.c_str(), decompressed_size));
-      }
-
-      if (compressed_gvm_data.empty()) {
-        compressed_gvm_data = prs_compress_optimal(decompressed_gvm_data);
-      }
-      if (compressed_gvm_data.size() > 0x3800) {
-        throw runtime_error(string_printf("banner %s cannot be compressed small enough (0x%zX bytes; maximum size is 0x3800 bytes compressed)", it->at(2).as_string().c_str(), compressed_gvm_data.size()));
-      }
-      config_log.info("Loaded Episode 3 lobby banner %s (0x%zX -> 0x%zX bytes)", path.c_str(), decompressed_size, compressed_gvm_data.size());
-      this->ep3_lobby_banners.emplace_back(
-          Ep3LobbyBannerEntry{.type = static_cast<uint32_t>(it->at(0).as_int()),
-              .which = static_cast<uint32_t>(it->at(1).as_int()),
-              .data = std::move(compressed_gvm_data)});
-    }
+    this->ep3_lobby_banners = new_ep3_lobby_banners
+        ? std::move(*new_ep3_lobby_banners)
+        : this->load_ep3_lobby_banners(*this->config_json);
   }
 
   {
@@ -945,6 +1209,18 @@ void ServerState::load_config_early() {
   this->bb_global_exp_multiplier = this->config_json->get_int("BBGlobalEXPMultiplier", 1);
   this->exp_share_multiplier = this->config_json->get_float("BBEXPShareMultiplier", 0.5);
   this->server_global_drop_rate_multiplier = this->config_json->get_float("ServerGlobalDropRateMultiplier", 1);
+  this->num_startup_load_threads = this->config_json->get_int("StartupLoadThreads", 0);
+  this->quest_content_cache_bytes = this->config_json->get_int("QuestContentCacheBytes", 0x4000000);
+  this->player_file_cache_bytes = this->config_json->get_int("PlayerFileCacheBytes", 0x1000000);
+  this->defer_map_floors = this->config_json->get_bool("DeferMapFloors", false);
+  if (this->player_files_manager) {
+    this->player_files_manager->set_max_cache_bytes(this->player_file_cache_bytes);
+  }
+  this->item_description_cache_entries = this->config_json->get_int("ItemDescriptionCacheEntries", 0x4000);
+  this->item_description_cache->set_max_entries(this->item_description_cache_entries);
+  this->account_storage = this->config_json->get_string("AccountStorage", "json");
+  this->account_log_sync_interval_usecs = this->config_json->get_int("AccountLogSyncInterval", 1000000);
+  this->data_snapshot_filename = this->config_json->get_string("DataSnapshotFile", "system/data-snapshot.bin");
 
   set_log_levels_from_json(this->config_json->get("LogLevels", JSON::dict()));
 
@@ -1001,6 +1277,7 @@ void ServerState::load_config_early() {
     }
   } catch (const out_of_range&) {
   }
+  this->rebuild_public_lobby_free_positions();
 
   this->pre_lobby_event = 0;
   try {
@@ -1332,6 +1609,37 @@ void ServerState::load_config_late() {
   }
 }
 
+void ServerState::publish(bool from_non_event_thread, const char* description, function<void()>&& set) {
+  if (!from_non_event_thread) {
+    set();
+    return;
+  }
+  uint64_t enqueue_time = now();
+  this->forward_to_event_thread([description, enqueue_time, set = std::move(set)]() -> void {
+    uint64_t start_time = now();
+    set();
+    uint64_t end_time = now();
+    config_log.info("Published new %s (waited %" PRIu64 " usecs for event thread; swap took %" PRIu64 " usecs)",
+        description, start_time - enqueue_time, end_time - start_time);
+  });
+}
+
+void ServerState::load_data_snapshot() {
+  this->data_snapshot.reset();
+  if (this->data_snapshot_filename.empty() || !isfile(this->data_snapshot_filename)) {
+    config_log.info("No data snapshot present; parsing all data from source files");
+    return;
+  }
+  try {
+    this->data_snapshot = make_shared<DataSnapshot>(this->data_snapshot_filename);
+    config_log.info("Loaded data snapshot with %zu entries from %s",
+        this->data_snapshot->num_entries(), this->data_snapshot_filename.c_str());
+  } catch (const exception& e) {
+    config_log.warning("Cannot load data snapshot from %s (%s); parsing all data from source files",
+        this->data_snapshot_filename.c_str(), e.what());
+  }
+}
+
 void ServerState::load_bb_private_keys(bool from_non_event_thread) {
   std::vector<std::shared_ptr<const PSOBBEncryption::KeyFile>> new_keys;
   for (const string& filename : list_directory("system/blueburst/keys")) {
@@ -1342,33 +1650,140 @@ void ServerState::load_bb_private_keys(bool from_non_event_thread) {
         load_object_file<PSOBBEncryption::KeyFile>("system/blueburst/keys/" + filename)));
     config_log.info("Loaded Blue Burst key file: %s", filename.c_str());
   }
-  config_log.info("%zu Blue Burst key file(s) loaded", this->bb_private_keys.size());
+  config_log.info("%zu Blue Burst key file(s) loaded", new_keys.size());
 
   auto set = [s = this->shared_from_this(), new_keys = std::move(new_keys)]() {
     s->bb_private_keys = std::move(new_keys);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "BB private keys", std::move(set));
+}
+
+void ServerState::load_bb_stream_files(bool from_non_event_thread) {
+  static const vector<string> stream_file_entries = {
+      "ItemMagEdit.prs",
+      "ItemPMT.prs",
+      "BattleParamEntry.dat",
+      "BattleParamEntry_on.dat",
+      "BattleParamEntry_lab.dat",
+      "BattleParamEntry_lab_on.dat",
+      "BattleParamEntry_ep4.dat",
+      "BattleParamEntry_ep4_on.dat",
+      "PlyLevelTbl.prs",
+  };
+
+  config_log.info("Loading BB stream files");
+  auto new_stream_files = make_shared<BBStreamFiles>();
+  string stream_data;
+  StringWriter index_w;
+  for (const string& filename : stream_file_entries) {
+    string file_data = load_file("system/blueburst/" + filename);
+    S_StreamFileIndexEntry_BB_01EB e;
+    e.size = file_data.size();
+    e.checksum = crc32(file_data.data(), file_data.size());
+    e.offset = stream_data.size();
+    e.filename.encode(filename);
+    index_w.put(e);
+    stream_data += file_data;
+  }
+  new_stream_files->num_files = stream_file_entries.size();
+  new_stream_files->index_data = std::move(index_w.str());
+
+  // The client may request the chunk that begins exactly at the end of the
+  // stream (if the stream's size is a multiple of the chunk size), so there is
+  // always one more chunk than the number of full chunks
+  S_StreamFileChunk_BB_02EB chunk_cmd;
+  size_t num_chunks = stream_data.size() / sizeof(chunk_cmd.data) + 1;
+  for (size_t z = 0; z < num_chunks; z++) {
+    size_t offset = z * sizeof(chunk_cmd.data);
+    size_t bytes = min<size_t>(stream_data.size() - offset, sizeof(chunk_cmd.data));
+    chunk_cmd.chunk_index = z;
+    chunk_cmd.data.assign_range(reinterpret_cast<const uint8_t*>(stream_data.data() + offset), bytes, 0);
+    size_t cmd_size = (offsetof(S_StreamFileChunk_BB_02EB, data) + bytes + 3) & ~3;
+    new_stream_files->chunk_commands.emplace_back(reinterpret_cast<const char*>(&chunk_cmd), cmd_size);
+  }
+  config_log.info("Prepared %zu BB stream files (%zu bytes, %zu chunks)",
+      new_stream_files->num_files, stream_data.size(), new_stream_files->chunk_commands.size());
+
+  auto set = [s = this->shared_from_this(), new_stream_files = std::move(new_stream_files)]() {
+    s->bb_stream_files = std::move(new_stream_files);
+  };
+  this->publish(from_non_event_thread, "BB stream files", std::move(set));
+}
+
+shared_ptr<AccountStore> ServerState::create_account_store() const {
+  if (this->account_storage == "json") {
+    return make_shared<JSONAccountStore>("system/licenses", this->file_write_queue);
+
+  } else if (this->account_storage == "log") {
+    static const string log_filename = "system/licenses/accounts.log";
+    if (!isdir("system/licenses")) {
+      mkdir("system/licenses", 0755);
+    }
+    // If the log doesn't exist yet, import any accounts from JSON files, so
+    // switching to the log doesn't lose any accounts. The JSON files are left
+    // in place, but are not updated afterward. The import is written to a
+    // temporary file which is renamed into place only when it's complete, so
+    // if it's interrupted, it's redone from scratch at the next startup.
+    if (!isfile(log_filename)) {
+      static const string import_filename = log_filename + ".import";
+      ::remove(import_filename.c_str());
+      JSONAccountStore json_store("system/licenses");
+      auto accounts = json_store.load_all();
+      {
+        // The import is synced only once, by flush()
+        LogAccountStore import_store(import_filename, UINT64_MAX);
+        for (const auto& a : accounts) {
+          import_store.save(*a);
+        }
+        import_store.flush();
+      }
+      if (rename(import_filename.c_str(), log_filename.c_str()) != 0) {
+        throw runtime_error("cannot rename imported account log into place");
+      }
+      if (!accounts.empty()) {
+        config_log.info("Imported %zu account(s) from JSON files into %s", accounts.size(), log_filename.c_str());
+      }
+    }
+    return make_shared<LogAccountStore>(
+        log_filename, this->account_log_sync_interval_usecs, this->base, this->file_write_queue);
+
+  } else {
+    throw runtime_error("invalid AccountStorage value: " + this->account_storage);
+  }
 }
 
 void ServerState::load_accounts(bool from_non_event_thread) {
   config_log.info("Indexing accounts");
-  shared_ptr<AccountIndex> new_index = make_shared<AccountIndex>(this->is_replay);
+  // The store is created only once, since accounts that are in use (e.g. by
+  // connected clients) keep a reference to the store they were loaded from and
+  // save to it later. This means changing AccountStorage requires a restart.
+  auto store = this->read_state<shared_ptr<AccountStore>>(from_non_event_thread, [&]() {
+    return this->account_store;
+  });
+  if (!store && !this->is_replay) {
+    store = this->create_account_store();
+  }
+  shared_ptr<AccountIndex> new_index = make_shared<AccountIndex>(store, this->is_replay);
 
-  auto set = [s = this->shared_from_this(), new_index = std::move(new_index)]() {
+  auto set = [s = this->shared_from_this(), store = std::move(store), new_index = std::move(new_index)]() {
+    s->account_store = std::move(store);
     s->account_index = std::move(new_index);
     s->update_dependent_server_configs();
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "account index", std::move(set));
 }
 
 void ServerState::load_teams(bool from_non_event_thread) {
   config_log.info("Indexing teams");
-  shared_ptr<TeamIndex> new_index = make_shared<TeamIndex>("system/teams", this->team_reward_defs_json);
+  auto reward_defs_json = this->read_state<JSON>(from_non_event_thread, [&]() -> JSON {
+    return this->team_reward_defs_json;
+  });
+  shared_ptr<TeamIndex> new_index = make_shared<TeamIndex>("system/teams", reward_defs_json);
 
   auto set = [s = this->shared_from_this(), new_index = std::move(new_index)]() {
     s->team_index = std::move(new_index);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "team index", std::move(set));
 }
 
 void ServerState::load_patch_indexes(bool from_non_event_thread) {
@@ -1405,7 +1820,7 @@ void ServerState::load_patch_indexes(bool from_non_event_thread) {
     s->bb_patch_file_index = std::move(bb_patch_file_index);
     s->update_dependent_server_configs();
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "patch file indexes", std::move(set));
 }
 
 void ServerState::clear_map_file_caches() {
@@ -1413,6 +1828,7 @@ void ServerState::clear_map_file_caches() {
   for (auto& cache : this->map_file_caches) {
     cache = make_shared<ThreadSafeFileCache>();
   }
+  this->map_template_cache = make_shared<MapTemplateCache>();
 }
 
 void ServerState::load_set_data_tables(bool from_non_event_thread) {
@@ -1458,7 +1874,7 @@ void ServerState::load_set_data_tables(bool from_non_event_thread) {
     s->bb_solo_set_data_table = std::move(new_table_bb_solo);
     s->bb_solo_set_data_table_ep1_ult = std::move(new_table_bb_solo_ep1_ult);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "set data tables", std::move(set));
 }
 
 void ServerState::load_battle_params(bool from_non_event_thread) {
@@ -1474,13 +1890,19 @@ void ServerState::load_battle_params(bool from_non_event_thread) {
   auto set = [s = this->shared_from_this(), new_battle_params = std::move(new_battle_params)]() {
     s->battle_params = std::move(new_battle_params);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "battle parameters", std::move(set));
+}
+
+static string prs_decompress_all(const string& data) {
+  return prs_decompress(data);
 }
 
 void ServerState::load_level_tables(bool from_non_event_thread) {
   config_log.info("Loading level tables");
-  auto new_table_v1_v2 = make_shared<LevelTableV2>(load_file("system/level-tables/PlayerTable-pc-v2.prs"), true);
-  auto new_table_v3 = make_shared<LevelTableV3BE>(load_file("system/level-tables/PlyLevelTbl-gc-v3.cpt"), true);
+  auto data_v1_v2 = this->load_decoded_file("system/level-tables/PlayerTable-pc-v2.prs", prs_decompress_all);
+  auto new_table_v1_v2 = make_shared<LevelTableV2>(data_v1_v2.data, false);
+  auto data_v3 = this->load_decoded_file("system/level-tables/PlyLevelTbl-gc-v3.cpt", decrypt_and_decompress_pr2_data<true>);
+  auto new_table_v3 = make_shared<LevelTableV3BE>(data_v3.data, false);
   auto new_table_v4 = make_shared<LevelTableV4>(*this->load_bb_file("PlyLevelTbl.prs"), true);
 
   auto set = [s = this->shared_from_this(), new_table_v1_v2 = std::move(new_table_v1_v2), new_table_v3 = std::move(new_table_v3), new_table_v4 = std::move(new_table_v4)]() {
@@ -1488,28 +1910,37 @@ void ServerState::load_level_tables(bool from_non_event_thread) {
     s->level_table_v3 = std::move(new_table_v3);
     s->level_table_v4 = std::move(new_table_v4);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "level tables", std::move(set));
 }
 
 void ServerState::load_text_index(bool from_non_event_thread) {
-  auto new_index = make_shared<TextIndex>("system/text-sets", [&](Version version, const string& filename) -> shared_ptr<const string> {
+  auto pc_patch_file_index = this->read_state<shared_ptr<const PatchFileIndex>>(from_non_event_thread, [&]() {
+    return this->pc_patch_file_index;
+  });
+  auto get_patch_file = [&](Version version, const string& filename) -> shared_ptr<const string> {
     try {
       if (version == Version::BB_V4) {
         return this->load_bb_file(filename);
+      } else if (pc_patch_file_index) {
+        return pc_patch_file_index->get("Media/PSO/" + filename)->load_data();
       } else {
-        return this->pc_patch_file_index->get("Media/PSO/" + filename)->load_data();
+        return nullptr;
       }
     } catch (const out_of_range&) {
       return nullptr;
     } catch (const cannot_open_file&) {
       return nullptr;
     }
-  });
+  };
+  auto load_decoded_file = [&](const string& path, function<string(const string&)> decompress) -> DecodedFileData {
+    return this->load_decoded_file(path, decompress);
+  };
+  auto new_index = make_shared<TextIndex>("system/text-sets", get_patch_file, load_decoded_file);
 
   auto set = [s = this->shared_from_this(), new_index = std::move(new_index)]() {
     s->text_index = std::move(new_index);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "text index", std::move(set));
 }
 
 void ServerState::load_word_select_table(bool from_non_event_thread) {
@@ -1524,19 +1955,25 @@ void ServerState::load_word_select_table(bool from_non_event_thread) {
     }
   }
 
+  auto text_index = this->read_state<shared_ptr<const TextIndex>>(from_non_event_thread, [&]() {
+    return this->text_index;
+  });
+
   const vector<string>* pc_unitxt_collection = nullptr;
   const vector<string>* bb_unitxt_collection = nullptr;
-  unique_ptr<UnicodeTextSet> pc_unitxt_data;
-  if (this->text_index) {
+  shared_ptr<UnicodeTextSet> pc_unitxt_data;
+  if (text_index) {
     config_log.info("(Word select) Using PC_V2 unitxt_e.prs from text index");
-    pc_unitxt_collection = &this->text_index->get(Version::PC_V2, 1, 35);
+    pc_unitxt_collection = &text_index->get(Version::PC_V2, 1, 35);
   } else {
     config_log.info("(Word select) Loading PC_V2 unitxt_e.prs");
-    pc_unitxt_data = make_unique<UnicodeTextSet>(load_file("system/text-sets/pc-v2/unitxt_e.prs"));
+    auto decoded = this->load_decoded_file("system/text-sets/pc-v2/unitxt_e.prs", UnicodeTextSet::decompress);
+    pc_unitxt_data = UnicodeTextSet::from_decompressed(decoded.data);
     pc_unitxt_collection = &pc_unitxt_data->get(35);
   }
   config_log.info("(Word select) Loading BB_V4 unitxt_ws_e.prs");
-  auto bb_unitxt_data = make_unique<UnicodeTextSet>(load_file("system/text-sets/bb-v4/unitxt_ws_e.prs"));
+  auto bb_unitxt_decoded = this->load_decoded_file("system/text-sets/bb-v4/unitxt_ws_e.prs", UnicodeTextSet::decompress);
+  auto bb_unitxt_data = UnicodeTextSet::from_decompressed(bb_unitxt_decoded.data);
   bb_unitxt_collection = &bb_unitxt_data->get(0);
 
   config_log.info("(Word select) Loading DC_NTE data");
@@ -1574,7 +2011,7 @@ void ServerState::load_word_select_table(bool from_non_event_thread) {
   auto set = [s = this->shared_from_this(), new_table = std::move(new_table)]() {
     s->word_select_table = std::move(new_table);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "Word Select table", std::move(set));
 }
 
 shared_ptr<ItemNameIndex> ServerState::create_item_name_index_for_version(
@@ -1608,24 +2045,51 @@ shared_ptr<ItemNameIndex> ServerState::create_item_name_index_for_version(
 }
 
 void ServerState::load_item_name_indexes(bool from_non_event_thread) {
-  std::array<std::shared_ptr<const ItemNameIndex>, NUM_VERSIONS> new_indexes;
+  struct Inputs {
+    std::array<std::shared_ptr<const ItemParameterTable>, NUM_VERSIONS> item_parameter_tables;
+    std::array<std::shared_ptr<const ItemData::StackLimits>, NUM_VERSIONS> item_stack_limits_tables;
+    std::shared_ptr<const TextIndex> text_index;
+  };
+  auto inputs = this->read_state<Inputs>(from_non_event_thread, [&]() -> Inputs {
+    return Inputs{this->item_parameter_tables, this->item_stack_limits_tables, this->text_index};
+  });
 
+  std::array<std::shared_ptr<const ItemNameIndex>, NUM_VERSIONS> new_indexes;
   for (size_t v_s = NUM_PATCH_VERSIONS; v_s < NUM_VERSIONS; v_s++) {
     Version v = static_cast<Version>(v_s);
+    if (!inputs.item_parameter_tables[v_s] || !inputs.item_stack_limits_tables[v_s]) {
+      throw runtime_error(string_printf("item parameter table or stack limits missing for %s", name_for_enum(v)));
+    }
     config_log.info("Generating item name index for %s", name_for_enum(v));
     new_indexes[v_s] = this->create_item_name_index_for_version(
-        this->item_parameter_table(v), this->item_stack_limits(v), this->text_index);
+        inputs.item_parameter_tables[v_s], inputs.item_stack_limits_tables[v_s], inputs.text_index);
   }
   new_indexes[static_cast<size_t>(Version::GC_EP3)] = new_indexes[static_cast<size_t>(Version::GC_V3)];
   new_indexes[static_cast<size_t>(Version::GC_EP3_NTE)] = new_indexes[static_cast<size_t>(Version::GC_V3)];
 
   auto set = [s = this->shared_from_this(), new_indexes = std::move(new_indexes)]() {
     s->item_name_indexes = std::move(new_indexes);
+    s->item_description_cache->clear();
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "item name indexes", std::move(set));
 }
 
 void ServerState::load_drop_tables(bool from_non_event_thread) {
+  struct Inputs {
+    std::array<std::shared_ptr<const ItemNameIndex>, NUM_VERSIONS> item_name_indexes;
+    double drop_rate_multiplier;
+  };
+  auto inputs = this->read_state<Inputs>(from_non_event_thread, [&]() -> Inputs {
+    return Inputs{this->item_name_indexes, this->server_global_drop_rate_multiplier};
+  });
+  auto name_index = [&](Version v) -> shared_ptr<const ItemNameIndex> {
+    auto ret = inputs.item_name_indexes.at(static_cast<size_t>(v));
+    if (ret == nullptr) {
+      throw runtime_error("no item name index exists for this version");
+    }
+    return ret;
+  };
+
   config_log.info("Loading rare item sets");
 
   unordered_map<string, shared_ptr<RareItemSet>> new_rare_item_sets;
@@ -1640,16 +2104,16 @@ void ServerState::load_drop_tables(bool from_non_event_thread) {
 
     if (ends_with(filename, "-v1.json")) {
       config_log.info("Loading v1 JSON rare item table %s", filename.c_str());
-      new_rare_item_sets.emplace(basename, make_shared<RareItemSet>(JSON::parse(load_file(path)), this->item_name_index(Version::DC_V1)));
+      new_rare_item_sets.emplace(basename, make_shared<RareItemSet>(JSON::parse(load_file(path)), name_index(Version::DC_V1)));
     } else if (ends_with(filename, "-v2.json")) {
       config_log.info("Loading v2 JSON rare item table %s", filename.c_str());
-      new_rare_item_sets.emplace(basename, make_shared<RareItemSet>(JSON::parse(load_file(path)), this->item_name_index(Version::PC_V2)));
+      new_rare_item_sets.emplace(basename, make_shared<RareItemSet>(JSON::parse(load_file(path)), name_index(Version::PC_V2)));
     } else if (ends_with(filename, "-v3.json")) {
       config_log.info("Loading v3 JSON rare item table %s", filename.c_str());
-      new_rare_item_sets.emplace(basename, make_shared<RareItemSet>(JSON::parse(load_file(path)), this->item_name_index(Version::GC_V3)));
+      new_rare_item_sets.emplace(basename, make_shared<RareItemSet>(JSON::parse(load_file(path)), name_index(Version::GC_V3)));
     } else if (ends_with(filename, "-v4.json")) {
       config_log.info("Loading v4 JSON rare item table %s", filename.c_str());
-      new_rare_item_sets.emplace(basename, make_shared<RareItemSet>(JSON::parse(load_file(path)), this->item_name_index(Version::BB_V4)));
+      new_rare_item_sets.emplace(basename, make_shared<RareItemSet>(JSON::parse(load_file(path)), name_index(Version::BB_V4)));
 
     } else if (ends_with(filename, ".afs")) {
       config_log.info("Loading AFS rare item table %s", filename.c_str());
@@ -1705,6 +2169,13 @@ void ServerState::load_drop_tables(bool from_non_event_thread) {
   auto tekker_data = make_shared<string>(load_file("system/item-tables/JudgeItem-gc-v3.rel"));
   auto new_tekker_adjustment_set = make_shared<TekkerAdjustmentSet>(tekker_data);
 
+  if (inputs.drop_rate_multiplier != 1.0) {
+    config_log.info("Applying global drop rate multiplier");
+    for (auto& it : new_rare_item_sets) {
+      it.second->multiply_all_rates(inputs.drop_rate_multiplier);
+    }
+  }
+
   auto set = [s = this->shared_from_this(),
                  new_rare_item_sets = std::move(new_rare_item_sets),
                  new_common_item_set_v2 = std::move(new_common_item_set_v2),
@@ -1713,11 +2184,6 @@ void ServerState::load_drop_tables(bool from_non_event_thread) {
                  new_tool_random_set = std::move(new_tool_random_set),
                  new_weapon_random_sets = std::move(new_weapon_random_sets),
                  new_tekker_adjustment_set = std::move(new_tekker_adjustment_set)]() {
-    if (s->server_global_drop_rate_multiplier != 1.0) {
-      for (auto& it : new_rare_item_sets) {
-        it.second->multiply_all_rates(s->server_global_drop_rate_multiplier);
-      }
-    }
     // We can't just move() new_rare_item_sets into place because its values are
     // not const :(
     s->rare_item_sets.clear();
@@ -1731,7 +2197,7 @@ void ServerState::load_drop_tables(bool from_non_event_thread) {
     s->weapon_random_sets = std::move(new_weapon_random_sets);
     s->tekker_adjustment_set = std::move(new_tekker_adjustment_set);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "drop tables", std::move(set));
 }
 
 void ServerState::load_item_definitions(bool from_non_event_thread) {
@@ -1740,22 +2206,23 @@ void ServerState::load_item_definitions(bool from_non_event_thread) {
     Version v = static_cast<Version>(v_s);
     string path = string_printf("system/item-tables/ItemPMT-%s.prs", file_path_token_for_version(v));
     config_log.info("Loading item definition table %s", path.c_str());
-    auto data = make_shared<string>(prs_decompress(load_file(path)));
-    new_item_parameter_tables[v_s] = make_shared<ItemParameterTable>(data, v);
+    auto data = this->load_decoded_file(path, prs_decompress_all);
+    new_item_parameter_tables[v_s] = make_shared<ItemParameterTable>(data.owner, data.data, v);
   }
 
   // TODO: We should probably load the tables for other versions too.
   config_log.info("Loading mag evolution table");
-  auto mag_data = make_shared<string>(prs_decompress(load_file("system/item-tables/ItemMagEdit-bb-v4.prs")));
-  auto new_mag_evolution_table = make_shared<MagEvolutionTable>(mag_data);
+  auto mag_data = this->load_decoded_file("system/item-tables/ItemMagEdit-bb-v4.prs", prs_decompress_all);
+  auto new_mag_evolution_table = make_shared<MagEvolutionTable>(mag_data.owner, mag_data.data);
 
   auto set = [s = this->shared_from_this(),
                  new_item_parameter_tables = std::move(new_item_parameter_tables),
                  new_mag_evolution_table = std::move(new_mag_evolution_table)]() {
     s->item_parameter_tables = std::move(new_item_parameter_tables);
+    s->item_description_cache->clear();
     s->mag_evolution_table = std::move(new_mag_evolution_table);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "item definitions", std::move(set));
 }
 
 void ServerState::load_ep3_cards(bool from_non_event_thread) {
@@ -1786,7 +2253,7 @@ void ServerState::load_ep3_cards(bool from_non_event_thread) {
     s->ep3_card_index_trial = std::move(new_ep3_card_index_trial);
     s->ep3_com_deck_index = std::move(new_ep3_com_deck_index);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "Episode 3 card definitions", std::move(set));
 }
 
 void ServerState::load_ep3_maps(bool from_non_event_thread) {
@@ -1796,28 +2263,40 @@ void ServerState::load_ep3_maps(bool from_non_event_thread) {
   auto set = [s = this->shared_from_this(), new_ep3_map_index = std::move(new_ep3_map_index)]() {
     s->ep3_map_index = std::move(new_ep3_map_index);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "Episode 3 maps", std::move(set));
 }
 
 void ServerState::load_ep3_tournament_state(bool from_non_event_thread) {
   config_log.info("Loading Episode 3 tournament state");
   const string& tournament_state_filename = "system/ep3/tournament-state.json";
+  auto [map_index, com_deck_index] = this->read_state<pair<shared_ptr<const Episode3::MapIndex>, shared_ptr<const Episode3::COMDeckIndex>>>(
+      from_non_event_thread, [&]() {
+        return make_pair(this->ep3_map_index, this->ep3_com_deck_index);
+      });
   auto new_ep3_tournament_index = make_shared<Episode3::TournamentIndex>(
-      this->ep3_map_index, this->ep3_com_deck_index, tournament_state_filename);
+      map_index, com_deck_index, tournament_state_filename);
 
   auto set = [s = this->shared_from_this(),
                  new_ep3_tournament_index = std::move(new_ep3_tournament_index)]() {
     s->ep3_tournament_index = std::move(new_ep3_tournament_index);
     s->ep3_tournament_index->link_all_clients(s);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "Episode 3 tournament state", std::move(set));
 }
 
 void ServerState::load_quest_index(bool from_non_event_thread) {
+  using Inputs = pair<shared_ptr<const QuestCategoryIndex>, size_t>;
+  auto inputs = this->read_state<Inputs>(from_non_event_thread, [&]() {
+    return make_pair(this->quest_category_index, this->quest_content_cache_bytes);
+  });
+  // Both indexes share the same cache, so the limit applies to all quests. The
+  // cache is replaced along with the indexes, so files that changed since the
+  // last load aren't served from the old cache.
+  auto content_cache = make_shared<QuestContentCache>(inputs.second);
   config_log.info("Collecting quests");
-  auto new_default_quest_index = make_shared<QuestIndex>("system/quests", this->quest_category_index, false);
+  auto new_default_quest_index = make_shared<QuestIndex>("system/quests", inputs.first, content_cache, false);
   config_log.info("Collecting Episode 3 download quests");
-  auto new_ep3_download_quest_index = make_shared<QuestIndex>("system/ep3/maps-download", this->quest_category_index, true);
+  auto new_ep3_download_quest_index = make_shared<QuestIndex>("system/ep3/maps-download", inputs.first, content_cache, true);
 
   auto set = [s = this->shared_from_this(),
                  new_default_quest_index = std::move(new_default_quest_index),
@@ -1825,7 +2304,7 @@ void ServerState::load_quest_index(bool from_non_event_thread) {
     s->default_quest_index = std::move(new_default_quest_index);
     s->ep3_download_quest_index = std::move(new_ep3_download_quest_index);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "quest indexes", std::move(set));
 }
 
 void ServerState::compile_functions(bool from_non_event_thread) {
@@ -1835,7 +2314,7 @@ void ServerState::compile_functions(bool from_non_event_thread) {
   auto set = [s = this->shared_from_this(), new_function_code_index = std::move(new_function_code_index)]() {
     s->function_code_index = std::move(new_function_code_index);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "client functions", std::move(set));
 }
 
 void ServerState::load_dol_files(bool from_non_event_thread) {
@@ -1845,7 +2324,7 @@ void ServerState::load_dol_files(bool from_non_event_thread) {
   auto set = [s = this->shared_from_this(), new_dol_file_index = std::move(new_dol_file_index)]() {
     s->dol_file_index = std::move(new_dol_file_index);
   };
-  this->forward_or_call(from_non_event_thread, std::move(set));
+  this->publish(from_non_event_thread, "DOL files", std::move(set));
 }
 
 void ServerState::create_default_lobbies() {
@@ -1891,32 +2370,56 @@ void ServerState::create_default_lobbies() {
       l->episode = Episode::EP3;
     }
   }
+
+  this->rebuild_public_lobby_free_positions();
 }
 
 void ServerState::load_all() {
   this->collect_network_addresses();
   this->load_config_early();
-  this->load_bb_private_keys(false);
-  this->load_accounts(false);
   this->clear_map_file_caches();
-  this->load_patch_indexes(false);
-  this->load_ep3_cards(false);
-  this->load_ep3_maps(false);
-  this->load_ep3_tournament_state(false);
-  this->compile_functions(false);
-  this->load_dol_files(false);
   this->create_default_lobbies();
-  this->load_set_data_tables(false);
-  this->load_battle_params(false);
-  this->load_level_tables(false);
-  this->load_text_index(false);
-  this->load_word_select_table(false);
-  this->load_item_definitions(false);
-  this->load_item_name_indexes(false);
-  this->load_drop_tables(false);
+  this->load_data_snapshot();
+
+  // The loaders below are run in parallel where their dependencies allow it.
+  // The event loop is not running yet, so each loader's set function runs on
+  // the worker thread that built the object; this is safe because no two
+  // loaders write the same fields, and a loader only reads fields written by
+  // loaders it depends on.
+  TaskGraph g;
+  g.add("bb-keys", {}, [&]() { this->load_bb_private_keys(false); });
+  g.add("bb-stream-files", {}, [&]() { this->load_bb_stream_files(false); });
+  g.add("accounts", {}, [&]() { this->load_accounts(false); });
+  // load_patch_indexes and load_accounts both call
+  // update_dependent_server_configs, which reads the fields they each write
+  g.add("patch-files", {"accounts"}, [&]() { this->load_patch_indexes(false); });
+  g.add("ep3-cards", {}, [&]() { this->load_ep3_cards(false); });
+  g.add("ep3-maps", {}, [&]() { this->load_ep3_maps(false); });
+  g.add("ep3-tournaments", {"ep3-cards", "ep3-maps"}, [&]() { this->load_ep3_tournament_state(false); });
+  g.add("functions", {}, [&]() { this->compile_functions(false); });
+  g.add("dol-files", {}, [&]() { this->load_dol_files(false); });
+  g.add("set-tables", {"patch-files"}, [&]() { this->load_set_data_tables(false); });
+  g.add("battle-params", {"patch-files"}, [&]() { this->load_battle_params(false); });
+  g.add("level-tables", {"patch-files"}, [&]() { this->load_level_tables(false); });
+  g.add("text-index", {"patch-files"}, [&]() { this->load_text_index(false); });
+  g.add("word-select", {"text-index"}, [&]() { this->load_word_select_table(false); });
+  g.add("item-definitions", {}, [&]() { this->load_item_definitions(false); });
+  g.add("item-name-index", {"text-index", "item-definitions"}, [&]() { this->load_item_name_indexes(false); });
+  g.add("drop-tables", {"item-name-index"}, [&]() { this->load_drop_tables(false); });
+  g.add("teams", {}, [&]() { this->load_teams(false); });
+  g.add("quests", {}, [&]() { this->load_quest_index(false); });
+
+  uint64_t start = now();
+  g.run(this->num_startup_load_threads);
+  for (const auto& it : g.timings()) {
+    string duration_str = format_duration(it.end_usecs - it.start_usecs);
+    config_log.info("Loader %s finished in %s (%.3f-%.3f sec)",
+        it.name.c_str(), duration_str.c_str(), it.start_usecs / 1000000.0, it.end_usecs / 1000000.0);
+  }
+  string total_duration_str = format_duration(now() - start);
+  config_log.info("All loaders finished in %s", total_duration_str.c_str());
+
   this->load_config_late();
-  this->load_teams(false);
-  this->load_quest_index(false);
 }
 
 shared_ptr<PatchServer::Config> ServerState::generate_patch_server_config(bool is_bb) const {
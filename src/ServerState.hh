@@ -15,12 +15,15 @@
 #include "Client.hh"
 #include "CommonItemSet.hh"
 #include "DNSServer.hh"
+#include "DataSnapshot.hh"
 #include "Episode3/DataIndexes.hh"
 #include "Episode3/Tournament.hh"
 #include "EventUtils.hh"
+#include "FileWriteQueue.hh"
 #include "FunctionCompiler.hh"
 #include "GSLArchive.hh"
 #include "IPV4RangeSet.hh"
+#include "ItemDescriptionCache.hh"
 #include "ItemNameIndex.hh"
 #include "ItemParameterTable.hh"
 #include "LevelTable.hh"
@@ -88,6 +91,13 @@ struct ServerState : public std::enable_shared_from_this<ServerState> {
   uint64_t client_ping_interval_usecs = 30000000;
   uint64_t client_idle_timeout_usecs = 60000000;
   uint64_t patch_client_idle_timeout_usecs = 300000000;
+  size_t num_startup_load_threads = 0; // 0 = one per CPU core
+  size_t quest_content_cache_bytes = 0x4000000;
+  size_t player_file_cache_bytes = 0x1000000;
+  size_t item_description_cache_entries = 0x4000;
+  bool defer_map_floors = false;
+  std::string account_storage = "json"; // "json" or "log"
+  uint64_t account_log_sync_interval_usecs = 1000000;
   bool ip_stack_debug = false;
   bool allow_unregistered_users = false;
   bool allow_pc_nte = false;
@@ -143,11 +153,24 @@ struct ServerState : public std::enable_shared_from_this<ServerState> {
   std::unordered_set<uint32_t> notify_server_for_item_primary_identifiers_v3;
   std::unordered_set<uint32_t> notify_server_for_item_primary_identifiers_v4;
   bool notify_server_for_max_level_achieved = false;
+  std::string data_snapshot_filename = "system/data-snapshot.bin";
+  std::shared_ptr<const DataSnapshot> data_snapshot;
+  std::shared_ptr<DataSnapshot::Builder> data_snapshot_builder; // Only used by build-data-snapshot
   std::vector<std::shared_ptr<const PSOBBEncryption::KeyFile>> bb_private_keys;
+  // Prebuilt 01EB and 02EB command bodies for the files that BB clients
+  // download during login (item, battle param, and level tables)
+  struct BBStreamFiles {
+    size_t num_files = 0;
+    std::string index_data; // S_StreamFileIndexEntry_BB_01EB[num_files]
+    std::vector<std::string> chunk_commands; // S_StreamFileChunk_BB_02EB, truncated
+  };
+  std::shared_ptr<const BBStreamFiles> bb_stream_files;
   std::shared_ptr<const FunctionCodeIndex> function_code_index;
   std::shared_ptr<const PatchFileIndex> pc_patch_file_index;
   std::shared_ptr<const PatchFileIndex> bb_patch_file_index;
   std::array<std::shared_ptr<ThreadSafeFileCache>, NUM_VERSIONS> map_file_caches;
+  // Parsed map files, shared between games; cleared along with map_file_caches
+  std::shared_ptr<MapTemplateCache> map_template_cache;
   std::shared_ptr<const DOLFileIndex> dol_file_index;
   std::shared_ptr<const Episode3::CardIndex> ep3_card_index;
   std::shared_ptr<const Episode3::CardIndex> ep3_card_index_trial;
@@ -224,6 +247,7 @@ struct ServerState : public std::enable_shared_from_this<ServerState> {
   };
   std::vector<Ep3LobbyBannerEntry> ep3_lobby_banners;
 
+  std::shared_ptr<AccountStore> account_store;
   std::shared_ptr<AccountIndex> account_index;
   std::shared_ptr<IPV4RangeSet> banned_ipv4_ranges;
   std::shared_ptr<TeamIndex> team_index;
@@ -247,14 +271,51 @@ struct ServerState : public std::enable_shared_from_this<ServerState> {
   std::string pc_patch_server_message;
   std::string bb_patch_server_message;
 
+  std::shared_ptr<FileWriteQueue> file_write_queue;
   std::shared_ptr<PlayerFilesManager> player_files_manager;
+  std::shared_ptr<ItemDescriptionCache> item_description_cache = std::make_shared<ItemDescriptionCache>(this->item_description_cache_entries);
   std::unordered_map<Channel*, std::shared_ptr<Client>> channel_to_client;
+  // Clients that are in any lobby or game, by account ID and by player name
+  // (decoded in the client's language). These are used by find_client.
+  std::unordered_multimap<uint32_t, std::shared_ptr<Client>> clients_by_account_id;
+  std::unordered_multimap<std::string, std::shared_ptr<Client>> clients_by_name;
   std::map<int64_t, std::shared_ptr<Lobby>> id_to_lobby;
   std::unordered_set<std::shared_ptr<Lobby>> lobbies_to_destroy;
   std::shared_ptr<struct event> destroy_lobbies_event;
   std::array<std::vector<uint32_t>, NUM_VERSIONS> public_lobby_search_orders;
   std::vector<uint32_t> client_customization_public_lobby_search_order;
+  // For each search order above (indexed by version, with the client
+  // customization order last), the positions within that order of the lobbies
+  // that have room for another client. These are kept up to date as clients
+  // join and leave lobbies, so add_client_to_available_lobby doesn't have to
+  // check every lobby in the search order.
+  std::array<std::set<size_t>, NUM_VERSIONS + 1> public_lobby_free_positions;
+  // Lobby ID -> (search order index, position) for each appearance of the
+  // lobby in any search order
+  std::unordered_map<uint32_t, std::vector<std::pair<size_t, size_t>>> public_lobby_search_positions;
+  // For each version, the IDs of the overflow lobbies for that version that
+  // have room for another client. Overflow lobbies are only created when all
+  // lobbies in the search order are full, and are reused (lowest ID first)
+  // before a new one is created. They're deleted when they become empty.
+  std::array<std::set<uint32_t>, NUM_VERSIONS> overflow_lobbies_with_space;
   std::atomic<int32_t> next_lobby_id = 1;
+  // Game menus (08 and E6 commands) are cached per combination of client
+  // version, language, and list filters, since clients tend to request the
+  // game list repeatedly while waiting for a game to appear. All cached menus
+  // are invalidated when game_menu_generation changes; this happens whenever
+  // any game is created, destroyed, or changed in a way that affects its menu
+  // entry (see Lobby::invalidate_game_menus).
+  struct GameMenuCacheEntry {
+    uint64_t generation = 0;
+    // Encoded S_GameMenuEntryT structs, not including the server name entry
+    std::string entries_data;
+    // The game for each entry, in the same order (used for per-client flags)
+    std::vector<std::weak_ptr<const Lobby>> games;
+  };
+  // Atomic because lobbies can be created off the event thread (e.g. by
+  // bench-game-create with multiple threads)
+  std::atomic<uint64_t> game_menu_generation = 1;
+  std::unordered_map<uint64_t, GameMenuCacheEntry> game_menu_cache;
   uint8_t pre_lobby_event = 0;
   int32_t ep3_menu_song = -1;
 
@@ -298,10 +359,15 @@ struct ServerState : public std::enable_shared_from_this<ServerState> {
   void remove_lobby(std::shared_ptr<Lobby> l);
   void on_player_left_lobby(std::shared_ptr<Lobby> l, uint8_t leaving_client_id);
 
+  // Returns nullptr if no matching client is in any lobby or game. If multiple
+  // clients match, prefers one in lobby l.
   std::shared_ptr<Client> find_client(
       const std::string* identifier = nullptr,
       uint64_t account_id = 0,
       std::shared_ptr<Lobby> l = nullptr);
+  // Must be called when a client joins or leaves a lobby, or when its account
+  // or player name changes.
+  void update_client_index(std::shared_ptr<Client> c);
 
   uint32_t connect_address_for_client(std::shared_ptr<Client> c) const;
 
@@ -315,6 +381,19 @@ struct ServerState : public std::enable_shared_from_this<ServerState> {
   std::shared_ptr<const ItemParameterTable> item_parameter_table(Version version) const;
   std::shared_ptr<const ItemParameterTable> item_parameter_table_for_encode(Version version) const;
   std::shared_ptr<const ItemData::StackLimits> item_stack_limits(Version version) const;
+  // Creates an item creator using the common and rare item sets appropriate for
+  // the given version. If rare_item_set is given, it's used instead of the
+  // version's default rare table. This does not depend on any Lobby, so it can
+  // also be used for offline drop simulations.
+  std::shared_ptr<ItemCreator> create_item_creator(
+      Version version,
+      Episode episode,
+      GameMode mode,
+      uint8_t difficulty,
+      uint8_t section_id,
+      std::shared_ptr<PSOLFGEncryption> opt_rand_crypt,
+      std::shared_ptr<const BattleRules> restrictions = nullptr,
+      std::shared_ptr<const RareItemSet> rare_item_set = nullptr) const;
   std::shared_ptr<const ItemNameIndex> item_name_index_opt(Version version) const; // Returns null if missing
   std::shared_ptr<const ItemNameIndex> item_name_index(Version version) const; // Throws if missing
   std::string describe_item(Version version, const ItemData& item, bool include_color_codes) const;
@@ -324,6 +403,8 @@ struct ServerState : public std::enable_shared_from_this<ServerState> {
   inline const std::vector<uint32_t>& public_lobby_search_order(std::shared_ptr<const Client> c) const {
     return this->public_lobby_search_order(c->version(), c->config.check_flag(Client::Flag::IS_CLIENT_CUSTOMIZATION));
   }
+  void rebuild_public_lobby_free_positions();
+  void update_public_lobby_free_positions(std::shared_ptr<const Lobby> l);
 
   inline uint32_t name_color_for_client(Version v, bool is_client_customization) const {
     if (is_client_customization && this->client_customization_name_color) {
@@ -347,37 +428,56 @@ struct ServerState : public std::enable_shared_from_this<ServerState> {
       const std::string& gsl_filename = "",
       const std::string& bb_directory_filename = "") const;
   std::shared_ptr<const std::string> load_map_file(Version version, const std::string& filename) const;
+  // Returns decode(contents of path), using the data snapshot if it has an
+  // up-to-date entry for the file. The returned data is not copied out of the
+  // snapshot; it remains valid as long as its owner is alive.
+  DecodedFileData load_decoded_file(
+      const std::string& path, std::function<std::string(const std::string&)> decode) const;
   std::shared_ptr<const std::string> load_map_file_uncached(Version version, const std::string& filename) const;
 
   std::pair<std::string, uint16_t> parse_port_spec(const JSON& json) const;
   std::vector<PortConfiguration> parse_port_configuration(const JSON& json) const;
 
   template <typename T>
-  inline void call_on_event_thread(std::function<T()>&& fn) {
+  inline T call_on_event_thread(std::function<T()>&& fn) {
     return ::call_on_event_thread<T>(this->base, std::move(fn));
   }
   inline void forward_to_event_thread(std::function<void()>&& fn) {
     ::forward_to_event_thread(this->base, std::move(fn));
   }
-  inline void forward_or_call(bool from_non_event_thread, std::function<void()>&& fn) {
-    if (from_non_event_thread) {
-      ::forward_to_event_thread(this->base, std::move(fn));
-    } else {
-      fn();
-    }
+
+  // Loaders use read_state to get the current values of any fields they
+  // depend on (which may only be safely read on the event thread), build their
+  // new objects on the calling thread, then use publish to replace the old
+  // objects. The function passed to publish should only move pointers into
+  // place, since it blocks the event thread while it runs.
+  template <typename T>
+  inline T read_state(bool from_non_event_thread, std::function<T()>&& fn) {
+    return from_non_event_thread ? this->call_on_event_thread<T>(std::move(fn)) : fn();
   }
+  void publish(bool from_non_event_thread, const char* description, std::function<void()>&& set);
 
   std::shared_ptr<PatchServer::Config> generate_patch_server_config(bool is_bb) const;
   void update_dependent_server_configs() const;
+  std::shared_ptr<AccountStore> create_account_store() const;
 
   // The following functions may only be called from a non-event thread if they
   // take a from_non_event_thread argument; any function that does not have this
   // argument must be called only from the event thread.
   void create_default_lobbies();
   void collect_network_addresses();
-  void load_config_early();
+  std::shared_ptr<const JSON> load_config_json() const;
+  static std::vector<Ep3LobbyBannerEntry> load_ep3_lobby_banners(const JSON& config_json);
+  void load_config(bool from_non_event_thread);
+  // If new_config_json or new_ep3_lobby_banners are not given, they are
+  // loaded from disk on the calling thread.
+  void load_config_early(
+      std::shared_ptr<const JSON> new_config_json = nullptr,
+      std::shared_ptr<std::vector<Ep3LobbyBannerEntry>> new_ep3_lobby_banners = nullptr);
   void load_config_late();
+  void load_data_snapshot();
   void load_bb_private_keys(bool from_non_event_thread);
+  void load_bb_stream_files(bool from_non_event_thread);
   void load_accounts(bool from_non_event_thread);
   void load_teams(bool from_non_event_thread);
   void load_patch_indexes(bool from_non_event_thread);
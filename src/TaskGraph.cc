@@ -0,0 +1,126 @@
+#include "TaskGraph.hh"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <phosg/Time.hh>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+void TaskGraph::add(const string& name, const vector<string>& dependencies, function<void()>&& fn) {
+  size_t index = this->tasks.size();
+  if (!this->name_to_index.emplace(name, index).second) {
+    throw logic_error("duplicate task name: " + name);
+  }
+  auto& task = this->tasks.emplace_back();
+  task.name = name;
+  task.fn = std::move(fn);
+  for (const auto& dep_name : dependencies) {
+    try {
+      this->tasks.at(this->name_to_index.at(dep_name)).dependent_indexes.emplace_back(index);
+    } catch (const out_of_range&) {
+      throw logic_error("task " + name + " depends on unknown task " + dep_name);
+    }
+    task.num_dependencies++;
+  }
+}
+
+void TaskGraph::run(size_t num_threads) {
+  this->task_timings.clear();
+  uint64_t start_time = now();
+
+  if (num_threads == 0) {
+    num_threads = thread::hardware_concurrency();
+  }
+  if (num_threads > this->tasks.size()) {
+    num_threads = this->tasks.size();
+  }
+
+  // Dependencies always precede their dependents in this->tasks, so running
+  // everything in order on one thread is always valid
+  if (num_threads <= 1) {
+    for (auto& task : this->tasks) {
+      uint64_t task_start = now() - start_time;
+      task.fn();
+      this->task_timings.emplace_back(TaskTiming{task.name, task_start, now() - start_time});
+    }
+    return;
+  }
+
+  mutex lock;
+  condition_variable cv;
+  deque<size_t> ready_indexes;
+  vector<size_t> remaining_dependencies;
+  size_t num_running = 0;
+  size_t num_finished = 0;
+  exception_ptr first_exc;
+
+  for (size_t z = 0; z < this->tasks.size(); z++) {
+    remaining_dependencies.emplace_back(this->tasks[z].num_dependencies);
+    if (this->tasks[z].num_dependencies == 0) {
+      ready_indexes.emplace_back(z);
+    }
+  }
+
+  auto thread_fn = [&]() -> void {
+    unique_lock g(lock);
+    for (;;) {
+      cv.wait(g, [&]() -> bool {
+        return first_exc || !ready_indexes.empty() || (num_finished == this->tasks.size());
+      });
+      if (first_exc || ready_indexes.empty()) {
+        return;
+      }
+
+      size_t index = ready_indexes.front();
+      ready_indexes.pop_front();
+      auto& task = this->tasks[index];
+      num_running++;
+      g.unlock();
+
+      uint64_t task_start = now() - start_time;
+      exception_ptr exc;
+      try {
+        task.fn();
+      } catch (...) {
+        exc = current_exception();
+      }
+      uint64_t task_end = now() - start_time;
+
+      g.lock();
+      num_running--;
+      num_finished++;
+      this->task_timings.emplace_back(TaskTiming{task.name, task_start, task_end});
+      if (exc) {
+        if (!first_exc) {
+          first_exc = exc;
+        }
+      } else {
+        for (size_t dependent_index : task.dependent_indexes) {
+          if (--remaining_dependencies[dependent_index] == 0) {
+            ready_indexes.emplace_back(dependent_index);
+          }
+        }
+      }
+      cv.notify_all();
+    }
+  };
+
+  vector<thread> threads;
+  for (size_t z = 0; z < num_threads; z++) {
+    threads.emplace_back(thread_fn);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  if (first_exc) {
+    rethrow_exception(first_exc);
+  }
+  if (num_finished != this->tasks.size() || num_running != 0) {
+    throw logic_error("not all tasks were run");
+  }
+}
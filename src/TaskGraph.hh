@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Runs a set of named tasks on a pool of worker threads. Each task starts as
+// soon as all of the tasks it depends on have finished, so the total wall time
+// is bounded by the longest dependency chain rather than the sum of all tasks.
+// If any task throws, no further tasks are started, and run() rethrows the
+// first exception after all in-progress tasks have finished.
+class TaskGraph {
+public:
+  struct TaskTiming {
+    std::string name;
+    uint64_t start_usecs; // Relative to the time run() was called
+    uint64_t end_usecs; // Same as above
+  };
+
+  TaskGraph() = default;
+  TaskGraph(const TaskGraph&) = delete;
+  TaskGraph(TaskGraph&&) = delete;
+  TaskGraph& operator=(const TaskGraph&) = delete;
+  TaskGraph& operator=(TaskGraph&&) = delete;
+  ~TaskGraph() = default;
+
+  // Dependencies must already have been added; this makes cycles impossible.
+  void add(const std::string& name, const std::vector<std::string>& dependencies, std::function<void()>&& fn);
+
+  // If num_threads is 0, uses one thread per CPU core. If num_threads is 1,
+  // all tasks are run on the calling thread, in the order they were added.
+  void run(size_t num_threads = 0);
+
+  // Returns the timing of each task, in the order the tasks finished. Only
+  // valid after run() returns.
+  inline const std::vector<TaskTiming>& timings() const {
+    return this->task_timings;
+  }
+
+private:
+  struct Task {
+    std::string name;
+    std::function<void()> fn;
+    std::vector<size_t> dependent_indexes;
+    size_t num_dependencies = 0;
+  };
+  std::vector<Task> tasks;
+  std::unordered_map<std::string, size_t> name_to_index;
+  std::vector<TaskTiming> task_timings;
+};
@@ -105,8 +105,21 @@ void TextSet::ensure_collection_exists(size_t collection_index) {
 }
 
 UnicodeTextSet::UnicodeTextSet(const string& prs_data) {
-  string data = prs_decompress(prs_data);
-  StringReader r(data);
+  this->parse_decompressed(this->decompress(prs_data));
+}
+
+string UnicodeTextSet::decompress(const string& prs_data) {
+  return prs_decompress(prs_data);
+}
+
+shared_ptr<UnicodeTextSet> UnicodeTextSet::from_decompressed(string_view data) {
+  shared_ptr<UnicodeTextSet> ret(new UnicodeTextSet());
+  ret->parse_decompressed(data);
+  return ret;
+}
+
+void UnicodeTextSet::parse_decompressed(string_view data) {
+  StringReader r(data.data(), data.size());
 
   uint32_t num_collections = r.get_u32l();
   deque<uint32_t> collection_sizes;
@@ -168,9 +181,23 @@ string UnicodeTextSet::serialize() const {
 }
 
 BinaryTextSet::BinaryTextSet(const std::string& pr2_data, size_t collection_count, bool has_rel_footer, bool is_sjis) {
+  this->parse_decompressed(this->decompress(pr2_data), collection_count, has_rel_footer, is_sjis);
+}
+
+string BinaryTextSet::decompress(const string& pr2_data) {
   auto pr2_decrypted = decrypt_pr2_data<false>(pr2_data);
-  auto decompressed = prs_decompress(pr2_decrypted.compressed_data);
-  StringReader r(decompressed);
+  return prs_decompress(pr2_decrypted.compressed_data);
+}
+
+shared_ptr<BinaryTextSet> BinaryTextSet::from_decompressed(
+    string_view data, size_t collection_count, bool has_rel_footer, bool is_sjis) {
+  shared_ptr<BinaryTextSet> ret(new BinaryTextSet());
+  ret->parse_decompressed(data, collection_count, has_rel_footer, is_sjis);
+  return ret;
+}
+
+void BinaryTextSet::parse_decompressed(string_view data, size_t collection_count, bool has_rel_footer, bool is_sjis) {
+  StringReader r(data.data(), data.size());
 
   // Annoyingly, there doesn't appear to be any bounds-checking on the language
   // functions, so there are no counts of strings in each collection. We have to
@@ -207,13 +234,30 @@ BinaryTextSet::BinaryTextSet(const std::string& pr2_data, size_t collection_coun
 }
 
 BinaryTextAndKeyboardsSet::BinaryTextAndKeyboardsSet(const string& pr2_data, bool big_endian, bool is_sjis) {
+  string decompressed = this->decompress(pr2_data, big_endian);
   if (big_endian) {
-    this->parse_t<true>(pr2_data, is_sjis);
+    this->parse_t<true>(decompressed, is_sjis);
   } else {
-    this->parse_t<false>(pr2_data, is_sjis);
+    this->parse_t<false>(decompressed, is_sjis);
   }
 }
 
+string BinaryTextAndKeyboardsSet::decompress(const string& pr2_data, bool big_endian) {
+  auto pr2_decrypted = big_endian ? decrypt_pr2_data<true>(pr2_data) : decrypt_pr2_data<false>(pr2_data);
+  return prs_decompress(pr2_decrypted.compressed_data);
+}
+
+shared_ptr<BinaryTextAndKeyboardsSet> BinaryTextAndKeyboardsSet::from_decompressed(
+    string_view data, bool big_endian, bool is_sjis) {
+  shared_ptr<BinaryTextAndKeyboardsSet> ret(new BinaryTextAndKeyboardsSet());
+  if (big_endian) {
+    ret->parse_t<true>(data, is_sjis);
+  } else {
+    ret->parse_t<false>(data, is_sjis);
+  }
+  return ret;
+}
+
 BinaryTextAndKeyboardsSet::BinaryTextAndKeyboardsSet(const JSON& json) {
   for (const auto& collection_json : json.at("collections").as_list()) {
     auto& collection = this->collections.emplace_back();
@@ -282,7 +326,7 @@ pair<string, string> BinaryTextAndKeyboardsSet::serialize(bool big_endian, bool
 }
 
 template <bool IsBigEndian>
-void BinaryTextAndKeyboardsSet::parse_t(const string& pr2_data, bool is_sjis) {
+void BinaryTextAndKeyboardsSet::parse_t(string_view decompressed_data, bool is_sjis) {
   using U32T = std::conditional_t<IsBigEndian, be_uint32_t, le_uint32_t>;
   using U16T = std::conditional_t<IsBigEndian, be_uint16_t, le_uint16_t>;
 
@@ -303,9 +347,7 @@ void BinaryTextAndKeyboardsSet::parse_t(const string& pr2_data, bool is_sjis) {
   //         char string[...\0]
   //   <EOF>
 
-  auto pr2_decrypted = decrypt_pr2_data<IsBigEndian>(pr2_data);
-  auto decompressed = prs_decompress(pr2_decrypted.compressed_data);
-  StringReader r(decompressed);
+  StringReader r(decompressed_data.data(), decompressed_data.size());
 
   // Annoyingly, there doesn't appear to be any bounds-checking on the language
   // functions, so there are no counts of strings in each collection. We have to
@@ -454,10 +496,22 @@ pair<string, string> BinaryTextAndKeyboardsSet::serialize_t(bool is_sjis) const
 
 TextIndex::TextIndex(
     const string& directory,
-    function<shared_ptr<const string>(Version, const string&)> get_patch_file)
+    function<shared_ptr<const string>(Version, const string&)> get_patch_file,
+    function<DecodedFileData(const string&, function<string(const string&)>)> load_decoded_file)
     : log("[TextIndex] ", static_game_data_log.min_level) {
   if (!directory.empty()) {
-    auto add_version = [&](Version version, const string& subdirectory, function<shared_ptr<TextSet>(const string&, bool)> make_set) -> void {
+    using DecompressFn = function<string(const string&)>;
+    using ParseFn = function<shared_ptr<TextSet>(string_view, bool)>;
+    auto make_set_from_file = [&](const string& file_path, const DecompressFn& decompress, const ParseFn& parse, bool is_sjis) -> shared_ptr<TextSet> {
+      if (load_decoded_file) {
+        auto decoded = load_decoded_file(file_path, decompress);
+        return parse(decoded.data, is_sjis);
+      } else {
+        return parse(decompress(load_file(file_path)), is_sjis);
+      }
+    };
+
+    auto add_version = [&](Version version, const string& subdirectory, DecompressFn decompress, ParseFn parse) -> void {
       static const map<string, uint8_t> bintext_filenames({
           {"TextJapanese.pr2", 0x00},
           {"TextEnglish.pr2", 0x01},
@@ -487,7 +541,7 @@ TextIndex::TextIndex(
             this->add_set(version, it.second, make_shared<BinaryTextSet>(JSON::parse(load_file(json_path))));
           } else if (isfile(file_path)) {
             this->log.info("Loading %s %c binary text set from %s", name_for_enum(version), char_for_language_code(it.second), file_path.c_str());
-            this->add_set(version, it.second, make_set(load_file(file_path), it.second == 0));
+            this->add_set(version, it.second, make_set_from_file(file_path, decompress, parse, it.second == 0));
           }
         }
       } else {
@@ -501,11 +555,11 @@ TextIndex::TextIndex(
             auto patch_file = get_patch_file ? get_patch_file(version, it.first) : nullptr;
             if (patch_file) {
               this->log.info("Loading %s %c Unicode text set from %s in patch tree", name_for_enum(version), char_for_language_code(it.second), it.first.c_str());
-              this->add_set(version, it.second, make_set(*patch_file, it.second == 0));
+              this->add_set(version, it.second, parse(decompress(*patch_file), it.second == 0));
             } else {
               if (isfile(file_path)) {
                 this->log.info("Loading %s %c Unicode text set from %s", name_for_enum(version), char_for_language_code(it.second), file_path.c_str());
-                this->add_set(version, it.second, make_set(load_file(file_path), it.second == 0));
+                this->add_set(version, it.second, make_set_from_file(file_path, decompress, parse, it.second == 0));
               }
             }
           }
@@ -513,25 +567,30 @@ TextIndex::TextIndex(
       }
     };
 
-    auto make_binary_dc112000 = +[](const string& data, bool is_sjis) { return make_shared<BinaryTextSet>(data, 21, true, is_sjis); };
-    auto make_binary_dcnte_dcv1 = +[](const string& data, bool is_sjis) { return make_shared<BinaryTextSet>(data, 26, true, is_sjis); };
-    auto make_binary_dcv2 = +[](const string& data, bool is_sjis) { return make_shared<BinaryTextSet>(data, 37, false, is_sjis); };
-    auto make_binary_gc = +[](const string& data, bool is_sjis) { return make_shared<BinaryTextAndKeyboardsSet>(data, true, is_sjis); };
-    auto make_binary_xb = +[](const string& data, bool is_sjis) { return make_shared<BinaryTextAndKeyboardsSet>(data, false, is_sjis); };
-    auto make_unitxt = +[](const string& data, bool) { return make_shared<UnicodeTextSet>(data); };
-
-    add_version(Version::DC_NTE, "dc-nte", make_binary_dcnte_dcv1);
-    add_version(Version::DC_V1_11_2000_PROTOTYPE, "dc-11-2000", make_binary_dc112000);
-    add_version(Version::DC_V1, "dc-v1", make_binary_dcnte_dcv1);
-    add_version(Version::DC_V2, "dc-v2", make_binary_dcv2);
-    add_version(Version::PC_NTE, "pc-nte", make_unitxt);
-    add_version(Version::PC_V2, "pc-v2", make_unitxt);
-    add_version(Version::GC_NTE, "gc-nte", make_binary_gc);
-    add_version(Version::GC_V3, "gc-v3", make_binary_gc);
-    add_version(Version::GC_EP3_NTE, "gc-ep3-nte", make_binary_gc);
-    add_version(Version::GC_EP3, "gc-ep3", make_binary_gc);
-    add_version(Version::XB_V3, "xb-v3", make_binary_xb);
-    add_version(Version::BB_V4, "bb-v4", make_unitxt);
+    auto decompress_binary = +[](const string& data) { return BinaryTextSet::decompress(data); };
+    auto decompress_binary_gc = +[](const string& data) { return BinaryTextAndKeyboardsSet::decompress(data, true); };
+    auto decompress_binary_xb = +[](const string& data) { return BinaryTextAndKeyboardsSet::decompress(data, false); };
+    auto decompress_unitxt = +[](const string& data) { return UnicodeTextSet::decompress(data); };
+
+    auto parse_binary_dc112000 = +[](string_view data, bool is_sjis) -> shared_ptr<TextSet> { return BinaryTextSet::from_decompressed(data, 21, true, is_sjis); };
+    auto parse_binary_dcnte_dcv1 = +[](string_view data, bool is_sjis) -> shared_ptr<TextSet> { return BinaryTextSet::from_decompressed(data, 26, true, is_sjis); };
+    auto parse_binary_dcv2 = +[](string_view data, bool is_sjis) -> shared_ptr<TextSet> { return BinaryTextSet::from_decompressed(data, 37, false, is_sjis); };
+    auto parse_binary_gc = +[](string_view data, bool is_sjis) -> shared_ptr<TextSet> { return BinaryTextAndKeyboardsSet::from_decompressed(data, true, is_sjis); };
+    auto parse_binary_xb = +[](string_view data, bool is_sjis) -> shared_ptr<TextSet> { return BinaryTextAndKeyboardsSet::from_decompressed(data, false, is_sjis); };
+    auto parse_unitxt = +[](string_view data, bool) -> shared_ptr<TextSet> { return UnicodeTextSet::from_decompressed(data); };
+
+    add_version(Version::DC_NTE, "dc-nte", decompress_binary, parse_binary_dcnte_dcv1);
+    add_version(Version::DC_V1_11_2000_PROTOTYPE, "dc-11-2000", decompress_binary, parse_binary_dc112000);
+    add_version(Version::DC_V1, "dc-v1", decompress_binary, parse_binary_dcnte_dcv1);
+    add_version(Version::DC_V2, "dc-v2", decompress_binary, parse_binary_dcv2);
+    add_version(Version::PC_NTE, "pc-nte", decompress_unitxt, parse_unitxt);
+    add_version(Version::PC_V2, "pc-v2", decompress_unitxt, parse_unitxt);
+    add_version(Version::GC_NTE, "gc-nte", decompress_binary_gc, parse_binary_gc);
+    add_version(Version::GC_V3, "gc-v3", decompress_binary_gc, parse_binary_gc);
+    add_version(Version::GC_EP3_NTE, "gc-ep3-nte", decompress_binary_gc, parse_binary_gc);
+    add_version(Version::GC_EP3, "gc-ep3", decompress_binary_gc, parse_binary_gc);
+    add_version(Version::XB_V3, "xb-v3", decompress_binary_xb, parse_binary_xb);
+    add_version(Version::BB_V4, "bb-v4", decompress_unitxt, parse_unitxt);
   }
 }
 
@@ -4,9 +4,11 @@
 
 #include <phosg/JSON.hh>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
+#include "DataSnapshot.hh"
 #include "Text.hh"
 #include "Version.hh"
 
@@ -47,6 +49,15 @@ public:
   explicit UnicodeTextSet(const std::string& unitxt_prs_data);
   virtual ~UnicodeTextSet() = default;
   std::string serialize() const;
+
+  // Text sets can be constructed from data that has already been passed
+  // through decompress(), so the decoded data can be cached in a DataSnapshot
+  static std::string decompress(const std::string& unitxt_prs_data);
+  static std::shared_ptr<UnicodeTextSet> from_decompressed(std::string_view data);
+
+protected:
+  UnicodeTextSet() = default;
+  void parse_decompressed(std::string_view data);
 };
 
 class BinaryTextSet : public TextSet {
@@ -56,6 +67,14 @@ public:
   BinaryTextSet(const std::string& pr2_data, size_t collection_count, bool has_rel_footer, bool is_sjis);
   ~BinaryTextSet() = default;
   // TODO: Implement serialize functions
+
+  static std::string decompress(const std::string& pr2_data);
+  static std::shared_ptr<BinaryTextSet> from_decompressed(
+      std::string_view data, size_t collection_count, bool has_rel_footer, bool is_sjis);
+
+protected:
+  BinaryTextSet() = default;
+  void parse_decompressed(std::string_view data, size_t collection_count, bool has_rel_footer, bool is_sjis);
 };
 
 class BinaryTextAndKeyboardsSet : public TextSet {
@@ -79,9 +98,15 @@ public:
   // Returns (pr2_data, pr3_data)
   std::pair<std::string, std::string> serialize(bool big_endian, bool is_sjis) const;
 
+  static std::string decompress(const std::string& pr2_data, bool big_endian);
+  static std::shared_ptr<BinaryTextAndKeyboardsSet> from_decompressed(
+      std::string_view data, bool big_endian, bool is_sjis);
+
 protected:
+  BinaryTextAndKeyboardsSet() = default;
+
   template <bool IsBigEndian>
-  void parse_t(const std::string& pr2_data, bool is_sjis);
+  void parse_t(std::string_view decompressed_data, bool is_sjis);
   template <bool IsBigEndian>
   std::pair<std::string, std::string> serialize_t(bool is_sjis) const;
 
@@ -91,9 +116,12 @@ protected:
 
 class TextIndex {
 public:
+  // If load_decoded_file is given, text sets that are read from files in
+  // directory are decompressed through it (see ServerState::load_decoded_file)
   explicit TextIndex(
       const std::string& directory = "",
-      std::function<std::shared_ptr<const std::string>(Version, const std::string&)> get_patch_file = nullptr);
+      std::function<std::shared_ptr<const std::string>(Version, const std::string&)> get_patch_file = nullptr,
+      std::function<DecodedFileData(const std::string&, std::function<std::string(const std::string&)>)> load_decoded_file = nullptr);
   ~TextIndex() = default;
 
   void add_set(Version version, uint8_t language, std::shared_ptr<const TextSet> ts);
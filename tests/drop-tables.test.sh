@@ -0,0 +1,10 @@
+#!/bin/sh
+
+set -e
+
+EXECUTABLE="$1"
+if [ -z "$EXECUTABLE" ]; then
+  EXECUTABLE="./newserv"
+fi
+
+$EXECUTABLE --config=tests/config.json drop-tables-test